@@ -1,15 +1,22 @@
 #include "plic.h"
 
-#define PLIC_BASE 0x0C000000UL
-#define PLIC_PRIORITY(id) (PLIC_BASE + (id) * 4)
-#define PLIC_PENDING(id) (PLIC_BASE + 0x1000 + ((id) / 32) * 4)
-#define PLIC_ENABLE(hart) (PLIC_BASE + 0x2000 + (hart) * 0x80)
-#define PLIC_THRESHOLD(hart) (PLIC_BASE + 0x200000 + (hart) * 0x1000)
-#define PLIC_CLAIM(hart) (PLIC_BASE + 0x200004 + (hart) * 0x1000)
+/* Each hart has an M-mode and an S-mode context; the kernel runs in
+ * S-mode on the boot hart, whose context the device tree names */
+static uint64_t plic_base = 0x0C000000UL;
+static uint32_t plic_context = 1;
 
-void plic_init(void) {
+#define PLIC_PRIORITY(id) (plic_base + (id) * 4)
+#define PLIC_PENDING(id) (plic_base + 0x1000 + ((id) / 32) * 4)
+#define PLIC_ENABLE(ctx) (plic_base + 0x2000 + (ctx) * 0x80)
+#define PLIC_THRESHOLD(ctx) (plic_base + 0x200000 + (ctx) * 0x1000)
+#define PLIC_CLAIM(ctx) (plic_base + 0x200004 + (ctx) * 0x1000)
+
+void plic_init(uint64_t base, uint32_t context) {
+    plic_base = base;
+    plic_context = context;
+    
     /* Set threshold to 0 (accept all interrupts) */
-    volatile uint32_t *threshold = (volatile uint32_t*)PLIC_THRESHOLD(0);
+    volatile uint32_t *threshold = (volatile uint32_t*)PLIC_THRESHOLD(plic_context);
     *threshold = 0;
 }
 
@@ -19,21 +26,21 @@ void plic_enable(uint32_t irq) {
     *priority = 1;
     
     /* Enable interrupt */
-    volatile uint32_t *enable = (volatile uint32_t*)PLIC_ENABLE(0);
-    enable[irq / 32] |= (1 << (irq % 32));
+    volatile uint32_t *enable = (volatile uint32_t*)PLIC_ENABLE(plic_context);
+    enable[irq / 32] |= (1U << (irq % 32));
 }
 
 void plic_disable(uint32_t irq) {
-    volatile uint32_t *enable = (volatile uint32_t*)PLIC_ENABLE(0);
-    enable[irq / 32] &= ~(1 << (irq % 32));
+    volatile uint32_t *enable = (volatile uint32_t*)PLIC_ENABLE(plic_context);
+    enable[irq / 32] &= ~(1U << (irq % 32));
 }
 
 uint32_t plic_claim(void) {
-    volatile uint32_t *claim = (volatile uint32_t*)PLIC_CLAIM(0);
+    volatile uint32_t *claim = (volatile uint32_t*)PLIC_CLAIM(plic_context);
     return *claim;
 }
 
 void plic_complete(uint32_t irq) {
-    volatile uint32_t *claim = (volatile uint32_t*)PLIC_CLAIM(0);
+    volatile uint32_t *claim = (volatile uint32_t*)PLIC_CLAIM(plic_context);
     *claim = irq;
 }
@@ -3,8 +3,8 @@
 
 #include "../../kernel/types.h"
 
-/* PLIC initialization */
-void plic_init(void);
+/* PLIC initialization, routing to the given S-mode context */
+void plic_init(uint64_t base, uint32_t context);
 
 /* Enable/disable interrupt */
 void plic_enable(uint32_t irq);
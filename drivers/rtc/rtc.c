@@ -1,13 +1,14 @@
 #include "rtc.h"
 
-#define RTC_BASE 0x101000UL
+static uint64_t rtc_base = 0x101000UL;
 
-void rtc_init(void) {
-    /* RTC initialization */
+void rtc_init(uint64_t base) {
+    /* Goldfish RTC needs no setup */
+    rtc_base = base;
 }
 
 uint64_t rtc_get_time(void) {
     /* Read RTC time register */
-    volatile uint32_t *rtc = (volatile uint32_t*)RTC_BASE;
+    volatile uint32_t *rtc = (volatile uint32_t*)rtc_base;
     return *rtc;
 }
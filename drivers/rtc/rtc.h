@@ -3,8 +3,8 @@
 
 #include "../../kernel/types.h"
 
-/* RTC initialization */
-void rtc_init(void);
+/* RTC initialization, for the goldfish RTC at base */
+void rtc_init(uint64_t base);
 
 /* Get current time */
 uint64_t rtc_get_time(void);
@@ -1,6 +1,7 @@
 #include "testdev.h"
 
 #include "../../kernel/printf.h"
+#include "../../kernel/lib/string.h"
 
 /* Test device buffer */
 #define TESTDEV_SIZE 1024
@@ -35,10 +36,7 @@ static int testdev_read(file_t *file, void *buf, size_t count) {
   }
 
   /* Copy data to user buffer */
-  char *cbuf = (char *)buf;
-  for (size_t i = 0; i < count; i++) {
-    cbuf[i] = testdev_buffer[file->offset + i];
-  }
+  memcpy(buf, testdev_buffer + file->offset, count);
 
   /* Update offset */
   file->offset += count;
@@ -61,10 +59,7 @@ static int testdev_write(file_t *file, const void *buf, size_t count) {
   }
 
   /* Copy data from user buffer */
-  const char *cbuf = (const char *)buf;
-  for (size_t i = 0; i < count; i++) {
-    testdev_buffer[file->offset + i] = cbuf[i];
-  }
+  memcpy(testdev_buffer + file->offset, buf, count);
 
   /* Update offset and length */
   file->offset += count;
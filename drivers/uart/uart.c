@@ -1,25 +1,32 @@
 #include "uart.h"
 
-/* UART registers for QEMU virt machine */
-#define UART_BASE 0x10000000UL
+/* 16550 registers, relative to the base the device tree gives */
+static uint64_t uart_base = 0x10000000UL;
 
-#define UART_RBR (UART_BASE + 0) /* Receive Buffer Register */
-#define UART_THR (UART_BASE + 0) /* Transmit Holding Register */
-#define UART_IER (UART_BASE + 1) /* Interrupt Enable Register */
-#define UART_FCR (UART_BASE + 2) /* FIFO Control Register */
-#define UART_LCR (UART_BASE + 3) /* Line Control Register */
-#define UART_MCR (UART_BASE + 4) /* Modem Control Register */
-#define UART_LSR (UART_BASE + 5) /* Line Status Register */
+#define UART_RBR (uart_base + 0) /* Receive Buffer Register */
+#define UART_THR (uart_base + 0) /* Transmit Holding Register */
+#define UART_IER (uart_base + 1) /* Interrupt Enable Register */
+#define UART_FCR (uart_base + 2) /* FIFO Control Register */
+#define UART_LCR (uart_base + 3) /* Line Control Register */
+#define UART_MCR (uart_base + 4) /* Modem Control Register */
+#define UART_LSR (uart_base + 5) /* Line Status Register */
 
 #define UART_LSR_TX_IDLE (1 << 5) /* Transmitter empty */
 #define UART_LSR_RX_READY (1 << 0) /* Data ready */
 
+#define UART_FCR_ENABLE 0x07 /* Enable and clear both FIFOs */
+#define UART_FIFO_DEPTH 16   /* 16550 transmit FIFO depth */
+
 /* Read/Write register macros */
 #define READ_REG(addr) (*(volatile uint8_t *)(addr))
 #define WRITE_REG(addr, val) (*(volatile uint8_t *)(addr) = (val))
 
-void uart_init(void) {
-    /* UART is already initialized by QEMU, no additional setup needed */
+void uart_init(uint64_t base) {
+    uart_base = base;
+    
+    /* Baud rate and line settings come from firmware; just make sure the
+     * FIFOs are on so uart_write() can push a full burst per poll */
+    WRITE_REG(UART_FCR, UART_FCR_ENABLE);
 }
 
 void uart_putc(char c) {
@@ -31,6 +38,25 @@ void uart_putc(char c) {
     WRITE_REG(UART_THR, c);
 }
 
+void uart_write(const char *buf, size_t len) {
+    size_t i = 0;
+    
+    while (i < len) {
+        /* Once THR reports empty the whole FIFO is free */
+        while ((READ_REG(UART_LSR) & UART_LSR_TX_IDLE) == 0)
+            ;
+        
+        size_t burst = len - i;
+        if (burst > UART_FIFO_DEPTH) {
+            burst = UART_FIFO_DEPTH;
+        }
+        for (size_t j = 0; j < burst; j++) {
+            WRITE_REG(UART_THR, buf[i + j]);
+        }
+        i += burst;
+    }
+}
+
 void uart_puts(const char *s) {
     while (*s) {
         if (*s == '\n') {
@@ -3,12 +3,13 @@
 
 #include "../../kernel/types.h"
 
-/* UART initialization */
-void uart_init(void);
+/* UART initialization, for the 16550 at base */
+void uart_init(uint64_t base);
 
 /* UART output */
 void uart_putc(char c);
 void uart_puts(const char *s);
+void uart_write(const char *buf, size_t len);
 
 /* UART input */
 char uart_getc(void);
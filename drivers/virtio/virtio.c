@@ -0,0 +1,243 @@
+#include "virtio.h"
+
+#include "../../kernel/printf.h"
+#include "../../kernel/mm/mm.h"
+#include "../../kernel/mm/dma.h"
+#include "../../kernel/fdt.h"
+
+#define REG(dev, off) (*(volatile uint32_t *)((dev)->base + (off)))
+
+/* Order ring updates against each other and against MMIO accesses */
+static inline void virtio_mb(void) {
+    asm volatile("fence iorw, iorw" ::: "memory");
+}
+
+int virtio_find(uint32_t device_id, int nth, virtio_dev_t *dev) {
+    for (int slot = 0; slot < machine.nr_virtio; slot++) {
+        dev->base = machine.virtio[slot].base;
+        dev->irq = machine.virtio[slot].irq;
+        dev->features = 0;
+        if (REG(dev, VIRTIO_MMIO_MAGIC_VALUE) != VIRTIO_MAGIC ||
+            REG(dev, VIRTIO_MMIO_DEVICE_ID) != device_id) {
+            continue;
+        }
+        if (REG(dev, VIRTIO_MMIO_VERSION) != 2) {
+            printf("[VIRTIO] Slot %d: legacy transport not supported "
+                   "(use -global virtio-mmio.force-legacy=false)\n", slot);
+            continue;
+        }
+        if (nth-- == 0) {
+            dev->device_id = device_id;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int virtio_negotiate(virtio_dev_t *dev, uint64_t wanted) {
+    REG(dev, VIRTIO_MMIO_STATUS) = 0;
+    uint32_t status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+    REG(dev, VIRTIO_MMIO_STATUS) = status;
+    
+    REG(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 0;
+    uint64_t offered = REG(dev, VIRTIO_MMIO_DEVICE_FEATURES);
+    REG(dev, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 1;
+    offered |= (uint64_t)REG(dev, VIRTIO_MMIO_DEVICE_FEATURES) << 32;
+    
+    if (!(offered & VIRTIO_F_VERSION_1)) {
+        REG(dev, VIRTIO_MMIO_STATUS) = status | VIRTIO_STATUS_FAILED;
+        return -1;
+    }
+    dev->features = offered & (wanted | VIRTIO_F_VERSION_1);
+    REG(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 0;
+    REG(dev, VIRTIO_MMIO_DRIVER_FEATURES) = (uint32_t)dev->features;
+    REG(dev, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 1;
+    REG(dev, VIRTIO_MMIO_DRIVER_FEATURES) = (uint32_t)(dev->features >> 32);
+    
+    status |= VIRTIO_STATUS_FEATURES_OK;
+    REG(dev, VIRTIO_MMIO_STATUS) = status;
+    if (!(REG(dev, VIRTIO_MMIO_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+        REG(dev, VIRTIO_MMIO_STATUS) = status | VIRTIO_STATUS_FAILED;
+        return -1;
+    }
+    return 0;
+}
+
+int virtq_init(virtio_dev_t *dev, virtq_t *vq, uint32_t index, uint16_t num) {
+    REG(dev, VIRTIO_MMIO_QUEUE_SEL) = index;
+    if (REG(dev, VIRTIO_MMIO_QUEUE_READY) != 0) {
+        return -1;
+    }
+    uint32_t max = REG(dev, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if (max == 0) {
+        return -1;
+    }
+    if (num > VIRTQ_MAX_SIZE) num = VIRTQ_MAX_SIZE;
+    if (num > max) num = max;
+    /* Round down to a power of two */
+    while (num & (num - 1)) {
+        num &= num - 1;
+    }
+    
+    /* The rings are shared with the device: DMA memory, sized to the
+     * queue (the cache-line alignment covers the ring alignment rules) */
+    dma_addr_t desc_dma, avail_dma, used_dma;
+    vq->desc = dma_alloc(VIRTQ_DESC_SIZE(num), &desc_dma);
+    vq->avail = dma_alloc(VIRTQ_AVAIL_SIZE(num), &avail_dma);
+    vq->used = dma_alloc(VIRTQ_USED_SIZE(num), &used_dma);
+    vq->token = (void**)alloc_page();
+    if (!vq->desc || !vq->avail || !vq->used || !vq->token) {
+        dma_free(vq->desc, VIRTQ_DESC_SIZE(num));
+        dma_free(vq->avail, VIRTQ_AVAIL_SIZE(num));
+        dma_free(vq->used, VIRTQ_USED_SIZE(num));
+        free_page(vq->token);
+        return -1;
+    }
+    
+    vq->dev = dev;
+    vq->index = index;
+    vq->num = num;
+    vq->num_free = num;
+    vq->free_head = 0;
+    vq->last_used = 0;
+    for (uint16_t i = 0; i < num; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    
+    REG(dev, VIRTIO_MMIO_QUEUE_NUM) = num;
+    REG(dev, VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint32_t)desc_dma;
+    REG(dev, VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint32_t)(desc_dma >> 32);
+    REG(dev, VIRTIO_MMIO_QUEUE_DRIVER_LOW) = (uint32_t)avail_dma;
+    REG(dev, VIRTIO_MMIO_QUEUE_DRIVER_HIGH) = (uint32_t)(avail_dma >> 32);
+    REG(dev, VIRTIO_MMIO_QUEUE_DEVICE_LOW) = (uint32_t)used_dma;
+    REG(dev, VIRTIO_MMIO_QUEUE_DEVICE_HIGH) = (uint32_t)(used_dma >> 32);
+    REG(dev, VIRTIO_MMIO_QUEUE_READY) = 1;
+    return 0;
+}
+
+void virtio_driver_ok(virtio_dev_t *dev) {
+    REG(dev, VIRTIO_MMIO_STATUS) = REG(dev, VIRTIO_MMIO_STATUS) |
+                                   VIRTIO_STATUS_DRIVER_OK;
+}
+
+uint8_t virtio_config_read8(virtio_dev_t *dev, uint32_t offset) {
+    return *(volatile uint8_t *)(dev->base + VIRTIO_MMIO_CONFIG + offset);
+}
+
+uint32_t virtio_config_read32(virtio_dev_t *dev, uint32_t offset) {
+    return REG(dev, VIRTIO_MMIO_CONFIG + offset);
+}
+
+uint32_t virtio_ack_irq(virtio_dev_t *dev) {
+    uint32_t status = REG(dev, VIRTIO_MMIO_INTERRUPT_STATUS);
+    REG(dev, VIRTIO_MMIO_INTERRUPT_ACK) = status;
+    return status;
+}
+
+/* Fill descriptor i and return the next free one */
+static uint16_t desc_fill(virtq_t *vq, uint16_t i, dma_addr_t addr, uint32_t len,
+                          int write) {
+    virtq_desc_t *d = &vq->desc[i];
+    d->addr = addr;
+    d->len = len;
+    d->flags = (write ? VIRTQ_DESC_F_WRITE : 0) | VIRTQ_DESC_F_NEXT;
+    return d->next;
+}
+
+/* Hand the n-descriptor chain head..last to the device */
+static void chain_publish(virtq_t *vq, uint16_t head, uint16_t last, int n,
+                          void *token) {
+    vq->desc[last].flags &= ~VIRTQ_DESC_F_NEXT;
+    vq->free_head = vq->desc[last].next;
+    vq->num_free -= n;
+    vq->token[head] = token;
+    
+    /* Descriptors must be visible before the ring entry, and the entry
+     * before the index that publishes it */
+    vq->avail->ring[vq->avail->idx & (vq->num - 1)] = head;
+    virtio_mb();
+    vq->avail->idx++;
+}
+
+int virtq_add(virtq_t *vq, const virtq_buf_t *bufs, int n, void *token) {
+    if (n <= 0 || n > vq->num_free) {
+        return -1;
+    }
+    
+    uint16_t head = vq->free_head;
+    uint16_t i = head, last = head;
+    for (int k = 0; k < n; k++) {
+        last = i;
+        i = desc_fill(vq, i, virt_to_dma(bufs[k].addr), bufs[k].len, bufs[k].write);
+    }
+    chain_publish(vq, head, last, n, token);
+    return 0;
+}
+
+int virtq_add_sg(virtq_t *vq, const sg_table_t *sgs[], int out, int in,
+                 void *token) {
+    int n = 0;
+    for (int t = 0; t < out + in; t++) {
+        n += sgs[t]->nents;
+    }
+    if (n <= 0 || n > vq->num_free) {
+        return -1;
+    }
+    
+    uint16_t head = vq->free_head;
+    uint16_t i = head, last = head;
+    for (int t = 0; t < out + in; t++) {
+        for (int k = 0; k < sgs[t]->nents; k++) {
+            last = i;
+            i = desc_fill(vq, i, sgs[t]->ents[k].addr, sgs[t]->ents[k].len, t >= out);
+        }
+    }
+    chain_publish(vq, head, last, n, token);
+    return 0;
+}
+
+void virtq_kick(virtq_t *vq) {
+    virtio_mb();
+    if (!(vq->used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        REG(vq->dev, VIRTIO_MMIO_QUEUE_NOTIFY) = vq->index;
+    }
+}
+
+int virtq_has_used(virtq_t *vq) {
+    return vq->last_used != *(volatile uint16_t *)&vq->used->idx;
+}
+
+void *virtq_get(virtq_t *vq, uint32_t *len) {
+    if (!virtq_has_used(vq)) {
+        return NULL;
+    }
+    virtio_mb();   /* Read the entry only after seeing the index */
+    virtq_used_elem_t *e = &vq->used->ring[vq->last_used & (vq->num - 1)];
+    uint16_t head = (uint16_t)e->id;
+    if (len) {
+        *len = e->len;
+    }
+    vq->last_used++;
+    
+    /* Return the chain to the free list */
+    void *token = vq->token[head];
+    uint16_t i = head;
+    vq->num_free++;
+    while (vq->desc[i].flags & VIRTQ_DESC_F_NEXT) {
+        i = vq->desc[i].next;
+        vq->num_free++;
+    }
+    vq->desc[i].next = vq->free_head;
+    vq->free_head = head;
+    return token;
+}
+
+void virtq_disable_cb(virtq_t *vq) {
+    vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+int virtq_enable_cb(virtq_t *vq) {
+    vq->avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    virtio_mb();
+    return virtq_has_used(vq);
+}
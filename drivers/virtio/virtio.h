@@ -0,0 +1,168 @@
+#ifndef _VIRTIO_H
+#define _VIRTIO_H
+
+#include "../../kernel/types.h"
+#include "../../kernel/mm/dma.h"
+
+/* virtio-mmio transport (version 2) and split virtqueues, shared by the
+ * virtio drivers. The transports and their PLIC IRQs come from the device
+ * tree (machine.virtio[], in address order); QEMU must be run with
+ * -global virtio-mmio.force-legacy=false to get version 2.
+ *
+ * Rings live in DMA memory (kernel/mm/dma.h); buffers are handed to the
+ * device as bus addresses, from virtq_buf_t kernel addresses or from
+ * scatter-gather tables. */
+/* MMIO register offsets */
+#define VIRTIO_MMIO_MAGIC_VALUE        0x000  /* "virt" */
+#define VIRTIO_MMIO_VERSION            0x004
+#define VIRTIO_MMIO_DEVICE_ID          0x008
+#define VIRTIO_MMIO_DEVICE_FEATURES    0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014
+#define VIRTIO_MMIO_DRIVER_FEATURES    0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024
+#define VIRTIO_MMIO_QUEUE_SEL          0x030
+#define VIRTIO_MMIO_QUEUE_NUM_MAX      0x034
+#define VIRTIO_MMIO_QUEUE_NUM          0x038
+#define VIRTIO_MMIO_QUEUE_READY        0x044
+#define VIRTIO_MMIO_QUEUE_NOTIFY       0x050
+#define VIRTIO_MMIO_INTERRUPT_STATUS   0x060
+#define VIRTIO_MMIO_INTERRUPT_ACK      0x064
+#define VIRTIO_MMIO_STATUS             0x070
+#define VIRTIO_MMIO_QUEUE_DESC_LOW     0x080
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH    0x084
+#define VIRTIO_MMIO_QUEUE_DRIVER_LOW   0x090
+#define VIRTIO_MMIO_QUEUE_DRIVER_HIGH  0x094
+#define VIRTIO_MMIO_QUEUE_DEVICE_LOW   0x0a0
+#define VIRTIO_MMIO_QUEUE_DEVICE_HIGH  0x0a4
+#define VIRTIO_MMIO_CONFIG             0x100
+
+#define VIRTIO_MAGIC 0x74726976
+
+/* Device IDs */
+#define VIRTIO_ID_NET   1
+#define VIRTIO_ID_BLOCK 2
+
+/* Device status bits */
+#define VIRTIO_STATUS_ACKNOWLEDGE 1
+#define VIRTIO_STATUS_DRIVER      2
+#define VIRTIO_STATUS_DRIVER_OK   4
+#define VIRTIO_STATUS_FEATURES_OK 8
+#define VIRTIO_STATUS_FAILED      128
+
+/* Transport feature bits */
+#define VIRTIO_F_VERSION_1 (1ULL << 32)
+
+/* Split virtqueue layout */
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2   /* Device writes (otherwise reads) */
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY     1
+
+/* Largest queue whose descriptor table fits in a page */
+#define VIRTQ_MAX_SIZE 256
+
+/* Ring sizes for a queue of num entries (flags, idx, entries, event) */
+#define VIRTQ_DESC_SIZE(num)  (16 * (num))
+#define VIRTQ_AVAIL_SIZE(num) (6 + 2 * (num))
+#define VIRTQ_USED_SIZE(num)  (6 + 8 * (num))
+
+typedef struct virtq_desc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+typedef struct virtq_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} virtq_avail_t;
+
+typedef struct virtq_used_elem {
+    uint32_t id;               /* Head of the completed chain */
+    uint32_t len;              /* Bytes the device wrote */
+} virtq_used_elem_t;
+
+typedef struct virtq_used {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} virtq_used_t;
+
+/* One transport instance */
+typedef struct virtio_dev {
+    uint64_t base;             /* MMIO registers */
+    uint32_t irq;              /* PLIC source */
+    uint32_t device_id;
+    uint64_t features;         /* Negotiated */
+} virtio_dev_t;
+
+/* Driver side of a virtqueue. Not locked: the driver serializes access. */
+typedef struct virtq {
+    virtio_dev_t *dev;
+    uint32_t index;
+    uint16_t num;              /* Entries (power of two) */
+    uint16_t num_free;         /* Unused descriptors */
+    uint16_t free_head;        /* Free descriptors, chained through next */
+    uint16_t last_used;        /* Next used entry to consume */
+    virtq_desc_t *desc;
+    virtq_avail_t *avail;
+    virtq_used_t *used;
+    void **token;              /* Caller's cookie per chain head */
+} virtq_t;
+
+/* One segment of a buffer chain */
+typedef struct virtq_buf {
+    void *addr;
+    uint32_t len;
+    int write;                 /* Device-writable */
+} virtq_buf_t;
+
+/* Find the nth (from 0) transport with the given device ID; 0 on success */
+int virtio_find(uint32_t device_id, int nth, virtio_dev_t *dev);
+
+/* Reset the device and negotiate features: accept the offered subset of
+ * 'wanted' (VERSION_1 is always required). 0 on success. */
+int virtio_negotiate(virtio_dev_t *dev, uint64_t wanted);
+
+/* Set up queue 'index' with at most num entries; 0 on success */
+int virtq_init(virtio_dev_t *dev, virtq_t *vq, uint32_t index, uint16_t num);
+
+/* Mark setup complete; the device may start using the queues */
+void virtio_driver_ok(virtio_dev_t *dev);
+
+/* Device-specific configuration space */
+uint8_t virtio_config_read8(virtio_dev_t *dev, uint32_t offset);
+uint32_t virtio_config_read32(virtio_dev_t *dev, uint32_t offset);
+
+/* Read and acknowledge the interrupt status (bit 0: used ring updated,
+ * bit 1: configuration changed) */
+uint32_t virtio_ack_irq(virtio_dev_t *dev);
+
+/* Post a chain of n buffers, identified by token on completion. The
+ * device is not told until virtq_kick(). 0 on success, -1 if full. */
+int virtq_add(virtq_t *vq, const virtq_buf_t *bufs, int n, void *token);
+
+/* Post one chain made of out device-readable tables followed by in
+ * device-writable ones, one descriptor per entry. 0 on success, -1 if
+ * the ring has too few free descriptors. */
+int virtq_add_sg(virtq_t *vq, const sg_table_t *sgs[], int out, int in,
+                 void *token);
+
+/* Notify the device of new buffers unless it has asked not to be */
+void virtq_kick(virtq_t *vq);
+
+/* Next completed chain's token (and bytes written), or NULL */
+void *virtq_get(virtq_t *vq, uint32_t *len);
+
+int virtq_has_used(virtq_t *vq);
+
+/* Suppress used-buffer interrupts while polling / turn them back on.
+ * virtq_enable_cb returns nonzero if buffers completed in the meantime,
+ * in which case the caller should keep polling. */
+void virtq_disable_cb(virtq_t *vq);
+int virtq_enable_cb(virtq_t *vq);
+
+#endif /* _VIRTIO_H */
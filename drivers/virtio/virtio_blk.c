@@ -0,0 +1,602 @@
+#include "virtio_blk.h"
+#include "virtio.h"
+
+#include "../../kernel/printf.h"
+#include "../../kernel/riscv.h"
+#include "../../kernel/lib/string.h"
+#include "../../kernel/sync/spinlock.h"
+#include "../../kernel/process/scheduler.h"
+#include "../../kernel/fs/vfs.h"
+#include "../../kernel/trap/trap.h"
+#include "../plic/plic.h"
+
+/* Feature bits */
+#define VIRTIO_BLK_F_SEG_MAX (1ULL << 2)
+#define VIRTIO_BLK_F_RO      (1ULL << 5)
+
+/* Configuration space */
+#define VIRTIO_BLK_CFG_CAPACITY 0    /* u64, in 512-byte sectors */
+#define VIRTIO_BLK_CFG_SEG_MAX  12   /* u32 */
+
+/* Request types */
+#define VIRTIO_BLK_T_IN  0
+#define VIRTIO_BLK_T_OUT 1
+
+#define VIRTIO_BLK_S_OK 0
+
+typedef struct virtio_blk_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_hdr_t;
+
+/* The part of a command the device reads and writes, a cache line each */
+typedef struct blk_cmd_io {
+    virtio_blk_hdr_t hdr;
+    volatile uint8_t status;
+} __attribute__((aligned(DMA_ALIGN))) blk_cmd_io_t;
+
+/* Commands the device may have in flight at once. Each one takes a
+ * header, up to BLK_MAX_SEGS data descriptors and a status descriptor. */
+#define BLK_MAX_CMDS 32
+#define BLK_QUEUE_SIZE VIRTQ_MAX_SIZE
+
+/* Deadline elevator: requests are served in ascending sector order from
+ * the last head position (C-LOOK), except that one whose deadline has
+ * passed goes first. Reads get the shorter deadline, as something is
+ * usually waiting on them; writes are mostly writeback. */
+#define BLK_READ_EXPIRE  (timebase_hz / 20)    /* 50 ms */
+#define BLK_WRITE_EXPIRE (timebase_hz / 2)     /* 500 ms */
+
+/* Requests moved by one VFS call before waiting for them, and the
+ * scatter-gather entries each may use */
+#define BLK_BATCH 4
+#define BLK_REQ_SEGS 8
+
+/* One device command: a run of sector-adjacent requests */
+typedef struct blk_cmd {
+    blk_cmd_io_t *io;          /* In DMA memory */
+    dma_addr_t io_dma;
+    struct blk_cmd *next_free;
+    blk_req_t *reqs;           /* Chained through next */
+} blk_cmd_t;
+
+typedef struct blk_stats {
+    uint64_t reqs;             /* Submitted requests */
+    uint64_t cmds;             /* Device commands they became */
+    uint64_t merged;           /* Requests that rode on another's command */
+    uint64_t expired;          /* Dispatched ahead of order by deadline */
+    uint64_t sectors_read;
+    uint64_t sectors_written;
+    uint64_t errors;
+    uint64_t irqs;
+    uint64_t max_inflight;
+} blk_stats_t;
+
+static virtio_dev_t blk_dev;
+static virtq_t blk_vq;
+static int blk_up = 0;
+static int blk_ro = 0;
+static uint64_t capacity;
+static uint32_t seg_max = BLK_MAX_SEGS;
+
+static blk_cmd_t cmds[BLK_MAX_CMDS];
+static blk_cmd_io_t *cmd_io;
+static blk_cmd_t *free_cmds;
+static int inflight;
+
+/* Pending requests: sorted by sector, and per direction in arrival order */
+static blk_req_t *sorted;
+static blk_req_t *fifo_head[2], *fifo_tail[2];
+static uint64_t head_pos;      /* Sector after the last dispatched command */
+static int plugged;            /* Hold requests back while batches build */
+
+static blk_stats_t stats;
+static file_ops_t blk_ops;
+
+/* Everything above; taken from the interrupt handler too */
+static spinlock_t blk_lock;
+
+static void fifo_remove(blk_req_t *req) {
+    blk_req_t **link = &fifo_head[req->write];
+    blk_req_t *prev = NULL;
+    while (*link != req) {
+        prev = *link;
+        link = &(*link)->fifo_next;
+    }
+    *link = req->fifo_next;
+    if (fifo_tail[req->write] == req) {
+        fifo_tail[req->write] = prev;
+    }
+}
+
+/* Take req off both pending lists; link is its slot in the sorted list */
+static void pending_remove(blk_req_t **link, blk_req_t *req) {
+    *link = req->next;
+    req->next = NULL;
+    fifo_remove(req);
+}
+
+static void pending_insert(blk_req_t *req) {
+    blk_req_t **link = &sorted;
+    while (*link != NULL && (*link)->sector <= req->sector) {
+        link = &(*link)->next;
+    }
+    req->next = *link;
+    *link = req;
+    
+    req->fifo_next = NULL;
+    if (fifo_tail[req->write] != NULL) {
+        fifo_tail[req->write]->fifo_next = req;
+    } else {
+        fifo_head[req->write] = req;
+    }
+    fifo_tail[req->write] = req;
+}
+
+/* Slot in the sorted list of the next request to serve; blk_lock held */
+static blk_req_t **pick_next(void) {
+    uint64_t now = r_time();
+    blk_req_t *expired = NULL;
+    
+    for (int dir = 0; dir < 2 && expired == NULL; dir++) {
+        if (fifo_head[dir] != NULL && fifo_head[dir]->deadline <= now) {
+            expired = fifo_head[dir];
+        }
+    }
+    
+    blk_req_t **link = &sorted;
+    if (expired != NULL) {
+        while (*link != expired) {
+            link = &(*link)->next;
+        }
+        stats.expired++;
+        return link;
+    }
+    
+    /* C-LOOK: first request at or past the head, else wrap around */
+    while (*link != NULL && (*link)->sector < head_pos) {
+        link = &(*link)->next;
+    }
+    return *link != NULL ? link : &sorted;
+}
+
+/* Descriptors req's data needs at most */
+static int req_nents(const blk_req_t *req) {
+    return req->sg != NULL ? req->sg->nents : 1;
+}
+
+/* Append req's data to a command; room was checked with req_nents() */
+static void req_add_sg(sg_table_t *sg, const blk_req_t *req) {
+    if (req->sg == NULL) {
+        sg_add_buf(sg, req->buf, (uint64_t)req->count * BLK_SECTOR_SIZE);
+        return;
+    }
+    for (int i = 0; i < req->sg->nents; i++) {
+        sg_add(sg, req->sg->ents[i].addr, req->sg->ents[i].len);
+    }
+}
+
+/* Move pending requests to the device while there is room; blk_lock held.
+ * Returns the number of commands queued. */
+static int dispatch(void) {
+    int queued = 0;
+    
+    while (!plugged && sorted != NULL && free_cmds != NULL && blk_vq.num_free >= 3) {
+        uint32_t max_segs = blk_vq.num_free - 2;
+        if (max_segs > seg_max) {
+            max_segs = seg_max;
+        }
+    
+        /* Start a command with the chosen request, then pull in the
+         * requests that continue it. The sorted order puts them right
+         * behind it. */
+        blk_req_t **link = pick_next();
+        blk_req_t *first = *link;
+        if (req_nents(first) > (int)max_segs) {
+            break;  /* Wait for descriptors to come back */
+        }
+        pending_remove(link, first);
+    
+        blk_cmd_t *cmd = free_cmds;
+        free_cmds = cmd->next_free;
+        cmd->io->hdr.type = first->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+        cmd->io->hdr.reserved = 0;
+        cmd->io->hdr.sector = first->sector;
+        cmd->io->status = 0xff;
+        cmd->reqs = first;
+        
+        sg_entry_t hdr_ent, status_ent, data_ents[BLK_MAX_SEGS];
+        sg_table_t hdr_sg, data_sg, status_sg;
+        sg_init(&hdr_sg, &hdr_ent, 1);
+        sg_add(&hdr_sg, cmd->io_dma + offsetof(blk_cmd_io_t, hdr), sizeof(virtio_blk_hdr_t));
+        sg_init(&status_sg, &status_ent, 1);
+        sg_add(&status_sg, cmd->io_dma + offsetof(blk_cmd_io_t, status), 1);
+        sg_init(&data_sg, data_ents, max_segs);
+        req_add_sg(&data_sg, first);
+        uint64_t end = first->sector + first->count;
+        blk_req_t *last = first;
+        
+        while (*link != NULL && (*link)->sector <= end) {
+            blk_req_t *r = *link;
+            if (r->sector != end || r->write != first->write) {
+                link = &r->next;
+                continue;
+            }
+            if (data_sg.nents + req_nents(r) > (int)max_segs) {
+                break;
+            }
+            pending_remove(link, r);
+            req_add_sg(&data_sg, r);
+            last->next = r;
+            last = r;
+            end += r->count;
+            stats.merged++;
+        }
+        
+        /* Cannot fail: the descriptors were counted above */
+        const sg_table_t *sgs[3] = { &hdr_sg, &data_sg, &status_sg };
+        virtq_add_sg(&blk_vq, sgs, first->write ? 2 : 1, first->write ? 1 : 2, cmd);
+        head_pos = end;
+        stats.cmds++;
+        if (first->write) {
+            stats.sectors_written += end - first->sector;
+        } else {
+            stats.sectors_read += end - first->sector;
+        }
+        if (++inflight > (int)stats.max_inflight) {
+            stats.max_inflight = inflight;
+        }
+        queued++;
+    }
+    return queued;
+}
+
+/* Report completion; after this the submitter owns req again */
+static void complete(blk_req_t *req, int status) {
+    void (*fn)(blk_req_t *req) = req->done;
+    process_t *w = __atomic_load_n(&req->waiter, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&req->status, status, __ATOMIC_SEQ_CST);
+    if (fn != NULL) {
+        fn(req);
+    } else if (w != NULL) {
+        sched_wakeup(w);
+    }
+}
+
+static void blk_irq(void *arg) {
+    (void)arg;
+    virtio_ack_irq(&blk_dev);
+    
+    spin_lock(&blk_lock);
+    stats.irqs++;
+    
+    /* Collect finished requests, carrying each command's status */
+    blk_req_t *done = NULL, **tail = &done;
+    blk_cmd_t *cmd;
+    while ((cmd = virtq_get(&blk_vq, NULL)) != NULL) {
+        int status = cmd->io->status == VIRTIO_BLK_S_OK ? 0 : -1;
+        if (status != 0) {
+            stats.errors++;
+        }
+        for (blk_req_t *r = cmd->reqs; r != NULL; r = r->next) {
+            r->error = status;
+        }
+        *tail = cmd->reqs;
+        while (*tail != NULL) {
+            tail = &(*tail)->next;
+        }
+        cmd->reqs = NULL;
+        cmd->next_free = free_cmds;
+        free_cmds = cmd;
+        inflight--;
+    }
+    
+    /* Refill the device before handing out completions */
+    if (dispatch() > 0) {
+        virtq_kick(&blk_vq);
+    }
+    spin_unlock(&blk_lock);
+    
+    while (done != NULL) {
+        blk_req_t *r = done;
+        done = r->next;
+        r->next = NULL;
+        complete(r, r->error);
+    }
+}
+
+int virtio_blk_init(void) {
+    if (virtio_find(VIRTIO_ID_BLOCK, 0, &blk_dev) != 0) {
+        printf("[VBLK] No virtio-blk device\n");
+        return -1;
+    }
+    if (virtio_negotiate(&blk_dev, VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO) != 0 ||
+        virtq_init(&blk_dev, &blk_vq, 0, BLK_QUEUE_SIZE) != 0) {
+        printf("[VBLK] Device setup failed\n");
+        return -1;
+    }
+    
+    spin_init(&blk_lock, "virtio-blk");
+    capacity = virtio_config_read32(&blk_dev, VIRTIO_BLK_CFG_CAPACITY) |
+               ((uint64_t)virtio_config_read32(&blk_dev, VIRTIO_BLK_CFG_CAPACITY + 4) << 32);
+    if (blk_dev.features & VIRTIO_BLK_F_SEG_MAX) {
+        uint32_t n = virtio_config_read32(&blk_dev, VIRTIO_BLK_CFG_SEG_MAX);
+        if (n > 0 && n < seg_max) {
+            seg_max = n;
+        }
+    }
+    blk_ro = (blk_dev.features & VIRTIO_BLK_F_RO) != 0;
+    
+    dma_addr_t io_dma;
+    cmd_io = dma_alloc(BLK_MAX_CMDS * sizeof(blk_cmd_io_t), &io_dma);
+    if (cmd_io == NULL) {
+        printf("[VBLK] No DMA memory\n");
+        return -1;
+    }
+    free_cmds = NULL;
+    for (int i = BLK_MAX_CMDS - 1; i >= 0; i--) {
+        cmds[i].io = &cmd_io[i];
+        cmds[i].io_dma = io_dma + i * sizeof(blk_cmd_io_t);
+        cmds[i].next_free = free_cmds;
+        free_cmds = &cmds[i];
+    }
+    
+    trap_register_irq(blk_dev.irq, blk_irq, NULL);
+    plic_enable(blk_dev.irq);
+    virtio_driver_ok(&blk_dev);
+    blk_up = 1;
+    vfs_register_device("blk", &blk_ops);
+    
+    printf("[VBLK] virtio-blk at %p irq %u, %u sectors (%u KB)%s, %u segments per command\n",
+           (void*)blk_dev.base, blk_dev.irq, capacity, capacity / 2,
+           blk_ro ? " read-only" : "", seg_max);
+    return 0;
+}
+
+int blk_present(void) {
+    return blk_up;
+}
+
+uint64_t blk_capacity(void) {
+    return capacity;
+}
+
+void blk_req_init(blk_req_t *req, int write, uint64_t sector, void *buf,
+                  uint32_t count) {
+    memset(req, 0, sizeof(*req));
+    req->write = write != 0;
+    req->sector = sector;
+    req->buf = buf;
+    req->count = count;
+}
+
+void blk_req_init_sg(blk_req_t *req, int write, uint64_t sector,
+                     const sg_table_t *sg) {
+    blk_req_init(req, write, sector, NULL, (uint32_t)(sg->len / BLK_SECTOR_SIZE));
+    req->sg = sg;
+}
+
+int blk_submit(blk_req_t *req) {
+    if (!blk_up || req->count == 0 || req->count > BLK_MAX_REQ_SECTORS ||
+        req->sector >= capacity || req->count > capacity - req->sector ||
+        (req->write && blk_ro)) {
+        return -1;
+    }
+    if (req->sg != NULL && (req->sg->len != (uint64_t)req->count * BLK_SECTOR_SIZE ||
+                            req->sg->nents > (int)seg_max)) {
+        return -1;
+    }
+    req->status = BLK_PENDING;
+    req->deadline = r_time() + (req->write ? BLK_WRITE_EXPIRE : BLK_READ_EXPIRE);
+    
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    stats.reqs++;
+    pending_insert(req);
+    if (dispatch() > 0) {
+        virtq_kick(&blk_vq);
+    }
+    spin_unlock_irqrestore(&blk_lock, flags);
+    return 0;
+}
+
+void blk_plug(void) {
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    plugged++;
+    spin_unlock_irqrestore(&blk_lock, flags);
+}
+
+void blk_unplug(void) {
+    uint64_t flags = spin_lock_irqsave(&blk_lock);
+    if (--plugged == 0 && dispatch() > 0) {
+        virtq_kick(&blk_vq);
+    }
+    spin_unlock_irqrestore(&blk_lock, flags);
+}
+
+int blk_wait(blk_req_t *req) {
+    process_t *p = current_proc();
+    while (__atomic_load_n(&req->status, __ATOMIC_SEQ_CST) == BLK_PENDING) {
+        if (p == NULL || p->policy == SCHED_IDLE) {
+            sched_yield();  /* The idle task cannot sleep: poll */
+            continue;
+        }
+        uint64_t flags = intr_save();
+        __atomic_store_n(&req->waiter, p, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&req->status, __ATOMIC_SEQ_CST) == BLK_PENDING) {
+            sched_sleep();
+        }
+        __atomic_store_n(&req->waiter, NULL, __ATOMIC_RELAXED);
+        intr_restore(flags);
+    }
+    return req->status;
+}
+
+/* Kernel address of byte pos of the segments, and how many bytes are
+ * contiguous from there */
+static uint8_t *iov_at(const iovec_t *iov, int iovcnt, uint64_t pos, uint64_t *avail) {
+    for (int i = 0; i < iovcnt; i++) {
+        if (pos < iov[i].iov_len) {
+            *avail = iov[i].iov_len - pos;
+            return (uint8_t*)iov[i].iov_base + pos;
+        }
+        pos -= iov[i].iov_len;
+    }
+    *avail = 0;
+    return NULL;
+}
+
+/* Transfer len bytes (whole sectors) between the segments and the disk
+ * from sector on. The segments are packed into scatter-gather requests
+ * of at most BLK_MAX_REQ_SECTORS, which need only add up to whole
+ * sectors, and a batch is submitted plugged so that the elevator can
+ * merge it back into large commands. */
+static int blk_xfer(int write, uint64_t sector, const iovec_t *iov, int iovcnt,
+                    uint64_t len) {
+    blk_req_t reqs[BLK_BATCH];
+    sg_entry_t ents[BLK_BATCH][BLK_REQ_SEGS];
+    sg_table_t sgs[BLK_BATCH];
+    uint64_t pos = 0;
+    int n = 0, ret = 0, plug = 0;
+    
+    while (pos < len) {
+        uint64_t want = len - pos;
+        if (want > BLK_MAX_REQ_SECTORS * BLK_SECTOR_SIZE) {
+            want = BLK_MAX_REQ_SECTORS * BLK_SECTOR_SIZE;
+        }
+        sg_table_t *sg = &sgs[n];
+        sg_init(sg, ents[n], BLK_REQ_SEGS);
+        while (sg->len < want) {
+            uint64_t avail;
+            uint8_t *p = iov_at(iov, iovcnt, pos + sg->len, &avail);
+            if (avail > want - sg->len) {
+                avail = want - sg->len;
+            }
+            if (p == NULL || sg_add_buf(sg, p, avail) != 0) {
+                break;
+            }
+        }
+        /* Out of entries mid-sector: the tail starts the next request */
+        sg_trim(sg, sg->len % BLK_SECTOR_SIZE);
+        if (sg->len == 0) {
+            ret = -1;
+            break;
+        }
+        
+        if (!plug) {
+            blk_plug();
+            plug = 1;
+        }
+        blk_req_init_sg(&reqs[n], write, sector, sg);
+        if (blk_submit(&reqs[n]) != 0) {
+            ret = -1;
+            break;
+        }
+        n++;
+        sector += sg->len / BLK_SECTOR_SIZE;
+        pos += sg->len;
+        if (n == BLK_BATCH) {
+            blk_unplug();
+            plug = 0;
+            for (int j = 0; j < n; j++) {
+                ret |= blk_wait(&reqs[j]);
+            }
+            n = 0;
+        }
+    }
+    
+    if (plug) {
+        blk_unplug();
+    }
+    for (int j = 0; j < n; j++) {
+        ret |= blk_wait(&reqs[j]);
+    }
+    return ret;
+}
+
+int blk_rw(int write, uint64_t sector, void *buf, uint32_t count) {
+    iovec_t iov = { buf, (size_t)count * BLK_SECTOR_SIZE };
+    return blk_xfer(write, sector, &iov, 1, iov.iov_len);
+}
+
+void blk_print_stats(void) {
+    if (!blk_up) {
+        printf("[VBLK] No virtio-blk device\n");
+        return;
+    }
+    printf("[VBLK] %u sectors%s, %u segments per command\n",
+           capacity, blk_ro ? " (read-only)" : "", seg_max);
+    printf("  Requests: %u in %u commands (%u merged, %u by deadline)\n",
+           stats.reqs, stats.cmds, stats.merged, stats.expired);
+    printf("  Sectors: %u read, %u written, %u errors\n",
+           stats.sectors_read, stats.sectors_written, stats.errors);
+    printf("  IRQs: %u, max in flight: %u commands\n",
+           stats.irqs, stats.max_inflight);
+}
+
+/* /blk device: the whole disk. Offsets and transfer lengths are whole
+ * sectors; the segments making up a transfer can be of any size. */
+
+static int blk_dev_rw(file_t *file, int write, const iovec_t *iov, int iovcnt) {
+    if (!blk_up || iovcnt < 0 || iovcnt > VFS_IOV_MAX ||
+        file->offset % BLK_SECTOR_SIZE != 0) {
+        return -1;
+    }
+    uint64_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+    if (total % BLK_SECTOR_SIZE != 0) {
+        return -1;
+    }
+    
+    /* Clip to the end of the disk */
+    uint64_t size = capacity * BLK_SECTOR_SIZE;
+    uint64_t avail = file->offset < size ? size - file->offset : 0;
+    if (total > avail) {
+        total = avail;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    
+    if (blk_xfer(write, file->offset / BLK_SECTOR_SIZE, iov, iovcnt, total) != 0) {
+        return -1;
+    }
+    file->offset += total;
+    return (int)total;
+}
+
+static int blk_dev_read(file_t *file, void *buf, size_t count) {
+    iovec_t iov = { buf, count };
+    return blk_dev_rw(file, 0, &iov, 1);
+}
+
+static int blk_dev_write(file_t *file, const void *buf, size_t count) {
+    iovec_t iov = { (void*)buf, count };
+    return blk_dev_rw(file, 1, &iov, 1);
+}
+
+static int blk_dev_readv(file_t *file, const iovec_t *iov, int iovcnt) {
+    return blk_dev_rw(file, 0, iov, iovcnt);
+}
+
+static int blk_dev_writev(file_t *file, const iovec_t *iov, int iovcnt) {
+    return blk_dev_rw(file, 1, iov, iovcnt);
+}
+
+static int blk_dev_seek(file_t *file, uint32_t offset) {
+    if (offset % BLK_SECTOR_SIZE != 0 || offset > capacity * BLK_SECTOR_SIZE) {
+        return -1;
+    }
+    file->offset = offset;
+    return 0;
+}
+
+static file_ops_t blk_ops = {
+    .read = blk_dev_read,
+    .write = blk_dev_write,
+    .seek = blk_dev_seek,
+    .readv = blk_dev_readv,
+    .writev = blk_dev_writev,
+};
@@ -0,0 +1,69 @@
+#ifndef _VIRTIO_BLK_H
+#define _VIRTIO_BLK_H
+
+#include "../../kernel/types.h"
+#include "../../kernel/process/process.h"
+#include "../../kernel/mm/dma.h"
+
+#define BLK_SECTOR_SIZE 512
+
+/* Largest single request, and the most requests merged into one device
+ * command */
+#define BLK_MAX_REQ_SECTORS 128    /* 64 KB */
+#define BLK_MAX_SEGS 16
+
+#define BLK_PENDING 1
+
+/* One transfer of count sectors at sector, to/from either a kernel
+ * buffer or a scatter-gather table of at most BLK_MAX_SEGS entries.
+ * Requests are queued by the deadline elevator, merged with
+ * sector-adjacent ones at dispatch, and completed from the device
+ * interrupt. */
+typedef struct blk_req {
+    struct blk_req *next;      /* Sorted queue, then the device command */
+    struct blk_req *fifo_next; /* Arrival order within its direction */
+    uint64_t sector;
+    uint32_t count;
+    int write;
+    void *buf;
+    const sg_table_t *sg;      /* Instead of buf, if set */
+    uint64_t deadline;         /* time CSR value */
+    volatile int status;       /* BLK_PENDING, then 0 or -1 */
+    int error;                 /* Device result, until status is set */
+    /* Called in interrupt context on completion, if set */
+    void (*done)(struct blk_req *req);
+    process_t *waiter;         /* Set by blk_wait() */
+    void *private;             /* For the submitter */
+} blk_req_t;
+
+/* Probe the first virtio-blk transport and register it as the /blk
+ * device; -1 if there is none */
+int virtio_blk_init(void);
+int blk_present(void);
+uint64_t blk_capacity(void);   /* In sectors */
+
+void blk_req_init(blk_req_t *req, int write, uint64_t sector, void *buf,
+                  uint32_t count);
+
+/* Request over a scatter-gather table; count is sg->len in sectors */
+void blk_req_init_sg(blk_req_t *req, int write, uint64_t sector,
+                     const sg_table_t *sg);
+
+/* Queue a request; -1 (and nothing queued) if it is out of range */
+int blk_submit(blk_req_t *req);
+
+/* Hold submitted requests back until the matching blk_unplug(), so that
+ * a batch reaches the elevator whole and adjacent requests merge. Nests;
+ * keep the window short, it stalls every submitter. */
+void blk_plug(void);
+void blk_unplug(void);
+
+/* Sleep until req completes; returns its status */
+int blk_wait(blk_req_t *req);
+
+/* Synchronous transfer of any length */
+int blk_rw(int write, uint64_t sector, void *buf, uint32_t count);
+
+void blk_print_stats(void);
+
+#endif /* _VIRTIO_BLK_H */
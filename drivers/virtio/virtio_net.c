@@ -0,0 +1,314 @@
+#include "virtio_net.h"
+#include "virtio.h"
+
+#include "../../kernel/printf.h"
+#include "../../kernel/lib/string.h"
+#include "../../kernel/sync/spinlock.h"
+#include "../../kernel/process/workqueue.h"
+#include "../../kernel/trap/trap.h"
+#include "../plic/plic.h"
+
+/* Feature bits */
+#define VIRTIO_NET_F_MAC (1ULL << 5)
+
+/* Prepended to every frame in both directions (VERSION_1 layout) */
+typedef struct virtio_net_hdr {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t num_buffers;
+} virtio_net_hdr_t;
+
+_Static_assert(sizeof(netbuf_t) + sizeof(virtio_net_hdr_t) <= NETBUF_HEADROOM,
+               "netbuf headroom too small");
+
+#define VNET_RXQ 0
+#define VNET_TXQ 1
+#define VNET_QUEUE_SIZE 64     /* RX pool pages, and TX ring entries */
+
+/* Most frames one poll pass delivers before yielding the worker. Under
+ * load a full pass reschedules itself with interrupts still off, so the
+ * device is polled; a short pass means the ring drained, and interrupts
+ * are turned back on. */
+#define VNET_NAPI_BUDGET 32
+
+typedef struct vnet_stats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_dropped;       /* No handler registered */
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;       /* Ring full or frame too long */
+    uint64_t irqs;
+    uint64_t polls;            /* Poll passes */
+    uint64_t busy_polls;       /* Passes that used their whole budget */
+} vnet_stats_t;
+
+static virtio_dev_t vnet_dev;
+static virtq_t rxq, txq;
+static int vnet_up = 0;
+static uint8_t vnet_mac[ETH_ALEN];
+static void (*rx_handler)(netbuf_t *nb) = NULL;
+static work_t napi_work;
+static vnet_stats_t stats;
+
+/* Both rings: RX refills may come from any task, TX from senders and
+ * the poll worker, the IRQ handler only touches the RX flags */
+static spinlock_t vnet_lock;
+
+static virtio_net_hdr_t *netbuf_hdr(netbuf_t *nb) {
+    return (virtio_net_hdr_t*)((uint8_t*)nb + NETBUF_HEADROOM - sizeof(virtio_net_hdr_t));
+}
+
+/* Hand an RX page to the device; vnet_lock held */
+static int rx_post(netbuf_t *nb) {
+    virtq_buf_t buf = {
+        .addr = netbuf_hdr(nb),
+        .len = sizeof(virtio_net_hdr_t) + NETBUF_MAX_FRAME,
+        .write = 1,
+    };
+    return virtq_add(&rxq, &buf, 1, nb);
+}
+
+/* Free transmitted buffers; vnet_lock held */
+static void tx_reap(void) {
+    netbuf_t *nb;
+    while ((nb = virtq_get(&txq, NULL)) != NULL) {
+        free_page(nb);
+    }
+}
+
+static void vnet_poll(work_t *w) {
+    int done = 0;
+    netbuf_t *nb;
+    
+    stats.polls++;
+    while (done < VNET_NAPI_BUDGET) {
+        uint32_t len;
+        uint64_t flags = spin_lock_irqsave(&vnet_lock);
+        nb = virtq_get(&rxq, &len);
+        spin_unlock_irqrestore(&vnet_lock, flags);
+        if (nb == NULL) {
+            break;
+        }
+        done++;
+        nb->data = (uint8_t*)nb + NETBUF_HEADROOM;
+        nb->len = len > sizeof(virtio_net_hdr_t) ? len - sizeof(virtio_net_hdr_t) : 0;
+        stats.rx_packets++;
+        stats.rx_bytes += nb->len;
+        
+        void (*fn)(netbuf_t *nb) = rx_handler;
+        if (fn) {
+            fn(nb);
+        } else {
+            stats.rx_dropped++;
+            netbuf_free(nb);
+        }
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&vnet_lock);
+    tx_reap();
+    if (done == VNET_NAPI_BUDGET) {
+        /* Still busy: stay in polling mode */
+        stats.busy_polls++;
+        spin_unlock_irqrestore(&vnet_lock, flags);
+        queue_work(w);
+        return;
+    }
+    /* Drained: back to interrupts, unless a frame slipped in meanwhile */
+    int more = virtq_enable_cb(&rxq);
+    if (more) {
+        virtq_disable_cb(&rxq);
+    }
+    spin_unlock_irqrestore(&vnet_lock, flags);
+    if (more) {
+        queue_work(w);
+    }
+}
+
+static void vnet_irq(void *arg) {
+    (void)arg;
+    virtio_ack_irq(&vnet_dev);
+    stats.irqs++;
+    
+    spin_lock(&vnet_lock);
+    virtq_disable_cb(&rxq);
+    spin_unlock(&vnet_lock);
+    queue_work(&napi_work);
+}
+
+int virtio_net_init(void) {
+    if (virtio_find(VIRTIO_ID_NET, 0, &vnet_dev) != 0) {
+        printf("[VNET] No virtio-net device\n");
+        return -1;
+    }
+    if (virtio_negotiate(&vnet_dev, VIRTIO_NET_F_MAC) != 0 ||
+        virtq_init(&vnet_dev, &rxq, VNET_RXQ, VNET_QUEUE_SIZE) != 0 ||
+        virtq_init(&vnet_dev, &txq, VNET_TXQ, VNET_QUEUE_SIZE) != 0) {
+        printf("[VNET] Device setup failed\n");
+        return -1;
+    }
+    
+    spin_init(&vnet_lock, "virtio-net");
+    work_init(&napi_work, vnet_poll, NULL);
+    for (int i = 0; i < ETH_ALEN; i++) {
+        vnet_mac[i] = (vnet_dev.features & VIRTIO_NET_F_MAC) ?
+                      virtio_config_read8(&vnet_dev, i) : 0;
+    }
+    if (!(vnet_dev.features & VIRTIO_NET_F_MAC)) {
+        /* Locally administered address */
+        vnet_mac[0] = 0x02;
+        vnet_mac[5] = 0x01;
+    }
+    
+    /* Fill the RX ring from the page pool once; pages circulate between
+     * the device and consumers from then on */
+    int posted = 0;
+    for (int i = 0; i < rxq.num; i++) {
+        netbuf_t *nb = (netbuf_t*)alloc_page();
+        if (nb == NULL) {
+            break;
+        }
+        nb->rx = 1;
+        rx_post(nb);
+        posted++;
+    }
+    
+    /* Transmit completions are reaped lazily, without interrupts */
+    virtq_disable_cb(&txq);
+    
+    trap_register_irq(vnet_dev.irq, vnet_irq, NULL);
+    plic_enable(vnet_dev.irq);
+    virtio_driver_ok(&vnet_dev);
+    virtq_kick(&rxq);
+    vnet_up = 1;
+    
+    printf("[VNET] virtio-net at %p irq %u, MAC %02x:%02x:%02x:%02x:%02x:%02x, %d RX buffers\n",
+           (void*)vnet_dev.base, vnet_dev.irq, vnet_mac[0], vnet_mac[1],
+           vnet_mac[2], vnet_mac[3], vnet_mac[4], vnet_mac[5], posted);
+    return 0;
+}
+
+int virtio_net_present(void) {
+    return vnet_up;
+}
+
+void virtio_net_mac(uint8_t mac[ETH_ALEN]) {
+    memcpy(mac, vnet_mac, ETH_ALEN);
+}
+
+void virtio_net_set_rx_handler(void (*fn)(netbuf_t *nb)) {
+    __atomic_store_n(&rx_handler, fn, __ATOMIC_RELEASE);
+}
+
+netbuf_t *netbuf_alloc(void) {
+    netbuf_t *nb = (netbuf_t*)alloc_page();
+    if (nb == NULL) {
+        return NULL;
+    }
+    nb->next = NULL;
+    nb->data = (uint8_t*)nb + NETBUF_HEADROOM;
+    nb->len = 0;
+    nb->rx = 0;
+    return nb;
+}
+
+void netbuf_free(netbuf_t *nb) {
+    if (nb == NULL) {
+        return;
+    }
+    if (!nb->rx) {
+        free_page(nb);
+        return;
+    }
+    uint64_t flags = spin_lock_irqsave(&vnet_lock);
+    rx_post(nb);
+    virtq_kick(&rxq);
+    spin_unlock_irqrestore(&vnet_lock, flags);
+}
+
+/* Put one frame on the TX ring; vnet_lock held */
+static int tx_queue(netbuf_t *nb) {
+    uint8_t *page = (uint8_t*)nb;
+    
+    /* The header goes right before the frame, in the headroom */
+    virtio_net_hdr_t *hdr = (virtio_net_hdr_t*)(nb->data - sizeof(virtio_net_hdr_t));
+    if ((uint8_t*)hdr < page + sizeof(netbuf_t) ||
+        nb->data + nb->len > page + PAGE_SIZE) {
+        return -1;
+    }
+    memset(hdr, 0, sizeof(*hdr));
+    virtq_buf_t buf = {
+        .addr = hdr,
+        .len = sizeof(virtio_net_hdr_t) + nb->len,
+        .write = 0,
+    };
+    
+    if (virtq_add(&txq, &buf, 1, nb) != 0) {
+        tx_reap();
+        if (virtq_add(&txq, &buf, 1, nb) != 0) {
+            return -1;
+        }
+    }
+    stats.tx_packets++;
+    stats.tx_bytes += nb->len;
+    return 0;
+}
+
+int virtio_net_send_list(netbuf_t *list) {
+    netbuf_t *dropped = NULL;
+    int sent = 0;
+    
+    if (!vnet_up) {
+        dropped = list;
+        list = NULL;
+    } else {
+        uint64_t flags = spin_lock_irqsave(&vnet_lock);
+        while (list != NULL) {
+            netbuf_t *nb = list;
+            list = nb->next;
+            nb->next = NULL;
+            if (tx_queue(nb) == 0) {
+                sent++;
+            } else {
+                nb->next = dropped;
+                dropped = nb;
+            }
+        }
+        if (sent > 0) {
+            virtq_kick(&txq);
+        }
+        spin_unlock_irqrestore(&vnet_lock, flags);
+    }
+    
+    while (dropped != NULL) {
+        netbuf_t *nb = dropped;
+        dropped = nb->next;
+        stats.tx_dropped++;
+        netbuf_free(nb);
+    }
+    return sent;
+}
+
+int virtio_net_send(netbuf_t *nb) {
+    nb->next = NULL;
+    return virtio_net_send_list(nb) == 1 ? 0 : -1;
+}
+
+void virtio_net_print_stats(void) {
+    if (!vnet_up) {
+        printf("[VNET] No virtio-net device\n");
+        return;
+    }
+    printf("[VNET] MAC %02x:%02x:%02x:%02x:%02x:%02x\n", vnet_mac[0], vnet_mac[1],
+           vnet_mac[2], vnet_mac[3], vnet_mac[4], vnet_mac[5]);
+    printf("  RX: %u packets, %u bytes, %u dropped\n",
+           stats.rx_packets, stats.rx_bytes, stats.rx_dropped);
+    printf("  TX: %u packets, %u bytes, %u dropped\n",
+           stats.tx_packets, stats.tx_bytes, stats.tx_dropped);
+    printf("  IRQs: %u, poll passes: %u (%u at budget)\n",
+           stats.irqs, stats.polls, stats.busy_polls);
+}
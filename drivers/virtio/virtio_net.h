@@ -0,0 +1,67 @@
+#ifndef _VIRTIO_NET_H
+#define _VIRTIO_NET_H
+
+#include "../../kernel/types.h"
+#include "../../kernel/mm/mm.h"
+
+/* Packet buffer: one page, with this header at its start and the frame
+ * at data. Frames are never copied between the device and consumers:
+ * received frames sit in pages of a preallocated RX pool, and the
+ * consumer hands the buffer back with netbuf_free(), which reposts the
+ * page to the device. */
+typedef struct netbuf {
+    struct netbuf *next;       /* Free for the current owner's use */
+    uint8_t *data;             /* Start of the frame */
+    uint32_t len;              /* Frame length */
+    uint32_t rx;               /* Belongs to the RX pool */
+    uint64_t cb[2];            /* Scratch for the layer holding the buffer */
+} netbuf_t;
+
+/* Frames start this far into the page; the bytes before them hold the
+ * netbuf and the device's virtio_net_hdr, and give headers room to be
+ * prepended in place */
+#define NETBUF_HEADROOM 128
+#define NETBUF_MAX_FRAME (PAGE_SIZE - NETBUF_HEADROOM)
+
+#define ETH_ALEN 6
+
+/* Grow the frame at the front (prepend a header) / drop its first n bytes */
+static inline uint8_t *netbuf_push(netbuf_t *nb, uint32_t n) {
+    nb->data -= n;
+    nb->len += n;
+    return nb->data;
+}
+
+static inline uint8_t *netbuf_pull(netbuf_t *nb, uint32_t n) {
+    nb->data += n;
+    nb->len -= n;
+    return nb->data;
+}
+
+/* Probe the first virtio-net transport; -1 if there is none */
+int virtio_net_init(void);
+int virtio_net_present(void);
+void virtio_net_mac(uint8_t mac[ETH_ALEN]);
+
+/* Called from the poll worker (task context) for each received frame.
+ * The handler owns the buffer until it calls netbuf_free(). Without a
+ * handler, frames are dropped. */
+void virtio_net_set_rx_handler(void (*fn)(netbuf_t *nb));
+
+/* A TX buffer with an empty frame at data; NULL if out of memory */
+netbuf_t *netbuf_alloc(void);
+
+/* Give a buffer back: RX buffers are reposted, TX buffers freed */
+void netbuf_free(netbuf_t *nb);
+
+/* Queue nb->len bytes at nb->data for transmission. Takes ownership
+ * either way; -1 if the frame was dropped (ring full or too long). */
+int virtio_net_send(netbuf_t *nb);
+
+/* Send a list chained through next with a single device notification;
+ * returns how many were queued (the rest are dropped) */
+int virtio_net_send_list(netbuf_t *list);
+
+void virtio_net_print_stats(void);
+
+#endif /* _VIRTIO_NET_H */
@@ -0,0 +1,423 @@
+#include "bench.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../lib/string.h"
+#include "../mm/mm.h"
+#include "../mm/vm.h"
+#include "../fs/vfs.h"
+#include "../fs/simplefs.h"
+#include "../process/process.h"
+#include "../syscall/syscall.h"
+#include "../../drivers/virtio/virtio_blk.h"
+
+extern void swtch(context_t *old, context_t *new);
+
+static uint64_t cycles[BENCH_MAX_SAMPLES];
+static uint64_t nanos[BENCH_MAX_SAMPLES];
+
+/* Scratch pages shared by the data-moving benchmarks */
+static uint8_t *page_a;
+static uint8_t *page_b;
+
+/* Memory allocation */
+
+static void run_page_alloc(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        free_page(alloc_page());
+    }
+}
+
+/* kmalloc()'s allocator on a scratch page, rewound every sample so the
+ * kernel heap, which never gets memory back, is left alone */
+
+static bump_heap_t bench_heap;
+static void *bench_heap_page;
+
+static int setup_kmalloc(void *arg) {
+    (void)arg;
+    bench_heap_page = alloc_page();
+    if (bench_heap_page == NULL) {
+        return -1;
+    }
+    bump_init(&bench_heap, bench_heap_page, PAGE_SIZE, "bench heap");
+    return 0;
+}
+
+static void run_kmalloc(void *arg, int iters) {
+    (void)arg;
+    bump_reset(&bench_heap);
+    for (int i = 0; i < iters; i++) {
+        bump_alloc(&bench_heap, 64);
+    }
+}
+
+static void teardown_kmalloc(void *arg) {
+    (void)arg;
+    free_page(bench_heap_page);
+}
+
+/* Page tables: map, look up and unmap one page in a scratch table */
+
+static pagetable_t bench_pt;
+
+static int setup_mappages(void *arg) {
+    (void)arg;
+    bench_pt = (pagetable_t)alloc_page();
+    return bench_pt == NULL;
+}
+
+static void run_mappages(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        uint64_t va = 0x40000000UL + (uint64_t)(i % 512) * PGSIZE;
+        mappages(bench_pt, va, PGSIZE, (uint64_t)page_a, PTE_R | PTE_W);
+        walk(bench_pt, va, 0);
+        unmappages(bench_pt, va, PGSIZE);
+    }
+}
+
+static void teardown_mappages(void *arg) {
+    (void)arg;
+    vm_free(bench_pt);
+}
+
+/* Context switch: swtch() to a peer context and straight back */
+
+static context_t bench_main_ctx;
+static context_t bench_peer_ctx;
+static void *peer_stack;
+
+static void peer_loop(void) {
+    for (;;) {
+        swtch(&bench_peer_ctx, &bench_main_ctx);
+    }
+}
+
+static int setup_swtch(void *arg) {
+    (void)arg;
+    peer_stack = alloc_page();
+    if (peer_stack == NULL) {
+        return -1;
+    }
+    memset(&bench_peer_ctx, 0, sizeof(bench_peer_ctx));
+    bench_peer_ctx.ra = (uint64_t)peer_loop;
+    bench_peer_ctx.sp = (uint64_t)peer_stack + PAGE_SIZE;
+    return 0;
+}
+
+static void run_swtch(void *arg, int iters) {
+    (void)arg;
+    uint64_t flags = intr_save();  /* The peer is not a schedulable task */
+    for (int i = 0; i < iters; i++) {
+        swtch(&bench_main_ctx, &bench_peer_ctx);
+    }
+    intr_restore(flags);
+}
+
+static void teardown_swtch(void *arg) {
+    (void)arg;
+    free_page(peer_stack);
+}
+
+/* Traps and syscalls. Only U-mode ecalls reach the kernel and nothing
+ * here runs in U-mode, so the round trip is measured in two halves: a
+ * full trap entry/exit via a self-raised software interrupt, and the
+ * syscall dispatch itself. */
+
+static int setup_trap(void *arg) {
+    (void)arg;
+    return !intr_get() || !(r_sie() & SIE_SSIE);
+}
+
+static void run_trap(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        w_sip(r_sip() | SIP_SSIP);  /* Taken at once; the handler clears it */
+    }
+}
+
+static void run_syscall(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        syscall_handler(SYS_GETPID, 0, 0, 0, 0, 0, 0);
+    }
+}
+
+/* VFS: read and rewind the test device. It is opened once, as
+ * vfs_open() takes its file and inode from the kernel heap. */
+
+static file_t *bench_file;
+
+static int setup_vfs(void *arg) {
+    (void)arg;
+    bench_file = vfs_open("/testdev", 0);
+    if (bench_file == NULL) {
+        return -1;
+    }
+    if (bench_file->inode->ops->seek == NULL) {
+        vfs_close(bench_file);
+        return -1;
+    }
+    memset(page_a, 'b', 64);
+    vfs_write(bench_file, page_a, 64);
+    return 0;
+}
+
+static void run_vfs(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        bench_file->inode->ops->seek(bench_file, 0);
+        vfs_read(bench_file, page_b, 64);
+    }
+}
+
+static void teardown_vfs(void *arg) {
+    (void)arg;
+    vfs_close(bench_file);
+}
+
+/* SimpleFS: whole-block writes and reads across a file */
+
+static int bench_ino;
+
+/* Both directions start from a file with every block allocated */
+static int setup_sfs(void *arg) {
+    (void)arg;
+    bench_ino = sfs_create("bench.dat", VFS_FILE);
+    if (bench_ino < 0) {
+        return -1;
+    }
+    for (int i = 0; i < SFS_DIRECT_BLOCKS; i++) {
+        sfs_write(bench_ino, page_a, i * SFS_BLOCK_SIZE, SFS_BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static void run_sfs_write(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        sfs_write(bench_ino, page_a, (i % SFS_DIRECT_BLOCKS) * SFS_BLOCK_SIZE,
+                  SFS_BLOCK_SIZE);
+    }
+}
+
+static void run_sfs_read(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        sfs_read(bench_ino, page_b, (i % SFS_DIRECT_BLOCKS) * SFS_BLOCK_SIZE,
+                 SFS_BLOCK_SIZE);
+    }
+}
+
+static void teardown_sfs(void *arg) {
+    (void)arg;
+    sfs_delete("bench.dat");
+}
+
+/* Block device: 4 KB transfers at pseudo-random offsets, and a queue of
+ * adjacent ones that the elevator merges into few device commands. The
+ * benchmark loop runs in the idle task, which polls for completions. */
+
+#define BLK_BENCH_SECTORS (PAGE_SIZE / BLK_SECTOR_SIZE)
+#define BLK_BENCH_DEPTH 16
+
+static uint64_t blk_seed;
+
+/* Page-aligned start of a run of n pages */
+static uint64_t blk_random_sector(int n) {
+    blk_seed = blk_seed * 6364136223846793005UL + 1442695040888963407UL;
+    uint64_t pages = blk_capacity() / BLK_BENCH_SECTORS - n + 1;
+    return ((blk_seed >> 33) % pages) * BLK_BENCH_SECTORS;
+}
+
+static int setup_blk(void *arg) {
+    (void)arg;
+    blk_seed = 1;
+    return blk_present() && blk_capacity() >= BLK_BENCH_DEPTH * BLK_BENCH_SECTORS ? 0 : -1;
+}
+
+static void run_blk_read(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        blk_rw(0, blk_random_sector(1), page_b, BLK_BENCH_SECTORS);
+    }
+}
+
+static void run_blk_write(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        blk_rw(1, blk_random_sector(1), page_a, BLK_BENCH_SECTORS);
+    }
+}
+
+static void run_blk_read_queued(void *arg, int iters) {
+    (void)arg;
+    blk_req_t reqs[BLK_BENCH_DEPTH];
+    for (int i = 0; i < iters; i++) {
+        uint64_t base = blk_random_sector(BLK_BENCH_DEPTH);
+        /* Submitted back to front so that merging needs the sort */
+        blk_plug();
+        for (int d = BLK_BENCH_DEPTH - 1; d >= 0; d--) {
+            blk_req_init(&reqs[d], 0, base + d * BLK_BENCH_SECTORS, page_b,
+                         BLK_BENCH_SECTORS);
+            blk_submit(&reqs[d]);
+        }
+        blk_unplug();
+        for (int d = 0; d < BLK_BENCH_DEPTH; d++) {
+            blk_wait(&reqs[d]);
+        }
+    }
+}
+
+/* String library; arg is the length */
+
+static void run_memcpy(void *arg, int iters) {
+    size_t n = (size_t)(uint64_t)arg;
+    for (int i = 0; i < iters; i++) {
+        memcpy(page_a, page_b, n);
+    }
+}
+
+static void run_memset(void *arg, int iters) {
+    size_t n = (size_t)(uint64_t)arg;
+    for (int i = 0; i < iters; i++) {
+        memset(page_a, i, n);
+    }
+}
+
+static int setup_memcmp(void *arg) {
+    memcpy(page_b, page_a, (size_t)(uint64_t)arg);
+    return 0;
+}
+
+static void run_memcmp(void *arg, int iters) {
+    size_t n = (size_t)(uint64_t)arg;
+    for (int i = 0; i < iters; i++) {
+        memcmp(page_a, page_b, n);
+    }
+}
+
+static void run_page_clear(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        page_clear(page_a);
+    }
+}
+
+static void run_page_copy(void *arg, int iters) {
+    (void)arg;
+    for (int i = 0; i < iters; i++) {
+        page_copy(page_a, page_b);
+    }
+}
+
+#define SZ(n) ((void*)(uint64_t)(n))
+
+static const bench_t benches[] = {
+    { "page_alloc", NULL, run_page_alloc, NULL, NULL, 16, 128, 0 },
+    { "kmalloc", setup_kmalloc, run_kmalloc, teardown_kmalloc, NULL, 16, 128, 0 },
+    { "mappages", setup_mappages, run_mappages, teardown_mappages, NULL, 16, 128, 0 },
+    { "swtch_rtt", setup_swtch, run_swtch, teardown_swtch, NULL, 64, 128, 0 },
+    { "trap_rtt", setup_trap, run_trap, NULL, NULL, 16, 128, 0 },
+    { "syscall_getpid", NULL, run_syscall, NULL, NULL, 64, 128, 0 },
+    { "vfs_testdev", setup_vfs, run_vfs, teardown_vfs, NULL, 16, 128, 64 },
+    { "sfs_write", setup_sfs, run_sfs_write, teardown_sfs, NULL, 4, 64, SFS_BLOCK_SIZE },
+    { "sfs_read", setup_sfs, run_sfs_read, teardown_sfs, NULL, 4, 64, SFS_BLOCK_SIZE },
+    { "blk_read_4k", setup_blk, run_blk_read, NULL, NULL, 4, 64, PAGE_SIZE },
+    { "blk_write_4k", setup_blk, run_blk_write, NULL, NULL, 4, 64, PAGE_SIZE },
+    { "blk_read_qd16", setup_blk, run_blk_read_queued, NULL, NULL, 1, 64,
+      BLK_BENCH_DEPTH * PAGE_SIZE },
+    { "mem_memcpy_64", NULL, run_memcpy, NULL, SZ(64), 64, 128, 64 },
+    { "mem_memcpy_512", NULL, run_memcpy, NULL, SZ(512), 16, 128, 512 },
+    { "mem_memcpy_4096", NULL, run_memcpy, NULL, SZ(4096), 4, 128, 4096 },
+    { "mem_memset_64", NULL, run_memset, NULL, SZ(64), 64, 128, 64 },
+    { "mem_memset_512", NULL, run_memset, NULL, SZ(512), 16, 128, 512 },
+    { "mem_memset_4096", NULL, run_memset, NULL, SZ(4096), 4, 128, 4096 },
+    { "mem_memcmp_64", setup_memcmp, run_memcmp, NULL, SZ(64), 64, 128, 64 },
+    { "mem_memcmp_512", setup_memcmp, run_memcmp, NULL, SZ(512), 16, 128, 512 },
+    { "mem_memcmp_4096", setup_memcmp, run_memcmp, NULL, SZ(4096), 4, 128, 4096 },
+    { "mem_page_clear", NULL, run_page_clear, NULL, NULL, 4, 128, PAGE_SIZE },
+    { "mem_page_copy", NULL, run_page_copy, NULL, NULL, 4, 128, PAGE_SIZE },
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void sort(uint64_t *v, int n) {
+    for (int i = 1; i < n; i++) {
+        uint64_t x = v[i];
+        int j = i - 1;
+        while (j >= 0 && v[j] > x) {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = x;
+    }
+}
+
+static void bench_one(const bench_t *b) {
+    int n = b->samples;
+    if (n > BENCH_MAX_SAMPLES) {
+        n = BENCH_MAX_SAMPLES;
+    }
+    if (b->setup && b->setup(b->arg) != 0) {
+        printf("BENCH name=%s skipped=1\n", b->name);
+        return;
+    }
+    
+    b->run(b->arg, b->iters);  /* Warm caches and TLB */
+    for (int s = 0; s < n; s++) {
+        uint64_t c0 = r_cycle();
+        uint64_t t0 = r_time();
+        b->run(b->arg, b->iters);
+        uint64_t t1 = r_time();
+        uint64_t c1 = r_cycle();
+        cycles[s] = (c1 - c0) / b->iters;
+        nanos[s] = time_to_ns(t1 - t0) / b->iters;
+    }
+    
+    if (b->teardown) {
+        b->teardown(b->arg);
+    }
+    
+    sort(cycles, n);
+    sort(nanos, n);
+    int p99 = (n * 99) / 100;
+    if (p99 >= n) {
+        p99 = n - 1;
+    }
+    
+    printf("BENCH name=%s samples=%d iters=%d min=%u med=%u p99=%u med_ns=%u",
+           b->name, n, b->iters, cycles[0], cycles[n / 2], cycles[p99],
+           nanos[n / 2]);
+    if (b->bytes != 0 && nanos[n / 2] != 0) {
+        printf(" mbps=%u", (uint64_t)b->bytes * 1000 / nanos[n / 2]);
+    }
+    printf("\n");
+}
+
+void bench_run_all(const char *filter) {
+    size_t flen = filter ? strlen(filter) : 0;
+    
+    page_a = (uint8_t*)alloc_page();
+    page_b = (uint8_t*)alloc_page();
+    if (page_a == NULL || page_b == NULL) {
+        printf("[BENCH] Out of memory\n");
+        free_page(page_a);
+        free_page(page_b);
+        return;
+    }
+    memset(page_a, 'a', PAGE_SIZE);
+    memset(page_b, 'b', PAGE_SIZE);
+    
+    printf("BENCH-BEGIN unit=cycles/op timebase_hz=%u\n", timebase_hz);
+    for (size_t i = 0; i < NUM_BENCHES; i++) {
+        if (flen == 0 || strncmp(benches[i].name, filter, flen) == 0) {
+            bench_one(&benches[i]);
+        }
+    }
+    printf("BENCH-END\n");
+    
+    free_page(page_a);
+    free_page(page_b);
+}
@@ -0,0 +1,29 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include "../types.h"
+
+/* Most samples one benchmark may take */
+#define BENCH_MAX_SAMPLES 128
+
+/* A benchmark times 'samples' runs of 'iters' operations each and
+ * reports cycles per operation. setup/teardown are optional; setup
+ * returning nonzero skips the benchmark. */
+typedef struct bench {
+    const char *name;
+    int (*setup)(void *arg);
+    void (*run)(void *arg, int iters);
+    void (*teardown)(void *arg);
+    void *arg;
+    int iters;                 /* Operations per sample */
+    int samples;               /* <= BENCH_MAX_SAMPLES */
+    uint32_t bytes;            /* Bytes moved per operation, 0 if n/a */
+} bench_t;
+
+/* Run every benchmark whose name starts with 'filter' (NULL or "" = all).
+ * Prints one line per benchmark, e.g.
+ *   BENCH name=page_alloc samples=128 iters=16 min=812 med=840 p99=1502 med_ns=84
+ * with min/med/p99 in cycles per operation, plus mbps= for data moves. */
+void bench_run_all(const char *filter);
+
+#endif /* _BENCH_H */
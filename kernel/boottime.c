@@ -0,0 +1,108 @@
+#include "boottime.h"
+#include "printf.h"
+#include "riscv.h"
+#include "process/kthread.h"
+
+typedef struct boot_phase {
+    const char *name;
+    uint64_t start;            /* time CSR */
+    uint64_t end;
+    int deferred;              /* Ran on kinit, overlapping the shell */
+} boot_phase_t;
+
+static boot_phase_t phases[MAX_BOOT_PHASES];
+static uint32_t nr_phases = 0;
+static uint64_t last_mark = 0;
+static uint64_t shell_time = 0;
+
+typedef struct boot_work {
+    void (*fn)(void);
+    const char *name;
+} boot_work_t;
+
+static boot_work_t deferred[MAX_BOOT_PHASES];
+static uint32_t nr_deferred = 0;
+
+/* Slots are claimed with an AMO: kinit and the boot thread both record */
+static void record(const char *name, uint64_t start, uint64_t end, int late) {
+    uint32_t i = __atomic_fetch_add(&nr_phases, 1, __ATOMIC_RELAXED);
+    if (i >= MAX_BOOT_PHASES) {
+        return;
+    }
+    phases[i].name = name;
+    phases[i].start = start;
+    phases[i].end = end;
+    phases[i].deferred = late;
+}
+
+void boot_mark(const char *phase) {
+    uint64_t now = r_time();
+    record(phase, last_mark, now, 0);
+    last_mark = now;
+}
+
+void boot_done(void) {
+    boot_mark("shell");
+    shell_time = last_mark;
+}
+
+void boot_defer(void (*fn)(void), const char *name) {
+    if (nr_deferred >= MAX_BOOT_PHASES) {
+        fn();  /* No room to defer: run it now */
+        return;
+    }
+    deferred[nr_deferred].fn = fn;
+    deferred[nr_deferred].name = name;
+    nr_deferred++;
+}
+
+static void kinit_main(void *arg) {
+    (void)arg;
+    
+    /* Deferred init is as chatty as the rest of boot: keep it in dmesg */
+    console_set_quiet(!BOOT_VERBOSE);
+    for (uint32_t i = 0; i < nr_deferred; i++) {
+        uint64_t start = r_time();
+        deferred[i].fn();
+        record(deferred[i].name, start, r_time(), 1);
+    }
+    console_set_quiet(0);
+}
+
+void boot_start_deferred(void) {
+    if (nr_deferred == 0) {
+        return;
+    }
+    if (kthread_create(kinit_main, NULL, "kinit") == NULL) {
+        /* Run everything inline rather than lose it */
+        kinit_main(NULL);
+    }
+}
+
+uint64_t boot_time_to_shell(uint64_t *since_entry) {
+    if (since_entry) {
+        *since_entry = (nr_phases > 0) ? time_to_ns(shell_time - phases[0].end) : 0;
+    }
+    return time_to_ns(shell_time);
+}
+
+void boot_report(void) {
+    uint32_t n = __atomic_load_n(&nr_phases, __ATOMIC_ACQUIRE);
+    if (n > MAX_BOOT_PHASES) {
+        n = MAX_BOOT_PHASES;
+    }
+    
+    printf("\n[BOOT] Boot phases (us):\n");
+    for (uint32_t i = 0; i < n; i++) {
+        printf("  %s%s: %u (at %u)\n", phases[i].deferred ? "+" : " ",
+               phases[i].name,
+               time_to_ns(phases[i].end - phases[i].start) / 1000,
+               time_to_ns(phases[i].end) / 1000);
+    }
+    
+    uint64_t entry;
+    uint64_t total = boot_time_to_shell(&entry);
+    printf("  Time to shell: %u us (%u us since kernel entry)\n",
+           total / 1000, entry / 1000);
+    printf("  '+' = deferred to kinit, after the shell started\n");
+}
@@ -0,0 +1,28 @@
+#ifndef _BOOTTIME_H
+#define _BOOTTIME_H
+
+#include "types.h"
+
+/* Boot-phase profiling. kernel_main() calls boot_mark() as each init
+ * step finishes; a phase's cost is the time since the previous mark.
+ * The first mark, taken on entry, is the time spent before the kernel
+ * (firmware), since the time CSR starts at zero on reset. */
+#define MAX_BOOT_PHASES 32
+
+void boot_mark(const char *phase);
+
+/* Last mark: the shell is about to prompt */
+void boot_done(void);
+
+/* Queue non-critical init to run on the "kinit" kernel thread once the
+ * boot thread first idles. Each function is profiled like a phase. */
+void boot_defer(void (*fn)(void), const char *name);
+void boot_start_deferred(void);
+
+/* Nanoseconds from reset / from kernel entry to the shell prompt */
+uint64_t boot_time_to_shell(uint64_t *since_entry);
+
+/* Print every phase with its duration */
+void boot_report(void);
+
+#endif /* _BOOTTIME_H */
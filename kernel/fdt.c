@@ -0,0 +1,426 @@
+#include "fdt.h"
+#include "printf.h"
+#include "riscv.h"
+#include "lib/string.h"
+
+/* Structure block tokens */
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+#define FDT_END        9
+
+/* Nodes deeper than this are skipped; QEMU's trees are four deep */
+#define FDT_MAX_DEPTH 8
+
+/* S-mode external interrupt, as numbered in interrupts-extended */
+#define IRQ_S_EXT 9
+
+typedef struct fdt_header {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+/* What one node said about itself, kept until its end tag */
+typedef struct fdt_node {
+    const char *name;
+    const uint8_t *reg;
+    uint32_t reg_len;
+    const char *compat;        /* NUL-separated list */
+    uint32_t compat_len;
+    const char *device_type;
+    const uint8_t *irq_ext;    /* interrupts-extended */
+    uint32_t irq_ext_len;
+    uint32_t irq;
+    uint32_t phandle;
+    uint32_t intc_phandle;     /* cpu nodes: their interrupt controller */
+    uint32_t numa_node;
+    int disabled;
+    uint32_t addr_cells;       /* For the children's reg */
+    uint32_t size_cells;
+} fdt_node_t;
+
+machine_t machine;
+
+/* Frequency of the time CSR, and its period in ns */
+uint64_t timebase_hz = 10000000;
+uint64_t ns_per_tick = 100;
+
+/* Per enabled hart: its cpu-intc phandle, to find the PLIC context */
+static uint32_t hart_intc[MACHINE_MAX_HARTS];
+static const uint8_t *plic_irq_ext;
+static uint32_t plic_irq_ext_len;
+static const char *fdt_error;
+
+/* The tree is big-endian; byte loads keep this alignment-safe */
+static uint32_t be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t be64(const uint8_t *p) {
+    return ((uint64_t)be32(p) << 32) | be32(p + 4);
+}
+
+/* A value of 'cells' 32-bit cells */
+static uint64_t read_cells(const uint8_t *p, uint32_t cells) {
+    return cells == 2 ? be64(p) : cells == 1 ? be32(p) : 0;
+}
+
+static int compatible(const fdt_node_t *n, const char *what) {
+    const char *s = n->compat;
+    const char *end = s + n->compat_len;
+    while (s != NULL && s < end) {
+        if (strcmp(s, what) == 0) {
+            return 1;
+        }
+        s += strlen(s) + 1;
+    }
+    return 0;
+}
+
+static void add_range(mem_range_t *ranges, int *nr, int max, uint64_t base, uint64_t size) {
+    if (size == 0 || *nr == max) {
+        return;
+    }
+    ranges[*nr].start = base;
+    ranges[*nr].end = base + size;
+    ranges[*nr].node = 0;
+    (*nr)++;
+}
+
+static void set_timebase(uint64_t hz) {
+    if (hz == 0) {
+        return;
+    }
+    machine.timebase_hz = hz;
+    timebase_hz = hz;
+    ns_per_tick = 1000000000UL / hz;
+    if (ns_per_tick == 0) {
+        ns_per_tick = 1;  /* Faster than 1 GHz: time reads coarser */
+    }
+}
+
+/* Default devices of QEMU virt, as in qemu/device-tree/virt.dts */
+static void machine_defaults(uint64_t hartid) {
+    memset(&machine, 0, sizeof(machine));
+    strlcpy(machine.model, "riscv-virtio,qemu (built-in)", sizeof(machine.model));
+    add_range(machine.ram, &machine.nr_ram, MACHINE_MAX_RAM, 0x80000000UL, 128UL << 20);
+    machine.boot_hart = (uint32_t)hartid;
+    machine.nr_harts = 1;
+    machine.harts[0] = (uint32_t)hartid;
+    machine.nr_nodes = 1;
+    set_timebase(10000000);
+    machine.uart = (mmio_dev_t){ 0x10000000UL, 0x100, 10 };
+    machine.rtc = (mmio_dev_t){ 0x101000UL, 0x1000, 11 };
+    machine.clint = (mmio_dev_t){ 0x2000000UL, 0x10000, 0 };
+    machine.plic = (mmio_dev_t){ 0xc000000UL, 0x4000000, 0 };
+    machine.plic_context = (uint32_t)hartid * 2 + 1;
+    machine.test = (mmio_dev_t){ 0x100000UL, 0x1000, 0 };
+    for (int i = 0; i < MACHINE_MAX_VIRTIO; i++) {
+        machine.virtio[i] = (mmio_dev_t){ 0x10001000UL + i * 0x1000UL, 0x1000, 1 + i };
+    }
+    machine.nr_virtio = MACHINE_MAX_VIRTIO;
+}
+
+static void node_prop(fdt_node_t *n, int depth, const char *name,
+                      const uint8_t *val, uint32_t len) {
+    if (strcmp(name, "reg") == 0) {
+        n->reg = val;
+        n->reg_len = len;
+    } else if (strcmp(name, "compatible") == 0) {
+        n->compat = (const char*)val;
+        n->compat_len = len;
+    } else if (strcmp(name, "device_type") == 0) {
+        n->device_type = (const char*)val;
+    } else if (strcmp(name, "status") == 0) {
+        n->disabled = strcmp((const char*)val, "okay") != 0 &&
+                      strcmp((const char*)val, "ok") != 0;
+    } else if (strcmp(name, "phandle") == 0 && len == 4) {
+        n->phandle = be32(val);
+    } else if (strcmp(name, "interrupts") == 0 && len >= 4) {
+        n->irq = be32(val);
+    } else if (strcmp(name, "interrupts-extended") == 0) {
+        n->irq_ext = val;
+        n->irq_ext_len = len;
+    } else if (strcmp(name, "#address-cells") == 0 && len == 4) {
+        n->addr_cells = be32(val);
+    } else if (strcmp(name, "#size-cells") == 0 && len == 4) {
+        n->size_cells = be32(val);
+    } else if (strcmp(name, "numa-node-id") == 0 && len == 4) {
+        n->numa_node = be32(val);
+    } else if (strcmp(name, "timebase-frequency") == 0) {
+        set_timebase(len == 8 ? be64(val) : len == 4 ? be32(val) : 0);
+    } else if (depth == 0 && strcmp(name, "model") == 0) {
+        strlcpy(machine.model, (const char*)val, sizeof(machine.model));
+    }
+}
+
+/* Node ids past what the allocator tracks fold onto node 0 */
+static int numa_node(uint32_t id) {
+    return id < MM_MAX_NODES ? (int)id : 0;
+}
+
+/* First reg entry of n, decoded with its parent's cell sizes */
+static mmio_dev_t node_mmio(const fdt_node_t *n, const fdt_node_t *parent) {
+    mmio_dev_t d = { 0, 0, n->irq };
+    uint32_t ac = parent->addr_cells, sc = parent->size_cells;
+    if (n->reg != NULL && n->reg_len >= (ac + sc) * 4) {
+        d.base = read_cells(n->reg, ac);
+        d.size = read_cells(n->reg + ac * 4, sc);
+    }
+    return d;
+}
+
+/* Every reg entry of n as a memory range */
+static void node_ranges(const fdt_node_t *n, const fdt_node_t *parent,
+                        mem_range_t *ranges, int *nr, int max) {
+    uint32_t ac = parent->addr_cells, sc = parent->size_cells;
+    uint32_t entry = (ac + sc) * 4;
+    for (uint32_t off = 0; entry > 0 && off + entry <= n->reg_len; off += entry) {
+        int before = *nr;
+        add_range(ranges, nr, max, read_cells(n->reg + off, ac),
+                  read_cells(n->reg + off + ac * 4, sc));
+        if (*nr > before) {
+            ranges[before].node = numa_node(n->numa_node);
+        }
+    }
+}
+
+/* A node is complete (its children were seen first) */
+static void node_done(fdt_node_t *n, fdt_node_t *parent) {
+    if (parent == NULL || n->disabled) {
+        return;
+    }
+    
+    if (n->device_type != NULL && strcmp(n->device_type, "memory") == 0) {
+        node_ranges(n, parent, machine.ram, &machine.nr_ram, MACHINE_MAX_RAM);
+    } else if (n->device_type != NULL && strcmp(n->device_type, "cpu") == 0) {
+        if (machine.nr_harts < MACHINE_MAX_HARTS && n->reg != NULL) {
+            hart_intc[machine.nr_harts] = n->intc_phandle;
+            machine.hart_node[machine.nr_harts] = numa_node(n->numa_node);
+            machine.harts[machine.nr_harts] = (uint32_t)read_cells(n->reg, parent->addr_cells);
+        }
+        machine.nr_harts++;
+    } else if (strcmp(parent->name, "reserved-memory") == 0) {
+        node_ranges(n, parent, machine.reserved, &machine.nr_reserved,
+                    MACHINE_MAX_RESERVED);
+    } else if (compatible(n, "riscv,cpu-intc")) {
+        parent->intc_phandle = n->phandle;
+    } else if (compatible(n, "ns16550a")) {
+        if (machine.uart.size == 0) {
+            machine.uart = node_mmio(n, parent);
+        }
+    } else if (compatible(n, "riscv,plic0") || compatible(n, "sifive,plic-1.0.0")) {
+        machine.plic = node_mmio(n, parent);
+        plic_irq_ext = n->irq_ext;
+        plic_irq_ext_len = n->irq_ext_len;
+    } else if (compatible(n, "riscv,clint0") || compatible(n, "sifive,clint0")) {
+        machine.clint = node_mmio(n, parent);
+    } else if (compatible(n, "google,goldfish-rtc")) {
+        machine.rtc = node_mmio(n, parent);
+    } else if (compatible(n, "sifive,test0")) {
+        machine.test = node_mmio(n, parent);
+    } else if (compatible(n, "virtio,mmio")) {
+        if (machine.nr_virtio < MACHINE_MAX_VIRTIO) {
+            machine.virtio[machine.nr_virtio++] = node_mmio(n, parent);
+        }
+    }
+}
+
+static int walk_structure(const uint8_t *p, const uint8_t *end, const char *strings,
+                          const char *strings_end) {
+    fdt_node_t stack[FDT_MAX_DEPTH];
+    int depth = -1;
+    
+    while (p + 4 <= end) {
+        uint32_t tok = be32(p);
+        p += 4;
+        switch (tok) {
+        case FDT_BEGIN_NODE: {
+            const char *name = (const char*)p;
+            p += (strlen(name) + 4) & ~3UL;
+            if (++depth < FDT_MAX_DEPTH) {
+                fdt_node_t *n = &stack[depth];
+                memset(n, 0, sizeof(*n));
+                n->name = name;
+                n->addr_cells = 2;
+                n->size_cells = 1;
+            }
+            break;
+        }
+        case FDT_PROP: {
+            if (p + 8 > end) {
+                return -1;
+            }
+            uint32_t len = be32(p);
+            uint32_t nameoff = be32(p + 4);
+            const uint8_t *val = p + 8;
+            p += 8 + ((len + 3) & ~3U);
+            if (p > end || strings + nameoff >= strings_end) {
+                return -1;
+            }
+            if (depth >= 0 && depth < FDT_MAX_DEPTH) {
+                node_prop(&stack[depth], depth, strings + nameoff, val, len);
+            }
+            break;
+        }
+        case FDT_END_NODE:
+            if (depth < 0) {
+                return -1;
+            }
+            if (depth < FDT_MAX_DEPTH) {
+                node_done(&stack[depth], depth > 0 ? &stack[depth - 1] : NULL);
+            }
+            depth--;
+            break;
+        case FDT_NOP:
+            break;
+        case FDT_END:
+            return depth == -1 ? 0 : -1;
+        default:
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/* The PLIC context whose interrupts-extended entry is the boot hart's
+ * S-mode external interrupt */
+static void find_plic_context(void) {
+    uint32_t intc = 0;
+    for (int i = 0; i < machine.nr_harts && i < MACHINE_MAX_HARTS; i++) {
+        if (machine.harts[i] == machine.boot_hart) {
+            intc = hart_intc[i];
+        }
+    }
+    if (intc == 0 || plic_irq_ext == NULL) {
+        return;
+    }
+    for (uint32_t off = 0; off + 8 <= plic_irq_ext_len; off += 8) {
+        if (be32(plic_irq_ext + off) == intc && be32(plic_irq_ext + off + 4) == IRQ_S_EXT) {
+            machine.plic_context = off / 8;
+            return;
+        }
+    }
+}
+
+int fdt_init(uint64_t hartid, const void *dtb) {
+    machine_defaults(hartid);
+    
+    const uint8_t *base = (const uint8_t*)dtb;
+    if (base == NULL || be32(base + offsetof(fdt_header_t, magic)) != FDT_MAGIC) {
+        fdt_error = "no device tree";
+        return -1;
+    }
+    uint32_t total = be32(base + offsetof(fdt_header_t, totalsize));
+    uint32_t off_struct = be32(base + offsetof(fdt_header_t, off_dt_struct));
+    uint32_t size_struct = be32(base + offsetof(fdt_header_t, size_dt_struct));
+    uint32_t off_strings = be32(base + offsetof(fdt_header_t, off_dt_strings));
+    uint32_t size_strings = be32(base + offsetof(fdt_header_t, size_dt_strings));
+    uint32_t off_rsvmap = be32(base + offsetof(fdt_header_t, off_mem_rsvmap));
+    if (be32(base + offsetof(fdt_header_t, last_comp_version)) > 17 ||
+        be32(base + offsetof(fdt_header_t, version)) < 16 ||
+        off_struct + size_struct > total || off_strings + size_strings > total ||
+        off_rsvmap >= total) {
+        fdt_error = "unsupported device tree";
+        return -1;
+    }
+    
+    /* The tree is authoritative for what it lists */
+    machine.nr_ram = 0;
+    machine.nr_harts = 0;
+    machine.nr_virtio = 0;
+    machine.uart.size = 0;
+    if (walk_structure(base + off_struct, base + off_struct + size_struct,
+                       (const char*)base + off_strings,
+                       (const char*)base + off_strings + size_strings) != 0) {
+        machine_defaults(hartid);
+        fdt_error = "malformed device tree";
+        return -1;
+    }
+    if (machine.nr_ram == 0) {
+        add_range(machine.ram, &machine.nr_ram, MACHINE_MAX_RAM, 0x80000000UL, 128UL << 20);
+    }
+    if (machine.nr_harts == 0) {
+        machine.nr_harts = 1;
+        machine.harts[0] = (uint32_t)hartid;
+    }
+    if (machine.uart.size == 0) {
+        machine.uart = (mmio_dev_t){ 0x10000000UL, 0x100, 10 };
+    }
+    find_plic_context();
+    
+    machine.nr_nodes = 1;
+    for (int i = 0; i < machine.nr_ram; i++) {
+        if (machine.ram[i].node >= machine.nr_nodes) {
+            machine.nr_nodes = machine.ram[i].node + 1;
+        }
+    }
+    
+    /* QEMU lists virtio-mmio nodes highest address first; drivers count
+     * devices in slot order */
+    for (int i = 1; i < machine.nr_virtio; i++) {
+        mmio_dev_t d = machine.virtio[i];
+        int j = i;
+        for (; j > 0 && machine.virtio[j - 1].base > d.base; j--) {
+            machine.virtio[j] = machine.virtio[j - 1];
+        }
+        machine.virtio[j] = d;
+    }
+    
+    /* /memreserve/ entries, then the tree itself, which stays readable */
+    for (const uint8_t *r = base + off_rsvmap; r + 16 <= base + total; r += 16) {
+        uint64_t addr = be64(r), size = be64(r + 8);
+        if (addr == 0 && size == 0) {
+            break;
+        }
+        add_range(machine.reserved, &machine.nr_reserved, MACHINE_MAX_RESERVED, addr, size);
+    }
+    add_range(machine.reserved, &machine.nr_reserved, MACHINE_MAX_RESERVED,
+              (uint64_t)base, total);
+    machine.fdt_base = (uint64_t)base;
+    machine.fdt_size = total;
+    return 0;
+}
+
+int machine_hart_node(uint32_t hartid) {
+    for (int i = 0; i < machine.nr_harts && i < MACHINE_MAX_HARTS; i++) {
+        if (machine.harts[i] == hartid) {
+            return machine.hart_node[i];
+        }
+    }
+    return 0;
+}
+
+void fdt_print(void) {
+    if (machine.fdt_base == 0) {
+        printf("[FDT] %s, using QEMU virt defaults\n", fdt_error ? fdt_error : "no device tree");
+    } else {
+        printf("[FDT] %s: device tree at %p (%u bytes)\n", machine.model,
+               (void*)machine.fdt_base, (uint64_t)machine.fdt_size);
+    }
+    for (int i = 0; i < machine.nr_ram; i++) {
+        printf("[FDT] RAM %p - %p (%u MB, node %d)\n", (void*)machine.ram[i].start,
+               (void*)machine.ram[i].end,
+               (machine.ram[i].end - machine.ram[i].start) >> 20, machine.ram[i].node);
+    }
+    for (int i = 0; i < machine.nr_reserved; i++) {
+        printf("[FDT] Reserved %p - %p\n", (void*)machine.reserved[i].start,
+               (void*)machine.reserved[i].end);
+    }
+    printf("[FDT] %d hart(s), booted on hart %u; timebase %u Hz; %d NUMA node(s)\n",
+           machine.nr_harts, (uint64_t)machine.boot_hart, machine.timebase_hz,
+           machine.nr_nodes);
+    printf("[FDT] UART %p irq %u, PLIC %p context %u, %d virtio-mmio slot(s)\n",
+           (void*)machine.uart.base, (uint64_t)machine.uart.irq,
+           (void*)machine.plic.base, (uint64_t)machine.plic_context, machine.nr_virtio);
+}
@@ -0,0 +1,66 @@
+#ifndef _FDT_H
+#define _FDT_H
+
+#include "types.h"
+#include "mm/mm.h"
+
+/* Flattened device tree that OpenSBI passes in a1, reduced at boot to the
+ * machine description below. Anything the tree does not describe keeps
+ * the QEMU virt default, so a kernel started without a tree still runs
+ * on 'virt' with 128 MB and one hart. */
+
+#define FDT_MAGIC 0xd00dfeed
+
+#define MACHINE_MAX_RAM      4
+#define MACHINE_MAX_RESERVED 8
+#define MACHINE_MAX_HARTS    32
+#define MACHINE_MAX_VIRTIO   8
+
+/* One MMIO device */
+typedef struct mmio_dev {
+    uint64_t base;
+    uint64_t size;             /* 0 if absent */
+    uint32_t irq;              /* PLIC source, 0 if none */
+} mmio_dev_t;
+
+typedef struct machine {
+    char model[48];
+    
+    mem_range_t ram[MACHINE_MAX_RAM];
+    int nr_ram;
+    /* Firmware, the tree itself and /reserved-memory; never allocated */
+    mem_range_t reserved[MACHINE_MAX_RESERVED];
+    int nr_reserved;
+    
+    uint32_t boot_hart;
+    int nr_harts;              /* Enabled harts in the tree */
+    uint32_t harts[MACHINE_MAX_HARTS];
+    uint8_t hart_node[MACHINE_MAX_HARTS];   /* NUMA node of each */
+    int nr_nodes;              /* From numa-node-id; 1 without */
+    uint64_t timebase_hz;
+    
+    mmio_dev_t uart;
+    mmio_dev_t rtc;
+    mmio_dev_t clint;
+    mmio_dev_t plic;
+    uint32_t plic_context;     /* Boot hart's S-mode context */
+    mmio_dev_t test;           /* SiFive test device (poweroff/reboot) */
+    mmio_dev_t virtio[MACHINE_MAX_VIRTIO];
+    int nr_virtio;
+    
+    uint64_t fdt_base;         /* 0 if booted without a tree */
+    uint64_t fdt_size;
+} machine_t;
+
+extern machine_t machine;
+
+/* Fill in 'machine' from the tree at dtb, if it is valid; 0 if it was.
+ * Runs before the console, so problems are reported by fdt_print(). */
+int fdt_init(uint64_t hartid, const void *dtb);
+
+/* NUMA node of a hart (0 if the tree does not say) */
+int machine_hart_node(uint32_t hartid);
+
+void fdt_print(void);
+
+#endif /* _FDT_H */
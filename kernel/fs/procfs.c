@@ -0,0 +1,218 @@
+#include "procfs.h"
+#include "vfs.h"
+#include "../printf.h"
+#include "../mm/mm.h"
+#include "../lib/string.h"
+#include "../process/process.h"
+#include "../process/scheduler.h"
+#include "../sync/rcu.h"
+
+typedef struct proc_entry {
+    char name[16];
+    void (*show)(seq_file_t *m);   /* Set last: the entry is live once non-NULL */
+} proc_entry_t;
+
+static proc_entry_t entries[PROCFS_MAX_ENTRIES];
+static int nr_entries;
+
+/* State of one open file: a page holding the entry and the output window */
+typedef struct proc_file {
+    const proc_entry_t *entry;     /* NULL for <pid>/stat */
+    uint64_t pid;
+    uint64_t from;                 /* File offset of buf[0] */
+    size_t len;                    /* Valid bytes in buf */
+    char buf[];
+} proc_file_t;
+
+#define PROC_FILE_BUF (PAGE_SIZE - sizeof(proc_file_t))
+
+void seq_write(seq_file_t *m, const void *data, size_t len) {
+    /* Keep only the part that falls inside the window */
+    uint64_t start = m->pos, end = m->pos + len;
+    uint64_t lo = start > m->from ? start : m->from;
+    uint64_t hi = end < m->from + m->size ? end : m->from + m->size;
+    if (lo < hi) {
+        memcpy(m->buf + (lo - m->from), (const char*)data + (lo - start), hi - lo);
+    }
+    m->pos = end;
+}
+
+void seq_printf(seq_file_t *m, const char *fmt, ...) {
+    char line[SEQ_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > (int)sizeof(line) - 1) {
+        n = sizeof(line) - 1;
+    }
+    if (n > 0) {
+        seq_write(m, line, n);
+    }
+}
+
+int procfs_register(const char *name, void (*show)(seq_file_t *m)) {
+    int i = __atomic_fetch_add(&nr_entries, 1, __ATOMIC_RELAXED);
+    if (i >= PROCFS_MAX_ENTRIES) {
+        __atomic_fetch_sub(&nr_entries, 1, __ATOMIC_RELAXED);
+        printf("[PROCFS] No room for /proc/%s\n", name);
+        return -1;
+    }
+    strlcpy(entries[i].name, name, sizeof(entries[i].name));
+    __atomic_store_n(&entries[i].show, show, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static const char *state_name(proc_state_t state) {
+    switch (state) {
+        case PROC_RUNNABLE: return "R";
+        case PROC_RUNNING:  return "R";
+        case PROC_SLEEPING: return "S";
+        case PROC_ZOMBIE:   return "Z";
+        default:            return "?";
+    }
+}
+
+/* pid (name) state policy prio dyn_prio level cpu utime_us stime_us
+ * irqtime_us switches rss_file rss_anon rss_kernel start_us */
+static void show_pid_stat(seq_file_t *m, uint64_t pid) {
+    rcu_read_lock();
+    process_t *p = process_find_by_pid(pid);
+    if (p != NULL) {
+        proc_stats_t st;
+        process_get_stats(p, &st);
+        seq_printf(m, "%u (%s) %s %d %d %d %d %d %u %u %u %u %u %u %u %u\n",
+                   p->pid, p->name, state_name(p->state), p->policy,
+                   p->priority, p->dynamic_priority, p->queue_level,
+                   p->cpu_id, st.utime / 1000, st.stime / 1000,
+                   st.irqtime / 1000, st.context_switches, p->rss[RSS_FILE],
+                   p->rss[RSS_ANON], p->rss[RSS_KERNEL], st.start_time / 1000);
+    }
+    rcu_read_unlock();
+}
+
+static void pids_line(process_t *p, void *arg) {
+    seq_printf((seq_file_t*)arg, "%u %s %s\n", p->pid, state_name(p->state), p->name);
+}
+
+/* One line per task: pid state name */
+static void show_pids(seq_file_t *m) {
+    process_for_each(pids_line, m);
+}
+
+/* Run the show callback with the window starting at offset */
+static void proc_render(proc_file_t *pf, uint64_t offset) {
+    seq_file_t m = { pf->buf, PROC_FILE_BUF, offset, 0 };
+    if (pf->entry != NULL) {
+        pf->entry->show(&m);
+    } else {
+        show_pid_stat(&m, pf->pid);
+    }
+    pf->from = offset;
+    if (m.pos <= offset) {
+        pf->len = 0;
+    } else {
+        pf->len = m.pos - offset < PROC_FILE_BUF ? m.pos - offset : PROC_FILE_BUF;
+    }
+}
+
+static int proc_read(file_t *file, void *buf, size_t count) {
+    proc_file_t *pf = (proc_file_t*)file->inode->private_data;
+    uint64_t off = file->offset;
+    
+    /* Generated afresh from the start of the file, and when the reader
+     * moves outside the window; reads within it see one snapshot */
+    if (off == 0 || off < pf->from || off >= pf->from + pf->len) {
+        proc_render(pf, off);
+    }
+    if (off >= pf->from + pf->len) {
+        return 0;
+    }
+    if (count > pf->from + pf->len - off) {
+        count = pf->from + pf->len - off;
+    }
+    memcpy(buf, pf->buf + (off - pf->from), count);
+    file->offset += count;
+    return (int)count;
+}
+
+static int proc_seek(file_t *file, uint32_t offset) {
+    file->offset = offset;
+    return 0;
+}
+
+static int proc_close(file_t *file) {
+    free_page(file->inode->private_data);
+    file->inode->private_data = NULL;
+    return 0;
+}
+
+static file_ops_t proc_file_ops = {
+    .read = proc_read,
+    .seek = proc_seek,
+    .close = proc_close,
+};
+
+/* "<pid>/stat" or "self/stat"; the PID, or 0 if path is neither */
+static uint64_t parse_pid_path(const char *path) {
+    uint64_t pid = 0;
+    if (strncmp(path, "self/", 5) == 0) {
+        process_t *p = current_proc();
+        pid = p ? p->pid : 0;
+        path += 4;
+    } else {
+        while (*path >= '0' && *path <= '9') {
+            pid = pid * 10 + (uint64_t)(*path++ - '0');
+        }
+    }
+    return strcmp(path, "/stat") == 0 ? pid : 0;
+}
+
+static int procfs_lookup(const char *path, uint32_t flags, inode_t *inode) {
+    if (flags & VFS_O_CREAT) {
+        return -1;
+    }
+    
+    const proc_entry_t *entry = NULL;
+    uint64_t pid = 0;
+    int n = __atomic_load_n(&nr_entries, __ATOMIC_RELAXED);
+    for (int i = 0; i < n && i < PROCFS_MAX_ENTRIES && entry == NULL; i++) {
+        if (__atomic_load_n(&entries[i].show, __ATOMIC_ACQUIRE) != NULL &&
+            strcmp(entries[i].name, path) == 0) {
+            entry = &entries[i];
+        }
+    }
+    if (entry == NULL) {
+        pid = parse_pid_path(path);
+        rcu_read_lock();
+        int found = pid != 0 && process_find_by_pid(pid) != NULL;
+        rcu_read_unlock();
+        if (!found) {
+            return -1;
+        }
+    }
+    
+    proc_file_t *pf = (proc_file_t*)alloc_page();
+    if (pf == NULL) {
+        return -1;
+    }
+    pf->entry = entry;
+    pf->pid = pid;
+    pf->from = 0;
+    pf->len = 0;
+    inode->type = VFS_FILE;
+    inode->ops = &proc_file_ops;
+    inode->private_data = pf;
+    return 0;
+}
+
+static fs_type_t procfs_type = {
+    .name = "procfs",
+    .lookup = procfs_lookup,
+};
+
+void procfs_init(void) {
+    procfs_register("pids", show_pids);
+    vfs_register_fs(&procfs_type);
+    printf("[PROCFS] Registered procfs\n");
+}
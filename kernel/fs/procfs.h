@@ -0,0 +1,38 @@
+#ifndef _PROCFS_H
+#define _PROCFS_H
+
+#include "../types.h"
+
+/* Synthetic filesystem mounted at /proc. Nothing is kept up to date in
+ * the background: each file is a show() callback run when it is read, so
+ * its counters cost nothing until someone looks.
+ *
+ *   /proc/<name>          registered with procfs_register()
+ *   /proc/<pid>/stat      one line per task, see procfs.c
+ *   /proc/self/stat       the calling task
+ */
+
+#define PROCFS_MAX_ENTRIES 16
+#define SEQ_LINE_MAX 256       /* Longest single seq_printf() */
+
+/* Output of one show() call. The whole file is generated on every pass,
+ * but only the window [from, from + size) is kept, so files may be larger
+ * than the buffer: reading past the window generates them again. */
+typedef struct seq_file {
+    char *buf;
+    size_t size;
+    uint64_t from;             /* File offset of buf[0] */
+    uint64_t pos;              /* Bytes generated so far */
+} seq_file_t;
+
+void seq_printf(seq_file_t *m, const char *fmt, ...);
+void seq_write(seq_file_t *m, const void *data, size_t len);
+
+/* Add /proc/<name>; safe at any time, also before procfs_init().
+ * 0 on success, -1 if the table is full. */
+int procfs_register(const char *name, void (*show)(seq_file_t *m));
+
+/* Register the filesystem type; mount it with vfs_mount("/proc", "procfs") */
+void procfs_init(void);
+
+#endif /* _PROCFS_H */
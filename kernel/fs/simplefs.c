@@ -1,76 +1,165 @@
 #include "simplefs.h"
+#include "vfs.h"
 #include "../printf.h"
 #include "../mm/mm.h"
+#include "../lib/string.h"
+#include "../sync/spinlock.h"
+#include "../sync/rcu.h"
 
 /* In-memory structures */
 static sfs_superblock_t superblock;
 static sfs_inode_t inodes[SFS_MAX_FILES];
 static void *data_blocks = NULL;
 
+/* Block allocation bitmap; block 0 is reserved so 0 can mean "hole" */
+static uint64_t block_bitmap[SFS_MAX_BLOCKS / 64];
+
+static fs_type_t sfs_fs_type;
+
+/* Name -> inode directory, hashed. Lookups walk it under RCU; entries
+ * are unlinked under sfs_lock, and neither the entry nor the inode number
+ * is reused until a grace period has passed. Each inode slot has its own
+ * entry, so the directory never allocates. */
+#define SFS_DIR_HASH 16
+
+typedef struct sfs_dirent {
+    struct sfs_dirent *next;
+    uint32_t ino;
+    char name[SFS_MAX_FILENAME];
+    rcu_head_t rcu;
+} sfs_dirent_t;
+
+static sfs_dirent_t *dir_hash[SFS_DIR_HASH];
+static sfs_dirent_t dirents[SFS_MAX_FILES];
+
+/* Protects the inode table, block bitmap, superblock counters and
+ * directory updates */
+static spinlock_t sfs_lock;
+
 /* Initialize simple file system */
 void sfs_init(void) {
     printf("[SFS] Initializing Simple File System\n");
     
+    spin_init(&sfs_lock, "simplefs");
+    
     /* Clear inode table */
     for (int i = 0; i < SFS_MAX_FILES; i++) {
         inodes[i].ino = 0;
         inodes[i].type = 0;
         inodes[i].size = 0;
+        inodes[i].maps = 0;
     }
+    for (int i = 0; i < SFS_DIR_HASH; i++) {
+        dir_hash[i] = NULL;
+    }
+    
+    vfs_register_fs(&sfs_fs_type);
 }
 
 /* Format the file system */
 int sfs_format(uint32_t num_blocks) {
     printf("[SFS] Formatting file system with %u blocks\n", num_blocks);
     
+    if (num_blocks < 2 || num_blocks > SFS_MAX_BLOCKS) {
+        printf("[SFS] Invalid block count\n");
+        return -1;
+    }
+    
     /* Initialize superblock */
     superblock.magic = SFS_MAGIC;
     superblock.block_size = SFS_BLOCK_SIZE;
     superblock.num_blocks = num_blocks;
     superblock.num_inodes = SFS_MAX_FILES;
-    superblock.num_free_blocks = num_blocks;
+    superblock.num_free_blocks = num_blocks - 1;
     superblock.num_free_inodes = SFS_MAX_FILES;
     
-    /* Allocate data blocks (in memory for now) */
-    data_blocks = kmalloc(num_blocks * SFS_BLOCK_SIZE);
-    if (data_blocks == NULL) {
+    /* Allocate data blocks (in memory for now), page aligned so blocks
+     * can be mapped straight into page tables */
+    void *raw = kmalloc((num_blocks + 1) * SFS_BLOCK_SIZE);
+    if (raw == NULL) {
         printf("[SFS] Failed to allocate data blocks\n");
         return -1;
     }
+    data_blocks = (void*)(((uint64_t)raw + SFS_BLOCK_SIZE - 1) &
+                          ~(uint64_t)(SFS_BLOCK_SIZE - 1));
+    
+    for (int i = 0; i < SFS_MAX_BLOCKS / 64; i++) {
+        block_bitmap[i] = 0;
+    }
+    block_bitmap[0] = 1;  /* Reserve block 0 */
     
     printf("[SFS] File system formatted successfully\n");
     return 0;
 }
 
-/* Find inode by name */
-static sfs_inode_t* find_inode(const char *name) {
-    for (int i = 0; i < SFS_MAX_FILES; i++) {
-        if (inodes[i].ino != 0) {
-            /* Compare names */
-            int match = 1;
-            for (int j = 0; j < SFS_MAX_FILENAME; j++) {
-                if (inodes[i].name[j] != name[j]) {
-                    match = 0;
-                    break;
-                }
-                if (name[j] == '\0') {
-                    break;
-                }
-            }
+/* Address of a data block */
+static uint8_t *block_ptr(uint32_t blk) {
+    return (uint8_t*)data_blocks + (uint64_t)blk * SFS_BLOCK_SIZE;
+}
+
+/* Allocate a zeroed data block, returns 0 when full */
+static uint32_t alloc_block(void) {
+    for (uint32_t blk = 1; blk < superblock.num_blocks; blk++) {
+        if (!(block_bitmap[blk / 64] & (1UL << (blk % 64)))) {
+            block_bitmap[blk / 64] |= (1UL << (blk % 64));
+            superblock.num_free_blocks--;
             
-            if (match) {
-                return &inodes[i];
-            }
+            page_clear(block_ptr(blk));
+            return blk;
+        }
+    }
+    return 0;
+}
+
+/* Return a data block to the bitmap */
+static void free_block(uint32_t blk) {
+    if (blk != 0 && blk < superblock.num_blocks) {
+        block_bitmap[blk / 64] &= ~(1UL << (blk % 64));
+        superblock.num_free_blocks++;
+    }
+}
+
+static uint32_t name_hash(const char *name) {
+    uint32_t h = 5381;
+    for (int i = 0; i < SFS_MAX_FILENAME && name[i] != '\0'; i++) {
+        h = h * 33 + (uint8_t)name[i];
+    }
+    return h % SFS_DIR_HASH;
+}
+
+/* Find directory entry by name; caller holds rcu_read_lock() or sfs_lock */
+static sfs_dirent_t* find_inode(const char *name) {
+    for (sfs_dirent_t *d = rcu_dereference(dir_hash[name_hash(name)]);
+         d != NULL; d = rcu_dereference(d->next)) {
+        if (strncmp(d->name, name, SFS_MAX_FILENAME) == 0) {
+            return d;
         }
     }
     
     return NULL;
 }
 
+/* Look up an inode (with validity check) by number; type 0 marks a file
+ * deleted but still inside its grace period */
+static sfs_inode_t* get_inode(uint32_t ino) {
+    if (ino == 0 || ino > SFS_MAX_FILES) {
+        return NULL;
+    }
+    
+    sfs_inode_t *inode = &inodes[ino - 1];
+    if (inode->ino != ino || inode->type == 0) {
+        return NULL;
+    }
+    return inode;
+}
+
 /* Create a new file */
 int sfs_create(const char *name, uint32_t type) {
+    spin_lock(&sfs_lock);
+    
     /* Check if file already exists */
     if (find_inode(name) != NULL) {
+        spin_unlock(&sfs_lock);
         printf("[SFS] File already exists: %s\n", name);
         return -1;
     }
@@ -82,69 +171,129 @@ int sfs_create(const char *name, uint32_t type) {
             inodes[i].ino = i + 1;
             inodes[i].type = type;
             inodes[i].size = 0;
+            inodes[i].maps = 0;
             
-            /* Copy name */
-            int j;
-            for (j = 0; j < SFS_MAX_FILENAME - 1 && name[j] != '\0'; j++) {
-                inodes[i].name[j] = name[j];
-            }
-            inodes[i].name[j] = '\0';
-            
-            /* Clear blocks */
-            for (j = 0; j < 12; j++) {
-                inodes[i].blocks[j] = 0;
-            }
+            strlcpy(inodes[i].name, name, SFS_MAX_FILENAME);
+            memset(inodes[i].blocks, 0, sizeof(inodes[i].blocks));
             
             superblock.num_free_inodes--;
             
-            printf("[SFS] Created file: %s (inode %u)\n", name, inodes[i].ino);
-            return inodes[i].ino;
+            /* Publish the name last, once the inode is ready */
+            sfs_dirent_t *d = &dirents[i];
+            uint32_t h = name_hash(name);
+            strlcpy(d->name, name, SFS_MAX_FILENAME);
+            d->ino = i + 1;
+            d->next = dir_hash[h];
+            rcu_assign_pointer(dir_hash[h], d);
+            spin_unlock(&sfs_lock);
+            
+            printf("[SFS] Created file: %s (inode %u)\n", name, (uint32_t)(i + 1));
+            return i + 1;
         }
     }
+    spin_unlock(&sfs_lock);
     
     printf("[SFS] No free inodes\n");
     return -1;
 }
 
 /* Delete a file */
+/* Grace period over: the entry and inode number may be reused */
+static void sfs_dirent_reclaim(rcu_head_t *head) {
+    sfs_dirent_t *d = container_of(head, sfs_dirent_t, rcu);
+    
+    spin_lock(&sfs_lock);
+    inodes[d->ino - 1].ino = 0;
+    superblock.num_free_inodes++;
+    spin_unlock(&sfs_lock);
+}
+
 int sfs_delete(const char *name) {
-    sfs_inode_t *inode = find_inode(name);
-    if (inode == NULL) {
+    spin_lock(&sfs_lock);
+    sfs_dirent_t **link = &dir_hash[name_hash(name)];
+    while (*link != NULL && strncmp((*link)->name, name, SFS_MAX_FILENAME) != 0) {
+        link = &(*link)->next;
+    }
+    sfs_dirent_t *d = *link;
+    if (d == NULL) {
+        spin_unlock(&sfs_lock);
         printf("[SFS] File not found: %s\n", name);
         return -1;
     }
     
+    /* Mapped blocks are reachable from user page tables */
+    sfs_inode_t *inode = &inodes[d->ino - 1];
+    if (inode->maps != 0) {
+        spin_unlock(&sfs_lock);
+        printf("[SFS] File is mapped: %s\n", name);
+        return -1;
+    }
+    rcu_assign_pointer(*link, d->next);
+    
     /* Free blocks */
-    for (int i = 0; i < 12; i++) {
-        if (inode->blocks[i] != 0) {
-            superblock.num_free_blocks++;
-        }
+    for (int i = 0; i < SFS_DIRECT_BLOCKS; i++) {
+        free_block(inode->blocks[i]);
+        inode->blocks[i] = 0;
     }
     
-    /* Clear inode */
-    inode->ino = 0;
+    /* Dead from now on; the slot is recycled by sfs_dirent_reclaim() */
     inode->type = 0;
     inode->size = 0;
-    superblock.num_free_inodes++;
+    spin_unlock(&sfs_lock);
+    call_rcu(&d->rcu, sfs_dirent_reclaim);
     
     printf("[SFS] Deleted file: %s\n", name);
     return 0;
 }
 
-/* Read from a file */
-int sfs_read(uint32_t ino, void *buf, uint32_t offset, uint32_t size) {
-    /* Find inode */
-    if (ino == 0 || ino > SFS_MAX_FILES) {
-        return -1;
+/* Get the inode number of a file, or -1 */
+int sfs_lookup(const char *name) {
+    rcu_read_lock();
+    sfs_dirent_t *d = find_inode(name);
+    int ino = d ? (int)d->ino : -1;
+    rcu_read_unlock();
+    return ino;
+}
+
+/* Block 'index' of inode, allocating it if asked; sfs_lock held */
+static void *block_addr(sfs_inode_t *inode, uint32_t index, int alloc) {
+    if (index >= SFS_DIRECT_BLOCKS) {
+        return NULL;
     }
     
-    sfs_inode_t *inode = &inodes[ino - 1];
-    if (inode->ino != ino) {
+    if (inode->blocks[index] == 0) {
+        if (!alloc) {
+            return NULL;
+        }
+        inode->blocks[index] = alloc_block();
+        if (inode->blocks[index] == 0) {
+            return NULL;
+        }
+    }
+    
+    return block_ptr(inode->blocks[index]);
+}
+
+void *sfs_block_addr(uint32_t ino, uint32_t index, int alloc) {
+    spin_lock(&sfs_lock);
+    sfs_inode_t *inode = get_inode(ino);
+    void *addr = inode ? block_addr(inode, index, alloc) : NULL;
+    spin_unlock(&sfs_lock);
+    return addr;
+}
+
+/* Read from a file */
+int sfs_read(uint32_t ino, void *buf, uint32_t offset, uint32_t size) {
+    spin_lock(&sfs_lock);
+    sfs_inode_t *inode = get_inode(ino);
+    if (inode == NULL) {
+        spin_unlock(&sfs_lock);
         return -1;
     }
     
     /* Check bounds */
     if (offset >= inode->size) {
+        spin_unlock(&sfs_lock);
         return 0;
     }
     
@@ -152,31 +301,155 @@ int sfs_read(uint32_t ino, void *buf, uint32_t offset, uint32_t size) {
         size = inode->size - offset;
     }
     
-    /* Read data (simplified - from memory buffer) */
-    /* Full implementation would read from actual blocks */
+    /* Copy block by block; holes read back as zeros */
+    uint8_t *dst = (uint8_t*)buf;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t off = pos % SFS_BLOCK_SIZE;
+        uint32_t n = SFS_BLOCK_SIZE - off;
+        if (n > size - done) {
+            n = size - done;
+        }
+        
+        uint32_t blk = inode->blocks[pos / SFS_BLOCK_SIZE];
+        if (blk) {
+            memcpy(dst + done, block_ptr(blk) + off, n);
+        } else {
+            memset(dst + done, 0, n);
+        }
+        done += n;
+    }
+    spin_unlock(&sfs_lock);
     
     return size;
 }
 
 /* Write to a file */
 int sfs_write(uint32_t ino, const void *buf, uint32_t offset, uint32_t size) {
-    /* Find inode */
-    if (ino == 0 || ino > SFS_MAX_FILES) {
+    spin_lock(&sfs_lock);
+    sfs_inode_t *inode = get_inode(ino);
+    if (inode == NULL) {
+        spin_unlock(&sfs_lock);
         return -1;
     }
     
-    sfs_inode_t *inode = &inodes[ino - 1];
-    if (inode->ino != ino) {
-        return -1;
+    if (offset >= SFS_MAX_FILE_SIZE) {
+        spin_unlock(&sfs_lock);
+        return 0;
+    }
+    if (offset + size > SFS_MAX_FILE_SIZE) {
+        size = SFS_MAX_FILE_SIZE - offset;
     }
     
-    /* Allocate blocks if needed */
-    /* Full implementation would manage block allocation */
+    /* Copy block by block, allocating blocks on first touch */
+    const uint8_t *src = (const uint8_t*)buf;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t pos = offset + done;
+        uint32_t off = pos % SFS_BLOCK_SIZE;
+        uint32_t n = SFS_BLOCK_SIZE - off;
+        if (n > size - done) {
+            n = size - done;
+        }
+        
+        uint8_t *blk = (uint8_t*)block_addr(inode, pos / SFS_BLOCK_SIZE, 1);
+        if (blk == NULL) {
+            break;  /* Out of blocks: short write */
+        }
+        memcpy(blk + off, src + done, n);
+        done += n;
+    }
     
     /* Update size */
-    if (offset + size > inode->size) {
-        inode->size = offset + size;
+    if (offset + done > inode->size) {
+        inode->size = offset + done;
     }
+    spin_unlock(&sfs_lock);
     
-    return size;
+    return done;
+}
+
+/* VFS glue: the SimpleFS inode number rides in private_data */
+static uint32_t file_ino(file_t *file) {
+    return (uint32_t)(uint64_t)file->inode->private_data;
 }
+
+static int sfs_vfs_read(file_t *file, void *buf, size_t count) {
+    int n = sfs_read(file_ino(file), buf, file->offset, (uint32_t)count);
+    if (n > 0) {
+        file->offset += n;
+    }
+    return n;
+}
+
+static int sfs_vfs_write(file_t *file, const void *buf, size_t count) {
+    int n = sfs_write(file_ino(file), buf, file->offset, (uint32_t)count);
+    if (n > 0) {
+        file->offset += n;
+        file->inode->size = inodes[file_ino(file) - 1].size;
+    }
+    return n;
+}
+
+static int sfs_vfs_seek(file_t *file, uint32_t offset) {
+    if (offset > SFS_MAX_FILE_SIZE) {
+        return -1;
+    }
+    file->offset = offset;
+    return 0;
+}
+
+static void *sfs_vfs_map_page(inode_t *inode, uint64_t index, int write) {
+    (void)write;  /* Blocks are allocated on any fault */
+    return sfs_block_addr((uint32_t)(uint64_t)inode->private_data,
+                          (uint32_t)index, 1);
+}
+
+/* Count mappings so sfs_delete() can't free blocks still mapped */
+static int sfs_vfs_map(inode_t *inode) {
+    spin_lock(&sfs_lock);
+    sfs_inode_t *si = get_inode((uint32_t)(uint64_t)inode->private_data);
+    if (si != NULL) {
+        si->maps++;
+    }
+    spin_unlock(&sfs_lock);
+    return si != NULL ? 0 : -1;
+}
+
+static void sfs_vfs_unmap(inode_t *inode) {
+    spin_lock(&sfs_lock);
+    inodes[(uint64_t)inode->private_data - 1].maps--;
+    spin_unlock(&sfs_lock);
+}
+
+static file_ops_t sfs_file_ops = {
+    .read = sfs_vfs_read,
+    .write = sfs_vfs_write,
+    .seek = sfs_vfs_seek,
+    .map_page = sfs_vfs_map_page,
+    .map = sfs_vfs_map,
+    .unmap = sfs_vfs_unmap,
+};
+
+/* Resolve a path for vfs_open(), creating the file if asked */
+static int sfs_vfs_lookup(const char *path, uint32_t flags, inode_t *inode) {
+    int ino = sfs_lookup(path);
+    if (ino < 0 && (flags & VFS_O_CREAT)) {
+        ino = sfs_create(path, VFS_FILE);
+    }
+    if (ino < 0) {
+        return -1;
+    }
+    
+    inode->type = VFS_FILE;
+    inode->size = inodes[ino - 1].size;
+    inode->ops = &sfs_file_ops;
+    inode->private_data = (void*)(uint64_t)ino;
+    return 0;
+}
+
+static fs_type_t sfs_fs_type = {
+    .name = "simplefs",
+    .lookup = sfs_vfs_lookup,
+};
@@ -8,6 +8,9 @@
 #define SFS_BLOCK_SIZE 4096
 #define SFS_MAX_FILES 64
 #define SFS_MAX_FILENAME 28
+#define SFS_MAX_BLOCKS 1024   /* Upper bound accepted by sfs_format() */
+#define SFS_DIRECT_BLOCKS 12
+#define SFS_MAX_FILE_SIZE (SFS_DIRECT_BLOCKS * SFS_BLOCK_SIZE)
 
 /* Simple FS superblock */
 typedef struct {
@@ -24,7 +27,8 @@ typedef struct {
     uint32_t ino;             /* Inode number */
     uint32_t type;            /* File type (1=file, 2=dir) */
     uint32_t size;            /* File size */
-    uint32_t blocks[12];      /* Direct blocks */
+    uint32_t blocks[SFS_DIRECT_BLOCKS]; /* Direct blocks (0 = hole) */
+    uint32_t maps;            /* Live mappings; the file can't be deleted */
     char name[SFS_MAX_FILENAME]; /* File name */
 } sfs_inode_t;
 
@@ -33,7 +37,12 @@ void sfs_init(void);
 int sfs_format(uint32_t num_blocks);
 int sfs_create(const char *name, uint32_t type);
 int sfs_delete(const char *name);
+int sfs_lookup(const char *name);
 int sfs_read(uint32_t ino, void *buf, uint32_t offset, uint32_t size);
 int sfs_write(uint32_t ino, const void *buf, uint32_t offset, uint32_t size);
 
+/* Kernel address of a file's block-sized page, allocating it if asked.
+ * Blocks are page-sized and page-aligned so they can be mapped directly. */
+void *sfs_block_addr(uint32_t ino, uint32_t index, int alloc);
+
 #endif /* _SIMPLEFS_H */
@@ -1,26 +1,48 @@
 #include "vfs.h"
 #include "../printf.h"
 #include "../mm/mm.h"
+#include "../lib/string.h"
+#include "../sync/rwlock.h"
+#include "../sync/rcu.h"
 
-#define MAX_DEVICES 16
+#define MAX_FS_TYPES 4
+#define MAX_MOUNTS 8
 
-/* Device registry */
+/* Device registry: RCU-protected list, searched without locks */
 typedef struct device {
+    struct device *next;
     char name[32];
     file_ops_t *ops;
-    int used;
+    rcu_head_t rcu;
 } device_t;
 
-static device_t devices[MAX_DEVICES];
+static device_t *devices = NULL;
 static uint32_t next_ino = 1;
 
+/* Mount table; paths are stored without the leading slash ("" is root) */
+typedef struct mount {
+    char path[32];
+    fs_type_t *fs;
+    int used;
+} mount_t;
+
+static fs_type_t *fs_types[MAX_FS_TYPES];
+static mount_t mounts[MAX_MOUNTS];
+
+/* Serializes updates to the device list, filesystem types and mount
+ * table. Lookups on the open path use RCU instead; mounts are published
+ * with a release store of 'used' and never removed. */
+static rwlock_t vfs_lock;
+
 /* Initialize VFS layer */
 void vfs_init(void) {
     printf("[VFS] Initializing Virtual File System\n");
     
-    /* Clear device registry */
-    for (int i = 0; i < MAX_DEVICES; i++) {
-        devices[i].used = 0;
+    rw_init(&vfs_lock, "vfs");
+    
+    devices = NULL;
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        mounts[i].used = 0;
     }
     
     printf("[VFS] VFS initialized\n");
@@ -33,7 +55,7 @@ inode_t* vfs_create_inode(uint32_t type) {
         return NULL;
     }
     
-    inode->ino = next_ino++;
+    inode->ino = __atomic_fetch_add(&next_ino, 1, __ATOMIC_RELAXED);
     inode->type = type;
     inode->size = 0;
     inode->ref = 1;
@@ -55,64 +77,117 @@ void vfs_destroy_inode(inode_t *inode) {
     }
 }
 
+/* Find device by name; caller holds rcu_read_lock() or vfs_lock */
+static device_t* find_device(const char *name) {
+    for (device_t *dev = rcu_dereference(devices); dev != NULL;
+         dev = rcu_dereference(dev->next)) {
+        if (strncmp(dev->name, name, sizeof(dev->name)) == 0) {
+            return dev;
+        }
+    }
+    
+    return NULL;
+}
+
 /* Register a device */
 int vfs_register_device(const char *name, file_ops_t *ops) {
-    /* Find free slot */
-    for (int i = 0; i < MAX_DEVICES; i++) {
-        if (!devices[i].used) {
-            /* Copy name */
-            int j;
-            for (j = 0; j < 31 && name[j] != '\0'; j++) {
-                devices[i].name[j] = name[j];
-            }
-            devices[i].name[j] = '\0';
-            
-            devices[i].ops = ops;
-            devices[i].used = 1;
-            
-            printf("[VFS] Registered device: %s\n", name);
-            return 0;
-        }
+    device_t *dev = (device_t*)kmalloc(sizeof(device_t));
+    if (dev == NULL) {
+        printf("[VFS] Failed to register device: %s (out of memory)\n", name);
+        return -1;
     }
+    strlcpy(dev->name, name, sizeof(dev->name));
+    dev->ops = ops;
     
-    printf("[VFS] Failed to register device: %s (no free slots)\n", name);
-    return -1;
+    write_lock(&vfs_lock);
+    if (find_device(name) != NULL) {
+        write_unlock(&vfs_lock);
+        kfree(dev);
+        printf("[VFS] Failed to register device: %s (exists)\n", name);
+        return -1;
+    }
+    dev->next = devices;
+    rcu_assign_pointer(devices, dev);
+    write_unlock(&vfs_lock);
+    
+    printf("[VFS] Registered device: %s\n", name);
+    return 0;
 }
 
-/* Find device by name */
-static device_t* find_device(const char *name) {
-    for (int i = 0; i < MAX_DEVICES; i++) {
-        if (devices[i].used) {
-            /* Compare names */
-            int match = 1;
-            for (int j = 0; j < 32; j++) {
-                if (devices[i].name[j] != name[j]) {
-                    match = 0;
-                    break;
-                }
-                if (name[j] == '\0') {
-                    break;
-                }
-            }
-            
-            if (match) {
-                return &devices[i];
-            }
+static void device_reclaim(rcu_head_t *head) {
+    kfree(container_of(head, device_t, rcu));
+}
+
+/* Remove a device; opens already in flight may still see it */
+int vfs_unregister_device(const char *name) {
+    write_lock(&vfs_lock);
+    device_t **link = &devices;
+    while (*link != NULL &&
+           strncmp((*link)->name, name, sizeof((*link)->name)) != 0) {
+        link = &(*link)->next;
+    }
+    device_t *dev = *link;
+    if (dev != NULL) {
+        rcu_assign_pointer(*link, dev->next);
+    }
+    write_unlock(&vfs_lock);
+    
+    if (dev == NULL) {
+        return -1;
+    }
+    call_rcu(&dev->rcu, device_reclaim);
+    printf("[VFS] Unregistered device: %s\n", name);
+    return 0;
+}
+
+/* Find the longest mount point prefixing path; *rest gets the remainder */
+static mount_t* find_mount(const char *path, const char **rest) {
+    mount_t *best = NULL;
+    int best_len = -1;
+    
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        if (!__atomic_load_n(&mounts[i].used, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        
+        int j = 0;
+        while (mounts[i].path[j] != '\0' && mounts[i].path[j] == path[j]) {
+            j++;
+        }
+        if (mounts[i].path[j] != '\0') {
+            continue;
+        }
+        /* Must end on a path component boundary */
+        if (j > 0 && path[j] != '\0' && path[j] != '/') {
+            continue;
+        }
+        
+        if (j > best_len) {
+            best = &mounts[i];
+            best_len = j;
+            *rest = (path[j] == '/') ? path + j + 1 : path + j;
         }
     }
     
-    return NULL;
+    return best;
 }
 
 /* Open a file */
 file_t* vfs_open(const char *path, uint32_t flags) {
-    /* Simple implementation: check if it's a device */
     if (path[0] == '/') {
         path++;  /* Skip leading slash */
     }
     
+    /* Devices take precedence over mounted filesystems. Only the ops and
+     * fs pointers (static driver data) are used after the read section. */
+    rcu_read_lock();
     device_t *dev = find_device(path);
-    if (dev == NULL) {
+    file_ops_t *dev_ops = dev ? dev->ops : NULL;
+    const char *rest = path;
+    mount_t *mnt = (dev == NULL) ? find_mount(path, &rest) : NULL;
+    fs_type_t *fs = mnt ? mnt->fs : NULL;
+    rcu_read_unlock();
+    if (dev_ops == NULL && fs == NULL) {
         printf("[VFS] File not found: %s\n", path);
         return NULL;
     }
@@ -124,19 +199,25 @@ file_t* vfs_open(const char *path, uint32_t flags) {
     }
     
     /* Create inode */
-    file->inode = vfs_create_inode(VFS_DEV);
+    file->inode = vfs_create_inode(dev_ops ? VFS_DEV : VFS_FILE);
     if (file->inode == NULL) {
         kfree(file);
         return NULL;
     }
     
-    file->inode->ops = dev->ops;
+    if (dev_ops) {
+        file->inode->ops = dev_ops;
+    } else if (fs->lookup(rest, flags, file->inode) != 0) {
+        vfs_destroy_inode(file->inode);
+        kfree(file);
+        return NULL;
+    }
     file->offset = 0;
     file->flags = flags;
     
     /* Call device open */
-    if (dev->ops->open) {
-        if (dev->ops->open(file->inode, file) != 0) {
+    if (file->inode->ops->open) {
+        if (file->inode->ops->open(file->inode, file) != 0) {
             vfs_destroy_inode(file->inode);
             kfree(file);
             return NULL;
@@ -181,8 +262,121 @@ int vfs_write(file_t *file, const void *buf, size_t count) {
     return file->inode->ops->write(file, buf, count);
 }
 
-/* Mount filesystem (stub) */
+/* Read into several buffers with a single call */
+int vfs_readv(file_t *file, const iovec_t *iov, int iovcnt) {
+    if (file == NULL || file->inode->ops == NULL || iov == NULL ||
+        iovcnt < 0 || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+    
+    if (file->inode->ops->readv) {
+        return file->inode->ops->readv(file, iov, iovcnt);
+    }
+    if (file->inode->ops->read == NULL) {
+        return -1;
+    }
+    
+    /* Fall back to one read per segment, stopping at the first short read */
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        int n = file->inode->ops->read(file, iov[i].iov_base, iov[i].iov_len);
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if ((size_t)n < iov[i].iov_len) {
+            break;
+        }
+    }
+    
+    return total;
+}
+
+/* Write from several buffers with a single call */
+int vfs_writev(file_t *file, const iovec_t *iov, int iovcnt) {
+    if (file == NULL || file->inode->ops == NULL || iov == NULL ||
+        iovcnt < 0 || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+    
+    if (file->inode->ops->writev) {
+        return file->inode->ops->writev(file, iov, iovcnt);
+    }
+    if (file->inode->ops->write == NULL) {
+        return -1;
+    }
+    
+    int total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        int n = file->inode->ops->write(file, iov[i].iov_base, iov[i].iov_len);
+        if (n < 0) {
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if ((size_t)n < iov[i].iov_len) {
+            break;
+        }
+    }
+    
+    return total;
+}
+
+/* Register a filesystem type for vfs_mount() */
+int vfs_register_fs(fs_type_t *fs) {
+    write_lock(&vfs_lock);
+    for (int i = 0; i < MAX_FS_TYPES; i++) {
+        if (fs_types[i] == NULL) {
+            fs_types[i] = fs;
+            write_unlock(&vfs_lock);
+            return 0;
+        }
+    }
+    write_unlock(&vfs_lock);
+    return -1;
+}
+
+/* Mount a registered filesystem type at path */
 int vfs_mount(const char *path, const char *fs_type) {
-    printf("[VFS] Mount %s at %s (not implemented)\n", fs_type, path);
-    return 0;
+    fs_type_t *fs = NULL;
+    read_lock(&vfs_lock);
+    for (int i = 0; i < MAX_FS_TYPES && fs == NULL; i++) {
+        if (fs_types[i] == NULL) {
+            continue;
+        }
+        if (strcmp(fs_types[i]->name, fs_type) == 0) {
+            fs = fs_types[i];
+        }
+    }
+    read_unlock(&vfs_lock);
+    if (fs == NULL) {
+        printf("[VFS] Unknown filesystem type: %s\n", fs_type);
+        return -1;
+    }
+    
+    if (path[0] == '/') {
+        path++;
+    }
+    
+    write_lock(&vfs_lock);
+    for (int i = 0; i < MAX_MOUNTS; i++) {
+        if (!mounts[i].used) {
+            strlcpy(mounts[i].path, path, sizeof(mounts[i].path));
+            mounts[i].fs = fs;
+            __atomic_store_n(&mounts[i].used, 1, __ATOMIC_RELEASE);
+            write_unlock(&vfs_lock);
+            
+            printf("[VFS] Mounted %s at /%s\n", fs_type, path);
+            return 0;
+        }
+    }
+    write_unlock(&vfs_lock);
+    
+    printf("[VFS] Mount table full\n");
+    return -1;
 }
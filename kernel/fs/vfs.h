@@ -8,6 +8,9 @@
 #define VFS_DIR  2
 #define VFS_DEV  3
 
+/* Open flags */
+#define VFS_O_CREAT 0x100  /* Create the file if it does not exist */
+
 /* File operations */
 struct file_operations;
 
@@ -21,6 +24,15 @@ typedef struct inode {
     void *private_data;        /* Private data for specific FS */
 } inode_t;
 
+/* Maximum number of segments accepted by vectored I/O */
+#define VFS_IOV_MAX 64
+
+/* Scatter/gather segment for vectored I/O */
+typedef struct iovec {
+    void *iov_base;            /* Segment start */
+    size_t iov_len;            /* Segment length in bytes */
+} iovec_t;
+
 /* File descriptor */
 typedef struct file {
     inode_t *inode;            /* Associated inode */
@@ -35,8 +47,23 @@ typedef struct file_operations {
     int (*read)(file_t *file, void *buf, size_t count);
     int (*write)(file_t *file, const void *buf, size_t count);
     int (*seek)(file_t *file, uint32_t offset);
+    /* Optional: drivers that can move several segments in one go */
+    int (*readv)(file_t *file, const iovec_t *iov, int iovcnt);
+    int (*writev)(file_t *file, const iovec_t *iov, int iovcnt);
+    /* Optional: kernel address of page 'index' of the file, for mmap */
+    void *(*map_page)(inode_t *inode, uint64_t index, int write);
+    /* Optional: a mapping of the file was set up / torn down */
+    int (*map)(inode_t *inode);
+    void (*unmap)(inode_t *inode);
 } file_ops_t;
 
+/* Filesystem type that can be mounted into the VFS namespace */
+typedef struct fs_type {
+    const char *name;
+    /* Resolve a path relative to the mount point and fill in the inode */
+    int (*lookup)(const char *path, uint32_t flags, inode_t *inode);
+} fs_type_t;
+
 /* VFS functions */
 void vfs_init(void);
 inode_t* vfs_create_inode(uint32_t type);
@@ -45,9 +72,15 @@ file_t* vfs_open(const char *path, uint32_t flags);
 int vfs_close(file_t *file);
 int vfs_read(file_t *file, void *buf, size_t count);
 int vfs_write(file_t *file, const void *buf, size_t count);
+int vfs_readv(file_t *file, const iovec_t *iov, int iovcnt);
+int vfs_writev(file_t *file, const iovec_t *iov, int iovcnt);
 int vfs_mount(const char *path, const char *fs_type);
 
 /* Device file registration */
 int vfs_register_device(const char *name, file_ops_t *ops);
+int vfs_unregister_device(const char *name);
+
+/* Filesystem type registration (see vfs_mount) */
+int vfs_register_fs(fs_type_t *fs);
 
 #endif /* _VFS_H */
@@ -0,0 +1,19 @@
+#ifndef _BITOPS_H
+#define _BITOPS_H
+
+#include "../types.h"
+
+/* Index of the lowest set bit; x must be nonzero. The base ISA has no
+ * count-trailing-zeros instruction and __builtin_ctzl would pull in
+ * libgcc, so isolate the bit and look it up with a de Bruijn multiply. */
+static inline int ctz64(uint64_t x) {
+    static const uint8_t table[64] = {
+         0,  1,  2, 53,  3,  7, 54, 27,  4, 38, 41,  8, 34, 55, 48, 28,
+        62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+        63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+        51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12,
+    };
+    return table[((x & -x) * 0x022fdd63cc95386dULL) >> 58];
+}
+
+#endif /* _BITOPS_H */
@@ -0,0 +1,70 @@
+#include "checksum.h"
+#include "rvv.h"
+
+/* Fold to 16 bits without complementing */
+static uint64_t csum_reduce(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+uint64_t csum_partial(const void *buf, size_t len, uint64_t sum) {
+    const uint8_t *p = (const uint8_t*)buf;
+    
+    if (len == 0) {
+        return sum;
+    }
+    
+    /* Odd address: take the first byte alone, sum the now-aligned rest and
+     * byte-swap it, since every following byte sits in the other half */
+    if (((uint64_t)p & 1) != 0) {
+        uint64_t rest = csum_reduce(csum_partial(p + 1, len - 1, 0));
+        return sum + p[0] + (((rest & 0xFF) << 8) | (rest >> 8));
+    }
+    
+    if (len >= RVV_MIN_BYTES && rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        sum += rvv_csum16(p, len / 2);
+        kernel_vector_end(flags);
+        p += len & ~(size_t)1;
+        len &= 1;
+    } else {
+        if (len >= 2 && ((uint64_t)p & 2) != 0) {
+            sum += *(const uint16_t*)p;
+            p += 2;
+            len -= 2;
+        }
+        /* 32-bit words summed into 64 bits cannot overflow for any sane length */
+        while (len >= 16) {
+            const uint32_t *w = (const uint32_t*)p;
+            sum += (uint64_t)w[0] + w[1] + w[2] + w[3];
+            p += 16;
+            len -= 16;
+        }
+        while (len >= 4) {
+            sum += *(const uint32_t*)p;
+            p += 4;
+            len -= 4;
+        }
+        if (len >= 2) {
+            sum += *(const uint16_t*)p;
+            p += 2;
+            len -= 2;
+        }
+    }
+    
+    /* Trailing byte is padded with zero: the low half on little-endian */
+    if (len > 0) {
+        sum += *p;
+    }
+    return sum;
+}
+
+uint16_t csum_fold(uint64_t sum) {
+    return (uint16_t)~csum_reduce(sum);
+}
+
+uint16_t ip_checksum(const void *buf, size_t len) {
+    return csum_fold(csum_partial(buf, len, 0));
+}
@@ -0,0 +1,15 @@
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include "../types.h"
+
+/* Internet (ones' complement) checksum, RFC 1071.
+ * csum_partial accumulates without folding so pieces can be chained;
+ * csum_fold produces the final 16-bit value in memory byte order. */
+uint64_t csum_partial(const void *buf, size_t len, uint64_t sum);
+uint16_t csum_fold(uint64_t sum);
+
+/* Convenience: checksum of one contiguous buffer */
+uint16_t ip_checksum(const void *buf, size_t len);
+
+#endif /* _CHECKSUM_H */
@@ -0,0 +1,37 @@
+#ifndef _LIST_H
+#define _LIST_H
+
+#include "../types.h"
+
+/* Intrusive circular doubly-linked list. A list is a head node that links
+ * to itself when empty; entries embed a list_node_t and get back to the
+ * containing object with container_of(). No operation allocates. */
+typedef struct list_node {
+    struct list_node *next;
+    struct list_node *prev;
+} list_node_t;
+
+static inline void list_init(list_node_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline int list_empty(const list_node_t *head) {
+    return head->next == head;
+}
+
+static inline void list_add_tail(list_node_t *head, list_node_t *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+/* Unlink node from whatever list holds it; it is left linked to itself */
+static inline void list_del(list_node_t *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    list_init(node);
+}
+
+#endif /* _LIST_H */
@@ -0,0 +1,145 @@
+#include "rvv.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../mm/mm.h"
+#include "../process/scheduler.h"
+
+int rvv_enabled = 0;
+static uint64_t vlenb = 0;
+
+/* Task whose state is live in the vector registers (per CPU) */
+static process_t *rvv_owner[MAX_CPUS];
+
+/* Vector CSRs: vstart, vxsat, vxrm, vcsr, vl, vtype, vlenb */
+static int is_vector_csr(uint32_t csr) {
+    return csr == 0x008 || csr == 0x009 || csr == 0x00A || csr == 0x00F ||
+           csr == 0xC20 || csr == 0xC21 || csr == 0xC22;
+}
+
+/* Does this (trapping) instruction need the vector unit? */
+static int is_vector_insn(uint32_t insn) {
+    uint32_t opcode = insn & 0x7F;
+    uint32_t funct3 = (insn >> 12) & 0x7;
+    
+    if (opcode == 0x57) {
+        return 1;  /* OP-V: arithmetic and vset{i}vl{i} */
+    }
+    if ((opcode == 0x07 || opcode == 0x27) && (funct3 == 0 || funct3 >= 5)) {
+        return 1;  /* Vector loads/stores share LOAD-FP/STORE-FP */
+    }
+    if (opcode == 0x73 && (funct3 & 3) != 0) {
+        return is_vector_csr(insn >> 20);
+    }
+    return 0;
+}
+
+static void set_vs(uint64_t vs) {
+    w_sstatus((r_sstatus() & ~SSTATUS_VS) | vs);
+}
+
+void rvv_init(void) {
+    /* sstatus.VS is WARL and reads back as Off when V is not implemented */
+    set_vs(SSTATUS_VS_INITIAL);
+    if ((r_sstatus() & SSTATUS_VS) != SSTATUS_VS_OFF) {
+        vlenb = rvv_vlenb();
+        /* Saved state must fit the page allocated per task */
+        if (sizeof(vstate_t) + 32 * vlenb <= PAGE_SIZE) {
+            rvv_enabled = 1;
+        }
+    }
+    set_vs(SSTATUS_VS_OFF);
+    
+    if (rvv_enabled) {
+        printf("[RVV] Vector extension present, VLEN = %u bits\n",
+               (uint32_t)(vlenb * 8));
+    } else {
+        printf("[RVV] No usable vector unit, using scalar routines\n");
+    }
+}
+
+uint64_t kernel_vector_begin(void) {
+    uint64_t flags = r_sstatus();
+    w_sstatus(flags & ~SSTATUS_SIE);
+    
+    int cpu = sched_cpu_id();
+    process_t *p = current_proc();
+    if ((flags & SSTATUS_VS) == SSTATUS_VS_DIRTY && p != NULL && p->vstate) {
+        rvv_save(p->vstate);
+    }
+    
+    /* The kernel is about to clobber whatever was live */
+    rvv_owner[cpu] = NULL;
+    set_vs(SSTATUS_VS_INITIAL);
+    return flags;
+}
+
+void kernel_vector_end(uint64_t flags) {
+    process_t *p = current_proc();
+    uint64_t vs = flags & SSTATUS_VS;
+    
+    if (vs != SSTATUS_VS_OFF && p != NULL && p->vstate) {
+        rvv_restore(p->vstate);
+        rvv_owner[sched_cpu_id()] = p;
+        vs = SSTATUS_VS_CLEAN;
+    } else {
+        vs = SSTATUS_VS_OFF;
+    }
+    
+    w_sstatus((flags & ~SSTATUS_VS) | vs);
+}
+
+void rvv_context_switch(process_t *old, process_t *new) {
+    if (!rvv_enabled) {
+        return;
+    }
+    
+    uint64_t s = r_sstatus();
+    if (old != NULL && old->vstate && (s & SSTATUS_VS) == SSTATUS_VS_DIRTY) {
+        rvv_save(old->vstate);
+    }
+    
+    /* Skip the first-use trap when the registers already hold new's state */
+    if (new != NULL && new->vstate && rvv_owner[sched_cpu_id()] == new) {
+        w_sstatus((s & ~SSTATUS_VS) | SSTATUS_VS_CLEAN);
+    } else {
+        w_sstatus(s & ~SSTATUS_VS);
+    }
+}
+
+int rvv_handle_trap(process_t *p, uint64_t insn) {
+    if (!rvv_enabled || p == NULL ||
+        (r_sstatus() & SSTATUS_VS) != SSTATUS_VS_OFF ||
+        !is_vector_insn((uint32_t)insn)) {
+        return -1;
+    }
+    
+    /* First use ever: start from a zeroed register image */
+    if (p->vstate == NULL) {
+        p->vstate = (vstate_t*)alloc_page();
+        if (p->vstate == NULL) {
+            return -1;
+        }
+        rss_add(p, RSS_KERNEL, 1);
+    }
+    
+    set_vs(SSTATUS_VS_INITIAL);
+    rvv_restore(p->vstate);
+    set_vs(SSTATUS_VS_CLEAN);
+    rvv_owner[sched_cpu_id()] = p;
+    return 0;
+}
+
+void rvv_release(process_t *p) {
+    if (p == NULL || p->vstate == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (rvv_owner[i] == p) {
+            rvv_owner[i] = NULL;
+        }
+    }
+    free_page(p->vstate);
+    p->vstate = NULL;
+    rss_add(p, RSS_KERNEL, -1);
+}
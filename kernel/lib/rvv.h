@@ -0,0 +1,48 @@
+#ifndef _RVV_H
+#define _RVV_H
+
+#include "../types.h"
+#include "../process/process.h"
+
+/* Below this size the strip-mining setup costs more than it saves */
+#define RVV_MIN_BYTES 256
+
+/* Saved vector unit state; regs[] holds 32 * vlenb bytes */
+typedef struct vstate {
+    uint64_t vstart;
+    uint64_t vl;
+    uint64_t vtype;
+    uint64_t vcsr;
+    uint8_t regs[];
+} vstate_t;
+
+/* Set at boot when the hart implements V */
+extern int rvv_enabled;
+
+/* Probe for V and report VLEN */
+void rvv_init(void);
+
+/* Bracket kernel use of vector registers. Interrupts stay off in between
+ * and the current task's vector state is preserved. */
+uint64_t kernel_vector_begin(void);
+void kernel_vector_end(uint64_t flags);
+
+/* Context switch hook: save old's state if dirty, leave V off for the next task */
+void rvv_context_switch(process_t *old, process_t *new);
+
+/* Lazy restore on a task's first vector instruction; 0 if handled */
+int rvv_handle_trap(process_t *p, uint64_t insn);
+
+/* Free a task's saved state */
+void rvv_release(process_t *p);
+
+/* Assembly kernels (kernel/lib/memvec.S); callers hold kernel_vector_begin */
+void rvv_memcpy(void *dst, const void *src, size_t n);
+void rvv_memset(void *dst, int c, size_t n);
+int rvv_memcmp(const void *a, const void *b, size_t n);
+uint64_t rvv_csum16(const void *buf, size_t nhalfwords);
+void rvv_save(vstate_t *vs);
+void rvv_restore(const vstate_t *vs);
+uint64_t rvv_vlenb(void);
+
+#endif /* _RVV_H */
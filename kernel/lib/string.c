@@ -0,0 +1,243 @@
+#include "string.h"
+#include "../mm/mm.h"
+#include "rvv.h"
+
+/* Both pointers share the same offset within a 64-bit word */
+#define CO_ALIGNED(a, b) (((((uint64_t)(a)) ^ ((uint64_t)(b))) & 7) == 0)
+
+void *memcpy(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t*)dst;
+    const uint8_t *s = (const uint8_t*)src;
+    
+    if (n >= RVV_MIN_BYTES && rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        rvv_memcpy(dst, src, n);
+        kernel_vector_end(flags);
+        return dst;
+    }
+    
+    if (CO_ALIGNED(d, s)) {
+        /* Byte-copy up to the first word boundary */
+        while (n > 0 && ((uint64_t)d & 7) != 0) {
+            *d++ = *s++;
+            n--;
+        }
+        
+        uint64_t *dw = (uint64_t*)d;
+        const uint64_t *sw = (const uint64_t*)s;
+        while (n >= 64) {
+            uint64_t w0 = sw[0], w1 = sw[1], w2 = sw[2], w3 = sw[3];
+            uint64_t w4 = sw[4], w5 = sw[5], w6 = sw[6], w7 = sw[7];
+            dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+            dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+            dw += 8;
+            sw += 8;
+            n -= 64;
+        }
+        while (n >= 8) {
+            *dw++ = *sw++;
+            n -= 8;
+        }
+        d = (uint8_t*)dw;
+        s = (const uint8_t*)sw;
+    } else {
+        /* Misaligned words trap or are emulated on many cores; stay bytewise */
+        while (n >= 8) {
+            d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+            d[4] = s[4]; d[5] = s[5]; d[6] = s[6]; d[7] = s[7];
+            d += 8;
+            s += 8;
+            n -= 8;
+        }
+    }
+    
+    while (n > 0) {
+        *d++ = *s++;
+        n--;
+    }
+    return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n) {
+    uint8_t *d = (uint8_t*)dst;
+    const uint8_t *s = (const uint8_t*)src;
+    
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+    
+    /* Overlapping with dst above src: copy backwards */
+    d += n;
+    s += n;
+    if (CO_ALIGNED(d, s)) {
+        while (n > 0 && ((uint64_t)d & 7) != 0) {
+            *--d = *--s;
+            n--;
+        }
+        while (n >= 8) {
+            d -= 8;
+            s -= 8;
+            *(uint64_t*)d = *(const uint64_t*)s;
+            n -= 8;
+        }
+    }
+    while (n > 0) {
+        *--d = *--s;
+        n--;
+    }
+    return dst;
+}
+
+void *memset(void *dst, int c, size_t n) {
+    uint8_t *d = (uint8_t*)dst;
+    uint64_t pattern = (uint8_t)c;
+    pattern |= pattern << 8;
+    pattern |= pattern << 16;
+    pattern |= pattern << 32;
+    
+    if (n >= RVV_MIN_BYTES && rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        rvv_memset(dst, c, n);
+        kernel_vector_end(flags);
+        return dst;
+    }
+    
+    while (n > 0 && ((uint64_t)d & 7) != 0) {
+        *d++ = (uint8_t)c;
+        n--;
+    }
+    
+    uint64_t *dw = (uint64_t*)d;
+    while (n >= 64) {
+        dw[0] = pattern; dw[1] = pattern; dw[2] = pattern; dw[3] = pattern;
+        dw[4] = pattern; dw[5] = pattern; dw[6] = pattern; dw[7] = pattern;
+        dw += 8;
+        n -= 64;
+    }
+    while (n >= 8) {
+        *dw++ = pattern;
+        n -= 8;
+    }
+    
+    d = (uint8_t*)dw;
+    while (n > 0) {
+        *d++ = (uint8_t)c;
+        n--;
+    }
+    return dst;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+    const uint8_t *pa = (const uint8_t*)a;
+    const uint8_t *pb = (const uint8_t*)b;
+    
+    if (n >= RVV_MIN_BYTES && rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        int r = rvv_memcmp(a, b, n);
+        kernel_vector_end(flags);
+        return r;
+    }
+    
+    if (CO_ALIGNED(pa, pb)) {
+        while (n > 0 && ((uint64_t)pa & 7) != 0) {
+            if (*pa != *pb) {
+                return *pa - *pb;
+            }
+            pa++;
+            pb++;
+            n--;
+        }
+        /* Skip equal words; the byte loop below locates the difference */
+        while (n >= 8 && *(const uint64_t*)pa == *(const uint64_t*)pb) {
+            pa += 8;
+            pb += 8;
+            n -= 8;
+        }
+    }
+    
+    while (n > 0) {
+        if (*pa != *pb) {
+            return *pa - *pb;
+        }
+        pa++;
+        pb++;
+        n--;
+    }
+    return 0;
+}
+
+void page_clear(void *page) {
+    uint64_t *p = (uint64_t*)page;
+    uint64_t *end = p + PAGE_SIZE / 8;
+    
+    if (rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        rvv_memset(page, 0, PAGE_SIZE);
+        kernel_vector_end(flags);
+        return;
+    }
+    
+    while (p < end) {
+        p[0] = 0; p[1] = 0; p[2] = 0; p[3] = 0;
+        p[4] = 0; p[5] = 0; p[6] = 0; p[7] = 0;
+        p += 8;
+    }
+}
+
+void page_copy(void *dst, const void *src) {
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    uint64_t *end = d + PAGE_SIZE / 8;
+    
+    if (rvv_enabled) {
+        uint64_t flags = kernel_vector_begin();
+        rvv_memcpy(dst, src, PAGE_SIZE);
+        kernel_vector_end(flags);
+        return;
+    }
+    
+    while (d < end) {
+        uint64_t w0 = s[0], w1 = s[1], w2 = s[2], w3 = s[3];
+        uint64_t w4 = s[4], w5 = s[5], w6 = s[6], w7 = s[7];
+        d[0] = w0; d[1] = w1; d[2] = w2; d[3] = w3;
+        d[4] = w4; d[5] = w5; d[6] = w6; d[7] = w7;
+        d += 8;
+        s += 8;
+    }
+}
+
+size_t strlen(const char *s) {
+    size_t len = 0;
+    while (s[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+int strcmp(const char *a, const char *b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint8_t)*a - (uint8_t)*b;
+}
+
+int strncmp(const char *a, const char *b, size_t n) {
+    while (n > 0 && *a != '\0' && *a == *b) {
+        a++;
+        b++;
+        n--;
+    }
+    return n == 0 ? 0 : (uint8_t)*a - (uint8_t)*b;
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    
+    if (size > 0) {
+        size_t n = (len >= size) ? size - 1 : len;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
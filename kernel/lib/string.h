@@ -0,0 +1,24 @@
+#ifndef _STRING_H
+#define _STRING_H
+
+#include "../types.h"
+
+/* Memory primitives (64-bit moves, unrolled, byte fallback when misaligned).
+ * Large requests go to the RVV kernels when the hart has a vector unit. */
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+
+/* Page-sized fast paths; both pointers must be page aligned */
+void page_clear(void *page);
+void page_copy(void *dst, const void *src);
+
+/* Strings */
+size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+int strncmp(const char *a, const char *b, size_t n);
+/* Copy at most size-1 bytes and always terminate; returns strlen(src) */
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif /* _STRING_H */
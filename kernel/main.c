@@ -1,26 +1,35 @@
+#include "../drivers/plic/plic.h"
+#include "../drivers/rtc/rtc.h"
 #include "../drivers/testdev/testdev.h"
 #include "../drivers/uart/uart.h"
+#include "../drivers/virtio/virtio_blk.h"
+#include "../drivers/virtio/virtio_net.h"
+#include "bench/bench.h"
+#include "boottime.h"
+#include "fdt.h"
+#include "fs/procfs.h"
 #include "fs/simplefs.h"
 #include "fs/vfs.h"
+#include "lib/rvv.h"
+#include "lib/string.h"
+#include "mm/dma.h"
 #include "mm/mm.h"
+#include "mm/reclaim.h"
 #include "mm/vm.h"
+#include "net/net.h"
 #include "printf.h"
+#include "process/fpu.h"
+#include "process/kthread.h"
 #include "process/scheduler.h"
+#include "process/workqueue.h"
 #include "riscv.h"
+#include "sync/lockstat.h"
+#include "sync/rcu.h"
+#include "trace/trace.h"
 #include "trap/trap.h"
 #include "types.h"
 
 #define SHELL_BUFFER_SIZE 128
-#define QEMU_VIRT_TEST 0x100000 /* QEMU virt test device for poweroff */
-
-/* Simple strlen implementation for bare-metal */
-static size_t strlen(const char *s) {
-  size_t len = 0;
-  while (s[len] != '\0') {
-    len++;
-  }
-  return len;
-}
 
 /* Test virtual memory */
 static void test_vm(void) {
@@ -69,10 +78,7 @@ static void test_scheduler(void) {
     return;
   }
 
-  int i;
-  for (i = 0; i < 5 && (p1->name[i] = "test1"[i]); i++)
-    ;
-  p1->name[i] = '\0';
+  strlcpy(p1->name, "test1", sizeof(p1->name));
   
   /* Set normal priority */
   sched_set_priority(p1, PRIORITY_DEFAULT);
@@ -85,9 +91,7 @@ static void test_scheduler(void) {
     return;
   }
 
-  for (i = 0; i < 5 && (p2->name[i] = "test2"[i]); i++)
-    ;
-  p2->name[i] = '\0';
+  strlcpy(p2->name, "test2", sizeof(p2->name));
   
   /* Set higher priority */
   sched_set_priority(p2, PRIORITY_NORMAL_MIN + 10);
@@ -101,9 +105,7 @@ static void test_scheduler(void) {
     return;
   }
 
-  for (i = 0; i < 7 && (p3->name[i] = "rt_test"[i]); i++)
-    ;
-  p3->name[i] = '\0';
+  strlcpy(p3->name, "rt_test", sizeof(p3->name));
   
   /* Set real-time priority */
   sched_set_priority(p3, 50);  /* RT priority */
@@ -120,9 +122,141 @@ static void test_scheduler(void) {
   // Show scheduler stats
   sched_print_stats();
 
+  /* These have no code to run; take them back off the queues */
+  sched_remove(p1);
+  sched_remove(p2);
+  sched_remove(p3);
+  process_free(p1);
+  process_free(p2);
+  process_free(p3);
+
   printf("[TEST] Scheduler test PASSED\n");
 }
 
+/* Test kernel threads and workqueues */
+static volatile int kthread_result;
+static int work_total;
+
+static void test_kthread_fn(void *arg) { kthread_result = (int)(uint64_t)arg; }
+
+static void test_work_fn(work_t *w) { work_total += (int)(uint64_t)w->data; }
+
+static void test_kthreads(void) {
+  printf("[TEST] Testing kernel threads and workqueues...\n");
+
+  kthread_result = 0;
+  if (kthread_create(test_kthread_fn, (void *)42, "ktest") == NULL) {
+    printf("[TEST] Failed to create kernel thread\n");
+    return;
+  }
+  while (kthread_result == 0) {
+    sched_yield();
+  }
+  printf("[TEST] Kernel thread ran with arg %d\n", kthread_result);
+
+  work_t works[WQ_BATCH * 2];
+  work_total = 0;
+  for (int i = 0; i < WQ_BATCH * 2; i++) {
+    work_init(&works[i], test_work_fn, (void *)(uint64_t)(i + 1));
+    queue_work(&works[i]);
+  }
+  workqueue_flush();
+
+  int expected = (WQ_BATCH * 2) * (WQ_BATCH * 2 + 1) / 2;
+  if (work_total != expected) {
+    printf("[TEST] Workqueue ran %d, expected %d\n", work_total, expected);
+    return;
+  }
+  printf("[TEST] Workqueue completed %d items\n", WQ_BATCH * 2);
+
+  printf("[TEST] Kernel thread test PASSED\n");
+}
+
+/* Test RCU lookups and deferred reclaim */
+static volatile int rcu_cb_ran;
+
+static void test_rcu_cb(rcu_head_t *head) {
+  (void)head;
+  rcu_cb_ran = 1;
+}
+
+static void test_rcu(void) {
+  printf("[TEST] Testing RCU...\n");
+
+  process_t *p = process_alloc();
+  if (p == NULL) {
+    printf("[TEST] Failed to allocate process\n");
+    return;
+  }
+  uint64_t pid = p->pid;
+
+  rcu_read_lock();
+  process_t *found = process_find_by_pid(pid);
+  rcu_read_unlock();
+  if (found != p) {
+    printf("[TEST] PID %d lookup failed\n", (int)pid);
+    return;
+  }
+
+  process_free(p);
+  rcu_read_lock();
+  found = process_find_by_pid(pid);
+  rcu_read_unlock();
+  if (found != NULL) {
+    printf("[TEST] Freed PID %d still found\n", (int)pid);
+    return;
+  }
+  synchronize_rcu();
+
+  /* Callbacks need two ticks (start, end of grace period) plus the worker */
+  static rcu_head_t head;
+  rcu_cb_ran = 0;
+  call_rcu(&head, test_rcu_cb);
+  uint64_t deadline = r_time() + timebase_hz;
+  while (!rcu_cb_ran && r_time() < deadline) {
+    sched_idle();
+  }
+  if (!rcu_cb_ran) {
+    printf("[TEST] call_rcu callback did not run\n");
+    return;
+  }
+
+  printf("[TEST] RCU test PASSED\n");
+}
+
+/* Test process table growth past the old 64-slot limit */
+static void test_proctable(void) {
+  printf("[TEST] Testing process table...\n");
+
+  static process_t *procs[80];
+  int n = 0;
+  for (; n < 80; n++) {
+    procs[n] = process_alloc();
+    if (procs[n] == NULL) {
+      break;
+    }
+  }
+
+  int found = 0;
+  rcu_read_lock();
+  for (int i = 0; i < n; i++) {
+    if (process_find_by_pid(procs[i]->pid) == procs[i]) {
+      found++;
+    }
+  }
+  rcu_read_unlock();
+
+  for (int i = 0; i < n; i++) {
+    process_free(procs[i]);
+  }
+  if (n != 80 || found != n) {
+    printf("[TEST] Allocated %d, found %d by PID\n", n, found);
+    return;
+  }
+  printf("[TEST] Allocated and looked up %d processes\n", n);
+  printf("[TEST] Process table test PASSED\n");
+}
+
 /* Test file system */
 static void test_filesystem(void) {
   printf("[TEST] Testing file system...\n");
@@ -135,6 +269,22 @@ static void test_filesystem(void) {
   }
   printf("[TEST] Created file 'testfile' with inode %d\n", ino);
 
+  // Test data round trip through the VFS mount
+  file_t *file = vfs_open("/testfile", 0);
+  if (file == NULL) {
+    printf("[TEST] Failed to open file through VFS\n");
+    return;
+  }
+  char data[6];
+  if (vfs_write(file, "hello", 5) != 5 || file->inode->ops->seek(file, 0) != 0 ||
+      vfs_read(file, data, 5) != 5 || data[0] != 'h' || data[4] != 'o') {
+    printf("[TEST] File data round trip failed\n");
+    vfs_close(file);
+    return;
+  }
+  vfs_close(file);
+  printf("[TEST] File data round trip verified\n");
+
   // Test file deletion
   int ret = sfs_delete("testfile");
   if (ret != 0) {
@@ -146,6 +296,74 @@ static void test_filesystem(void) {
   printf("[TEST] File system test PASSED\n");
 }
 
+/* Test UDP sockets over loopback: batched send and receive, then the
+ * VFS read/write path */
+#define UDP_TEST_PORT 7000
+#define UDP_TEST_MSGS 8
+
+static void test_udp(void) {
+  printf("[TEST] Testing UDP sockets (loopback)...\n");
+
+  file_t *rx = vfs_open("/udp", 0);
+  file_t *tx = vfs_open("/udp", 0);
+  if (rx == NULL || tx == NULL || udp_bind(rx, UDP_TEST_PORT) != 0 ||
+      udp_connect(tx, NET_IP(127, 0, 0, 1), UDP_TEST_PORT) != 0) {
+    printf("[TEST] Socket setup failed\n");
+    return;
+  }
+
+  char out[UDP_TEST_MSGS][8];
+  net_msg_t msgs[UDP_TEST_MSGS];
+  for (int i = 0; i < UDP_TEST_MSGS; i++) {
+    snprintf(out[i], sizeof(out[i]), "msg%d", i);
+    msgs[i] = (net_msg_t){.buf = out[i], .len = (uint32_t)strlen(out[i]) + 1};
+  }
+  if (udp_sendmmsg(tx, msgs, UDP_TEST_MSGS, NULL) != UDP_TEST_MSGS) {
+    printf("[TEST] sendmmsg failed\n");
+    return;
+  }
+
+  /* Delivery runs on the workqueue; collect until all have arrived */
+  char in[UDP_TEST_MSGS][16];
+  int got = 0;
+  uint64_t start = r_time();
+  while (got < UDP_TEST_MSGS && r_time() - start < timebase_hz) {
+    for (int i = got; i < UDP_TEST_MSGS; i++) {
+      msgs[i] = (net_msg_t){.buf = in[i], .len = sizeof(in[i])};
+    }
+    int n = udp_recvmmsg(rx, msgs + got, UDP_TEST_MSGS - got,
+                         NET_MSG_DONTWAIT, NULL);
+    if (n > 0) {
+      got += n;
+    } else {
+      sched_yield();
+    }
+  }
+  if (got != UDP_TEST_MSGS) {
+    printf("[TEST] Received %d of %d datagrams\n", got, UDP_TEST_MSGS);
+    return;
+  }
+  for (int i = 0; i < UDP_TEST_MSGS; i++) {
+    if (strcmp(in[i], out[i]) != 0 || msgs[i].addr != net_local_addr()) {
+      printf("[TEST] Datagram %d mismatch: '%s'\n", i, in[i]);
+      return;
+    }
+  }
+  printf("[TEST] recvmmsg got %d datagrams in order\n", got);
+
+  /* Plain VFS calls: one datagram per write / read */
+  char buf[16];
+  if (vfs_write(tx, "hello", 6) != 6 || vfs_read(rx, buf, sizeof(buf)) != 6 ||
+      strcmp(buf, "hello") != 0) {
+    printf("[TEST] vfs_read/vfs_write on socket failed\n");
+    return;
+  }
+  vfs_close(tx);
+  vfs_close(rx);
+
+  printf("[TEST] UDP test PASSED\n");
+}
+
 /* Run all tests */
 static void run_tests(void) {
   printf("\n========================================\n");
@@ -158,14 +376,60 @@ static void run_tests(void) {
   test_scheduler();
   printf("\n");
 
+  test_kthreads();
+  printf("\n");
+
+  test_rcu();
+  printf("\n");
+
+  test_proctable();
+  printf("\n");
+
   test_filesystem();
   printf("\n");
 
+  test_udp();
+  printf("\n");
+
   printf("========================================\n");
   printf("  All Tests Completed\n");
   printf("========================================\n\n");
 }
 
+static void ps_print(process_t *p, void *arg) {
+  (void)arg;
+  process_print_stats(p);
+}
+
+/* Copy a file to the console, e.g. /schedlat or anything under /proc */
+static void cat_file(const char *path) {
+  file_t *file = vfs_open(path, 0);
+  if (file == NULL) {
+    printf("Failed to open %s\n", path);
+    return;
+  }
+  char chunk[128];
+  int n;
+  while ((n = vfs_read(file, chunk, sizeof(chunk) - 1)) > 0) {
+    chunk[n] = '\0';
+    printf("%s", chunk);
+  }
+  vfs_close(file);
+}
+
+/* 'net arp': resolve the QEMU user-mode gateway */
+static void net_arp(void) {
+  uint8_t mac[ETH_ALEN];
+  uint64_t start = r_time();
+  if (arp_resolve(NET_GATEWAY, mac, 1000000000UL) != 0) {
+    printf("No ARP reply\n");
+    return;
+  }
+  printf("10.0.2.2 is at %02x:%02x:%02x:%02x:%02x:%02x (%u us)\n", mac[0],
+         mac[1], mac[2], mac[3], mac[4], mac[5],
+         time_to_ns(r_time() - start) / 1000);
+}
+
 /* Banner */
 static void print_banner(void) {
   printf("\n");
@@ -202,6 +466,14 @@ static void show_system_info(void) {
   printf("  Architecture: RISC-V 64-bit (RV64IMAC)\n");
   printf("  Privilege Mode: Supervisor (S-mode)\n");
   printf("  Page Size: %d bytes\n", PAGE_SIZE);
+  printf("  Machine: %s\n", machine.model);
+  uint64_t ram = 0;
+  for (int i = 0; i < machine.nr_ram; i++) {
+    ram += machine.ram[i].end - machine.ram[i].start;
+  }
+  printf("  RAM: %u MB in %d bank(s)\n", ram >> 20, machine.nr_ram);
+  printf("  Harts: %d present, %d online (boot hart %u)\n", machine.nr_harts,
+         sched_num_cpus(), (uint64_t)machine.boot_hart);
 
   /* Read CSR registers */
   uint64_t sstatus = r_sstatus();
@@ -216,6 +488,12 @@ static void show_system_info(void) {
 
 /* Simple shell */
 static void run_shell(void) {
+  boot_done();
+  uint64_t since_entry;
+  uint64_t to_shell = boot_time_to_shell(&since_entry);
+  printf("[BOOT] Shell reached %u us after reset (%u us in the kernel)\n",
+         (uint32_t)(to_shell / 1000), (uint32_t)(since_entry / 1000));
+
   printf("[SHELL] Starting simple shell\n");
   printf("Type 'help' for available commands\n");
 
@@ -228,6 +506,10 @@ static void run_shell(void) {
     /* Read line */
     pos = 0;
     while (1) {
+      /* The shell is the idle task: let other work run while waiting */
+      while (!uart_has_char()) {
+        sched_idle();
+      }
       char c = uart_getc();
 
       if (c == '\r' || c == '\n') {
@@ -262,28 +544,68 @@ static void run_shell(void) {
       printf("  testdev  - Test VFS device driver\n");
       printf("  ps       - Show process statistics\n");
       printf("  sched    - Show scheduler statistics\n");
+      printf("  bench    - Run benchmarks (bench <prefix> for a subset)\n");
+      printf("  schedlat - Show wakeup latency / run delay histograms\n");
+      printf("  cat      - Print a file (cat /proc/sched, /proc/<pid>/stat, ...)\n");
+      printf("  locks    - Show lock contention and RCU counters\n");
+      printf("  mem      - Show memory zones, watermarks and reclaim\n");
+      printf("  boot     - Show boot phase timings\n");
+      printf("  dmesg    - Show the kernel log\n");
+      printf("  net      - Show network statistics (net arp: ARP the gateway)\n");
+      printf("  blk      - Show block device statistics\n");
       printf("  echo     - Echo back the input\n");
       printf("  reboot   - Reboot the system\n");
     } else if (buffer[0] == 'p' && buffer[1] == 's' && buffer[2] == '\0') {
       /* Show all process statistics */
       printf("\n[PS] Process List:\n");
       printf("========================================\n");
-      extern process_t* process_alloc(void);  /* Access to iterate processes */
-      /* We need a way to iterate all processes - for now show current */
+      /* The shell runs as the idle task, which is not in the table */
       process_t *curr = current_proc();
       if (curr != NULL) {
         process_print_stats(curr);
-      } else {
-        printf("No current process\n");
       }
+      process_for_each(ps_print, NULL);
+      printf("%u processes\n", process_count());
       printf("========================================\n");
     } else if (buffer[0] == 's' && buffer[1] == 'c' && buffer[2] == 'h' &&
                buffer[3] == 'e' && buffer[4] == 'd' && buffer[5] == '\0') {
       /* Show scheduler statistics */
       sched_print_stats();
+      workqueue_print_stats();
+    } else if (strcmp(buffer, "bench") == 0) {
+      bench_run_all(NULL);
+    } else if (strncmp(buffer, "bench ", 6) == 0) {
+      bench_run_all(buffer + 6);
+    } else if (strcmp(buffer, "boot") == 0) {
+      boot_report();
+    } else if (strcmp(buffer, "dmesg") == 0) {
+      klog_dump();
+    } else if (strcmp(buffer, "net") == 0) {
+      virtio_net_print_stats();
+      net_print_stats();
+    } else if (strcmp(buffer, "net arp") == 0) {
+      if (virtio_net_present()) {
+        net_arp();
+      } else {
+        printf("No network device\n");
+      }
+    } else if (strcmp(buffer, "blk") == 0) {
+      blk_print_stats();
+    } else if (strcmp(buffer, "mem") == 0) {
+      mm_print_zones();
+      reclaim_print_stats();
+    } else if (strcmp(buffer, "locks") == 0) {
+      lockstat_print();
+      rcu_print_stats();
+    } else if (strcmp(buffer, "schedlat") == 0) {
+      cat_file("/schedlat");
+    } else if (strncmp(buffer, "cat ", 4) == 0) {
+      cat_file(buffer + 4);
     } else if (buffer[0] == 'i' && buffer[1] == 'n' && buffer[2] == 'f' &&
                buffer[3] == 'o' && buffer[4] == '\0') {
       show_system_info();
+      mm_print_zones();
+      dma_print_stats();
     } else if (buffer[0] == 't' && buffer[1] == 'e' && buffer[2] == 's' &&
                buffer[3] == 't' && buffer[4] == 'd' && buffer[5] == 'e' &&
                buffer[6] == 'v' && buffer[7] == '\0') {
@@ -345,8 +667,8 @@ static void run_shell(void) {
                buffer[3] == 'o' && buffer[4] == 'o' && buffer[5] == 't' &&
                buffer[6] == '\0') {
       printf("Rebooting...\n");
-      /* QEMU virt test device - writing 0x5555 causes QEMU to exit */
-      *(volatile uint32_t *)QEMU_VIRT_TEST = 0x5555;
+      /* SiFive test device - writing 0x5555 causes QEMU to exit */
+      *(volatile uint32_t *)machine.test.base = 0x5555;
     } else {
       printf("Unknown command: %s\n", buffer);
       printf("Type 'help' for available commands\n");
@@ -354,38 +676,92 @@ static void run_shell(void) {
   }
 }
 
-/* Kernel main entry */
-void kernel_main(void) {
-  /* Initialize UART for console output */
-  uart_init();
+/* Test device, registered late - AFTER vm_init() */
+static void testdev_boot(void) {
+  testdev_init();
+  testdev_register();
+}
+
+/* Network device; nothing at boot waits for it */
+static void net_boot(void) { virtio_net_init(); }
+
+/* Block device (/blk); the root filesystem does not live on it */
+static void blk_boot(void) { virtio_blk_init(); }
+
+/* Kernel main entry; OpenSBI passes the boot hart and the device tree */
+void kernel_main(uint64_t hartid, uint64_t dtb) {
+  /* Everything before this was firmware */
+  boot_mark("firmware");
+
+  /* Find RAM and devices, then the console */
+  fdt_init(hartid, (const void *)dtb);
+  uart_init(machine.uart.base);
 
   /* Print banner */
   print_banner();
 
+  /* Init messages go to the kernel log ('dmesg') unless BOOT_VERBOSE */
+  console_set_quiet(!BOOT_VERBOSE);
+
   printf("[KERNEL] Starting RISC-V OS kernel...\n");
   printf("[KERNEL] Kernel loaded at 0x80200000\n");
+  fdt_print();
+  boot_mark("uart");
 
-  /* Initialize memory management */
-  mm_init();
+  /* Initialize memory management; the DMA pool is carved while RAM is
+   * still contiguous */
+  mm_init(machine.ram, machine.nr_ram, machine.reserved, machine.nr_reserved);
+  mm_set_cpu_node(0, machine_hart_node(machine.boot_hart));
+  dma_init();
+  boot_mark("mm");
 
   /* Initialize virtual memory (SV39 paging) */
   vm_init();
   kvminithart();
+  boot_mark("vm");
 
-  /* Initialize trap handling */
+  /* Initialize trap handling and the interrupt controller */
   trap_init();
+  plic_init(machine.plic.base, machine.plic_context);
+  rtc_init(machine.rtc.base);
+
+  /* Probe FPU, then pick vector or scalar memory routines */
+  fpu_init();
+  rvv_init();
+  boot_mark("trap/fpu/rvv");
 
-  /* Initialize scheduler */
+  /* Process table, then the scheduler; from here on this thread is CPU 0's
+   * idle task */
+  process_init();
   scheduler_init();
+  workqueue_init();
+  rcu_init();
+  boot_mark("sched");
 
   /* Initialize file systems */
   vfs_init();
   sfs_init();
   sfs_format(256); /* Format with 256 blocks (1MB) */
+  vfs_mount("/", "simplefs");
+  procfs_init();
+  vfs_mount("/proc", "procfs");
+  boot_mark("fs");
 
-  /* Initialize and register test device - AFTER vm_init() */
-  testdev_init();
-  testdev_register();
+  /* kreclaimd and /proc/meminfo; shrinkers may register earlier */
+  reclaim_init();
+
+  /* IPv4/UDP stack; the NIC itself comes up later, loopback works now */
+  net_init();
+  boot_mark("net");
+
+  /* Devices nothing at boot depends on are registered by kinit once the
+   * shell is up */
+  boot_defer(testdev_boot, "testdev");
+  boot_defer(trace_init, "trace");  /* /trace, /schedlat */
+  boot_defer(net_boot, "virtio-net");
+  boot_defer(blk_boot, "virtio-blk");
+
+  console_set_quiet(0);
 
   /* Show system info */
   show_system_info();
@@ -395,8 +771,10 @@ void kernel_main(void) {
 
   /* Run initial test */
   test_memory();
+  boot_mark("tests");
 
   /* Start shell */
+  boot_start_deferred();
   run_shell();
 
   /* Should never reach here */
@@ -0,0 +1,200 @@
+#include "dma.h"
+#include "mm.h"
+#include "../printf.h"
+#include "../lib/bitops.h"
+#include "../lib/string.h"
+#include "../sync/spinlock.h"
+
+/* The pool is carved once, contiguous, and handed out in DMA_ALIGN units
+ * tracked by a bitmap (set = in use). Allocations are first fit; device
+ * buffers are few and long-lived, so the scan is not on any hot path. */
+#define DMA_POOL_SIZE  (DMA_POOL_PAGES * PAGE_SIZE)
+#define DMA_POOL_UNITS (DMA_POOL_SIZE / DMA_ALIGN)
+#define UNITS_PER_PAGE (PAGE_SIZE / DMA_ALIGN)
+#define NO_UNIT ((uint32_t)-1)
+
+/* Largest length one entry can describe */
+#define SG_MAX_LEN 0x80000000UL
+
+static uint8_t *pool;
+static uint64_t bitmap[DMA_POOL_UNITS / 64];
+static uint32_t units_used;
+static uint64_t big_allocs;    /* Served outside the pool */
+static uint64_t failures;
+
+static spinlock_t dma_lock;
+
+void dma_init(void) {
+    spin_init(&dma_lock, "dma");
+    pool = (uint8_t*)alloc_pages_contig(DMA_POOL_PAGES);
+    if (pool == NULL) {
+        printf("[DMA] No memory for the pool\n");
+        return;
+    }
+    printf("[DMA] Pool: %p - %p\n", pool, pool + DMA_POOL_SIZE);
+}
+
+/* First unit in use within [pos, pos + n), or NO_UNIT */
+static uint32_t first_used(uint32_t pos, uint32_t n) {
+    uint32_t end = pos + n;
+    for (uint32_t i = pos; i < end; i = (i / 64 + 1) * 64) {
+        uint64_t w = bitmap[i / 64] >> (i % 64);
+        if (w != 0) {
+            uint32_t bit = i + ctz64(w);
+            return bit < end ? bit : NO_UNIT;
+        }
+    }
+    return NO_UNIT;
+}
+
+static void mark(uint32_t pos, uint32_t n, int used) {
+    for (uint32_t i = pos; i < pos + n; i++) {
+        if (used) {
+            bitmap[i / 64] |= 1UL << (i % 64);
+        } else {
+            bitmap[i / 64] &= ~(1UL << (i % 64));
+        }
+    }
+}
+
+/* First free run of n units starting on a multiple of align; dma_lock held */
+static uint32_t find_run(uint32_t n, uint32_t align) {
+    uint32_t pos = 0;
+    while (pos + n <= DMA_POOL_UNITS) {
+        uint32_t used = first_used(pos, n);
+        if (used == NO_UNIT) {
+            return pos;
+        }
+        pos = (used + align) & ~(align - 1);
+    }
+    return NO_UNIT;
+}
+
+void *dma_alloc(size_t size, dma_addr_t *dma) {
+    if (size == 0) {
+        return NULL;
+    }
+    void *p = NULL;
+    
+    if (pool != NULL && size <= DMA_POOL_SIZE / 4) {
+        uint32_t n = (size + DMA_ALIGN - 1) / DMA_ALIGN;
+        uint32_t align = size >= PAGE_SIZE ? UNITS_PER_PAGE : 1;
+        uint64_t flags = spin_lock_irqsave(&dma_lock);
+        uint32_t pos = find_run(n, align);
+        if (pos != NO_UNIT) {
+            mark(pos, n, 1);
+            units_used += n;
+            p = pool + (uint64_t)pos * DMA_ALIGN;
+        }
+        spin_unlock_irqrestore(&dma_lock, flags);
+        if (p != NULL) {
+            memset(p, 0, n * DMA_ALIGN);
+        }
+    }
+    
+    if (p == NULL) {
+        /* Too big for the pool, or the pool is full */
+        p = alloc_pages_contig((size + PAGE_SIZE - 1) / PAGE_SIZE);
+        uint64_t flags = spin_lock_irqsave(&dma_lock);
+        if (p != NULL) {
+            big_allocs++;
+        } else {
+            failures++;
+        }
+        spin_unlock_irqrestore(&dma_lock, flags);
+    }
+    
+    if (p != NULL && dma != NULL) {
+        *dma = virt_to_dma(p);
+    }
+    return p;
+}
+
+void dma_free(void *addr, size_t size) {
+    uint8_t *p = (uint8_t*)addr;
+    if (p == NULL || size == 0) {
+        return;
+    }
+    
+    if (pool != NULL && p >= pool && p < pool + DMA_POOL_SIZE) {
+        uint32_t pos = (p - pool) / DMA_ALIGN;
+        uint32_t n = (size + DMA_ALIGN - 1) / DMA_ALIGN;
+        uint64_t flags = spin_lock_irqsave(&dma_lock);
+        mark(pos, n, 0);
+        units_used -= n;
+        spin_unlock_irqrestore(&dma_lock, flags);
+        return;
+    }
+    
+    /* Contiguous pages go back individually */
+    for (size_t off = 0; off < size; off += PAGE_SIZE) {
+        free_page(p + off);
+    }
+}
+
+void sg_init(sg_table_t *sg, sg_entry_t *ents, int max) {
+    sg->ents = ents;
+    sg->nents = 0;
+    sg->max = max;
+    sg->len = 0;
+}
+
+int sg_add(sg_table_t *sg, dma_addr_t addr, uint64_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (len > SG_MAX_LEN) {
+        return -1;
+    }
+    if (sg->nents > 0) {
+        sg_entry_t *last = &sg->ents[sg->nents - 1];
+        if (last->addr + last->len == addr && last->len + len <= SG_MAX_LEN) {
+            last->len += len;
+            sg->len += len;
+            return 0;
+        }
+    }
+    if (sg->nents == sg->max) {
+        return -1;
+    }
+    sg->ents[sg->nents].addr = addr;
+    sg->ents[sg->nents].len = (uint32_t)len;
+    sg->nents++;
+    sg->len += len;
+    return 0;
+}
+
+int sg_add_buf(sg_table_t *sg, const void *buf, uint64_t len) {
+    return sg_add(sg, virt_to_dma(buf), len);
+}
+
+int sg_add_iov(sg_table_t *sg, const iovec_t *iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; i++) {
+        if (sg_add_buf(sg, iov[i].iov_base, iov[i].iov_len) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void sg_trim(sg_table_t *sg, uint64_t len) {
+    if (len > sg->len) {
+        len = sg->len;
+    }
+    sg->len -= len;
+    while (len > 0) {
+        sg_entry_t *last = &sg->ents[sg->nents - 1];
+        if (last->len > len) {
+            last->len -= len;
+            break;
+        }
+        len -= last->len;
+        sg->nents--;
+    }
+}
+
+void dma_print_stats(void) {
+    printf("[DMA] Pool: %u / %u KB in use, %u large allocations, %u failures\n",
+           (uint64_t)units_used * DMA_ALIGN / 1024, (uint64_t)DMA_POOL_SIZE / 1024,
+           big_allocs, failures);
+}
@@ -0,0 +1,66 @@
+#ifndef _DMA_H
+#define _DMA_H
+
+#include "../types.h"
+#include "../fs/vfs.h"
+
+/* Memory shared with devices. The kernel is identity mapped, so a kernel
+ * address is also the bus address; drivers still go through
+ * virt_to_dma() so that the assumption lives in one place. */
+typedef uint64_t dma_addr_t;
+
+/* Allocation granule and minimum alignment: one cache line, so a device
+ * write never shares a line with unrelated CPU data */
+#define DMA_ALIGN 64
+
+/* Contiguous pool backing dma_alloc(); larger requests get their own
+ * contiguous pages */
+#define DMA_POOL_PAGES 256
+
+static inline dma_addr_t virt_to_dma(const void *p) {
+    return (dma_addr_t)p;
+}
+
+static inline void *dma_to_virt(dma_addr_t addr) {
+    return (void*)addr;
+}
+
+void dma_init(void);
+
+/* size bytes, zeroed and physically contiguous, aligned to DMA_ALIGN (to
+ * PAGE_SIZE from a page up). The bus address goes to *dma if not NULL. */
+void *dma_alloc(size_t size, dma_addr_t *dma);
+void dma_free(void *addr, size_t size);
+
+/* Scatter-gather list: the physically contiguous runs making up one
+ * buffer, in order. The caller provides the entry array. */
+typedef struct sg_entry {
+    dma_addr_t addr;
+    uint32_t len;
+} sg_entry_t;
+
+typedef struct sg_table {
+    sg_entry_t *ents;
+    int nents;
+    int max;
+    uint64_t len;              /* Total bytes */
+} sg_table_t;
+
+void sg_init(sg_table_t *sg, sg_entry_t *ents, int max);
+
+/* Append a bus range, extending the last entry when the two are
+ * adjacent. 0 on success, -1 (and nothing added) if out of entries or
+ * the range is over 2 GB. */
+int sg_add(sg_table_t *sg, dma_addr_t addr, uint64_t len);
+
+/* Append kernel buffers; on failure the segments before the one that
+ * did not fit stay in the table */
+int sg_add_buf(sg_table_t *sg, const void *buf, uint64_t len);
+int sg_add_iov(sg_table_t *sg, const iovec_t *iov, int iovcnt);
+
+/* Drop the last len bytes */
+void sg_trim(sg_table_t *sg, uint64_t len);
+
+void dma_print_stats(void);
+
+#endif /* _DMA_H */
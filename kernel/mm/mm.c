@@ -1,83 +1,385 @@
 #include "mm.h"
 #include "../printf.h"
+#include "../lib/string.h"
+#include "../sync/spinlock.h"
+#include "../process/scheduler.h"
+#include "reclaim.h"
+#include "../fs/procfs.h"
 
 /* Defined in linker script */
 extern char __heap_start[];
 extern char __heap_end[];
 extern char __kernel_end[];
 
-/* Simple stack-based page allocator */
-static uint64_t *free_pages = NULL;
-static uint64_t num_free_pages = 0;
-static void *heap_current = NULL;
+/* Page allocator. RAM is split into zones, one per NUMA node and type;
+ * each zone is a stack of freed pages backed by memory regions that are
+ * carved a page at a time from a watermark. Nothing is touched until it
+ * is first allocated, so init cost does not grow with RAM size. */
+#define ZONE_MAX_REGIONS 4
 
-void mm_init(void) {
-    /* Initialize heap */
-    heap_current = (void*)__heap_start;
+typedef struct mem_region {
+    uint64_t start;
+    uint64_t next;             /* Carve watermark */
+    uint64_t end;
+} mem_region_t;
+
+typedef struct zone {
+    spinlock_t lock;           /* Pages may be freed from interrupt
+                                * context (e.g. I/O completion) */
+    mem_region_t regions[ZONE_MAX_REGIONS];
+    int nr_regions;
+    int carve_idx;             /* First region with uncarved pages */
+    uint64_t *free_list;
+    zone_stats_t stats;
+} zone_t;
+
+static zone_t zones[MM_MAX_NODES][MM_NR_ZONES];
+static int cpu_node[MAX_CPUS];
+static uint64_t alloc_failures;
+
+/* Below wmark_low the reclaim thread is woken; it works until free
+ * memory is back at wmark_high (see reclaim.c) */
+static uint64_t wmark_low, wmark_high;
+
+static void zones_show(seq_file_t *m);
+
+static const char *zone_names[MM_NR_ZONES] = { "DMA32", "Normal" };
+
+static bump_heap_t kernel_heap;
+
+/* Add [start, end) less the reserved ranges from index i on */
+static void add_unreserved(uint64_t start, uint64_t end, int node, const mem_range_t *rsv,
+                           int i, int n) {
+    for (; i < n && start < end; i++) {
+        if (rsv[i].end <= start || rsv[i].start >= end) {
+            continue;
+        }
+        if (rsv[i].start > start) {
+            add_unreserved(start, rsv[i].start, node, rsv, i + 1, n);
+        }
+        start = rsv[i].end;
+    }
+    if (start < end && mm_add_region(start, end, node) == 0) {
+        printf("[MM] Free memory: %p - %p (node %d)\n", (void*)start, (void*)end, node);
+    }
+}
+
+void mm_init(const mem_range_t *ram, int nram, const mem_range_t *reserved, int nreserved) {
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int z = 0; z < MM_NR_ZONES; z++) {
+            memset(&zones[node][z], 0, sizeof(zone_t));
+            spin_init(&zones[node][z].lock, "zone");
+        }
+    }
     
-    /* Calculate available memory after kernel */
-    uint64_t mem_start = (uint64_t)__heap_end;
-    uint64_t mem_end = 0x80000000 + (128 * 1024 * 1024); /* 128MB total RAM */
+    /* Initialize heap */
+    bump_init(&kernel_heap, __heap_start, (uint64_t)(__heap_end - __heap_start), "heap");
     
-    /* Align to page boundary */
-    mem_start = (mem_start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    /* Free memory starts after the kernel image and its heap */
+    uint64_t kernel_end = ((uint64_t)__heap_end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
     
     printf("[MM] Initializing memory manager\n");
     printf("[MM] Heap: %p - %p\n", __heap_start, __heap_end);
-    printf("[MM] Free memory: %p - %p\n", (void*)mem_start, (void*)mem_end);
     
-    /* Initialize free page list */
-    free_pages = (uint64_t*)mem_start;
-    num_free_pages = (mem_end - mem_start) / PAGE_SIZE;
+    for (int i = 0; i < nram; i++) {
+        uint64_t start = ram[i].start;
+        /* Firmware sits below the kernel in the bank that holds it */
+        if (start <= (uint64_t)__heap_start && (uint64_t)__heap_start < ram[i].end) {
+            start = kernel_end;
+        }
+        add_unreserved(start, ram[i].end, ram[i].node, reserved, 0, nreserved);
+    }
     
-    /* Build linked list of free pages */
-    for (uint64_t i = 0; i < num_free_pages; i++) {
-        uint64_t *page = (uint64_t*)(mem_start + i * PAGE_SIZE);
-        if (i + 1 < num_free_pages) {
-            *page = mem_start + (i + 1) * PAGE_SIZE;
-        } else {
-            *page = 0; /* End of list */
+    /* 1/64 of RAM, as a floor for bursts that allocate faster than
+     * reclaim can run */
+    uint64_t free = mm_free_pages();
+    wmark_low = free / 64 > 16 ? free / 64 : 16;
+    wmark_high = wmark_low + wmark_low / 2;
+    printf("[MM] Initialized %u free pages (%u KB), watermarks %u/%u\n", 
+           (uint32_t)free, (uint32_t)(free * PAGE_SIZE / 1024), wmark_low, wmark_high);
+    procfs_register("zones", zones_show);
+}
+
+/* Hand [start, end) to one zone; 0 on success */
+static int zone_add(zone_t *z, uint64_t start, uint64_t end) {
+    uint64_t flags = spin_lock_irqsave(&z->lock);
+    if (z->nr_regions == ZONE_MAX_REGIONS) {
+        spin_unlock_irqrestore(&z->lock, flags);
+        return -1;
+    }
+    mem_region_t *r = &z->regions[z->nr_regions++];
+    r->start = r->next = start;
+    r->end = end;
+    z->stats.present += (end - start) / PAGE_SIZE;
+    z->stats.free += (end - start) / PAGE_SIZE;
+    spin_unlock_irqrestore(&z->lock, flags);
+    return 0;
+}
+
+/* Hand the page allocator a range of free RAM; pages are carved lazily.
+ * A range that crosses MM_DMA32_LIMIT is split between the two zones. */
+int mm_add_region(uint64_t start, uint64_t end, int node) {
+    start = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    end &= ~(uint64_t)(PAGE_SIZE - 1);
+    if (end <= start) {
+        return -1;
+    }
+    if (node < 0 || node >= MM_MAX_NODES) {
+        node = 0;
+    }
+    
+    if (start < MM_DMA32_LIMIT && end > MM_DMA32_LIMIT) {
+        if (zone_add(&zones[node][ZONE_DMA32], start, MM_DMA32_LIMIT) != 0) {
+            return -1;
         }
+        start = MM_DMA32_LIMIT;
     }
+    return zone_add(&zones[node][start < MM_DMA32_LIMIT ? ZONE_DMA32 : ZONE_NORMAL],
+                    start, end);
+}
+
+void mm_set_cpu_node(int cpu, int node) {
+    if (cpu >= 0 && cpu < MAX_CPUS && node >= 0 && node < MM_MAX_NODES) {
+        cpu_node[cpu] = node;
+    }
+}
+
+int mm_local_node(void) {
+    return cpu_node[sched_cpu_id()];
+}
+
+/* Next never-used page above the watermarks, or NULL; z->lock held */
+static void *carve_page(zone_t *z) {
+    while (z->carve_idx < z->nr_regions) {
+        mem_region_t *r = &z->regions[z->carve_idx];
+        if (r->next < r->end) {
+            void *page = (void*)r->next;
+            r->next += PAGE_SIZE;
+            return page;
+        }
+        z->carve_idx++;
+    }
+    return NULL;
+}
+
+/* One page from z, or NULL if it is empty */
+static void *zone_alloc(zone_t *z, int local) {
+    if (z->stats.free == 0) {
+        return NULL;
+    }
+    uint64_t flags = spin_lock_irqsave(&z->lock);
     
-    printf("[MM] Initialized %u free pages (%u KB)\n", 
-           (uint32_t)num_free_pages, (uint32_t)(num_free_pages * PAGE_SIZE / 1024));
+    /* Recycle freed pages first, they are likely still cached */
+    void *page = (void*)z->free_list;
+    if (page != NULL) {
+        z->free_list = (uint64_t*)(*z->free_list);
+    } else {
+        page = carve_page(z);
+    }
+    if (page != NULL) {
+        z->stats.free--;
+        z->stats.allocs++;
+        if (local) {
+            z->stats.local++;
+        } else {
+            z->stats.remote++;
+        }
+    }
+    spin_unlock_irqrestore(&z->lock, flags);
+    return page;
 }
 
-void* alloc_page(void) {
-    if (free_pages == NULL || num_free_pages == 0) {
+/* Zone fallback order: the preferred node first, then the others in
+ * turn; within a node, Normal before DMA32, so that low memory is left
+ * for the devices that need it */
+static void *zonelist_alloc(int node) {
+    void *page = NULL;
+    for (int i = 0; i < MM_MAX_NODES && page == NULL; i++) {
+        int n = (node + i) % MM_MAX_NODES;
+        page = zone_alloc(&zones[n][ZONE_NORMAL], i == 0);
+        if (page == NULL) {
+            page = zone_alloc(&zones[n][ZONE_DMA32], i == 0);
+        }
+    }
+    return page;
+}
+
+/* Wake reclaim once free memory is below the low watermark */
+static void check_watermark(void) {
+    if (mm_free_pages() < wmark_low) {
+        reclaim_wakeup();
+    }
+}
+
+void *alloc_page_node(int node) {
+    if (node < 0 || node >= MM_MAX_NODES) {
+        node = mm_local_node();
+    }
+    
+    void *page = zonelist_alloc(node);
+    if (page == NULL && reclaim_direct(RECLAIM_BATCH) > 0) {
+        page = zonelist_alloc(node);
+    }
+    if (page == NULL) {
+        __atomic_fetch_add(&alloc_failures, 1, __ATOMIC_RELAXED);
+        reclaim_wakeup();
         printf("[MM] Out of memory!\n");
         return NULL;
     }
+    check_watermark();
     
-    /* Pop from stack */
-    void *page = (void*)free_pages;
-    free_pages = (uint64_t*)(*free_pages);
-    num_free_pages--;
+    /* Clear page (outside the lock) */
+    page_clear(page);
     
-    /* Clear page */
-    uint64_t *p = (uint64_t*)page;
-    for (int i = 0; i < PAGE_SIZE / 8; i++) {
-        p[i] = 0;
+    return page;
+}
+
+void* alloc_page(void) {
+    return alloc_page_node(mm_local_node());
+}
+
+/* Contiguous pages come from DMA32 zones first, local node first */
+void *alloc_pages_contig(uint64_t npages) {
+    if (npages == 0) {
+        return NULL;
     }
+    uint64_t size = npages * PAGE_SIZE;
+    void *base = NULL;
+    int local = mm_local_node();
     
-    return page;
+    for (int t = 0; t < MM_NR_ZONES && base == NULL; t++) {
+        for (int i = 0; i < MM_MAX_NODES && base == NULL; i++) {
+            zone_t *z = &zones[(local + i) % MM_MAX_NODES][t];
+            uint64_t flags = spin_lock_irqsave(&z->lock);
+            for (int r = z->carve_idx; r < z->nr_regions; r++) {
+                mem_region_t *reg = &z->regions[r];
+                if (reg->end - reg->next >= size) {
+                    base = (void*)reg->next;
+                    reg->next += size;
+                    z->stats.free -= npages;
+                    z->stats.allocs += npages;
+                    if (i == 0) {
+                        z->stats.local += npages;
+                    } else {
+                        z->stats.remote += npages;
+                    }
+                    break;
+                }
+            }
+            spin_unlock_irqrestore(&z->lock, flags);
+        }
+    }
+    
+    if (base == NULL) {
+        printf("[MM] No %u contiguous pages\n", npages);
+        return NULL;
+    }
+    check_watermark();
+    for (uint64_t i = 0; i < npages; i++) {
+        page_clear((uint8_t*)base + i * PAGE_SIZE);
+    }
+    return base;
+}
+
+/* The zone whose regions hold addr */
+static zone_t *addr_zone(uint64_t addr) {
+    int t = addr < MM_DMA32_LIMIT ? ZONE_DMA32 : ZONE_NORMAL;
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        zone_t *z = &zones[node][t];
+        for (int r = 0; r < z->nr_regions; r++) {
+            if (addr >= z->regions[r].start && addr < z->regions[r].end) {
+                return z;
+            }
+        }
+    }
+    return NULL;
 }
 
 void free_page(void* page) {
     if (page == NULL) {
         return;
     }
+    zone_t *z = addr_zone((uint64_t)page);
+    if (z == NULL) {
+        panic("free_page: not a managed page");
+    }
     
     /* Push to stack */
     uint64_t *p = (uint64_t*)page;
-    *p = (uint64_t)free_pages;
-    free_pages = p;
-    num_free_pages++;
+    uint64_t flags = spin_lock_irqsave(&z->lock);
+    *p = (uint64_t)z->free_list;
+    z->free_list = p;
+    z->stats.free++;
+    z->stats.frees++;
+    spin_unlock_irqrestore(&z->lock, flags);
 }
 
-/* Simple bump allocator for small allocations */
-void* kmalloc(size_t size) {
+void mm_get_stats(mm_stats_t *out) {
+    out->total = 0;
+    out->free = 0;
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int t = 0; t < MM_NR_ZONES; t++) {
+            out->total += zones[node][t].stats.present;
+            out->free += zones[node][t].stats.free;
+        }
+    }
+    out->wmark_low = wmark_low;
+    out->wmark_high = wmark_high;
+    out->alloc_failures = alloc_failures;
+}
+
+int mm_zone_stats(int node, int type, zone_stats_t *out) {
+    if (node < 0 || node >= MM_MAX_NODES || type < 0 || type >= MM_NR_ZONES ||
+        zones[node][type].stats.present == 0) {
+        return -1;
+    }
+    *out = zones[node][type].stats;
+    return 0;
+}
+
+const char *mm_zone_name(int type) {
+    return type >= 0 && type < MM_NR_ZONES ? zone_names[type] : "?";
+}
+
+void mm_print_zones(void) {
+    printf("[MM] Zones (local node %d):\n", mm_local_node());
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int t = 0; t < MM_NR_ZONES; t++) {
+            zone_stats_t st;
+            if (mm_zone_stats(node, t, &st) != 0) {
+                continue;
+            }
+            printf("  node %d %s: %u / %u pages free, %u allocs (%u local, %u remote), "
+                   "%u frees\n", node, zone_names[t], st.free, st.present, st.allocs,
+                   st.local, st.remote, st.frees);
+        }
+    }
+    printf("  allocation failures: %u\n", alloc_failures);
+}
+
+/* /proc/zones: a header, then one row per populated zone */
+static void zones_show(seq_file_t *m) {
+    seq_printf(m, "node zone present free allocs frees local remote\n");
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int t = 0; t < MM_NR_ZONES; t++) {
+            zone_stats_t st;
+            if (mm_zone_stats(node, t, &st) != 0) {
+                continue;
+            }
+            seq_printf(m, "%d %s %u %u %u %u %u %u\n", node, zone_names[t],
+                       st.present, st.free, st.allocs, st.frees, st.local, st.remote);
+        }
+    }
+}
+
+void bump_init(bump_heap_t *h, void *start, uint64_t size, const char *name) {
+    spin_init(&h->lock, name);
+    h->start = (uint64_t)start;
+    h->current = h->start;
+    h->end = h->start + size;
+}
+
+void *bump_alloc(bump_heap_t *h, size_t size) {
     if (size == 0) {
         return NULL;
     }
@@ -86,17 +388,41 @@ void* kmalloc(size_t size) {
     size = (size + 7) & ~7;
     
     /* Check if we have space */
-    if ((uint64_t)heap_current + size > (uint64_t)__heap_end) {
+    uint64_t flags = spin_lock_irqsave(&h->lock);
+    if (h->current + size > h->end) {
+        spin_unlock_irqrestore(&h->lock, flags);
         printf("[MM] Heap exhausted!\n");
         return NULL;
     }
     
-    void *ptr = heap_current;
-    heap_current = (void*)((uint64_t)heap_current + size);
+    void *ptr = (void*)h->current;
+    h->current += size;
+    spin_unlock_irqrestore(&h->lock, flags);
     
     return ptr;
 }
 
+void bump_reset(bump_heap_t *h) {
+    uint64_t flags = spin_lock_irqsave(&h->lock);
+    h->current = h->start;
+    spin_unlock_irqrestore(&h->lock, flags);
+}
+
+/* Simple bump allocator for small allocations */
+void* kmalloc(size_t size) {
+    return bump_alloc(&kernel_heap, size);
+}
+
+uint64_t mm_free_pages(void) {
+    uint64_t free = 0;
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int t = 0; t < MM_NR_ZONES; t++) {
+            free += zones[node][t].stats.free;
+        }
+    }
+    return free;
+}
+
 void kfree(void* ptr) {
     /* Simple bump allocator doesn't support free */
     (void)ptr;
@@ -2,17 +2,90 @@
 #define _MM_H
 
 #include "../types.h"
+#include "../sync/spinlock.h"
 
 #define PAGE_SIZE 4096
 #define PAGE_SHIFT 12
 
-/* Memory management initialization */
-void mm_init(void);
+/* Physical address range [start, end) */
+typedef struct mem_range {
+    uint64_t start;
+    uint64_t end;
+    int node;                  /* NUMA node, for RAM */
+} mem_range_t;
 
-/* Page allocation */
+/* Each NUMA node has up to one zone of each type: DMA32 is RAM below
+ * 4 GB, which any 32-bit bus master can reach; Normal is the rest */
+#define MM_MAX_NODES 4
+#define MM_DMA32_LIMIT 0x100000000UL
+
+enum { ZONE_DMA32, ZONE_NORMAL, MM_NR_ZONES };
+
+typedef struct zone_stats {
+    uint64_t present;          /* Pages the zone was given */
+    uint64_t free;             /* Free list plus not yet carved */
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t local;            /* Allocations that wanted this node */
+    uint64_t remote;           /* Fallbacks from another node */
+} zone_stats_t;
+
+/* Memory management initialization: the page allocator gets the RAM
+ * ranges above the kernel image, less the reserved ranges */
+void mm_init(const mem_range_t *ram, int nram, const mem_range_t *reserved, int nreserved);
+
+/* Add free RAM [start, end) on node to the page allocator; 0 on success */
+int mm_add_region(uint64_t start, uint64_t end, int node);
+
+/* Pages still available in all zones (free lists plus not yet carved) */
+uint64_t mm_free_pages(void);
+
+/* The node a CPU allocates from by default */
+void mm_set_cpu_node(int cpu, int node);
+int mm_local_node(void);
+
+/* Page allocation: alloc_page() prefers the calling CPU's node,
+ * alloc_page_node() the given one (-1: local); both fall back to the
+ * other nodes in turn, then reclaim (mm/reclaim.h) before failing */
 void* alloc_page(void);
+void *alloc_page_node(int node);
 void free_page(void* page);
 
+/* npages physically contiguous, zeroed pages, taken from memory that has
+ * never been handed out (the free lists are not contiguous), from DMA32
+ * zones first. They go back one at a time with free_page(). NULL if no
+ * region has room. */
+void *alloc_pages_contig(uint64_t npages);
+
+typedef struct mm_stats {
+    uint64_t total;            /* Pages given to the allocator */
+    uint64_t free;
+    uint64_t wmark_low;        /* Reclaim starts below this... */
+    uint64_t wmark_high;       /* ...and stops here */
+    uint64_t alloc_failures;   /* alloc_page() calls that returned NULL */
+} mm_stats_t;
+
+void mm_get_stats(mm_stats_t *out);
+
+/* Statistics of one zone; -1 if the node has no memory of that type */
+int mm_zone_stats(int node, int type, zone_stats_t *out);
+const char *mm_zone_name(int type);
+void mm_print_zones(void);
+
+/* Bump allocator over a fixed region: nothing is freed on its own, only
+ * everything at once by bump_reset(). kmalloc() uses one over the heap
+ * the linker script sets aside. */
+typedef struct bump_heap {
+    uint64_t start;
+    uint64_t current;
+    uint64_t end;
+    spinlock_t lock;
+} bump_heap_t;
+
+void bump_init(bump_heap_t *h, void *start, uint64_t size, const char *name);
+void *bump_alloc(bump_heap_t *h, size_t size);   /* 8-byte aligned, or NULL */
+void bump_reset(bump_heap_t *h);
+
 /* Simple heap allocator */
 void* kmalloc(size_t size);
 void kfree(void* ptr);
@@ -0,0 +1,304 @@
+#include "mmap.h"
+#include "mm.h"
+#include "vm.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../process/scheduler.h"
+
+/* VMAs live in one lazily allocated page per process */
+#define MAX_VMAS (PAGE_SIZE / sizeof(vma_t))
+
+/* Get the process VMA table, allocating it on first use */
+static vma_t *vma_table(process_t *p, int alloc) {
+    if (p->vmas == NULL && alloc) {
+        p->vmas = (vma_t*)alloc_page();
+        p->mmap_top = MMAP_BASE;
+        if (p->vmas != NULL) {
+            rss_add(p, RSS_KERNEL, 1);
+        }
+    }
+    return p->vmas;
+}
+
+/* Find the VMA covering va */
+static vma_t *find_vma(process_t *p, uint64_t va) {
+    vma_t *vmas = vma_table(p, 0);
+    if (vmas == NULL) {
+        return NULL;
+    }
+    
+    for (uint64_t i = 0; i < MAX_VMAS; i++) {
+        if (vmas[i].used && va >= vmas[i].start && va < vmas[i].end) {
+            return &vmas[i];
+        }
+    }
+    return NULL;
+}
+
+static vma_t *alloc_vma(process_t *p) {
+    vma_t *vmas = vma_table(p, 1);
+    if (vmas == NULL) {
+        return NULL;
+    }
+    
+    for (uint64_t i = 0; i < MAX_VMAS; i++) {
+        if (!vmas[i].used) {
+            vmas[i].used = 1;
+            return &vmas[i];
+        }
+    }
+    return NULL;
+}
+
+static void put_vma(vma_t *vma) {
+    if (vma->inode->ops->unmap != NULL) {
+        vma->inode->ops->unmap(vma->inode);
+    }
+    vfs_destroy_inode(vma->inode);  /* Drops our reference */
+    vma->inode = NULL;
+    vma->used = 0;
+}
+
+uint64_t mmap_map(process_t *p, uint64_t len, int prot, int flags,
+                  file_t *file, uint64_t offset) {
+    if (p == NULL || p->pagetable == NULL || file == NULL || len == 0) {
+        return 0;
+    }
+    if (!(flags & MAP_SHARED) || (offset & (PGSIZE - 1)) != 0) {
+        return 0;
+    }
+    /* SV39 has no write-only leaves and PROT_NONE has nothing to fault in,
+     * so only readable mappings are accepted */
+    if (!(prot & PROT_READ) || (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))) {
+        return 0;
+    }
+    if (file->inode->ops == NULL || file->inode->ops->map_page == NULL) {
+        return 0;  /* Backing store can't hand out pages */
+    }
+    
+    vma_t *vma = alloc_vma(p);
+    if (vma == NULL) {
+        return 0;
+    }
+    
+    len = PGROUNDUP(len);
+    if (p->mmap_top + len > MAXVA) {
+        vma->used = 0;
+        return 0;
+    }
+    if (file->inode->ops->map != NULL && file->inode->ops->map(file->inode) != 0) {
+        vma->used = 0;
+        return 0;
+    }
+    
+    /* Nothing is mapped yet: pages are populated by mmap_fault() */
+    vma->start = p->mmap_top;
+    vma->end = vma->start + len;
+    vma->pgoff = offset / PGSIZE;
+    vma->prot = prot;
+    vma->inode = file->inode;
+    vma->inode->ref++;
+    p->mmap_top = vma->end;
+    
+    return vma->start;
+}
+
+int mmap_fault(process_t *p, uint64_t va, int access) {
+    if (p == NULL || p->pagetable == NULL) {
+        return -1;
+    }
+    
+    vma_t *vma = find_vma(p, va);
+    if (vma == NULL || !(vma->prot & access)) {
+        return -1;
+    }
+    
+    /* Already present: another hart populated it, or the hardware leaves
+     * A/D updates to software. Anything else is a real permission fault. */
+    uint64_t page = PGROUNDDOWN(va);
+    pte_t *pte = walk(p->pagetable, page, 0);
+    if (pte != NULL && PTE_VALID(*pte)) {
+        pte_t need = (access == PROT_WRITE) ? PTE_W :
+                     (access == PROT_EXEC) ? PTE_X : PTE_R;
+        if (!(*pte & need)) {
+            return -1;
+        }
+        *pte |= PTE_A | ((access == PROT_WRITE) ? PTE_D : 0);
+        sfence_vma();
+        return 0;
+    }
+    
+    int write = (access == PROT_WRITE);
+    uint64_t index = vma->pgoff + (page - vma->start) / PGSIZE;
+    void *kpage = vma->inode->ops->map_page(vma->inode, index, write);
+    if (kpage == NULL) {
+        return -1;
+    }
+    
+    /* Another hart may have raced us here */
+    pte = walk(p->pagetable, page, 0);
+    if (pte != NULL && PTE_VALID(*pte)) {
+        return 0;
+    }
+    
+    int perm = PTE_U | PTE_A;
+    if (vma->prot & PROT_READ) perm |= PTE_R;
+    if (vma->prot & PROT_WRITE) perm |= PTE_W | PTE_R;
+    if (vma->prot & PROT_EXEC) perm |= PTE_X;
+    if (write) perm |= PTE_D;  /* The store that faulted is about to dirty it */
+    
+    if (mappages(p->pagetable, page, PGSIZE, (uint64_t)kpage, perm) != 0) {
+        return -1;
+    }
+    rss_add(p, RSS_FILE, 1);
+    return 0;
+}
+
+typedef struct pt_fault {
+    pagetable_t pt;
+    uint64_t va;
+    int access;
+    int ret;
+} pt_fault_t;
+
+static void fault_if_owner(process_t *p, void *arg) {
+    pt_fault_t *f = (pt_fault_t*)arg;
+    if (f->ret != 0 && p->pagetable == f->pt && p->state != PROC_ZOMBIE) {
+        f->ret = mmap_fault(p, f->va, f->access);
+    }
+}
+
+int mmap_fault_pt(pagetable_t pt, uint64_t va, int access) {
+    process_t *p = current_proc();
+    if (p != NULL && p->pagetable == pt) {
+        return mmap_fault(p, va, access);
+    }
+    
+    /* Serving another task's buffers (an SQPOLL ring drained from idle):
+     * find the owner, inside RCU so its slot can't be recycled under us */
+    pt_fault_t f = { pt, va, access, -1 };
+    process_for_each(fault_if_owner, &f);
+    return f.ret;
+}
+
+/* Unmap whatever pages of [start, end) were faulted in */
+static int unmap_present(process_t *p, uint64_t start, uint64_t end) {
+    /* Refuse if any page is pinned for DMA */
+    for (uint64_t a = start; a < end; a += PGSIZE) {
+        pte_t *pte = walk(p->pagetable, a, 0);
+        if (pte != NULL && PTE_VALID(*pte) && PTE_PINS(*pte) != 0) {
+            return -1;
+        }
+    }
+    
+    for (uint64_t a = start; a < end; a += PGSIZE) {
+        pte_t *pte = walk(p->pagetable, a, 0);
+        if (pte != NULL && PTE_VALID(*pte)) {
+            *pte = 0;  /* Page belongs to the file, not to us */
+            rss_add(p, RSS_FILE, -1);
+        }
+    }
+    sfence_vma();
+    return 0;
+}
+
+int mmap_unmap(process_t *p, uint64_t va, uint64_t len) {
+    if (p == NULL || p->pagetable == NULL || (va & (PGSIZE - 1)) != 0 ||
+        len == 0) {
+        return -1;
+    }
+    
+    vma_t *vmas = vma_table(p, 0);
+    if (vmas == NULL) {
+        return 0;
+    }
+    
+    uint64_t end = va + PGROUNDUP(len);
+    for (uint64_t i = 0; i < MAX_VMAS; i++) {
+        vma_t *vma = &vmas[i];
+        if (!vma->used || vma->end <= va || vma->start >= end) {
+            continue;
+        }
+        
+        uint64_t lo = (va > vma->start) ? va : vma->start;
+        uint64_t hi = (end < vma->end) ? end : vma->end;
+        if (unmap_present(p, lo, hi) != 0) {
+            return -1;
+        }
+        
+        if (lo == vma->start && hi == vma->end) {
+            put_vma(vma);
+        } else if (lo == vma->start) {
+            vma->pgoff += (hi - vma->start) / PGSIZE;
+            vma->start = hi;
+        } else if (hi == vma->end) {
+            vma->end = lo;
+        } else {
+            /* Hole in the middle: split off the tail */
+            vma_t *tail = alloc_vma(p);
+            if (tail == NULL) {
+                return -1;
+            }
+            *tail = *vma;
+            tail->start = hi;
+            tail->pgoff = vma->pgoff + (hi - vma->start) / PGSIZE;
+            tail->inode->ref++;
+            if (tail->inode->ops->map != NULL) {
+                tail->inode->ops->map(tail->inode);  /* Can't fail: still mapped */
+            }
+            vma->end = lo;
+        }
+    }
+    
+    return 0;
+}
+
+int mmap_sync(process_t *p, uint64_t va, uint64_t len) {
+    if (p == NULL || p->pagetable == NULL || (va & (PGSIZE - 1)) != 0) {
+        return -1;
+    }
+    
+    /*
+     * Mapped pages are the file's own blocks, so stores are already
+     * visible to sfs_read(). Collect the dirty bits here; this is where
+     * write-back goes once a block device backs the filesystem.
+     */
+    int synced = 0;
+    for (uint64_t a = va; a < va + len; a += PGSIZE) {
+        vma_t *vma = find_vma(p, a);
+        if (vma == NULL) {
+            return -1;
+        }
+        
+        pte_t *pte = walk(p->pagetable, a, 0);
+        if (pte != NULL && PTE_VALID(*pte) && (*pte & PTE_D)) {
+            *pte &= ~PTE_D;
+            synced++;
+        }
+    }
+    
+    if (synced > 0) {
+        sfence_vma();
+    }
+    return synced;
+}
+
+void mmap_release(process_t *p) {
+    if (p == NULL || p->vmas == NULL) {
+        return;
+    }
+    
+    for (uint64_t i = 0; i < MAX_VMAS; i++) {
+        vma_t *vma = &p->vmas[i];
+        if (vma->used) {
+            if (p->pagetable != NULL) {
+                unmap_present(p, vma->start, vma->end);
+            }
+            put_vma(vma);
+        }
+    }
+    
+    free_page(p->vmas);
+    p->vmas = NULL;
+    rss_add(p, RSS_KERNEL, -1);
+}
@@ -0,0 +1,52 @@
+#ifndef _MMAP_H
+#define _MMAP_H
+
+#include "../types.h"
+#include "../fs/vfs.h"
+#include "../process/process.h"
+#include "vm.h"
+
+/* Protection bits */
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+#define PROT_EXEC  0x4
+
+/* Mapping flags (only shared file mappings are supported) */
+#define MAP_SHARED 0x01
+
+/* File mappings are placed upwards from here in the user address space */
+#define MMAP_BASE 0x2000000000UL
+
+/* A mapped range of a file */
+typedef struct vma {
+    uint64_t start;            /* First mapped user address */
+    uint64_t end;              /* One past the last mapped address */
+    uint64_t pgoff;            /* File page backing 'start' */
+    inode_t *inode;            /* Backing file (holds a reference) */
+    int prot;                  /* PROT_* bits */
+    int used;
+} vma_t;
+
+/* Map len bytes of file at page-aligned offset; returns the user address or 0.
+ * prot must include PROT_READ. */
+uint64_t mmap_map(process_t *p, uint64_t len, int prot, int flags,
+                  file_t *file, uint64_t offset);
+
+/* mmap_fault() for the task whose page table is pt, for kernel accesses
+ * to user buffers (copyout, pinning); 0 if the page is now accessible */
+int mmap_fault_pt(pagetable_t pt, uint64_t va, int access);
+
+/* Remove mappings in [va, va + len) */
+int mmap_unmap(process_t *p, uint64_t va, uint64_t len);
+
+/* Write back dirty pages in [va, va + len) */
+int mmap_sync(process_t *p, uint64_t va, uint64_t len);
+
+/* Populate the page for a faulting address; access is the PROT_* bit the
+ * faulting load, store or fetch needs. 0 if the fault was handled. */
+int mmap_fault(process_t *p, uint64_t va, int access);
+
+/* Drop all mappings of a process */
+void mmap_release(process_t *p);
+
+#endif /* _MMAP_H */
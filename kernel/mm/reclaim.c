@@ -0,0 +1,175 @@
+#include "reclaim.h"
+#include "mm.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../fs/procfs.h"
+#include "../process/kthread.h"
+#include "../process/process.h"
+#include "../process/scheduler.h"
+
+static shrinker_t *shrinkers;
+static process_t *kreclaimd;
+static volatile int reclaim_wanted;
+/* Direct reclaim is skipped when already inside a shrinker */
+static volatile int reclaim_active;
+
+static uint64_t wakeups;
+static uint64_t kreclaimd_pages;
+static uint64_t direct_runs;
+static uint64_t direct_pages;
+
+void register_shrinker(shrinker_t *s) {
+    s->freed = 0;
+    shrinker_t *head = __atomic_load_n(&shrinkers, __ATOMIC_RELAXED);
+    do {
+        s->next = head;
+    } while (!__atomic_compare_exchange_n(&shrinkers, &head, s, 0,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+uint64_t reclaimable_pages(void) {
+    uint64_t n = 0;
+    for (shrinker_t *s = __atomic_load_n(&shrinkers, __ATOMIC_ACQUIRE);
+         s != NULL; s = s->next) {
+        n += s->count();
+    }
+    return n;
+}
+
+uint64_t reclaim_pages(uint64_t nr) {
+    uint64_t freed = 0;
+    
+    __atomic_fetch_add(&reclaim_active, 1, __ATOMIC_ACQUIRE);
+    for (shrinker_t *s = __atomic_load_n(&shrinkers, __ATOMIC_ACQUIRE);
+         s != NULL && freed < nr; s = s->next) {
+        if (s->count() == 0) {
+            continue;
+        }
+        uint64_t n = s->scan(nr - freed);
+        __atomic_fetch_add(&s->freed, n, __ATOMIC_RELAXED);
+        freed += n;
+    }
+    __atomic_fetch_sub(&reclaim_active, 1, __ATOMIC_RELEASE);
+    return freed;
+}
+
+uint64_t reclaim_direct(uint64_t nr) {
+    /* A shrinker that allocates must not recurse into reclaim */
+    if (__atomic_load_n(&reclaim_active, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    uint64_t freed = reclaim_pages(nr);
+    __atomic_fetch_add(&direct_runs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&direct_pages, freed, __ATOMIC_RELAXED);
+    return freed;
+}
+
+void reclaim_wakeup(void) {
+    if (kreclaimd == NULL) {
+        return;
+    }
+    if (__atomic_exchange_n(&reclaim_wanted, 1, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_fetch_add(&wakeups, 1, __ATOMIC_RELAXED);
+        sched_wakeup(kreclaimd);
+    }
+}
+
+static void kreclaimd_main(void *arg) {
+    (void)arg;
+    
+    while (1) {
+        uint64_t flags = intr_save();
+        while (!reclaim_wanted) {
+            sched_sleep();
+        }
+        intr_restore(flags);
+        
+        /* Cleared before the counters are read, so a wakeup that arrives
+         * after the snapshot sets it again and buys another pass */
+        while (__atomic_exchange_n(&reclaim_wanted, 0, __ATOMIC_ACQ_REL)) {
+            /* Batches until the high watermark, or until nothing is left
+             * to give; frees deferred by RCU show up in later passes */
+            mm_stats_t st;
+            mm_get_stats(&st);
+            while (st.free < st.wmark_high) {
+                uint64_t n = reclaim_pages(RECLAIM_BATCH);
+                kreclaimd_pages += n;
+                if (n == 0) {
+                    break;
+                }
+                sched_yield();
+                mm_get_stats(&st);
+            }
+        }
+    }
+}
+
+/* ---- /proc/meminfo: "name value" lines ---- */
+
+static void meminfo_rss(process_t *p, void *arg) {
+    if (p->state != PROC_ZOMBIE) {
+        seq_printf((seq_file_t*)arg, "rss %u %s %u %u %u\n", p->pid, p->name,
+                   p->rss[RSS_FILE], p->rss[RSS_ANON], p->rss[RSS_KERNEL]);
+    }
+}
+
+static void meminfo_show(seq_file_t *m) {
+    uint64_t kb = PAGE_SIZE / 1024;
+    mm_stats_t st;
+    mm_get_stats(&st);
+    
+    seq_printf(m, "mem_total_kb %u\nmem_free_kb %u\n", st.total * kb, st.free * kb);
+    seq_printf(m, "watermark_low_kb %u\nwatermark_high_kb %u\n",
+               st.wmark_low * kb, st.wmark_high * kb);
+    seq_printf(m, "reclaimable_kb %u\nalloc_failures %u\n",
+               reclaimable_pages() * kb, st.alloc_failures);
+    for (int node = 0; node < MM_MAX_NODES; node++) {
+        for (int t = 0; t < MM_NR_ZONES; t++) {
+            zone_stats_t zs;
+            if (mm_zone_stats(node, t, &zs) != 0 || zs.present == 0) {
+                continue;
+            }
+            seq_printf(m, "zone_free_kb %d %s %u\n", node, mm_zone_name(t), zs.free * kb);
+        }
+    }
+    seq_printf(m, "reclaim_wakeups %u\nreclaim_kreclaimd_pages %u\n",
+               wakeups, kreclaimd_pages);
+    seq_printf(m, "reclaim_direct_runs %u\nreclaim_direct_pages %u\n",
+               direct_runs, direct_pages);
+    for (shrinker_t *s = __atomic_load_n(&shrinkers, __ATOMIC_ACQUIRE);
+         s != NULL; s = s->next) {
+        seq_printf(m, "shrinker_freed %s %u\n", s->name, s->freed);
+    }
+    process_for_each(meminfo_rss, m);
+}
+
+void reclaim_init(void) {
+    kreclaimd = kthread_create(kreclaimd_main, NULL, "kreclaimd");
+    if (kreclaimd == NULL) {
+        printf("[RECLAIM] Failed to start kreclaimd, direct reclaim only\n");
+    }
+    procfs_register("meminfo", meminfo_show);
+    
+    mm_stats_t st;
+    mm_get_stats(&st);
+    printf("[RECLAIM] Watermarks low %u / high %u pages, batch %d\n",
+           st.wmark_low, st.wmark_high, RECLAIM_BATCH);
+}
+
+void reclaim_print_stats(void) {
+    mm_stats_t st;
+    mm_get_stats(&st);
+    
+    printf("\n[RECLAIM] Reclaim Statistics:\n");
+    printf("  Free: %u of %u pages (low %u, high %u)\n",
+           st.free, st.total, st.wmark_low, st.wmark_high);
+    printf("  Reclaimable: %u pages, allocation failures: %u\n",
+           reclaimable_pages(), st.alloc_failures);
+    printf("  kreclaimd: %u wakeups, %u pages; direct: %u runs, %u pages\n",
+           wakeups, kreclaimd_pages, direct_runs, direct_pages);
+    for (shrinker_t *s = __atomic_load_n(&shrinkers, __ATOMIC_ACQUIRE);
+         s != NULL; s = s->next) {
+        printf("  Shrinker %s: %u reclaimable, %u freed\n",
+               s->name, s->count(), s->freed);
+    }
+}
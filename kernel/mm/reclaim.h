@@ -0,0 +1,45 @@
+#ifndef _RECLAIM_H
+#define _RECLAIM_H
+
+#include "../types.h"
+
+/* Memory reclaim. Caches that hold pages they could give back register a
+ * shrinker; when free memory drops below the low watermark the kreclaimd
+ * thread calls them until it is back above the high one. An allocation
+ * that would fail first runs one batch itself (direct reclaim). */
+
+/* Pages asked of the shrinkers per pass */
+#define RECLAIM_BATCH 32
+
+typedef struct shrinker {
+    const char *name;
+    /* Pages that scan() could free now; cheap, no side effects */
+    uint64_t (*count)(void);
+    /* Free up to nr pages, return how many were released. Pages may reach
+     * the allocator only after an RCU grace period. */
+    uint64_t (*scan)(uint64_t nr);
+    uint64_t freed;            /* Total returned by scan() */
+    struct shrinker *next;
+} shrinker_t;
+
+/* Shrinkers are never unregistered; safe before reclaim_init() */
+void register_shrinker(shrinker_t *s);
+
+/* Start kreclaimd and register /proc/meminfo */
+void reclaim_init(void);
+
+/* Ask every shrinker in turn until nr pages are freed; pages freed */
+uint64_t reclaim_pages(uint64_t nr);
+
+/* From the allocator: run a batch in the caller's context */
+uint64_t reclaim_direct(uint64_t nr);
+
+/* Kick kreclaimd; safe from interrupt context */
+void reclaim_wakeup(void);
+
+/* Pages the shrinkers report as reclaimable */
+uint64_t reclaimable_pages(void);
+
+void reclaim_print_stats(void);
+
+#endif /* _RECLAIM_H */
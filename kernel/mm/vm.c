@@ -1,7 +1,10 @@
 #include "vm.h"
 #include "mm.h"
+#include "mmap.h"
 #include "../printf.h"
 #include "../riscv.h"
+#include "../lib/string.h"
+#include "../fdt.h"
 
 pagetable_t kernel_pagetable;
 
@@ -11,7 +14,63 @@ void vm_init(void) {
     kvminit();
 }
 
-/* Create the kernel's page table */
+#define MEGAPAGE (PGSIZE * 512)
+
+/* Identity-map [start, end), with 2 MB megapages where alignment allows.
+ * Nothing walks the kernel page table in software, so leaves may sit at
+ * either level. */
+static void kvmmap_ram(uint64_t start, uint64_t end, int perm) {
+    uint64_t a = PGROUNDDOWN(start);
+    end = PGROUNDUP(end);
+    while (a < end) {
+        if ((a & (MEGAPAGE - 1)) == 0 && end - a >= MEGAPAGE) {
+            pte_t *l2 = &kernel_pagetable[PX(2, a)];
+            if (!PTE_VALID(*l2)) {
+                pagetable_t l1 = (pagetable_t)alloc_page();
+                if (l1 == NULL) {
+                    panic("kvminit: out of page tables");
+                }
+                *l2 = PA2PTE(l1) | PTE_V;
+            }
+            pte_t *pte = &((pagetable_t)PTE2PA(*l2))[PX(1, a)];
+            if (PTE_VALID(*pte)) {
+                panic("kvminit: remap");
+            }
+            *pte = PA2PTE(a) | perm | PTE_V;
+            a += MEGAPAGE;
+            continue;
+        }
+        uint64_t next = (a + MEGAPAGE) & ~(uint64_t)(MEGAPAGE - 1);
+        if (next > end) {
+            next = end;
+        }
+        if (mappages(kernel_pagetable, a, next - a, a, perm) != 0) {
+            panic("kvminit: mappages failed for RAM");
+        }
+        a = next;
+    }
+}
+
+/* Identity-map a device's registers, which may share a page with one
+ * mapped already */
+static void kvmmap_mmio(const mmio_dev_t *dev, uint64_t min_size) {
+    uint64_t size = dev->size > min_size ? dev->size : min_size;
+    if (dev->base == 0 && dev->size == 0) {
+        return;
+    }
+    for (uint64_t a = PGROUNDDOWN(dev->base); a < dev->base + size; a += PGSIZE) {
+        pte_t *pte = walk(kernel_pagetable, a, 0);
+        if (pte != NULL && PTE_VALID(*pte)) {
+            continue;
+        }
+        if (mappages(kernel_pagetable, a, PGSIZE, a, PTE_R | PTE_W) != 0) {
+            panic("kvminit: mappages failed for MMIO");
+        }
+    }
+}
+
+/* Create the kernel's page table: all RAM and the devices in the
+ * machine description, identity mapped */
 void kvminit(void) {
     kernel_pagetable = (pagetable_t)alloc_page();
     
@@ -21,29 +80,17 @@ void kvminit(void) {
     
     printf("[VM] Created kernel page table at %p\n", kernel_pagetable);
     
-    /* Map kernel text and data (identity mapping) */
-    /* QEMU virt machine: kernel loaded at 0x80000000 */
-    if (mappages(kernel_pagetable, KERNBASE, PHYSTOP - KERNBASE, 
-                 KERNBASE, PTE_R | PTE_W | PTE_X) != 0) {
-        panic("kvminit: mappages failed for kernel");
-    }
-    
-    /* Map UART (0x10000000) */
-    if (mappages(kernel_pagetable, 0x10000000, PGSIZE,
-                 0x10000000, PTE_R | PTE_W) != 0) {
-        panic("kvminit: mappages failed for UART");
+    for (int i = 0; i < machine.nr_ram; i++) {
+        kvmmap_ram(machine.ram[i].start, machine.ram[i].end, PTE_R | PTE_W | PTE_X);
     }
     
-    /* Map PLIC (0x0C000000 - 0x10000000) */
-    if (mappages(kernel_pagetable, 0x0C000000, 0x4000000,
-                 0x0C000000, PTE_R | PTE_W) != 0) {
-        panic("kvminit: mappages failed for PLIC");
-    }
-    
-    /* Map CLINT (0x02000000) */
-    if (mappages(kernel_pagetable, 0x02000000, 0x10000,
-                 0x02000000, PTE_R | PTE_W) != 0) {
-        panic("kvminit: mappages failed for CLINT");
+    kvmmap_mmio(&machine.uart, PGSIZE);
+    kvmmap_mmio(&machine.rtc, PGSIZE);
+    kvmmap_mmio(&machine.test, PGSIZE);
+    kvmmap_mmio(&machine.plic, 0x4000000);
+    kvmmap_mmio(&machine.clint, 0x10000);
+    for (int i = 0; i < machine.nr_virtio; i++) {
+        kvmmap_mmio(&machine.virtio[i], PGSIZE);
     }
     
     printf("[VM] Kernel page table initialized\n");
@@ -124,24 +171,34 @@ int mappages(pagetable_t pagetable, uint64_t va, uint64_t size, uint64_t pa, int
     return 0;
 }
 
-/* Remove mappings from the page table */
-void unmappages(pagetable_t pagetable, uint64_t va, uint64_t size) {
+/* Remove mappings from the page table. Fails, leaving every mapping in
+ * place, if a page in the range is pinned. */
+int unmappages(pagetable_t pagetable, uint64_t va, uint64_t size) {
     uint64_t a, last;
     pte_t *pte;
     
     if (size == 0) {
-        return;
+        return 0;
     }
     
     a = (va / PGSIZE) * PGSIZE;
     last = ((va + size - 1) / PGSIZE) * PGSIZE;
     
-    for (;;) {
-        pte = walk(pagetable, a, 0);
+    for (uint64_t b = a;; b += PGSIZE) {
+        pte = walk(pagetable, b, 0);
         if (pte == NULL || !PTE_VALID(*pte)) {
             panic("unmappages: not mapped");
         }
-        
+        if (PTE_PINS(*pte) != 0) {
+            return -1;
+        }
+        if (b == last) {
+            break;
+        }
+    }
+    
+    for (;;) {
+        pte = walk(pagetable, a, 0);
         *pte = 0;
         
         if (a == last) {
@@ -150,6 +207,8 @@ void unmappages(pagetable_t pagetable, uint64_t va, uint64_t size) {
         
         a += PGSIZE;
     }
+    
+    return 0;
 }
 
 /* Look up a virtual address, return the physical address */
@@ -170,6 +229,167 @@ uint64_t walkaddr(pagetable_t pagetable, uint64_t va) {
     return pa;
 }
 
+/* The PTE of a user page that allows access (a PROT_* bit), faulting in a
+ * file page that mmap left to be populated on first touch. Sets A, and D
+ * for writes, since kernel stores through the direct map bypass them.
+ * NULL if the task may not access va that way. */
+static pte_t *user_pte(pagetable_t pagetable, uint64_t va, int access) {
+    if (va >= MAXVA) {
+        return NULL;
+    }
+    
+    for (int tries = 0; tries < 2; tries++) {
+        pte_t *pte = walk(pagetable, va, 0);
+        if (pte != NULL && PTE_VALID(*pte) && (*pte & PTE_U) &&
+            (access != PROT_WRITE || (*pte & PTE_W))) {
+            *pte |= PTE_A | ((access == PROT_WRITE) ? PTE_D : 0);
+            return pte;
+        }
+        if (tries == 0 && mmap_fault_pt(pagetable, va, access) != 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Copy from user virtual address srcva to kernel buffer dst */
+int copyin(pagetable_t pagetable, void *dst, uint64_t srcva, uint64_t len) {
+    uint8_t *d = (uint8_t*)dst;
+    
+    while (len > 0) {
+        uint64_t va0 = PGROUNDDOWN(srcva);
+        pte_t *pte = user_pte(pagetable, va0, PROT_READ);
+        if (pte == NULL) {
+            return -1;
+        }
+        uint64_t pa0 = PTE2PA(*pte);
+        
+        uint64_t n = PGSIZE - (srcva - va0);
+        if (n > len) {
+            n = len;
+        }
+        memcpy(d, (void*)(pa0 + (srcva - va0)), n);
+        
+        len -= n;
+        d += n;
+        srcva = va0 + PGSIZE;
+    }
+    
+    return 0;
+}
+
+/* Copy from kernel buffer src to user virtual address dstva */
+int copyout(pagetable_t pagetable, uint64_t dstva, const void *src, uint64_t len) {
+    const uint8_t *s = (const uint8_t*)src;
+    
+    while (len > 0) {
+        uint64_t va0 = PGROUNDDOWN(dstva);
+        pte_t *pte = user_pte(pagetable, va0, PROT_WRITE);
+        if (pte == NULL) {
+            return -1;
+        }
+        
+        uint64_t n = PGSIZE - (dstva - va0);
+        if (n > len) {
+            n = len;
+        }
+        memcpy((void*)(PTE2PA(*pte) + (dstva - va0)), s, n);
+        
+        len -= n;
+        s += n;
+        dstva = va0 + PGSIZE;
+    }
+    
+    return 0;
+}
+
+/* Copy a NUL-terminated string of at most max bytes from user space */
+int copyinstr(pagetable_t pagetable, char *dst, uint64_t srcva, uint64_t max) {
+    while (max > 0) {
+        uint64_t va0 = PGROUNDDOWN(srcva);
+        pte_t *pte = user_pte(pagetable, va0, PROT_READ);
+        if (pte == NULL) {
+            return -1;
+        }
+        uint64_t pa0 = PTE2PA(*pte);
+        
+        uint64_t n = PGSIZE - (srcva - va0);
+        if (n > max) {
+            n = max;
+        }
+        
+        const char *p = (const char*)(pa0 + (srcva - va0));
+        for (uint64_t i = 0; i < n; i++) {
+            *dst = p[i];
+            if (p[i] == '\0') {
+                return 0;
+            }
+            dst++;
+        }
+        
+        max -= n;
+        srcva = va0 + PGSIZE;
+    }
+    
+    return -1;  /* No terminator within max bytes */
+}
+
+/* Drop one pin from each page in [va, va + len) */
+void vm_unpin_user(pagetable_t pagetable, uint64_t va, uint64_t len) {
+    if (len == 0) {
+        return;
+    }
+    
+    uint64_t a = PGROUNDDOWN(va);
+    uint64_t last = PGROUNDDOWN(va + len - 1);
+    
+    for (;;) {
+        pte_t *pte = walk(pagetable, a, 0);
+        if (pte != NULL && PTE_VALID(*pte) && PTE_PINS(*pte) != 0) {
+            *pte -= (1UL << PTE_PIN_SHIFT);
+        }
+        if (a == last) {
+            break;
+        }
+        a += PGSIZE;
+    }
+}
+
+/* Pin every user page in [va, va + len) and report its physical address */
+int vm_pin_user(pagetable_t pagetable, uint64_t va, uint64_t len, int write,
+                uint64_t *pas, int max_pages) {
+    if (len == 0) {
+        return 0;
+    }
+    
+    uint64_t a = PGROUNDDOWN(va);
+    uint64_t last = PGROUNDDOWN(va + len - 1);
+    int n = 0;
+    
+    for (;;) {
+        /* A device writing the page is a store the MMU never sees */
+        pte_t *pte = (n < max_pages) ?
+            user_pte(pagetable, a, write ? PROT_WRITE : PROT_READ) : NULL;
+        if (pte == NULL || PTE_PINS(*pte) >= PTE_PIN_MAX) {
+            /* Undo the pins taken so far */
+            if (n > 0) {
+                vm_unpin_user(pagetable, PGROUNDDOWN(va), a - PGROUNDDOWN(va));
+            }
+            return -1;
+        }
+        
+        *pte += (1UL << PTE_PIN_SHIFT);
+        pas[n++] = PTE2PA(*pte);
+        
+        if (a == last) {
+            break;
+        }
+        a += PGSIZE;
+    }
+    
+    return n;
+}
+
 /* Translate physical address to virtual (identity mapping for kernel) */
 void *pa2va(uint64_t pa) {
     return (void*)pa;
@@ -10,8 +10,7 @@
 
 /* Virtual address space layout */
 #define MAXVA (1UL << (9 + 9 + 9 + 12 - 1))  /* 256GB (half of 512GB space) */
-#define KERNBASE 0x80000000UL
-#define PHYSTOP (KERNBASE + 128*1024*1024)  /* 128MB physical memory */
+#define KERNBASE 0x80000000UL   /* RAM itself comes from the device tree */
 
 /* Page table entry (PTE) fields */
 #define PTE_V    (1UL << 0)  /* Valid */
@@ -23,12 +22,22 @@
 #define PTE_A    (1UL << 6)  /* Accessed */
 #define PTE_D    (1UL << 7)  /* Dirty */
 
+/* Software pin count kept in the two RSW bits (8-9) of a leaf PTE */
+#define PTE_PIN_SHIFT 8
+#define PTE_PIN_MASK  (3UL << PTE_PIN_SHIFT)
+#define PTE_PIN_MAX   3
+#define PTE_PINS(pte) (((pte) & PTE_PIN_MASK) >> PTE_PIN_SHIFT)
+
 /* Page table entry flags */
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 #define PA2PTE(pa) ((((uint64_t)pa) >> 12) << 10)
 #define PTE2PA(pte) (((pte) >> 10) << 12)
 #define PTE_VALID(pte) ((pte) & PTE_V)
 
+/* Page rounding */
+#define PGROUNDUP(a) (((a) + PGSIZE - 1) & ~(PGSIZE - 1))
+#define PGROUNDDOWN(a) ((a) & ~(PGSIZE - 1))
+
 /* Extract the three 9-bit page table indices from a virtual address */
 #define PXMASK 0x1FF  /* 9 bits */
 #define PXSHIFT(level) (PGSHIFT + (9 * (level)))
@@ -47,9 +56,20 @@ void vm_free(pagetable_t pagetable);
 /* Page table manipulation */
 pte_t *walk(pagetable_t pagetable, uint64_t va, int alloc);
 int mappages(pagetable_t pagetable, uint64_t va, uint64_t size, uint64_t pa, int perm);
-void unmappages(pagetable_t pagetable, uint64_t va, uint64_t size);
+int unmappages(pagetable_t pagetable, uint64_t va, uint64_t size);
 uint64_t walkaddr(pagetable_t pagetable, uint64_t va);
 
+/* Copy between kernel memory and a user address space */
+int copyin(pagetable_t pagetable, void *dst, uint64_t srcva, uint64_t len);
+int copyout(pagetable_t pagetable, uint64_t dstva, const void *src, uint64_t len);
+int copyinstr(pagetable_t pagetable, char *dst, uint64_t srcva, uint64_t max);
+
+/* Pin user pages so a driver can transfer straight into them.
+ * Fills pas[] with one physical address per page, returns the page count. */
+int vm_pin_user(pagetable_t pagetable, uint64_t va, uint64_t len, int write,
+                uint64_t *pas, int max_pages);
+void vm_unpin_user(pagetable_t pagetable, uint64_t va, uint64_t len);
+
 /* Address translation */
 void *pa2va(uint64_t pa);
 uint64_t va2pa(pagetable_t pagetable, uint64_t va);
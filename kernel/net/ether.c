@@ -0,0 +1,334 @@
+#include "net.h"
+#include "ip.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../lib/string.h"
+#include "../sync/spinlock.h"
+#include "../process/scheduler.h"
+#include "../process/workqueue.h"
+
+/* Ethernet framing, ARP and loopback */
+
+#define ARP_TABLE_SIZE  16
+#define ARP_PENDING_MAX 8          /* Packets held per unresolved entry */
+#define ARP_RETRY_NS    1000000000UL
+
+#define ARP_HLEN        28
+#define ARP_OP_REQUEST  1
+#define ARP_OP_REPLY    2
+
+typedef enum { ARP_FREE, ARP_PENDING, ARP_RESOLVED } arp_state_t;
+
+typedef struct arp_entry {
+    uint32_t addr;
+    uint8_t mac[ETH_ALEN];
+    arp_state_t state;
+    uint64_t stamp;            /* Request sent / reply seen (time CSR) */
+    netbuf_t *pending;         /* Waiting for the reply, oldest first */
+    int npending;
+} arp_entry_t;
+
+net_stats_t net_stats;
+
+static arp_entry_t arp_table[ARP_TABLE_SIZE];
+static spinlock_t arp_lock;
+
+static const uint8_t eth_broadcast[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+/* Packets to our own address; fed back in from a work item so that
+ * receive processing always runs in worker context */
+static netbuf_t *lo_head, *lo_tail;
+static spinlock_t lo_lock;
+static work_t lo_work;
+
+/* Prepend the Ethernet header and queue the frame */
+static void eth_output(net_batch_t *b, netbuf_t *nb, const uint8_t *dst, uint16_t type) {
+    uint8_t *h = netbuf_push(nb, ETH_HLEN);
+    memcpy(h, dst, ETH_ALEN);
+    virtio_net_mac(h + ETH_ALEN);
+    put16(h + 12, type);
+    
+    nb->next = NULL;
+    if (b->tail) {
+        b->tail->next = nb;
+    } else {
+        b->head = nb;
+    }
+    b->tail = nb;
+}
+
+void net_tx_flush(net_batch_t *b) {
+    if (b->head) {
+        virtio_net_send_list(b->head);
+    }
+    net_batch_init(b);
+}
+
+static void arp_send(net_batch_t *b, uint16_t op, const uint8_t *tha, uint32_t tpa) {
+    netbuf_t *nb = netbuf_alloc();
+    if (nb == NULL) {
+        return;
+    }
+    uint8_t *a = nb->data;
+    put16(a, 1);                       /* Ethernet */
+    put16(a + 2, ETH_P_IP);
+    a[4] = ETH_ALEN;
+    a[5] = 4;
+    put16(a + 6, op);
+    virtio_net_mac(a + 8);
+    put32(a + 14, net_local_addr());
+    memcpy(a + 18, tha ? tha : (const uint8_t*)"\0\0\0\0\0\0", ETH_ALEN);
+    put32(a + 24, tpa);
+    /* Pad to the 60-byte Ethernet minimum */
+    memset(a + ARP_HLEN, 0, 60 - ETH_HLEN - ARP_HLEN);
+    nb->len = 60 - ETH_HLEN;
+    
+    if (op == ARP_OP_REQUEST) {
+        net_stats.arp_requests++;
+    }
+    eth_output(b, nb, tha ? tha : eth_broadcast, ETH_P_ARP);
+}
+
+/* Entry for addr, or a free / least recently used one to recycle;
+ * arp_lock held */
+static arp_entry_t *arp_slot(uint32_t addr, int create) {
+    arp_entry_t *victim = NULL;
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        arp_entry_t *e = &arp_table[i];
+        if (e->state != ARP_FREE && e->addr == addr) {
+            return e;
+        }
+        if (e->state == ARP_FREE) {
+            if (victim == NULL || victim->state != ARP_FREE) {
+                victim = e;
+            }
+        } else if (victim == NULL ||
+                   (victim->state != ARP_FREE && e->stamp < victim->stamp)) {
+            victim = e;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    
+    while (victim->pending) {
+        netbuf_t *nb = victim->pending;
+        victim->pending = nb->next;
+        net_stats.arp_unresolved++;
+        netbuf_free(nb);
+    }
+    victim->addr = addr;
+    victim->state = ARP_PENDING;
+    victim->stamp = 0;
+    victim->npending = 0;
+    return victim;
+}
+
+/* Send a request if none went out recently; arp_lock held */
+static void arp_maybe_request(net_batch_t *b, arp_entry_t *e) {
+    uint64_t now = r_time();
+    if (e->stamp == 0 || time_to_ns(now - e->stamp) >= ARP_RETRY_NS) {
+        e->stamp = now;
+        arp_send(b, ARP_OP_REQUEST, NULL, e->addr);
+    }
+}
+
+static void loopback_input(work_t *w) {
+    (void)w;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&lo_lock);
+        netbuf_t *nb = lo_head;
+        if (nb) {
+            lo_head = nb->next;
+            if (lo_head == NULL) {
+                lo_tail = NULL;
+            }
+        }
+        spin_unlock_irqrestore(&lo_lock, flags);
+        if (nb == NULL) {
+            break;
+        }
+        nb->next = NULL;
+        ip_input(nb);
+    }
+}
+
+void arp_output(net_batch_t *b, netbuf_t *nb, uint32_t nexthop) {
+    if (nexthop == net_local_addr()) {
+        net_stats.ip_loopback++;
+        nb->next = NULL;
+        uint64_t flags = spin_lock_irqsave(&lo_lock);
+        if (lo_tail) {
+            lo_tail->next = nb;
+        } else {
+            lo_head = nb;
+        }
+        lo_tail = nb;
+        spin_unlock_irqrestore(&lo_lock, flags);
+        queue_work(&lo_work);
+        return;
+    }
+    if (!virtio_net_present()) {
+        netbuf_free(nb);
+        return;
+    }
+    if (nexthop == 0xFFFFFFFF) {
+        eth_output(b, nb, eth_broadcast, ETH_P_IP);
+        return;
+    }
+    
+    uint64_t flags = spin_lock_irqsave(&arp_lock);
+    arp_entry_t *e = arp_slot(nexthop, 1);
+    if (e->state == ARP_RESOLVED) {
+        eth_output(b, nb, e->mac, ETH_P_IP);
+    } else if (e->npending < ARP_PENDING_MAX) {
+        /* Hold the packet until the reply arrives */
+        nb->next = NULL;
+        netbuf_t **tail = &e->pending;
+        while (*tail) {
+            tail = &(*tail)->next;
+        }
+        *tail = nb;
+        e->npending++;
+        arp_maybe_request(b, e);
+    } else {
+        net_stats.arp_unresolved++;
+        arp_maybe_request(b, e);
+        nb->next = NULL;
+        spin_unlock_irqrestore(&arp_lock, flags);
+        netbuf_free(nb);
+        return;
+    }
+    spin_unlock_irqrestore(&arp_lock, flags);
+}
+
+void arp_input(netbuf_t *nb) {
+    uint8_t *a = nb->data;
+    net_stats.arp_in++;
+    if (nb->len < ARP_HLEN || get16(a) != 1 || get16(a + 2) != ETH_P_IP ||
+        a[4] != ETH_ALEN || a[5] != 4) {
+        netbuf_free(nb);
+        return;
+    }
+    uint16_t op = get16(a + 6);
+    uint8_t sha[ETH_ALEN];
+    memcpy(sha, a + 8, ETH_ALEN);
+    uint32_t spa = get32(a + 14);
+    uint32_t tpa = get32(a + 24);
+    netbuf_free(nb);
+    
+    net_batch_t b;
+    net_batch_init(&b);
+    uint64_t flags = spin_lock_irqsave(&arp_lock);
+    /* Learn the sender if we were waiting for it or are its target */
+    arp_entry_t *e = arp_slot(spa, tpa == net_local_addr());
+    if (e != NULL) {
+        memcpy(e->mac, sha, ETH_ALEN);
+        e->state = ARP_RESOLVED;
+        e->stamp = r_time();
+        while (e->pending) {
+            netbuf_t *p = e->pending;
+            e->pending = p->next;
+            eth_output(&b, p, e->mac, ETH_P_IP);
+        }
+        e->npending = 0;
+    }
+    if (op == ARP_OP_REQUEST && tpa == net_local_addr()) {
+        arp_send(&b, ARP_OP_REPLY, sha, spa);
+    }
+    spin_unlock_irqrestore(&arp_lock, flags);
+    net_tx_flush(&b);
+}
+
+int arp_resolve(uint32_t addr, uint8_t mac[ETH_ALEN], uint64_t timeout_ns) {
+    uint64_t start = r_time();
+    for (;;) {
+        net_batch_t b;
+        net_batch_init(&b);
+        uint64_t flags = spin_lock_irqsave(&arp_lock);
+        arp_entry_t *e = arp_slot(addr, 1);
+        if (e->state == ARP_RESOLVED) {
+            memcpy(mac, e->mac, ETH_ALEN);
+            spin_unlock_irqrestore(&arp_lock, flags);
+            return 0;
+        }
+        arp_maybe_request(&b, e);
+        spin_unlock_irqrestore(&arp_lock, flags);
+        net_tx_flush(&b);
+        
+        if (!virtio_net_present() || time_to_ns(r_time() - start) >= timeout_ns) {
+            return -1;
+        }
+        sched_yield();
+    }
+}
+
+/* Driver RX handler: one frame, in the poll worker */
+static void net_rx(netbuf_t *nb) {
+    net_stats.rx_frames++;
+    if (nb->len < ETH_HLEN) {
+        netbuf_free(nb);
+        return;
+    }
+    uint16_t type = get16(nb->data + 12);
+    netbuf_pull(nb, ETH_HLEN);
+    if (type == ETH_P_IP) {
+        ip_input(nb);
+    } else if (type == ETH_P_ARP) {
+        arp_input(nb);
+    } else {
+        net_stats.rx_unknown++;
+        netbuf_free(nb);
+    }
+}
+
+void arp_init(void) {
+    spin_init(&arp_lock, "arp");
+    spin_init(&lo_lock, "loopback");
+    work_init(&lo_work, loopback_input, NULL);
+}
+
+void arp_print(void) {
+    uint64_t flags = spin_lock_irqsave(&arp_lock);
+    for (int i = 0; i < ARP_TABLE_SIZE; i++) {
+        arp_entry_t *e = &arp_table[i];
+        if (e->state == ARP_RESOLVED) {
+            printf("  %u.%u.%u.%u at %02x:%02x:%02x:%02x:%02x:%02x\n",
+                   e->addr >> 24, (e->addr >> 16) & 0xff, (e->addr >> 8) & 0xff,
+                   e->addr & 0xff, e->mac[0], e->mac[1], e->mac[2], e->mac[3],
+                   e->mac[4], e->mac[5]);
+        } else if (e->state == ARP_PENDING) {
+            printf("  %u.%u.%u.%u incomplete (%d queued)\n",
+                   e->addr >> 24, (e->addr >> 16) & 0xff, (e->addr >> 8) & 0xff,
+                   e->addr & 0xff, e->npending);
+        }
+    }
+    spin_unlock_irqrestore(&arp_lock, flags);
+}
+
+uint32_t net_local_addr(void) {
+    return NET_ADDR;
+}
+
+void net_init(void) {
+    arp_init();
+    udp_init();
+    virtio_net_set_rx_handler(net_rx);
+    printf("[NET] IPv4 %u.%u.%u.%u/24, gateway %u.%u.%u.%u\n",
+           NET_ADDR >> 24, (NET_ADDR >> 16) & 0xff, (NET_ADDR >> 8) & 0xff,
+           NET_ADDR & 0xff, NET_GATEWAY >> 24, (NET_GATEWAY >> 16) & 0xff,
+           (NET_GATEWAY >> 8) & 0xff, NET_GATEWAY & 0xff);
+}
+
+void net_print_stats(void) {
+    net_stats_t *s = &net_stats;
+    printf("[NET] Ethernet: %u frames in, %u unknown type\n", s->rx_frames, s->rx_unknown);
+    printf("  ARP: %u in, %u requests sent, %u packets dropped unresolved\n",
+           s->arp_in, s->arp_requests, s->arp_unresolved);
+    printf("  IP:  %u in, %u bad, %u not for us, %u out, %u loopback\n",
+           s->ip_in, s->ip_bad, s->ip_not_local, s->ip_out, s->ip_loopback);
+    printf("  UDP: %u in, %u bad, %u no port, %u out\n",
+           s->udp_in, s->udp_bad, s->udp_no_port, s->udp_out);
+    printf("  ARP cache:\n");
+    arp_print();
+}
@@ -0,0 +1,90 @@
+#include "net.h"
+#include "ip.h"
+#include "../lib/string.h"
+#include "../lib/checksum.h"
+
+/* IPv4 input and output. Fragments and options are not supported. */
+
+#define IP_TTL   64
+#define IP_DF    0x4000
+#define IP_MF    0x2000
+#define IP_OFFSET_MASK 0x1FFF
+
+static uint16_t ip_id = 0;
+
+static int ip_is_local(uint32_t dst) {
+    uint32_t local = net_local_addr();
+    return dst == local || (dst >> 24) == 127 || dst == 0xFFFFFFFF ||
+           dst == ((local & NET_NETMASK) | ~NET_NETMASK);
+}
+
+void ip_input(netbuf_t *nb) {
+    uint8_t *h = nb->data;
+    net_stats.ip_in++;
+    
+    if (nb->len < IP_HLEN || (h[0] >> 4) != 4) {
+        goto bad;
+    }
+    uint32_t hlen = (h[0] & 0xF) * 4;
+    uint32_t total = get16(h + 2);
+    if (hlen < IP_HLEN || total < hlen || total > nb->len ||
+        ip_checksum(h, hlen) != 0) {
+        goto bad;
+    }
+    if (get16(h + 6) & (IP_MF | IP_OFFSET_MASK)) {
+        goto bad;  /* Fragment */
+    }
+    
+    uint32_t src = get32(h + 12);
+    uint32_t dst = get32(h + 16);
+    if (!ip_is_local(dst)) {
+        net_stats.ip_not_local++;
+        netbuf_free(nb);
+        return;
+    }
+    
+    /* Drop Ethernet padding past the IP payload */
+    nb->len = total;
+    uint8_t proto = h[9];
+    netbuf_pull(nb, hlen);
+    if (proto == IPPROTO_UDP) {
+        udp_input(nb, src, dst);
+        return;
+    }
+    netbuf_free(nb);
+    return;
+    
+bad:
+    net_stats.ip_bad++;
+    netbuf_free(nb);
+}
+
+void ip_output(net_batch_t *b, netbuf_t *nb, uint32_t dst, uint8_t proto) {
+    uint32_t local = net_local_addr();
+    uint8_t *h = netbuf_push(nb, IP_HLEN);
+    
+    h[0] = 0x45;               /* Version 4, 5 words */
+    h[1] = 0;
+    put16(h + 2, (uint16_t)nb->len);
+    put16(h + 4, __atomic_fetch_add(&ip_id, 1, __ATOMIC_RELAXED));
+    put16(h + 6, IP_DF);
+    h[8] = IP_TTL;
+    h[9] = proto;
+    put16(h + 10, 0);
+    put32(h + 12, local);
+    put32(h + 16, dst);
+    uint16_t csum = ip_checksum(h, IP_HLEN);
+    memcpy(h + 10, &csum, sizeof(csum));
+    net_stats.ip_out++;
+    
+    /* Route: ourselves, the local subnet directly, the rest via the gateway */
+    uint32_t nexthop;
+    if (dst == local || (dst >> 24) == 127) {
+        nexthop = local;
+    } else if (dst == 0xFFFFFFFF || (dst & NET_NETMASK) == (local & NET_NETMASK)) {
+        nexthop = dst;
+    } else {
+        nexthop = NET_GATEWAY;
+    }
+    arp_output(b, nb, nexthop);
+}
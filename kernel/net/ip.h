@@ -0,0 +1,91 @@
+#ifndef _NET_IP_H
+#define _NET_IP_H
+
+#include "../types.h"
+#include "../../drivers/virtio/virtio_net.h"
+
+/* Stack internals shared by ether.c, ip.c and udp.c */
+
+#define ETH_HLEN   14
+#define ETH_P_IP   0x0800
+#define ETH_P_ARP  0x0806
+#define IP_HLEN    20
+#define UDP_HLEN   8
+#define IPPROTO_UDP 17
+
+/* Headers in received frames are only 2-byte aligned, so fields are
+ * accessed bytewise in network order */
+static inline uint16_t get16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/* Frames for the device, sent together by net_tx_flush() */
+typedef struct net_batch {
+    netbuf_t *head;
+    netbuf_t *tail;
+} net_batch_t;
+
+static inline void net_batch_init(net_batch_t *b) {
+    b->head = NULL;
+    b->tail = NULL;
+}
+
+void net_tx_flush(net_batch_t *b);
+
+/* Counters, bumped without locks (approximate under SMP) */
+typedef struct net_stats {
+    uint64_t rx_frames;
+    uint64_t rx_unknown;       /* Not IPv4 or ARP */
+    uint64_t arp_in;
+    uint64_t arp_requests;     /* Sent */
+    uint64_t arp_unresolved;   /* Packets dropped waiting for ARP */
+    uint64_t ip_in;
+    uint64_t ip_bad;           /* Malformed, bad checksum, fragment */
+    uint64_t ip_not_local;
+    uint64_t ip_out;
+    uint64_t ip_loopback;
+    uint64_t udp_in;
+    uint64_t udp_bad;
+    uint64_t udp_no_port;
+    uint64_t udp_out;
+} net_stats_t;
+
+extern net_stats_t net_stats;
+
+/* nb->data at the ARP header */
+void arp_input(netbuf_t *nb);
+
+/* Send the IP packet at nb->data to nexthop, resolving its MAC first;
+ * the frame is appended to b. Takes nb. */
+void arp_output(net_batch_t *b, netbuf_t *nb, uint32_t nexthop);
+void arp_init(void);
+void arp_print(void);
+
+/* nb->data at the IP header */
+void ip_input(netbuf_t *nb);
+
+/* Prepend an IP header to the payload at nb->data and route it; takes nb */
+void ip_output(net_batch_t *b, netbuf_t *nb, uint32_t dst, uint8_t proto);
+
+/* nb->data at the UDP header */
+void udp_input(netbuf_t *nb, uint32_t src, uint32_t dst);
+void udp_init(void);
+
+#endif /* _NET_IP_H */
@@ -0,0 +1,64 @@
+#ifndef _NET_H
+#define _NET_H
+
+#include "../types.h"
+#include "../fs/vfs.h"
+#include "../mm/vm.h"
+
+/* Minimal IPv4 stack: ARP, IPv4 (no fragments, no options on output) and
+ * UDP over virtio-net. Addresses are host-order uint32_t.
+ *
+ * UDP sockets are VFS files: vfs_open("/udp", 0) makes an unbound socket,
+ * vfs_write() sends one datagram to the connected peer and vfs_read()
+ * returns one datagram. Received frames go from the driver's RX page
+ * straight into a lock-free per-socket ring; the reader copies the
+ * payload out and hands the page back. */
+
+/* QEMU user-mode networking defaults */
+#define NET_ADDR    0x0A00020F   /* 10.0.2.15 */
+#define NET_NETMASK 0xFFFFFF00
+#define NET_GATEWAY 0x0A000202   /* 10.0.2.2 */
+
+#define NET_IP(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+/* Largest UDP payload that fits one frame */
+#define UDP_MAX_PAYLOAD (1500 - 20 - 8)
+
+/* One datagram for udp_sendmmsg/udp_recvmmsg */
+typedef struct net_msg {
+    void *buf;
+    uint32_t len;              /* Payload / buffer size; received length */
+    uint32_t addr;             /* Peer address (send: 0 = connected peer) */
+    uint16_t port;             /* Peer port */
+    uint16_t flags;            /* NET_MSG_TRUNC on receive */
+} net_msg_t;
+
+#define NET_MSG_TRUNC    1     /* Datagram was longer than the buffer */
+#define NET_MSG_DONTWAIT 1     /* recvmmsg: return 0 instead of blocking */
+
+/* Most messages per sendmmsg/recvmmsg call */
+#define NET_MMSG_MAX 64
+
+/* Bring up the stack and register /udp; works without a NIC (loopback) */
+void net_init(void);
+
+uint32_t net_local_addr(void);
+
+/* Socket calls; 0 or a count on success, -1 on error. Port 0 binds an
+ * ephemeral port. Buffers are user addresses in pt, or kernel pointers
+ * if pt is NULL. */
+int udp_bind(file_t *file, uint16_t port);
+int udp_connect(file_t *file, uint32_t addr, uint16_t port);
+int udp_sendmmsg(file_t *file, net_msg_t *msgs, int n, pagetable_t pt);
+
+/* Block for the first datagram (unless NET_MSG_DONTWAIT), then take
+ * whatever else is already queued, up to n */
+int udp_recvmmsg(file_t *file, net_msg_t *msgs, int n, int flags, pagetable_t pt);
+
+/* Resolve addr with ARP, waiting up to timeout_ns; 0 and the MAC on success */
+int arp_resolve(uint32_t addr, uint8_t mac[6], uint64_t timeout_ns);
+
+void net_print_stats(void);
+
+#endif /* _NET_H */
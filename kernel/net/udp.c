@@ -0,0 +1,408 @@
+#include "net.h"
+#include "ip.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../lib/string.h"
+#include "../lib/checksum.h"
+#include "../mm/mm.h"
+#include "../sync/spinlock.h"
+#include "../sync/rcu.h"
+#include "../process/scheduler.h"
+
+/* UDP sockets. Each socket is one page: the header below, then a bounded
+ * lock-free ring (Vyukov's per-cell sequence scheme) of received
+ * netbufs. Producers (the driver's poll worker, loopback) and readers
+ * only ever touch the ring with atomics; a sleeping reader is woken by
+ * whoever fills the ring. */
+
+#define UDP_RING_SIZE   64     /* Power of two */
+#define UDP_HASH_SIZE   64
+#define UDP_EPHEMERAL_MIN 49152
+
+typedef struct udp_cell {
+    uint64_t seq;
+    netbuf_t *nb;
+} udp_cell_t;
+
+typedef struct udp_sock {
+    struct udp_sock *next;     /* Port hash chain (RCU) */
+    rcu_head_t rcu;
+    uint16_t port;             /* Bound local port, 0 if unbound */
+    uint16_t peer_port;
+    uint32_t peer_addr;        /* connect(); 0 if unconnected */
+    process_t *waiter;         /* Reader sleeping on an empty ring */
+    uint64_t rx_dropped;       /* Ring full */
+    /* Producer and consumer positions on their own cache lines */
+    uint64_t enq_pos __attribute__((aligned(64)));
+    uint64_t deq_pos __attribute__((aligned(64)));
+    udp_cell_t ring[UDP_RING_SIZE] __attribute__((aligned(64)));
+} udp_sock_t;
+
+_Static_assert(sizeof(udp_sock_t) <= PAGE_SIZE, "udp socket must fit a page");
+
+static udp_sock_t *udp_hash[UDP_HASH_SIZE];
+static spinlock_t udp_lock;    /* Hash updates and port allocation */
+static uint16_t next_ephemeral = UDP_EPHEMERAL_MIN;
+
+static int ring_push(udp_sock_t *s, netbuf_t *nb) {
+    uint64_t pos = __atomic_load_n(&s->enq_pos, __ATOMIC_RELAXED);
+    udp_cell_t *cell;
+    for (;;) {
+        cell = &s->ring[pos & (UDP_RING_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&s->enq_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;  /* Full */
+        } else {
+            pos = __atomic_load_n(&s->enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->nb = nb;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static netbuf_t *ring_pop(udp_sock_t *s) {
+    uint64_t pos = __atomic_load_n(&s->deq_pos, __ATOMIC_RELAXED);
+    udp_cell_t *cell;
+    for (;;) {
+        cell = &s->ring[pos & (UDP_RING_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&s->deq_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;  /* Empty */
+        } else {
+            pos = __atomic_load_n(&s->deq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    netbuf_t *nb = cell->nb;
+    __atomic_store_n(&cell->seq, pos + UDP_RING_SIZE, __ATOMIC_RELEASE);
+    return nb;
+}
+
+static int ring_empty(udp_sock_t *s) {
+    return __atomic_load_n(&s->enq_pos, __ATOMIC_SEQ_CST) ==
+           __atomic_load_n(&s->deq_pos, __ATOMIC_SEQ_CST);
+}
+
+/* Next datagram, sleeping until one arrives */
+static netbuf_t *sock_wait(udp_sock_t *s) {
+    process_t *p = current_proc();
+    netbuf_t *nb;
+    while ((nb = ring_pop(s)) == NULL) {
+        if (p == NULL || p->policy == SCHED_IDLE) {
+            sched_yield();  /* The idle task cannot sleep: poll */
+            continue;
+        }
+        uint64_t flags = intr_save();
+        __atomic_store_n(&s->waiter, p, __ATOMIC_SEQ_CST);
+        if (ring_empty(s)) {
+            sched_sleep();
+        }
+        __atomic_store_n(&s->waiter, NULL, __ATOMIC_RELAXED);
+        intr_restore(flags);
+    }
+    return nb;
+}
+
+/* Socket bound to port; caller holds rcu_read_lock or udp_lock */
+static udp_sock_t *udp_lookup(uint16_t port) {
+    for (udp_sock_t *s = rcu_dereference(udp_hash[port % UDP_HASH_SIZE]);
+         s != NULL; s = rcu_dereference(s->next)) {
+        if (s->port == port) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* UDP checksum over the pseudo-header and the datagram at udp */
+static uint16_t udp_checksum(uint32_t src, uint32_t dst, const uint8_t *udp, uint32_t len) {
+    uint8_t pseudo[12];
+    put32(pseudo, src);
+    put32(pseudo + 4, dst);
+    pseudo[8] = 0;
+    pseudo[9] = IPPROTO_UDP;
+    put16(pseudo + 10, (uint16_t)len);
+    return csum_fold(csum_partial(udp, len, csum_partial(pseudo, sizeof(pseudo), 0)));
+}
+
+void udp_input(netbuf_t *nb, uint32_t src, uint32_t dst) {
+    uint8_t *h = nb->data;
+    net_stats.udp_in++;
+    
+    uint32_t len = nb->len >= UDP_HLEN ? get16(h + 4) : 0;
+    if (len < UDP_HLEN || len > nb->len) {
+        goto bad;
+    }
+    uint16_t csum;
+    memcpy(&csum, h + 6, sizeof(csum));
+    if (csum != 0 && udp_checksum(src, dst, h, len) != 0) {
+        goto bad;
+    }
+    
+    uint16_t sport = get16(h);
+    uint16_t dport = get16(h + 2);
+    nb->len = len;
+    netbuf_pull(nb, UDP_HLEN);
+    nb->cb[0] = src;
+    nb->cb[1] = sport;
+    
+    rcu_read_lock();
+    udp_sock_t *s = udp_lookup(dport);
+    if (s == NULL) {
+        rcu_read_unlock();
+        net_stats.udp_no_port++;
+        netbuf_free(nb);
+        return;
+    }
+    if (ring_push(s, nb) != 0) {
+        s->rx_dropped++;
+        rcu_read_unlock();
+        netbuf_free(nb);
+        return;
+    }
+    process_t *w = __atomic_load_n(&s->waiter, __ATOMIC_SEQ_CST);
+    if (w != NULL) {
+        sched_wakeup(w);
+    }
+    rcu_read_unlock();
+    return;
+    
+bad:
+    net_stats.udp_bad++;
+    netbuf_free(nb);
+}
+
+static udp_sock_t *sock_of(file_t *file);
+
+/* Bind s to port (0: pick an ephemeral one); udp_lock held */
+static int bind_locked(udp_sock_t *s, uint16_t port) {
+    if (s->port != 0) {
+        return -1;
+    }
+    if (port == 0) {
+        for (int tries = 0; tries < 65536 - UDP_EPHEMERAL_MIN; tries++) {
+            uint16_t p = next_ephemeral++;
+            if (next_ephemeral == 0) {
+                next_ephemeral = UDP_EPHEMERAL_MIN;
+            }
+            if (udp_lookup(p) == NULL) {
+                port = p;
+                break;
+            }
+        }
+        if (port == 0) {
+            return -1;
+        }
+    } else if (udp_lookup(port) != NULL) {
+        return -1;
+    }
+    
+    s->port = port;
+    udp_sock_t **bucket = &udp_hash[port % UDP_HASH_SIZE];
+    s->next = *bucket;
+    rcu_assign_pointer(*bucket, s);
+    return 0;
+}
+
+int udp_bind(file_t *file, uint16_t port) {
+    udp_sock_t *s = sock_of(file);
+    if (s == NULL) {
+        return -1;
+    }
+    uint64_t flags = spin_lock_irqsave(&udp_lock);
+    int ret = bind_locked(s, port);
+    spin_unlock_irqrestore(&udp_lock, flags);
+    return ret;
+}
+
+int udp_connect(file_t *file, uint32_t addr, uint16_t port) {
+    udp_sock_t *s = sock_of(file);
+    if (s == NULL || addr == 0 || port == 0) {
+        return -1;
+    }
+    s->peer_addr = addr;
+    s->peer_port = port;
+    return 0;
+}
+
+int udp_sendmmsg(file_t *file, net_msg_t *msgs, int n, pagetable_t pt) {
+    udp_sock_t *s = sock_of(file);
+    if (s == NULL || n < 0) {
+        return -1;
+    }
+    if (s->port == 0 && udp_bind(file, 0) != 0) {
+        return -1;
+    }
+    
+    /* Build every datagram, then hand the lot to the device at once */
+    net_batch_t b;
+    net_batch_init(&b);
+    int sent = 0;
+    for (; sent < n; sent++) {
+        net_msg_t *m = &msgs[sent];
+        uint32_t dst = m->addr ? m->addr : s->peer_addr;
+        uint16_t dport = m->addr ? m->port : s->peer_port;
+        if (dst == 0 || dport == 0 || m->len > UDP_MAX_PAYLOAD) {
+            break;
+        }
+        netbuf_t *nb = netbuf_alloc();
+        if (nb == NULL) {
+            break;
+        }
+        if (pt != NULL) {
+            if (copyin(pt, nb->data, (uint64_t)m->buf, m->len) != 0) {
+                netbuf_free(nb);
+                break;
+            }
+        } else {
+            memcpy(nb->data, m->buf, m->len);
+        }
+        nb->len = m->len;
+        
+        uint8_t *h = netbuf_push(nb, UDP_HLEN);
+        put16(h, s->port);
+        put16(h + 2, dport);
+        put16(h + 4, (uint16_t)nb->len);
+        put16(h + 6, 0);
+        uint16_t csum = udp_checksum(net_local_addr(), dst, h, nb->len);
+        if (csum == 0) {
+            csum = 0xFFFF;  /* 0 means "no checksum" */
+        }
+        memcpy(h + 6, &csum, sizeof(csum));
+        net_stats.udp_out++;
+        ip_output(&b, nb, dst, IPPROTO_UDP);
+    }
+    net_tx_flush(&b);
+    return sent > 0 || n == 0 ? sent : -1;
+}
+
+int udp_recvmmsg(file_t *file, net_msg_t *msgs, int n, int flags, pagetable_t pt) {
+    udp_sock_t *s = sock_of(file);
+    if (s == NULL || n < 0) {
+        return -1;
+    }
+    
+    int got = 0;
+    while (got < n) {
+        netbuf_t *nb = (got == 0 && !(flags & NET_MSG_DONTWAIT)) ?
+                       sock_wait(s) : ring_pop(s);
+        if (nb == NULL) {
+            break;
+        }
+        net_msg_t *m = &msgs[got];
+        uint32_t len = nb->len;
+        m->flags = 0;
+        if (len > m->len) {
+            len = m->len;
+            m->flags = NET_MSG_TRUNC;
+        }
+        int err = 0;
+        if (pt != NULL) {
+            err = copyout(pt, (uint64_t)m->buf, nb->data, len);
+        } else {
+            memcpy(m->buf, nb->data, len);
+        }
+        m->len = len;
+        m->addr = (uint32_t)nb->cb[0];
+        m->port = (uint16_t)nb->cb[1];
+        netbuf_free(nb);
+        if (err != 0) {
+            return got > 0 ? got : -1;
+        }
+        got++;
+    }
+    return got;
+}
+
+/* /udp device: every open is a new socket */
+
+static int udp_open(inode_t *inode, file_t *file) {
+    (void)file;
+    udp_sock_t *s = (udp_sock_t*)alloc_page();
+    if (s == NULL) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < UDP_RING_SIZE; i++) {
+        s->ring[i].seq = i;
+    }
+    inode->private_data = s;
+    return 0;
+}
+
+static void udp_reclaim(rcu_head_t *head) {
+    udp_sock_t *s = container_of(head, udp_sock_t, rcu);
+    netbuf_t *nb;
+    while ((nb = ring_pop(s)) != NULL) {
+        netbuf_free(nb);
+    }
+    free_page(s);
+}
+
+static int udp_close(file_t *file) {
+    udp_sock_t *s = sock_of(file);
+    if (s == NULL) {
+        return -1;
+    }
+    file->inode->private_data = NULL;
+    
+    /* Unhash now; in-flight deliveries may still push until the grace
+     * period ends, and the ring is drained after it */
+    uint64_t flags = spin_lock_irqsave(&udp_lock);
+    if (s->port != 0) {
+        udp_sock_t **link = &udp_hash[s->port % UDP_HASH_SIZE];
+        while (*link != NULL && *link != s) {
+            link = &(*link)->next;
+        }
+        if (*link == s) {
+            rcu_assign_pointer(*link, s->next);
+        }
+    }
+    spin_unlock_irqrestore(&udp_lock, flags);
+    call_rcu(&s->rcu, udp_reclaim);
+    return 0;
+}
+
+/* One datagram per read, truncated to count */
+static int udp_read(file_t *file, void *buf, size_t count) {
+    net_msg_t m = { .buf = buf, .len = (uint32_t)count };
+    int n = udp_recvmmsg(file, &m, 1, 0, NULL);
+    return n == 1 ? (int)m.len : -1;
+}
+
+/* One datagram per write, to the connected peer */
+static int udp_write(file_t *file, const void *buf, size_t count) {
+    net_msg_t m = { .buf = (void*)buf, .len = (uint32_t)count };
+    int n = udp_sendmmsg(file, &m, 1, NULL);
+    return n == 1 ? (int)count : -1;
+}
+
+static file_ops_t udp_ops = {
+    .open = udp_open,
+    .close = udp_close,
+    .read = udp_read,
+    .write = udp_write,
+};
+
+static udp_sock_t *sock_of(file_t *file) {
+    if (file == NULL || file->inode == NULL || file->inode->ops != &udp_ops) {
+        return NULL;
+    }
+    return (udp_sock_t*)file->inode->private_data;
+}
+
+void udp_init(void) {
+    spin_init(&udp_lock, "udp");
+    vfs_register_device("udp", &udp_ops);
+}
@@ -1,13 +1,11 @@
 #include "printf.h"
 #include "../drivers/uart/uart.h"
 
-typedef __builtin_va_list va_list;
-#define va_start(ap, last) __builtin_va_start(ap, last)
-#define va_arg(ap, type) __builtin_va_arg(ap, type)
-#define va_end(ap) __builtin_va_end(ap)
+/* Output sink for the shared formatter */
+typedef void (*putc_fn)(char c, void *ctx);
 
 /* Helper to print a number in a given base */
-static void print_num(uint64_t num, int base, int width, char pad) {
+static void print_num(putc_fn out, void *ctx, uint64_t num, int base, int width, char pad) {
     char buf[32];
     int i = 0;
     const char *digits = "0123456789abcdef";
@@ -28,14 +26,18 @@ static void print_num(uint64_t num, int base, int width, char pad) {
     
     /* Print in reverse order */
     while (i > 0) {
-        uart_putc(buf[--i]);
+        out(buf[--i], ctx);
     }
 }
 
-void printf(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    
+static void print_str(putc_fn out, void *ctx, const char *s) {
+    while (*s) {
+        out(*s++, ctx);
+    }
+}
+
+/* Formatter shared by printf and vsnprintf */
+static void format(putc_fn out, void *ctx, const char *fmt, va_list args) {
     while (*fmt) {
         if (*fmt == '%') {
             fmt++;
@@ -56,65 +58,135 @@ void printf(const char *fmt, ...) {
                 case 'd': {
                     int64_t num = va_arg(args, int64_t);
                     if (num < 0) {
-                        uart_putc('-');
+                        out('-', ctx);
                         num = -num;
                     }
-                    print_num(num, 10, width, pad);
+                    print_num(out, ctx, num, 10, width, pad);
                     break;
                 }
                 case 'u': {
                     uint64_t num = va_arg(args, uint64_t);
-                    print_num(num, 10, width, pad);
+                    print_num(out, ctx, num, 10, width, pad);
                     break;
                 }
                 case 'x': {
                     uint64_t num = va_arg(args, uint64_t);
-                    print_num(num, 16, width, pad);
+                    print_num(out, ctx, num, 16, width, pad);
                     break;
                 }
                 case 'p': {
-                    uart_puts("0x");
+                    print_str(out, ctx, "0x");
                     uint64_t ptr = (uint64_t)va_arg(args, void*);
-                    print_num(ptr, 16, 16, '0');
+                    print_num(out, ctx, ptr, 16, 16, '0');
                     break;
                 }
                 case 's': {
                     const char *s = va_arg(args, const char*);
-                    if (s) {
-                        uart_puts(s);
-                    } else {
-                        uart_puts("(null)");
-                    }
+                    print_str(out, ctx, s ? s : "(null)");
                     break;
                 }
                 case 'c': {
                     char c = (char)va_arg(args, int);
-                    uart_putc(c);
+                    out(c, ctx);
                     break;
                 }
                 case '%': {
-                    uart_putc('%');
+                    out('%', ctx);
                     break;
                 }
                 default: {
-                    uart_putc('%');
-                    uart_putc(*fmt);
+                    out('%', ctx);
+                    out(*fmt, ctx);
                     break;
                 }
             }
         } else {
-            if (*fmt == '\n') {
-                uart_putc('\r');
-            }
-            uart_putc(*fmt);
+            out(*fmt, ctx);
         }
         fmt++;
     }
+}
+
+/* Kernel log: everything printed is kept here, shown or not */
+#define KLOG_SIZE 16384
+
+static char klog[KLOG_SIZE];
+static uint64_t klog_len = 0;          /* Total characters ever logged */
+static volatile int console_quiet = 0;
+
+void console_set_quiet(int quiet) {
+    console_quiet = quiet;
+}
+
+/* Replay the kernel log to the UART (oldest first) */
+void klog_dump(void) {
+    uint64_t end = klog_len;
+    uint64_t start = (end > KLOG_SIZE) ? end - KLOG_SIZE : 0;
+    for (uint64_t i = start; i < end; i++) {
+        char c = klog[i % KLOG_SIZE];
+        if (c == '\n') {
+            uart_putc('\r');
+        }
+        uart_putc(c);
+    }
+}
+
+/* Console sink: the UART wants CRLF line endings */
+static void uart_sink(char c, void *ctx) {
+    (void)ctx;
+    klog[klog_len % KLOG_SIZE] = c;
+    klog_len++;
+    if (console_quiet) {
+        return;
+    }
+    if (c == '\n') {
+        uart_putc('\r');
+    }
+    uart_putc(c);
+}
+
+void printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    format(uart_sink, NULL, fmt, args);
+    va_end(args);
+}
+
+/* Buffer sink: counts everything, stores what fits */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} buf_sink_t;
+
+static void buf_sink(char c, void *ctx) {
+    buf_sink_t *b = (buf_sink_t*)ctx;
+    if (b->len + 1 < b->size) {
+        b->buf[b->len] = c;
+    }
+    b->len++;
+}
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+    buf_sink_t b = { buf, size, 0 };
     
+    format(buf_sink, &b, fmt, args);
+    if (size > 0) {
+        buf[b.len < size ? b.len : size - 1] = '\0';
+    }
+    return (int)b.len;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, size, fmt, args);
     va_end(args);
+    return n;
 }
 
 void panic(const char *msg) {
+    console_quiet = 0;
     printf("\n\n*** KERNEL PANIC ***\n");
     printf("%s\n", msg);
     printf("System halted.\n");
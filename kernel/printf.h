@@ -3,7 +3,26 @@
 
 #include "types.h"
 
+typedef __builtin_va_list va_list;
+#define va_start(ap, last) __builtin_va_start(ap, last)
+#define va_arg(ap, type) __builtin_va_arg(ap, type)
+#define va_end(ap) __builtin_va_end(ap)
+
 void printf(const char *fmt, ...);
-void panic(const char *msg);
+void panic(const char *msg) __attribute__((noreturn));
+
+/* Format into buf (always terminated if size > 0); returns the length the
+ * full output would have had, as in C99 */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int snprintf(char *buf, size_t size, const char *fmt, ...);
+
+/* While quiet, printf only appends to the kernel log (see klog_dump) */
+void console_set_quiet(int quiet);
+void klog_dump(void);
+
+/* Echo boot-time init messages to the console (make BOOT_VERBOSE=1) */
+#ifndef BOOT_VERBOSE
+#define BOOT_VERBOSE 0
+#endif
 
 #endif /* _PRINTF_H */
@@ -0,0 +1,76 @@
+#include "cputime.h"
+#include "scheduler.h"
+#include "../riscv.h"
+
+/* Per-CPU clock: time CSR at the last transition and the mode since then */
+typedef struct cpu_clock {
+    uint64_t stamp;
+    int mode;
+} cpu_clock_t;
+
+static cpu_clock_t clocks[MAX_CPUS];
+
+/* Charge time since the last transition to the current task */
+static void charge(cpu_clock_t *c, uint64_t now) {
+    process_t *p = current_proc();
+    
+    if (p != NULL) {
+        p->cputime[c->mode] += now - c->stamp;
+    }
+    c->stamp = now;
+}
+
+void cputime_init(void) {
+    cpu_clock_t *c = &clocks[sched_cpu_id()];
+    c->stamp = r_time();
+    c->mode = CPUTIME_SYS;
+}
+
+void cputime_switch(process_t *old, process_t *new) {
+    cpu_clock_t *c = &clocks[sched_cpu_id()];
+    uint64_t now = r_time();
+    
+    /* current_proc() is still old here */
+    charge(c, now);
+    if (old != NULL) {
+        old->cputime_mode = c->mode;
+    }
+    c->mode = new ? new->cputime_mode : CPUTIME_SYS;
+}
+
+int cputime_trap_enter(int mode, int from_user) {
+    cpu_clock_t *c = &clocks[sched_cpu_id()];
+    int prev = from_user ? CPUTIME_USER : c->mode;
+    
+    c->mode = prev;
+    charge(c, r_time());
+    c->mode = mode;
+    return prev;
+}
+
+void cputime_trap_exit(int prev_mode) {
+    cpu_clock_t *c = &clocks[sched_cpu_id()];
+    
+    charge(c, r_time());
+    c->mode = prev_mode;
+}
+
+void cputime_read(process_t *p, uint64_t ns[CPUTIME_NR]) {
+    uint64_t flags = intr_save();
+    uint64_t raw[CPUTIME_NR];
+    
+    for (int i = 0; i < CPUTIME_NR; i++) {
+        raw[i] = p->cputime[i];
+    }
+    
+    /* Add the slice in progress if p is on a CPU right now */
+    if (p->state == PROC_RUNNING && p->cpu_id >= 0 && p->cpu_id < MAX_CPUS) {
+        cpu_clock_t *c = &clocks[p->cpu_id];
+        raw[c->mode] += r_time() - c->stamp;
+    }
+    intr_restore(flags);
+    
+    for (int i = 0; i < CPUTIME_NR; i++) {
+        ns[i] = time_to_ns(raw[i]);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef _CPUTIME_H
+#define _CPUTIME_H
+
+#include "../types.h"
+#include "process.h"
+
+/* What the CPU is doing on behalf of the current task; zero-initialized
+ * tasks start in SYS since they first run inside context_switch */
+#define CPUTIME_SYS   0
+#define CPUTIME_USER  1
+#define CPUTIME_IRQ   2
+#define CPUTIME_NR    3
+
+/* Start the clock on this CPU (boot thread is current) */
+void cputime_init(void);
+
+/* Charge the outgoing task up to now and hand the clock to new */
+void cputime_switch(process_t *old, process_t *new);
+
+/* Trap boundaries; enter returns the mode to hand back to exit */
+int cputime_trap_enter(int mode, int from_user);
+void cputime_trap_exit(int prev_mode);
+
+/* Exact accumulated time per mode in ns, including a running slice */
+void cputime_read(process_t *p, uint64_t ns[CPUTIME_NR]);
+
+#endif /* _CPUTIME_H */
@@ -0,0 +1,112 @@
+#include "fpu.h"
+#include "scheduler.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../lib/string.h"
+
+int fpu_enabled = 0;
+
+/* Task whose state is live in the FP registers (per CPU) */
+static process_t *fpu_owner[MAX_CPUS];
+
+/* Does this (trapping) instruction need the FP unit? */
+static int is_fp_insn(uint32_t insn) {
+    /* Compressed FP loads/stores: c.fld/c.fsd (quadrant 0), c.fldsp/c.fsdsp (quadrant 2) */
+    if ((insn & 3) != 3) {
+        uint32_t quadrant = insn & 3;
+        uint32_t funct3 = (insn >> 13) & 0x7;
+        return (quadrant == 0 || quadrant == 2) && (funct3 == 1 || funct3 == 5);
+    }
+    
+    uint32_t opcode = insn & 0x7F;
+    uint32_t funct3 = (insn >> 12) & 0x7;
+    switch (opcode) {
+        case 0x07:  /* LOAD-FP (widths 1-4; the rest are vector) */
+        case 0x27:  /* STORE-FP */
+            return funct3 >= 1 && funct3 <= 4;
+        case 0x43:  /* FMADD */
+        case 0x47:  /* FMSUB */
+        case 0x4B:  /* FNMSUB */
+        case 0x4F:  /* FNMADD */
+        case 0x53:  /* OP-FP */
+            return 1;
+        case 0x57:  /* OP-V with a scalar FP operand (OPFVV/OPFVF) */
+            return funct3 == 1 || funct3 == 5;
+        case 0x73:  /* fflags, frm, fcsr */
+            if ((funct3 & 3) != 0) {
+                uint32_t csr = insn >> 20;
+                return csr >= 1 && csr <= 3;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static void set_fs(uint64_t fs) {
+    w_sstatus((r_sstatus() & ~SSTATUS_FS) | fs);
+}
+
+void fpu_init(void) {
+    /* sstatus.FS is WARL and reads back as Off without an FPU */
+    set_fs(SSTATUS_FS_INITIAL);
+    fpu_enabled = (r_sstatus() & SSTATUS_FS) != SSTATUS_FS_OFF;
+    set_fs(SSTATUS_FS_OFF);
+    
+    if (fpu_enabled) {
+        printf("[FPU] F/D present, lazy FP context switching enabled\n");
+    } else {
+        printf("[FPU] No FPU, tasks must use soft-float\n");
+    }
+}
+
+void fpu_context_switch(process_t *old, process_t *new) {
+    if (!fpu_enabled) {
+        return;
+    }
+    
+    uint64_t s = r_sstatus();
+    if (old != NULL && (s & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+        fpu_save(&old->fpstate);
+    }
+    
+    /* Skip the first-use trap when the registers already hold new's state */
+    if (new != NULL && new->fp_used && fpu_owner[sched_cpu_id()] == new) {
+        w_sstatus((s & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+    } else {
+        w_sstatus(s & ~SSTATUS_FS);
+    }
+}
+
+int fpu_handle_trap(process_t *p, uint64_t insn) {
+    if (!fpu_enabled || p == NULL ||
+        (r_sstatus() & SSTATUS_FS) != SSTATUS_FS_OFF ||
+        !is_fp_insn((uint32_t)insn)) {
+        return -1;
+    }
+    
+    /* First use ever: registers start at +0.0 with default rounding */
+    if (!p->fp_used) {
+        memset(&p->fpstate, 0, sizeof(p->fpstate));
+        p->fp_used = 1;
+    }
+    
+    set_fs(SSTATUS_FS_INITIAL);
+    fpu_restore(&p->fpstate);
+    set_fs(SSTATUS_FS_CLEAN);
+    fpu_owner[sched_cpu_id()] = p;
+    return 0;
+}
+
+void fpu_release(process_t *p) {
+    if (p == NULL) {
+        return;
+    }
+    
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (fpu_owner[i] == p) {
+            fpu_owner[i] = NULL;
+        }
+    }
+    p->fp_used = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "../types.h"
+#include "process.h"
+
+/* Set at boot when the hart implements F and D */
+extern int fpu_enabled;
+
+/* Probe for an FPU */
+void fpu_init(void);
+
+/* Context switch hook: save old's registers only if dirty, leave FP off */
+void fpu_context_switch(process_t *old, process_t *new);
+
+/* Lazy restore on a task's first FP instruction; 0 if handled */
+int fpu_handle_trap(process_t *p, uint64_t insn);
+
+/* Forget a task's state (process teardown) */
+void fpu_release(process_t *p);
+
+/* Assembly helpers (fpu.S) */
+void fpu_save(fpstate_t *fs);
+void fpu_restore(const fpstate_t *fs);
+
+#endif /* _FPU_H */
@@ -0,0 +1,61 @@
+#include "kthread.h"
+#include "scheduler.h"
+#include "../mm/mm.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../lib/string.h"
+
+/* First return address of a new thread (swtch.S) */
+extern void kthread_trampoline(void);
+
+process_t* kthread_create(void (*fn)(void *), void *arg, const char *name) {
+    if (fn == NULL) {
+        return NULL;
+    }
+    
+    process_t *p = process_alloc();
+    if (p == NULL) {
+        return NULL;
+    }
+    
+    void *stack = alloc_page();
+    if (stack == NULL) {
+        process_free(p);
+        return NULL;
+    }
+    
+    p->kstack = stack;
+    rss_add(p, RSS_KERNEL, 1);
+    p->kernel_sp = (uint64_t)stack + KTHREAD_STACK_SIZE;
+    strlcpy(p->name, name ? name : "kthread", sizeof(p->name));
+    
+    /* swtch "returns" into the trampoline with fn/arg in s0/s1 */
+    memset(&p->context, 0, sizeof(p->context));
+    p->context.ra = (uint64_t)kthread_trampoline;
+    p->context.sp = p->kernel_sp;
+    p->context.s0 = (uint64_t)fn;
+    p->context.s1 = (uint64_t)arg;
+    
+    sched_add(p);
+    return p;
+}
+
+void kthread_start(void (*fn)(void *), void *arg) {
+    /* We arrived via swtch but not through context_switch's return path */
+    sched_finish_switch();
+    intr_on();
+    
+    fn(arg);
+    kthread_exit();
+}
+
+void kthread_exit(void) {
+    process_t *p = current_proc();
+    
+    intr_off();
+    p->state = PROC_ZOMBIE;
+    sched_yield();
+    
+    /* A zombie is never scheduled again */
+    panic("kthread_exit: zombie rescheduled");
+}
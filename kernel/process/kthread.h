@@ -0,0 +1,22 @@
+#ifndef _KTHREAD_H
+#define _KTHREAD_H
+
+#include "../types.h"
+#include "process.h"
+
+/* Kernel threads: scheduled like any task, run in S-mode on the kernel
+ * page table with a one-page stack of their own. There is no guard page
+ * below it (RAM is mapped with megapages), so nothing KB-sized goes on
+ * kernel stacks; see syscall_iov() for the vectored I/O arrays. */
+#define KTHREAD_STACK_SIZE 4096
+
+/* Create a thread running fn(arg) and make it runnable */
+process_t* kthread_create(void (*fn)(void *), void *arg, const char *name);
+
+/* Terminate the calling kernel thread; its stack is freed after the switch */
+void kthread_exit(void) __attribute__((noreturn));
+
+/* C entry reached from kthread_trampoline (swtch.S) */
+void kthread_start(void (*fn)(void *), void *arg) __attribute__((noreturn));
+
+#endif /* _KTHREAD_H */
@@ -1,64 +1,237 @@
 #include "process.h"
 #include "../mm/mm.h"
+#include "../mm/mmap.h"
+#include "../mm/reclaim.h"
 #include "../printf.h"
+#include "../syscall/ioring.h"
+#include "../lib/rvv.h"
+#include "fpu.h"
+#include "cputime.h"
+#include "scheduler.h"
+#include "../riscv.h"
+#include "../sync/seqlock.h"
+#include "../sync/spinlock.h"
+#include "../lib/bitops.h"
 
-#define MAX_PROCESSES 64
+/* Process slots live in page-sized chunks from the page allocator, so
+ * the table grows on demand. Each chunk keeps a bitmap of free slots;
+ * chunks with a free slot sit on the partial list, so allocation takes
+ * the first one and its lowest set bit without scanning. Empty chunks are
+ * kept until memory runs low, when the shrinker below gives them back. */
+typedef struct proc_chunk {
+    struct proc_chunk *next;          /* All chunks */
+    struct proc_chunk *next_partial;  /* Chunks with a free slot */
+    int on_partial;
+    uint64_t free;                    /* Bit i set: procs[i] is free */
+    process_t procs[];
+} proc_chunk_t;
+
+#define PROCS_PER_CHUNK \
+    ((PAGE_SIZE - sizeof(proc_chunk_t)) / sizeof(process_t))
+
+#define CHUNK_ALL_FREE \
+    ((PROCS_PER_CHUNK == 64) ? ~0UL : (1UL << PROCS_PER_CHUNK) - 1)
+
+_Static_assert(PROCS_PER_CHUNK >= 1 && PROCS_PER_CHUNK <= 64,
+               "process chunk must hold 1..64 slots");
+
+/* PID -> process; chains are RCU lists through process_t.pid_next */
+#define PID_HASH_SIZE 256
+
+static proc_chunk_t *chunks = NULL;
+static proc_chunk_t *partial = NULL;
+static process_t *pid_hash[PID_HASH_SIZE];
+static uint32_t nr_procs = 0;
 
-static process_t proc_table[MAX_PROCESSES];
 static uint64_t next_pid = 1;
+static spinlock_t proc_lock;       /* Chunks, bitmaps and PID hash updates */
 static uint64_t global_ticks = 0;  /* Global tick counter */
+static uint64_t tick_stamp = 0;    /* time CSR value at the last tick */
+static seqlock_t tick_lock;        /* Pairs global_ticks with tick_stamp */
+static shrinker_t chunk_shrinker;  /* Defined with its callbacks below */
 
 /* Get global tick counter */
 uint64_t get_ticks(void) {
-    return global_ticks;
+    uint64_t ticks;
+    get_tick_snapshot(&ticks, NULL);
+    return ticks;
+}
+
+/* Read the tick count and the time it was taken as one consistent pair */
+void get_tick_snapshot(uint64_t *ticks, uint64_t *stamp) {
+    uint32_t seq;
+    uint64_t t, s;
+    do {
+        seq = read_seqbegin(&tick_lock);
+        t = global_ticks;
+        s = tick_stamp;
+    } while (read_seqretry(&tick_lock, seq));
+    if (ticks) *ticks = t;
+    if (stamp) *stamp = s;
 }
 
 /* Increment global tick counter */
 void tick_increment(void) {
+    uint64_t flags = write_seqlock_irqsave(&tick_lock);
     global_ticks++;
+    tick_stamp = r_time();
+    write_sequnlock_irqrestore(&tick_lock, flags);
 }
 
 void process_init(void) {
-    /* Initialize process table */
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        proc_table[i].state = PROC_UNUSED;
-        proc_table[i].pid = 0;
+    seqlock_init(&tick_lock, "ticks");
+    spin_init(&proc_lock, "proctable");
+    
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        pid_hash[i] = NULL;
+    }
+    register_shrinker(&chunk_shrinker);
+    printf("[PROC] %u process slots per chunk\n", (uint32_t)PROCS_PER_CHUNK);
+}
+
+/* Add the page c to the table as a chunk; proc_lock held */
+static proc_chunk_t* chunk_grow(proc_chunk_t *c) {
+    for (uint32_t i = 0; i < PROCS_PER_CHUNK; i++) {
+        c->procs[i].state = PROC_UNUSED;
+        c->procs[i].pid = 0;
     }
+    c->free = CHUNK_ALL_FREE;
+    c->next_partial = partial;
+    c->on_partial = 1;
+    partial = c;
+    rcu_assign_pointer(c->next, chunks);
+    rcu_assign_pointer(chunks, c);
+    return c;
+}
+
+/* Chunks are page-aligned, so a slot finds its chunk by masking */
+static proc_chunk_t* chunk_of(process_t *p) {
+    return (proc_chunk_t*)((uint64_t)p & ~(uint64_t)(PAGE_SIZE - 1));
 }
 
 process_t* process_alloc(void) {
-    /* Find free slot */
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        if (proc_table[i].state == PROC_UNUSED) {
-            proc_table[i].pid = next_pid++;
-            proc_table[i].state = PROC_RUNNABLE;
-            proc_table[i].name[0] = '\0';
-            
-            /* Initialize scheduling fields */
-            proc_table[i].priority = PRIORITY_DEFAULT;
-            proc_table[i].dynamic_priority = PRIORITY_DEFAULT;
-            proc_table[i].policy = SCHED_NORMAL;
-            proc_table[i].queue_level = 0;
-            proc_table[i].time_slice = 0;
-            proc_table[i].cpu_affinity = 0xFFFFFFFFFFFFFFFFULL; /* All CPUs */
-            proc_table[i].cpu_id = -1;
-            
-            /* Initialize statistics */
-            proc_table[i].stats.cpu_time = 0;
-            proc_table[i].stats.context_switches = 0;
-            proc_table[i].stats.start_time = global_ticks;
-            proc_table[i].stats.last_run = 0;
-            
-            return &proc_table[i];
+    /* Take the lowest free slot of the first partial chunk. A new chunk
+     * is allocated without the lock held: allocation may reclaim, and the
+     * shrinker takes proc_lock. */
+    uint64_t flags = spin_lock_irqsave(&proc_lock);
+    proc_chunk_t *c = partial;
+    if (c == NULL) {
+        spin_unlock_irqrestore(&proc_lock, flags);
+        proc_chunk_t *page = (proc_chunk_t*)alloc_page();
+        if (page == NULL) {
+            return NULL;
         }
+        flags = spin_lock_irqsave(&proc_lock);
+        c = chunk_grow(page);
     }
-    return NULL;
+    int slot = ctz64(c->free);
+    c->free &= c->free - 1;
+    if (c->free == 0) {
+        partial = c->next_partial;
+        c->on_partial = 0;
+    }
+    process_t *p = &c->procs[slot];
+    p->state = PROC_RUNNABLE;
+    uint64_t pid = next_pid++;
+    nr_procs++;
+    spin_unlock_irqrestore(&proc_lock, flags);
+    
+    p->name[0] = '\0';
+    p->pagetable = NULL;
+    p->kstack = NULL;
+    p->iov_scratch = NULL;
+    p->kernel_sp = 0;
+    
+    /* Initialize scheduling fields */
+    p->priority = PRIORITY_DEFAULT;
+    p->dynamic_priority = PRIORITY_DEFAULT;
+    p->policy = SCHED_NORMAL;
+    p->queue_level = 0;
+    p->rq_queue = -1;
+    list_init(&p->rq_node);
+    p->time_slice = 0;
+    p->cpu_affinity = 0xFFFFFFFFFFFFFFFFULL; /* All CPUs */
+    p->cpu_id = -1;
+    p->ready_ts = 0;
+    p->wake_ts = 0;
+    p->rcu_nesting = 0;
+    
+    /* Initialize statistics */
+    p->stats.cpu_time = 0;
+    p->stats.context_switches = 0;
+    p->stats.start_time = time_to_ns(r_time());
+    p->stats.last_run = 0;
+    for (int m = 0; m < CPUTIME_NR; m++) {
+        p->cputime[m] = 0;
+    }
+    p->cputime_mode = CPUTIME_SYS;
+    for (int k = 0; k < RSS_NR; k++) {
+        p->rss[k] = 0;
+    }
+    
+    p->ioring = NULL;
+    p->vmas = NULL;
+    p->mmap_top = 0;
+    p->vstate = NULL;
+    p->fp_used = 0;
+    
+    /* Visible to process_find_by_pid() only once initialized */
+    p->pid = pid;
+    flags = spin_lock_irqsave(&proc_lock);
+    process_t **bucket = &pid_hash[pid % PID_HASH_SIZE];
+    p->pid_next = *bucket;
+    rcu_assign_pointer(*bucket, p);
+    spin_unlock_irqrestore(&proc_lock, flags);
+    return p;
+}
+
+/* Grace period over: no lookup can still be looking at the old task */
+static void process_reclaim(rcu_head_t *head) {
+    process_t *p = container_of(head, process_t, rcu);
+    proc_chunk_t *c = chunk_of(p);
+    
+    uint64_t flags = spin_lock_irqsave(&proc_lock);
+    p->state = PROC_UNUSED;
+    p->pid = 0;
+    c->free |= 1UL << (p - c->procs);
+    if (!c->on_partial) {
+        c->next_partial = partial;
+        c->on_partial = 1;
+        partial = c;
+    }
+    nr_procs--;
+    spin_unlock_irqrestore(&proc_lock, flags);
 }
 
 void process_free(process_t *p) {
     if (p) {
-        p->state = PROC_UNUSED;
-        p->pid = 0;
+        /* A queued task would leave its slot linked into a run queue */
+        sched_remove(p);
+        ioring_release(p);
+        mmap_release(p);
+        rvv_release(p);
+        fpu_release(p);
+        if (p->kstack) {
+            free_page(p->kstack);
+            p->kstack = NULL;
+            rss_add(p, RSS_KERNEL, -1);
+        }
+        if (p->iov_scratch) {
+            free_page(p->iov_scratch);
+            p->iov_scratch = NULL;
+            rss_add(p, RSS_KERNEL, -1);
+        }
+        /* Unpublish now, recycle the slot after a grace period */
+        uint64_t flags = spin_lock_irqsave(&proc_lock);
+        process_t **link = &pid_hash[p->pid % PID_HASH_SIZE];
+        while (*link != NULL && *link != p) {
+            link = &(*link)->pid_next;
+        }
+        if (*link == p) {
+            rcu_assign_pointer(*link, p->pid_next);
+        }
+        spin_unlock_irqrestore(&proc_lock, flags);
+        p->state = PROC_ZOMBIE;
         p->priority = 0;
         p->dynamic_priority = 0;
         p->queue_level = 0;
@@ -66,13 +239,112 @@ void process_free(process_t *p) {
         p->cpu_id = -1;
         p->stats.cpu_time = 0;
         p->stats.context_switches = 0;
+        call_rcu(&p->rcu, process_reclaim);
+    }
+}
+
+/* ---- Shrinker: empty chunks go back to the page allocator ---- */
+
+static uint64_t chunk_shrink_count(void) {
+    uint64_t n = 0;
+    uint64_t flags = spin_lock_irqsave(&proc_lock);
+    for (proc_chunk_t *c = partial; c != NULL; c = c->next_partial) {
+        if (c->free == CHUNK_ALL_FREE) {
+            n++;
+        }
+    }
+    spin_unlock_irqrestore(&proc_lock, flags);
+    return n;
+}
+
+/* Lookups may still be walking the chunk list through c */
+static void chunk_free_rcu(rcu_head_t *head) {
+    free_page(chunk_of(container_of(head, process_t, rcu)));
+}
+
+static uint64_t chunk_shrink_scan(uint64_t nr) {
+    proc_chunk_t *victims = NULL;
+    uint64_t n = 0;
+    
+    uint64_t flags = spin_lock_irqsave(&proc_lock);
+    proc_chunk_t **pp = &partial;
+    while (*pp != NULL && n < nr) {
+        proc_chunk_t *c = *pp;
+        if (c->free != CHUNK_ALL_FREE) {
+            pp = &c->next_partial;
+            continue;
+        }
+        *pp = c->next_partial;
+        c->on_partial = 0;
+        
+        /* Readers already on c keep following c->next */
+        proc_chunk_t **link = &chunks;
+        while (*link != c) {
+            link = &(*link)->next;
+        }
+        rcu_assign_pointer(*link, c->next);
+        
+        c->next_partial = victims;
+        victims = c;
+        n++;
+    }
+    spin_unlock_irqrestore(&proc_lock, flags);
+    
+    /* All slots are free, so no slot's rcu head is in use */
+    while (victims != NULL) {
+        proc_chunk_t *c = victims;
+        victims = c->next_partial;
+        call_rcu(&c->procs[0].rcu, chunk_free_rcu);
     }
+    return n;
+}
+
+static shrinker_t chunk_shrinker = {
+    .name = "proc-chunks",
+    .count = chunk_shrink_count,
+    .scan = chunk_shrink_scan,
+};
+
+process_t* process_find_by_pid(uint64_t pid) {
+    for (process_t *p = rcu_dereference(pid_hash[pid % PID_HASH_SIZE]);
+         p != NULL; p = rcu_dereference(p->pid_next)) {
+        if (p->pid == pid) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Call fn on every allocated process; fn runs inside an RCU read-side
+ * section and must not sleep */
+void process_for_each(void (*fn)(process_t *p, void *arg), void *arg) {
+    rcu_read_lock();
+    for (proc_chunk_t *c = rcu_dereference(chunks); c != NULL;
+         c = rcu_dereference(c->next)) {
+        for (uint32_t i = 0; i < PROCS_PER_CHUNK; i++) {
+            process_t *p = &c->procs[i];
+            if (__atomic_load_n(&p->state, __ATOMIC_ACQUIRE) != PROC_UNUSED &&
+                p->pid != 0) {
+                fn(p, arg);
+            }
+        }
+    }
+    rcu_read_unlock();
+}
+
+uint32_t process_count(void) {
+    return nr_procs;
 }
 
-/* Get process statistics */
+/* Get process statistics; CPU times are exact up to the moment of the call */
 void process_get_stats(process_t *p, proc_stats_t *stats) {
     if (p && stats) {
-        stats->cpu_time = p->stats.cpu_time;
+        uint64_t ns[CPUTIME_NR];
+        cputime_read(p, ns);
+        stats->utime = ns[CPUTIME_USER];
+        stats->stime = ns[CPUTIME_SYS];
+        stats->irqtime = ns[CPUTIME_IRQ];
+        stats->cpu_time = stats->utime + stats->stime;
         stats->context_switches = p->stats.context_switches;
         stats->start_time = p->stats.start_time;
         stats->last_run = p->stats.last_run;
@@ -82,16 +354,23 @@ void process_get_stats(process_t *p, proc_stats_t *stats) {
 /* Print process statistics */
 void process_print_stats(process_t *p) {
     if (p && p->state != PROC_UNUSED) {
-        uint64_t uptime = global_ticks - p->stats.start_time;
-        printf("Process %lu (%s):\n", p->pid, p->name);
+        proc_stats_t st;
+        process_get_stats(p, &st);
+        uint64_t uptime = time_to_ns(r_time()) - st.start_time;
+        printf("Process %u (%s):\n", p->pid, p->name);
         printf("  State: %d, Priority: %d, Policy: %d\n", 
                p->state, p->priority, p->policy);
-        printf("  CPU Time: %lu ticks\n", p->stats.cpu_time);
-        printf("  Context Switches: %lu\n", p->stats.context_switches);
-        printf("  Uptime: %lu ticks\n", uptime);
+        printf("  CPU Time: %u us (user %u, sys %u, irq %u)\n",
+               st.cpu_time / 1000, st.utime / 1000, st.stime / 1000,
+               st.irqtime / 1000);
+        printf("  Context Switches: %u\n", st.context_switches);
+        printf("  RSS: %u KB (file %u, anon %u, kernel %u pages)\n",
+               rss_total(p) * PAGE_SIZE / 1024, p->rss[RSS_FILE],
+               p->rss[RSS_ANON], p->rss[RSS_KERNEL]);
+        printf("  Uptime: %u us\n", uptime / 1000);
         if (uptime > 0) {
-            uint64_t cpu_percent = (p->stats.cpu_time * 100) / uptime;
-            printf("  CPU Usage: %lu%%\n", cpu_percent);
+            uint64_t cpu_percent = (st.cpu_time * 100) / uptime;
+            printf("  CPU Usage: %u%%\n", cpu_percent);
         }
     }
 }
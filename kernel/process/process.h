@@ -2,6 +2,8 @@
 #define _PROCESS_H
 
 #include "../types.h"
+#include "../sync/rcu.h"
+#include "../lib/list.h"
 
 /* Process states */
 typedef enum {
@@ -45,48 +47,122 @@ typedef struct context {
     uint64_t s11;
 } context_t;
 
+/* Saved F/D register file; only valid once the task has used FP */
+typedef struct fpstate {
+    uint64_t f[32];
+    uint64_t fcsr;
+} fpstate_t;
+
 /* Process statistics */
 typedef struct proc_stats {
-    uint64_t cpu_time;         /* Total CPU time used (ticks) */
+    uint64_t cpu_time;         /* Total CPU time used (ns, utime + stime) */
+    uint64_t utime;            /* Time in user mode (ns) */
+    uint64_t stime;            /* Time in the kernel for this task (ns) */
+    uint64_t irqtime;          /* Interrupt handling while current (ns) */
     uint64_t context_switches; /* Number of context switches */
-    uint64_t start_time;       /* Process start time (ticks) */
-    uint64_t last_run;         /* Last time process ran */
+    uint64_t start_time;       /* Process start time (ns since reset) */
+    uint64_t last_run;         /* Last time process ran (ns since reset) */
 } proc_stats_t;
 
-/* Process structure */
+/* Resident pages held for a task, by kind */
+enum {
+    RSS_FILE,                  /* File pages mapped by mmap */
+    RSS_ANON,                  /* Task-owned pages mapped into user space */
+    RSS_KERNEL,                /* Kernel stack, VMA table, vector state */
+    RSS_NR
+};
+
+struct ioring_ctx;
+struct vma;
+struct vstate;
+
+/* Process structure, grouped by who touches it. The scheduler walks many
+ * tasks per tick and per pick but only reads their first cache line; the
+ * switch path touches the second group of the two tasks involved; the
+ * rest is set up once or used by syscalls, /proc and teardown. */
 typedef struct process {
+    /* Scheduling: one cache line */
     uint64_t pid;
     proc_state_t state;
-    uint64_t *pagetable;
-    context_t context;
-    uint64_t kernel_sp;
-    uint64_t user_sp;
-    char name[32];
-    
-    /* Scheduling fields */
+    sched_policy_t policy;     /* Scheduling policy */
     int priority;              /* Static priority (0-139) */
     int dynamic_priority;      /* Dynamic priority for MLFQ */
-    sched_policy_t policy;     /* Scheduling policy */
-    int queue_level;           /* Current queue level in MLFQ */
-    uint64_t time_slice;       /* Remaining time slice */
-    uint64_t cpu_affinity;     /* CPU affinity mask for SMP */
+    int16_t queue_level;       /* Current queue level in MLFQ */
+    int16_t rq_queue;          /* Run queue the task is linked on, -1 if none */
+    uint32_t time_slice;       /* Remaining time slice (ticks) */
     int cpu_id;                /* Currently assigned CPU (-1 if none) */
+    int rcu_nesting;           /* RCU read-side depth; no preemption while > 0 */
+    uint64_t cpu_affinity;     /* CPU affinity mask for SMP */
+    list_node_t rq_node;       /* Run queue link; see scheduler.c */
     
-    /* Statistics */
+    /* Context switch */
+    context_t context __attribute__((aligned(64)));
+    uint64_t ready_ts;         /* time CSR when made runnable (0 = unset) */
+    uint64_t wake_ts;          /* time CSR when woken from sleep (0 = unset) */
+    uint64_t kernel_sp;
+    uint64_t *pagetable;
     proc_stats_t stats;
-} process_t;
+    uint64_t cputime[3];       /* Raw time CSR per CPUTIME_* mode (see cputime.h) */
+    int cputime_mode;          /* Mode to resume in when switched back in */
+    int fp_used;               /* FP registers saved only while sstatus.FS says written */
+    struct vstate *vstate;     /* Vector unit state, allocated on first use */
+    
+    /* Cold */
+    char name[32];
+    void *kstack;              /* Kernel stack page (kernel threads) */
+    struct iovec *iov_scratch; /* Vectored I/O arrays, see syscall_iov() */
+    uint64_t user_sp;
+    uint64_t rss[RSS_NR];      /* Pages by RSS_* kind; see rss_add() */
+    
+    /* Submission/completion ring, if the task set one up */
+    struct ioring_ctx *ioring;
+    
+    /* File mappings (see mm/mmap.h) */
+    struct vma *vmas;          /* VMA table page, NULL until first mmap */
+    uint64_t mmap_top;         /* Next free address in the mmap region */
+    
+    fpstate_t fpstate;
+    
+    /* PID hash chain, and deferred slot reuse past concurrent lookups */
+    struct process *pid_next;
+    rcu_head_t rcu;
+} __attribute__((aligned(64))) process_t;
+
+_Static_assert(offsetof(process_t, context) == 64,
+               "scheduling fields must fit the first cache line");
+
+/* Account pages mapped or allocated on p's behalf (negative to release);
+ * faults and unmaps may race on different harts */
+static inline void rss_add(process_t *p, int kind, int64_t pages) {
+    if (p != NULL) {
+        __atomic_fetch_add(&p->rss[kind], (uint64_t)pages, __ATOMIC_RELAXED);
+    }
+}
+
+static inline uint64_t rss_total(const process_t *p) {
+    return p->rss[RSS_FILE] + p->rss[RSS_ANON] + p->rss[RSS_KERNEL];
+}
 
 /* Process management functions */
 void process_init(void);
 process_t* process_alloc(void);
 void process_free(process_t *p);
 
+/* Look up a live process; call inside rcu_read_lock(), and the result
+ * stays valid (though it may exit) until rcu_read_unlock() */
+process_t* process_find_by_pid(uint64_t pid);
+
+/* Visit every allocated process (RCU read side; fn must not sleep) */
+void process_for_each(void (*fn)(process_t *p, void *arg), void *arg);
+uint32_t process_count(void);
+
 /* Statistics functions */
 void process_get_stats(process_t *p, proc_stats_t *stats);
 void process_print_stats(process_t *p);
 
 /* Time functions */
 uint64_t get_ticks(void);
+void get_tick_snapshot(uint64_t *ticks, uint64_t *stamp);
 void tick_increment(void);
 
 #endif /* _PROCESS_H */
@@ -1,12 +1,22 @@
 #include "scheduler.h"
 #include "../printf.h"
 #include "../riscv.h"
+#include "../lib/string.h"
+#include "../lib/bitops.h"
+#include "../lib/list.h"
+#include "../syscall/ioring.h"
+#include "../lib/rvv.h"
+#include "fpu.h"
+#include "cputime.h"
+#include "../sync/mcs.h"
+#include "../sync/rcu.h"
+#include "../trace/trace.h"
+#include "../fdt.h"
+#include "../fs/procfs.h"
 
 /* External assembly function for context switching */
 extern void swtch(context_t *old, context_t *new);
 
-#define MAX_PROCESSES 64
-
 /* Time slices for different queue levels (in ticks) */
 static const uint64_t queue_time_slices[NUM_QUEUE_LEVELS] = {
     5,   /* Level 0: Highest priority, shortest time slice */
@@ -15,19 +25,22 @@ static const uint64_t queue_time_slices[NUM_QUEUE_LEVELS] = {
     40   /* Level 3: Lowest priority, longest time slice */
 };
 
-/* Multi-level feedback queue */
-typedef struct mlfq {
-    process_t *queue[MAX_PROCESSES];
-    int head;
-    int tail;
-    int size;
-} mlfq_t;
+/* Run queues, highest priority first: one FIFO list per RT priority
+ * (0..PRIORITY_RT_MAX), then one per MLFQ level. Tasks are linked through
+ * their own rq_node, so queueing never allocates and has no capacity
+ * limit, and any task can be unlinked in O(1); the bitmap of non-empty
+ * lists turns the pick into a find-first-set. */
+#define NR_RT_QUEUES  (PRIORITY_RT_MAX + 1)
+#define NR_RUNQUEUES  (NR_RT_QUEUES + NUM_QUEUE_LEVELS)
+#define RQ_MLFQ(level) (NR_RT_QUEUES + (level))
+#define RQ_WORDS      ((NR_RUNQUEUES + 63) / 64)
 
-/* Real-time queue for RT processes */
-typedef struct rt_queue {
-    process_t *queue[MAX_PROCESSES];
-    int size;
-} rt_queue_t;
+typedef struct runqueue {
+    list_node_t queues[NR_RUNQUEUES];
+    uint32_t len[NR_RUNQUEUES];
+    uint64_t bitmap[RQ_WORDS];     /* Bit q set: queues[q] is non-empty */
+    uint32_t nr_rt;                /* Tasks on the RT lists */
+} runqueue_t;
 
 /* Per-CPU scheduler data */
 typedef struct cpu_sched {
@@ -35,84 +48,106 @@ typedef struct cpu_sched {
     process_t *idle;           /* Idle process for this CPU */
     int cpu_id;                /* CPU ID */
     uint64_t ticks;            /* Local tick counter */
-    uint64_t idle_ticks;       /* Time spent in idle */
+    process_t *prev;           /* Task switched away from, reaped if a zombie */
 } cpu_sched_t;
 
 /* Global scheduler data */
-static mlfq_t ready_queues[NUM_QUEUE_LEVELS];
-static rt_queue_t rt_queue;
+static runqueue_t rq;
 static cpu_sched_t cpu_data[MAX_CPUS];
 static int num_cpus = 1;  /* Start with 1 CPU */
 static process_t idle_processes[MAX_CPUS];
 
+/* Protects the MLFQ and RT queues; shared by all CPUs, hence MCS */
+static mcs_lock_t rq_lock;
+
 /* Current CPU (simplified for single core initially) */
 static int current_cpu = 0;
 
 /*
- * NOTE: The ready queues and RT queue are currently global and shared.
- * In a true SMP environment, these would need synchronization (locks)
- * or per-CPU run queues with load balancing to prevent race conditions.
- * The current implementation is designed for single-CPU mode but includes
- * the infrastructure for future multi-CPU expansion.
+ * NOTE: The run queues are global and shared, serialized
+ * by rq_lock. Per-CPU run queues with load balancing would scale better
+ * once more than a few CPUs compete for it (see the "locks" shell command).
  */
 
-/* Initialize an MLFQ queue */
-static void mlfq_init(mlfq_t *q) {
-    q->head = 0;
-    q->tail = 0;
-    q->size = 0;
+static void sched_show(seq_file_t *m);
+
+static void rq_init(void) {
+    for (int q = 0; q < NR_RUNQUEUES; q++) {
+        list_init(&rq.queues[q]);
+        rq.len[q] = 0;
+    }
+    for (int w = 0; w < RQ_WORDS; w++) {
+        rq.bitmap[w] = 0;
+    }
+    rq.nr_rt = 0;
 }
 
-/* Add process to MLFQ queue */
-static void mlfq_enqueue(mlfq_t *q, process_t *proc) {
-    if (proc == NULL || q->size >= MAX_PROCESSES) {
-        return;
+/* Link p at the tail of queue q; rq_lock held */
+static void rq_enqueue(process_t *p, int q) {
+    list_add_tail(&rq.queues[q], &p->rq_node);
+    p->rq_queue = q;
+    rq.len[q]++;
+    rq.bitmap[q / 64] |= 1UL << (q % 64);
+    if (q < NR_RT_QUEUES) {
+        rq.nr_rt++;
     }
-    q->queue[q->tail] = proc;
-    q->tail = (q->tail + 1) % MAX_PROCESSES;
-    q->size++;
 }
 
-/* Remove process from MLFQ queue */
-static process_t* mlfq_dequeue(mlfq_t *q) {
-    if (q->size == 0) {
-        return NULL;
+/* Unlink p from the queue it is on; rq_lock held */
+static void rq_dequeue(process_t *p) {
+    int q = p->rq_queue;
+    list_del(&p->rq_node);
+    p->rq_queue = -1;
+    if (--rq.len[q] == 0) {
+        rq.bitmap[q / 64] &= ~(1UL << (q % 64));
+    }
+    if (q < NR_RT_QUEUES) {
+        rq.nr_rt--;
     }
-    process_t *proc = q->queue[q->head];
-    q->head = (q->head + 1) % MAX_PROCESSES;
-    q->size--;
-    return proc;
 }
 
-/* Add process to RT queue (priority sorted) */
-static void rt_enqueue(rt_queue_t *q, process_t *proc) {
-    if (proc == NULL || q->size >= MAX_PROCESSES) {
-        return;
+/* Queue proc runs from given its policy and priority; -1 for idle */
+static int rq_queue_for(process_t *proc) {
+    if (proc->policy == SCHED_IDLE) {
+        return -1;
     }
-    
-    /* Find insertion point based on priority (lower value = higher priority) */
-    int i;
-    for (i = q->size; i > 0; i--) {
-        if (q->queue[i-1]->priority <= proc->priority) {
-            break;
-        }
-        q->queue[i] = q->queue[i-1];
+    if (proc->policy == SCHED_FIFO || proc->policy == SCHED_RR) {
+        /* Real-time process; an RT policy with a normal priority runs at
+         * the lowest RT priority */
+        int prio = proc->priority;
+        if (prio < 0) prio = 0;
+        if (prio > PRIORITY_RT_MAX) prio = PRIORITY_RT_MAX;
+        return prio;
     }
-    q->queue[i] = proc;
-    q->size++;
+    /* Normal process - MLFQ */
+    int level = proc->queue_level;
+    if (level < 0) level = 0;
+    if (level >= NUM_QUEUE_LEVELS) level = NUM_QUEUE_LEVELS - 1;
+    return RQ_MLFQ(level);
 }
 
-/* Remove highest priority process from RT queue */
-static process_t* rt_dequeue(rt_queue_t *q) {
-    if (q->size == 0) {
-        return NULL;
+/* After a policy or priority change, move a queued proc to the tail of
+ * the queue it now belongs on; rq_lock held */
+static void rq_requeue(process_t *proc) {
+    if (proc->rq_queue < 0) {
+        return;
+    }
+    rq_dequeue(proc);
+    int q = rq_queue_for(proc);
+    if (q >= 0) {
+        rq_enqueue(proc, q);
     }
-    process_t *proc = q->queue[0];
-    q->size--;
-    for (int i = 0; i < q->size; i++) {
-        q->queue[i] = q->queue[i+1];
+}
+
+/* Highest-priority non-empty queue, or -1 */
+static int rq_first(void) {
+    for (int w = 0; w < RQ_WORDS; w++) {
+        uint64_t bits = __atomic_load_n(&rq.bitmap[w], __ATOMIC_RELAXED);
+        if (bits != 0) {
+            return w * 64 + ctz64(bits);
+        }
     }
-    return proc;
+    return -1;
 }
 
 /* Initialize idle process */
@@ -124,24 +159,19 @@ static void init_idle_process(int cpu_id) {
     idle->priority = PRIORITY_MAX;  /* Lowest priority */
     idle->policy = SCHED_IDLE;
     idle->queue_level = NUM_QUEUE_LEVELS - 1;
+    idle->rq_queue = -1;  /* Never queued */
+    list_init(&idle->rq_node);
     idle->cpu_id = cpu_id;
     idle->cpu_affinity = (1ULL << cpu_id);  /* Tied to specific CPU */
     
-    /* Copy "idle" string to name */
-    const char *name = "idle";
-    int i;
-    for (i = 0; name[i] != '\0' && i < 31; i++) {
-        idle->name[i] = name[i];
-    }
-    idle->name[i] = '\0';
+    strlcpy(idle->name, "idle", sizeof(idle->name));
     
     /* Initialize stats */
     idle->stats.cpu_time = 0;
     idle->stats.context_switches = 0;
-    idle->stats.start_time = get_ticks();
+    idle->stats.start_time = time_to_ns(r_time());
     idle->stats.last_run = 0;
     
-    cpu_data[cpu_id].idle = idle;
 }
 
 /* Initialize the scheduler */
@@ -149,79 +179,102 @@ void scheduler_init(void) {
     printf("[SCHED] Initializing advanced scheduler\n");
     printf("[SCHED] Multi-level feedback queue (MLFQ) with %d levels\n", NUM_QUEUE_LEVELS);
     printf("[SCHED] Real-time scheduling support enabled\n");
-    printf("[SCHED] SMP support: %d CPU(s)\n", num_cpus);
+    /* Secondary harts are left parked in the firmware */
+    printf("[SCHED] SMP support: %d of %d hart(s) online\n", num_cpus, machine.nr_harts);
+    
+    mcs_init(&rq_lock, "runqueue");
     
-    /* Initialize MLFQ queues */
+    rq_init();
     for (int i = 0; i < NUM_QUEUE_LEVELS; i++) {
-        mlfq_init(&ready_queues[i]);
         printf("[SCHED] Queue %d: time slice = %lu ticks\n", i, queue_time_slices[i]);
     }
     
-    /* Initialize RT queue */
-    rt_queue.size = 0;
-    
     /* Initialize per-CPU data */
     for (int i = 0; i < num_cpus; i++) {
         cpu_data[i].current = NULL;
         cpu_data[i].cpu_id = i;
         cpu_data[i].ticks = 0;
-        cpu_data[i].idle_ticks = 0;
+        cpu_data[i].prev = NULL;
         init_idle_process(i);
+        cpu_data[i].idle = &idle_processes[i];
     }
     
+    /* The boot thread becomes CPU 0's idle task; its context is saved
+     * the first time it switches away */
+    cpu_data[0].current = cpu_data[0].idle;
+    cpu_data[0].idle->state = PROC_RUNNING;
+    cputime_init();
+    procfs_register("sched", sched_show);
+    
     printf("[SCHED] Scheduler initialized\n");
 }
 
-/* Add a process to the ready queue */
+/* Add a process to the ready queue (safe from interrupt context) */
 void sched_add(process_t *proc) {
     if (proc == NULL) {
         return;
     }
     
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
     proc->state = PROC_RUNNABLE;
     
-    /* Route based on scheduling policy */
-    if (proc->policy == SCHED_FIFO || proc->policy == SCHED_RR) {
-        /* Real-time process */
-        rt_enqueue(&rt_queue, proc);
-    } else if (proc->policy == SCHED_IDLE) {
-        /* Idle process - don't queue it */
+    /* Already queued, or idle: nothing to link */
+    if (proc->rq_queue >= 0 || proc->policy == SCHED_IDLE) {
+        mcs_unlock_irqrestore(&rq_lock, &node, flags);
         return;
-    } else {
-        /* Normal process - add to MLFQ */
-        int level = proc->queue_level;
-        if (level < 0) level = 0;
-        if (level >= NUM_QUEUE_LEVELS) level = NUM_QUEUE_LEVELS - 1;
-        mlfq_enqueue(&ready_queues[level], proc);
     }
+    
+    /* Route based on scheduling policy */
+    int q = rq_queue_for(proc);
+    rq_enqueue(proc, q);
+    trace_event(TRACE_ENQUEUE, proc->pid,
+                q < RQ_MLFQ(0) ? (uint64_t)-1 : (uint64_t)(q - RQ_MLFQ(0)));
+    
+    /* Run delay is measured from here to the switch in */
+    if (proc->ready_ts == 0) {
+        proc->ready_ts = r_time();
+    }
+    mcs_unlock_irqrestore(&rq_lock, &node, flags);
+}
+
+/* Take a runnable process off the ready queues */
+int sched_remove(process_t *proc) {
+    if (proc == NULL) {
+        return -1;
+    }
+    
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
+    int ret = -1;
+    if (proc->rq_queue >= 0) {
+        rq_dequeue(proc);
+        ret = 0;
+    }
+    mcs_unlock_irqrestore(&rq_lock, &node, flags);
+    return ret;
 }
 
 /* Get next process to run (priority scheduling) */
 static process_t* sched_next(int cpu_id) {
     process_t *proc = NULL;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
     
-    /* First check RT queue (highest priority) */
-    if (rt_queue.size > 0) {
-        proc = rt_dequeue(&rt_queue);
-        if (proc != NULL) {
-            return proc;
-        }
-    }
-    
-    /* Then check MLFQ levels from highest to lowest */
-    for (int level = 0; level < NUM_QUEUE_LEVELS; level++) {
-        if (ready_queues[level].size > 0) {
-            proc = mlfq_dequeue(&ready_queues[level]);
-            if (proc != NULL) {
-                /* Reset time slice for this level */
-                proc->time_slice = queue_time_slices[level];
-                return proc;
-            }
+    /* RT priorities first, then MLFQ levels from highest to lowest */
+    int q = rq_first();
+    if (q >= 0) {
+        proc = container_of(rq.queues[q].next, process_t, rq_node);
+        rq_dequeue(proc);
+        if (q >= RQ_MLFQ(0)) {
+            /* Reset time slice for this level */
+            proc->time_slice = queue_time_slices[q - RQ_MLFQ(0)];
         }
     }
+    mcs_unlock_irqrestore(&rq_lock, &node, flags);
     
     /* No ready processes, return idle process */
-    return cpu_data[cpu_id].idle;
+    return proc ? proc : cpu_data[cpu_id].idle;
 }
 
 /* Get current running process */
@@ -234,13 +287,15 @@ int sched_cpu_id(void) {
     return current_cpu;
 }
 
-/* Set process priority */
+/* Set process priority; a queued process moves to its new queue */
 void sched_set_priority(process_t *proc, int priority) {
     if (proc == NULL) return;
     
     if (priority < PRIORITY_MIN) priority = PRIORITY_MIN;
     if (priority > PRIORITY_MAX) priority = PRIORITY_MAX;
     
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
     proc->priority = priority;
     proc->dynamic_priority = priority;
     
@@ -255,12 +310,19 @@ void sched_set_priority(process_t *proc, int priority) {
         if (level >= NUM_QUEUE_LEVELS) level = NUM_QUEUE_LEVELS - 1;
         proc->queue_level = level;
     }
+    rq_requeue(proc);
+    mcs_unlock_irqrestore(&rq_lock, &node, flags);
 }
 
-/* Set process policy */
+/* Set process policy; a queued process moves to its new queue */
 void sched_set_policy(process_t *proc, sched_policy_t policy) {
     if (proc == NULL) return;
+    
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
     proc->policy = policy;
+    rq_requeue(proc);
+    mcs_unlock_irqrestore(&rq_lock, &node, flags);
 }
 
 /* Context switch from old to new process */
@@ -295,10 +357,29 @@ static void context_switch(process_t *old, process_t *new) {
         }
     }
     
+    /* Switches never happen inside a read-side section */
+    rcu_quiescent();
+    
+    /* FP/vector state is saved only if dirty and restored on first use */
+    fpu_context_switch(old, new);
+    rvv_context_switch(old, new);
+    
     /* Load new process state */
     if (new != NULL) {
+        uint64_t now = r_time();
+        if (new->ready_ts != 0) {
+            trace_run_delay(now - new->ready_ts);
+            new->ready_ts = 0;
+        }
+        if (new->wake_ts != 0) {
+            trace_wakeup_latency(now - new->wake_ts);
+            new->wake_ts = 0;
+        }
+        trace_event(TRACE_SWITCH, old ? old->pid : 0, new->pid);
+        cputime_switch(old, new);
+        
         new->state = PROC_RUNNING;
-        new->stats.last_run = get_ticks();
+        new->stats.last_run = time_to_ns(now);
         new->stats.context_switches++;
         new->cpu_id = cpu_id;
         cpu_data[cpu_id].current = new;
@@ -312,19 +393,92 @@ static void context_switch(process_t *old, process_t *new) {
         
         /* Perform actual context switch via assembly */
         /* Always call swtch to load new context, even if old is NULL */
+        cpu_data[cpu_id].prev = old;
         swtch(old ? &old->context : NULL, &new->context);
+        
+        /* Back on old's stack, possibly much later */
+        sched_finish_switch();
+    }
+}
+
+/* Runs first thing after a switch lands, on the new task's stack */
+void sched_finish_switch(void) {
+    int cpu_id = current_cpu;
+    process_t *prev = cpu_data[cpu_id].prev;
+    
+    cpu_data[cpu_id].prev = NULL;
+    
+    /* An exited task cannot free its own stack; do it once we are off it */
+    if (prev != NULL && prev->state == PROC_ZOMBIE) {
+        process_free(prev);
     }
 }
 
 /* Yield CPU to next process */
 void sched_yield(void) {
     int cpu_id = current_cpu;
+    uint64_t flags = intr_save();
     process_t *old = cpu_data[cpu_id].current;
+    
+    if (old != NULL && old->rcu_nesting != 0) {
+        panic("sched_yield: inside RCU read-side section");
+    }
     process_t *new = sched_next(cpu_id);
     
+    /* Nothing else is ready: keep running rather than bounce through idle */
+    if (new == cpu_data[cpu_id].idle && old != NULL && old != new &&
+        old->state == PROC_RUNNING) {
+        intr_restore(flags);
+        return;
+    }
+    
     if (new != NULL) {
         context_switch(old, new);
     }
+    
+    /* Interrupt state is per task: restore the one we yielded with */
+    intr_restore(flags);
+}
+
+/* Block the current task until sched_wakeup(). Call with interrupts off
+ * after checking the wait condition, or a wakeup can be lost. */
+void sched_sleep(void) {
+    process_t *p = current_proc();
+    
+    if (p == NULL || p == cpu_data[current_cpu].idle) {
+        return;  /* Idle never blocks */
+    }
+    p->state = PROC_SLEEPING;
+    sched_yield();
+}
+
+/* Make a sleeping task runnable again (safe from interrupt context) */
+void sched_wakeup(process_t *p) {
+    uint64_t flags = intr_save();
+    if (p != NULL && p->state == PROC_SLEEPING) {
+        p->wake_ts = r_time();
+        trace_event(TRACE_WAKEUP, p->pid, 0);
+        sched_add(p);
+    }
+    intr_restore(flags);
+}
+
+/* Is anything besides idle ready to run? */
+int sched_has_runnable(void) {
+    return rq_first() >= 0;
+}
+
+/* One pass of idle-time work; idle loops call this while waiting */
+void sched_idle(void) {
+    rcu_quiescent();
+    ioring_poll();  /* Service SQPOLL rings */
+    if (sched_has_runnable()) {
+        sched_yield();
+    }
+}
+
+int sched_num_cpus(void) {
+    return num_cpus;
 }
 
 /* Timer tick handler for preemption */
@@ -335,26 +489,22 @@ void sched_tick(void) {
     /* Increment global tick counter */
     tick_increment();
     cpu_data[cpu_id].ticks++;
+    trace_event(TRACE_TICK, proc ? proc->pid : 0, 0);
+    rcu_tick();
     
+    /* CPU time is charged at switches and trap boundaries (cputime.c) */
     if (proc == NULL) {
         return;
     }
     
-    /* Update CPU time statistics */
-    proc->stats.cpu_time++;
-    
-    /* Track idle time */
-    if (proc == cpu_data[cpu_id].idle) {
-        cpu_data[cpu_id].idle_ticks++;
-    }
-    
     /* Decrement time slice */
     if (proc->time_slice > 0) {
         proc->time_slice--;
     }
     
-    /* Check if time slice expired */
-    if (proc->time_slice == 0) {
+    /* Check if time slice expired; readers are preempted once they leave
+     * their RCU read-side section, at a later tick */
+    if (proc->time_slice == 0 && proc->rcu_nesting == 0) {
         /* Preempt current process */
         if (proc->policy == SCHED_NORMAL) {
             /* For normal processes, this will trigger queue demotion */
@@ -369,17 +519,21 @@ void sched_tick(void) {
     /* Aging mechanism: periodically boost all processes back to highest queue */
     /* This prevents starvation */
     if (get_ticks() % 100 == 0) {
+        mcs_node_t node;
+        uint64_t flags = mcs_lock_irqsave(&rq_lock, &node);
+        
         /* Boost all processes in lower queues */
         for (int level = 1; level < NUM_QUEUE_LEVELS; level++) {
-            while (ready_queues[level].size > 0) {
-                process_t *p = mlfq_dequeue(&ready_queues[level]);
-                if (p != NULL && p->policy == SCHED_NORMAL) {
-                    p->queue_level = 0;  /* Boost to highest queue */
-                    p->time_slice = queue_time_slices[0];  /* Reset time slice */
-                    mlfq_enqueue(&ready_queues[0], p);
-                }
+            list_node_t *head = &rq.queues[RQ_MLFQ(level)];
+            while (!list_empty(head)) {
+                process_t *p = container_of(head->next, process_t, rq_node);
+                rq_dequeue(p);
+                p->queue_level = 0;  /* Boost to highest queue */
+                p->time_slice = queue_time_slices[0];  /* Reset time slice */
+                rq_enqueue(p, RQ_MLFQ(0));
             }
         }
+        mcs_unlock_irqrestore(&rq_lock, &node, flags);
     }
 }
 
@@ -390,13 +544,19 @@ void sched_print_stats(void) {
     
     for (int cpu_id = 0; cpu_id < num_cpus; cpu_id++) {
         printf("CPU %d:\n", cpu_id);
-        printf("  Total ticks: %lu\n", cpu_data[cpu_id].ticks);
-        printf("  Idle ticks: %lu\n", cpu_data[cpu_id].idle_ticks);
+        printf("  Total ticks: %u\n", cpu_data[cpu_id].ticks);
+        
+        /* The idle task's own time is this CPU's idle time; on CPU 0 it also
+         * covers the boot thread and shell, which run as idle */
+        proc_stats_t idle;
+        process_get_stats(cpu_data[cpu_id].idle, &idle);
+        uint64_t total = time_to_ns(r_time()) - idle.start_time;
+        uint64_t idle_ns = idle.cpu_time + idle.irqtime;
+        printf("  Idle time: %u us of %u us\n", idle_ns / 1000, total / 1000);
         
-        if (cpu_data[cpu_id].ticks > 0) {
-            uint64_t busy_ticks = cpu_data[cpu_id].ticks - cpu_data[cpu_id].idle_ticks;
-            uint64_t usage = (busy_ticks * 100) / cpu_data[cpu_id].ticks;
-            printf("  CPU Usage: %lu%%\n", usage);
+        if (total > 0 && total >= idle_ns) {
+            uint64_t usage = ((total - idle_ns) * 100) / total;
+            printf("  CPU Usage: %u%%\n", usage);
         }
         
         if (cpu_data[cpu_id].current != NULL) {
@@ -407,33 +567,50 @@ void sched_print_stats(void) {
     }
     
     printf("\nQueue Status:\n");
-    printf("  RT Queue: %d processes\n", rt_queue.size);
+    printf("  RT Queue: %d processes\n", rq.nr_rt);
     for (int i = 0; i < NUM_QUEUE_LEVELS; i++) {
         printf("  Queue %d: %d processes (time slice: %lu)\n", 
-               i, ready_queues[i].size, queue_time_slices[i]);
+               i, rq.len[RQ_MLFQ(i)], queue_time_slices[i]);
     }
     printf("========================================\n");
 }
 
-/* Main scheduler loop (never returns) */
+/* /proc/sched: per-CPU state, then the depth of each ready queue. Sizes
+ * are read without rq_lock; each is exact, the set is not a snapshot. */
+static void sched_show(seq_file_t *m) {
+    for (int cpu_id = 0; cpu_id < num_cpus; cpu_id++) {
+        process_t *curr = cpu_data[cpu_id].current;
+        seq_printf(m, "cpu %d ticks %u current %u %s\n", cpu_id,
+                   cpu_data[cpu_id].ticks, curr ? curr->pid : 0,
+                   curr ? curr->name : "-");
+    }
+    seq_printf(m, "rt_queue %d\n", __atomic_load_n(&rq.nr_rt, __ATOMIC_RELAXED));
+    for (int i = 0; i < NUM_QUEUE_LEVELS; i++) {
+        seq_printf(m, "mlfq %d %d slice %u\n", i,
+                   __atomic_load_n(&rq.len[RQ_MLFQ(i)], __ATOMIC_RELAXED),
+                   queue_time_slices[i]);
+    }
+}
+
+/* Idle loop: the calling thread becomes this CPU's idle task (never returns) */
 void scheduler(void) {
     printf("[SCHED] Starting scheduler\n");
     
+    /* CPU 0's boot thread was made its idle task, with the clock started,
+     * by scheduler_init(); restarting the clock would lose time not yet
+     * charged */
     int cpu_id = current_cpu;
+    if (cpu_data[cpu_id].current != cpu_data[cpu_id].idle) {
+        cpu_data[cpu_id].current = cpu_data[cpu_id].idle;
+        cpu_data[cpu_id].idle->state = PROC_RUNNING;
+        cputime_init();
+    }
     
     while (1) {
-        /* Get next process */
-        process_t *proc = sched_next(cpu_id);
+        sched_idle();
         
-        if (proc != NULL) {
-            /* Switch to process */
-            context_switch(NULL, proc);
-            
-            /* Run the process (would jump to process code here) */
-            /* For now, just yield back */
-            wfi();  /* Wait for interrupt */
-        } else {
-            /* Should not happen since we have idle process */
+        /* Nothing to do until an interrupt makes something runnable */
+        if (!sched_has_runnable()) {
             wfi();
         }
     }
@@ -17,9 +17,27 @@ void scheduler(void) __attribute__((noreturn));
 /* Add a process to the ready queue */
 void sched_add(process_t *proc);
 
+/* Take a runnable process back off the ready queues; 0 on success */
+int sched_remove(process_t *proc);
+
 /* Remove current process and schedule next */
 void sched_yield(void);
 
+/* Block the current task (interrupts off, condition checked) until woken */
+void sched_sleep(void);
+
+/* Requeue a sleeping task; callable from interrupt context */
+void sched_wakeup(process_t *p);
+
+/* Nonzero if a task other than idle is ready */
+int sched_has_runnable(void);
+
+/* Idle-time housekeeping, then yield if anything is ready */
+void sched_idle(void);
+
+/* Completes a switch on the incoming task's stack (reaps exited tasks) */
+void sched_finish_switch(void);
+
 /* Timer tick for preemption */
 void sched_tick(void);
 
@@ -29,6 +47,9 @@ process_t* current_proc(void);
 /* Get current CPU ID */
 int sched_cpu_id(void);
 
+/* Number of CPUs the scheduler manages */
+int sched_num_cpus(void);
+
 /* Set process priority */
 void sched_set_priority(process_t *proc, int priority);
 
@@ -0,0 +1,145 @@
+#include "workqueue.h"
+#include "kthread.h"
+#include "scheduler.h"
+#include "../printf.h"
+#include "../riscv.h"
+
+/* Per-CPU queue drained by one worker thread */
+typedef struct workqueue {
+    work_t *head;
+    work_t *tail;
+    process_t *worker;
+    volatile int running;      /* Worker is executing a batch */
+    uint64_t queued;
+    uint64_t completed;
+    uint64_t batches;
+    uint64_t max_batch;
+} workqueue_t;
+
+static workqueue_t workqueues[MAX_CPUS];
+
+static void worker_main(void *arg) {
+    workqueue_t *wq = (workqueue_t*)arg;
+    
+    while (1) {
+        uint64_t flags = intr_save();
+        while (wq->head == NULL) {
+            sched_sleep();
+        }
+        
+        /* Detach up to WQ_BATCH items with interrupts off, run them with
+         * interrupts on so handlers can keep queueing */
+        work_t *batch = wq->head;
+        work_t *last = batch;
+        uint64_t n = 1;
+        while (n < WQ_BATCH && last->next != NULL) {
+            last = last->next;
+            n++;
+        }
+        wq->head = last->next;
+        if (wq->head == NULL) {
+            wq->tail = NULL;
+        }
+        last->next = NULL;
+        wq->running = 1;
+        intr_restore(flags);
+        
+        while (batch != NULL) {
+            work_t *w = batch;
+            batch = w->next;
+            /* Cleared first so the item may requeue itself */
+            w->next = NULL;
+            w->pending = 0;
+            w->fn(w);
+        }
+        
+        wq->running = 0;
+        wq->completed += n;
+        wq->batches++;
+        if (n > wq->max_batch) {
+            wq->max_batch = n;
+        }
+        
+        /* More left: let other tasks in before the next batch */
+        if (wq->head != NULL) {
+            sched_yield();
+        }
+    }
+}
+
+void workqueue_init(void) {
+    for (int cpu = 0; cpu < sched_num_cpus(); cpu++) {
+        workqueue_t *wq = &workqueues[cpu];
+        wq->head = NULL;
+        wq->tail = NULL;
+        wq->running = 0;
+        wq->queued = 0;
+        wq->completed = 0;
+        wq->batches = 0;
+        wq->max_batch = 0;
+        
+        wq->worker = kthread_create(worker_main, wq, "kworker");
+        if (wq->worker == NULL) {
+            printf("[WQ] Failed to start worker for CPU %d\n", cpu);
+            continue;
+        }
+        wq->worker->cpu_affinity = 1ULL << cpu;
+    }
+    printf("[WQ] Workqueues initialized (%d CPU(s), batch %d)\n",
+           sched_num_cpus(), WQ_BATCH);
+}
+
+void work_init(work_t *w, void (*fn)(work_t *w), void *data) {
+    w->next = NULL;
+    w->fn = fn;
+    w->data = data;
+    w->pending = 0;
+}
+
+int queue_work_on(int cpu, work_t *w) {
+    if (w == NULL || w->fn == NULL || cpu < 0 || cpu >= sched_num_cpus()) {
+        return -1;
+    }
+    
+    workqueue_t *wq = &workqueues[cpu];
+    uint64_t flags = intr_save();
+    
+    if (w->pending) {
+        intr_restore(flags);
+        return -1;
+    }
+    w->pending = 1;
+    w->next = NULL;
+    if (wq->tail != NULL) {
+        wq->tail->next = w;
+    } else {
+        wq->head = w;
+    }
+    wq->tail = w;
+    wq->queued++;
+    
+    sched_wakeup(wq->worker);
+    intr_restore(flags);
+    return 0;
+}
+
+int queue_work(work_t *w) {
+    return queue_work_on(sched_cpu_id(), w);
+}
+
+void workqueue_flush(void) {
+    workqueue_t *wq = &workqueues[sched_cpu_id()];
+    
+    while (wq->head != NULL || wq->running) {
+        sched_yield();
+    }
+}
+
+void workqueue_print_stats(void) {
+    printf("\n[WQ] Workqueue Statistics:\n");
+    for (int cpu = 0; cpu < sched_num_cpus(); cpu++) {
+        workqueue_t *wq = &workqueues[cpu];
+        printf("  CPU %d: queued %u, completed %u, batches %u, max batch %u\n",
+               cpu, wq->queued, wq->completed, wq->batches, wq->max_batch);
+    }
+}
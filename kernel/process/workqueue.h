@@ -0,0 +1,32 @@
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "../types.h"
+
+/* Most items a worker runs before giving other tasks a turn */
+#define WQ_BATCH 16
+
+/* Deferred work item; embed in the owning object */
+typedef struct work {
+    struct work *next;
+    void (*fn)(struct work *w);
+    void *data;
+    volatile int pending;      /* Queued and not yet started */
+} work_t;
+
+/* Start one worker thread per CPU */
+void workqueue_init(void);
+
+void work_init(work_t *w, void (*fn)(work_t *w), void *data);
+
+/* Queue on the current / a given CPU. Safe from interrupt context.
+ * Returns 0 if queued, -1 if the item was already pending. */
+int queue_work(work_t *w);
+int queue_work_on(int cpu, work_t *w);
+
+/* Wait until the current CPU's queue is empty (not from a work item) */
+void workqueue_flush(void);
+
+void workqueue_print_stats(void);
+
+#endif /* _WORKQUEUE_H */
@@ -18,11 +18,22 @@
 #define SSTATUS_SIE  (1UL << 1)   /* Supervisor Interrupt Enable */
 #define SSTATUS_SPIE (1UL << 5)   /* Previous Interrupt Enable */
 #define SSTATUS_SPP  (1UL << 8)   /* Previous Privilege */
+#define SSTATUS_VS   (3UL << 9)   /* Vector unit state */
+#define SSTATUS_VS_OFF     (0UL << 9)
+#define SSTATUS_VS_INITIAL (1UL << 9)
+#define SSTATUS_VS_CLEAN   (2UL << 9)
+#define SSTATUS_VS_DIRTY   (3UL << 9)
+#define SSTATUS_FS   (3UL << 13)  /* Floating-point unit state */
+#define SSTATUS_FS_OFF     (0UL << 13)
+#define SSTATUS_FS_INITIAL (1UL << 13)
+#define SSTATUS_FS_CLEAN   (2UL << 13)
+#define SSTATUS_FS_DIRTY   (3UL << 13)
 
 /* Interrupt bits */
 #define SIE_SSIE     (1UL << 1)   /* Software interrupt */
 #define SIE_STIE     (1UL << 5)   /* Timer interrupt */
 #define SIE_SEIE     (1UL << 9)   /* External interrupt */
+#define SIP_SSIP     (1UL << 1)   /* Software interrupt pending (writable) */
 
 /* Trap causes */
 #define CAUSE_MISALIGNED_FETCH    0
@@ -37,11 +48,15 @@
 #define CAUSE_SUPERVISOR_ECALL    9
 #define CAUSE_HYPERVISOR_ECALL    10
 #define CAUSE_MACHINE_ECALL       11
+#define CAUSE_FETCH_PAGE_FAULT    12
+#define CAUSE_LOAD_PAGE_FAULT     13
+#define CAUSE_STORE_PAGE_FAULT    15
 
 /* Interrupt bit */
 #define INTERRUPT_BIT             (1UL << 63)
 
 /* CSR read/write inline functions */
+#ifndef HOST_TEST
 static inline uint64_t r_sstatus() {
     uint64_t x;
     asm volatile("csrr %0, sstatus" : "=r"(x));
@@ -62,6 +77,16 @@ static inline void w_sie(uint64_t x) {
     asm volatile("csrw sie, %0" : : "r"(x));
 }
 
+static inline uint64_t r_sip() {
+    uint64_t x;
+    asm volatile("csrr %0, sip" : "=r"(x));
+    return x;
+}
+
+static inline void w_sip(uint64_t x) {
+    asm volatile("csrw sip, %0" : : "r"(x));
+}
+
 static inline uint64_t r_stvec() {
     uint64_t x;
     asm volatile("csrr %0, stvec" : "=r"(x));
@@ -103,6 +128,72 @@ static inline uint64_t r_satp() {
 static inline void w_satp(uint64_t x) {
     asm volatile("csrw satp, %0" : : "r"(x));
 }
+#else
+/* Host unit tests (tests/host): CSRs are plain variables in the shim */
+uint64_t r_sstatus(void);
+void w_sstatus(uint64_t x);
+uint64_t r_sie(void);
+void w_sie(uint64_t x);
+uint64_t r_sip(void);
+void w_sip(uint64_t x);
+uint64_t r_stvec(void);
+void w_stvec(uint64_t x);
+uint64_t r_sepc(void);
+void w_sepc(uint64_t x);
+uint64_t r_scause(void);
+uint64_t r_stval(void);
+uint64_t r_satp(void);
+void w_satp(uint64_t x);
+#endif /* HOST_TEST */
+
+/* Interrupt enable helpers */
+static inline void intr_on() {
+    w_sstatus(r_sstatus() | SSTATUS_SIE);
+}
+
+static inline void intr_off() {
+    w_sstatus(r_sstatus() & ~SSTATUS_SIE);
+}
+
+static inline int intr_get() {
+    return (r_sstatus() & SSTATUS_SIE) != 0;
+}
+
+/* Disable interrupts, returning the previous enable state for intr_restore() */
+static inline uint64_t intr_save() {
+    uint64_t s = r_sstatus();
+    w_sstatus(s & ~SSTATUS_SIE);
+    return s & SSTATUS_SIE;
+}
+
+static inline void intr_restore(uint64_t flags) {
+    if (flags & SSTATUS_SIE) {
+        w_sstatus(r_sstatus() | SSTATUS_SIE);
+    }
+}
+
+/* Counters (S-mode access is enabled by OpenSBI through mcounteren) */
+/* Frequency of the time CSR, from the device tree (QEMU virt: 10 MHz),
+ * and its period; a timebase that does not divide 1 GHz rounds down */
+extern uint64_t timebase_hz;
+extern uint64_t ns_per_tick;
+
+static inline uint64_t time_to_ns(uint64_t t) {
+    return t * ns_per_tick;
+}
+
+#ifndef HOST_TEST
+static inline uint64_t r_time() {
+    uint64_t x;
+    asm volatile("rdtime %0" : "=r"(x));
+    return x;
+}
+
+static inline uint64_t r_cycle() {
+    uint64_t x;
+    asm volatile("rdcycle %0" : "=r"(x));
+    return x;
+}
 
 /* Memory barrier */
 static inline void sfence_vma() {
@@ -113,5 +204,11 @@ static inline void sfence_vma() {
 static inline void wfi() {
     asm volatile("wfi");
 }
+#else
+uint64_t r_time(void);             /* Host monotonic clock in timebase_hz units */
+uint64_t r_cycle(void);
+static inline void sfence_vma() {}
+static inline void wfi() {}
+#endif /* HOST_TEST */
 
 #endif /* _RISCV_H */
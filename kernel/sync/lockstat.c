@@ -0,0 +1,34 @@
+#include "lockstat.h"
+#include "../printf.h"
+
+static lock_stat_t *registry[MAX_LOCKSTATS];
+static uint32_t registry_count = 0;
+
+void lockstat_register(lock_stat_t *st, const char *name) {
+    st->name = name;
+    st->acquired = 0;
+    st->contended = 0;
+    st->spins = 0;
+    
+    /* Claim a slot with an AMO; locks past the table still work, unlisted */
+    uint32_t slot = __atomic_fetch_add(&registry_count, 1, __ATOMIC_RELAXED);
+    if (slot < MAX_LOCKSTATS) {
+        __atomic_store_n(&registry[slot], st, __ATOMIC_RELEASE);
+    }
+}
+
+void lockstat_print(void) {
+    uint32_t n = __atomic_load_n(&registry_count, __ATOMIC_ACQUIRE);
+    if (n > MAX_LOCKSTATS) {
+        n = MAX_LOCKSTATS;
+    }
+    
+    printf("\n[LOCK] Lock Statistics:\n");
+    for (uint32_t i = 0; i < n; i++) {
+        lock_stat_t *st = __atomic_load_n(&registry[i], __ATOMIC_ACQUIRE);
+        if (st != NULL) {
+            printf("  %s: acquired %u, contended %u, spins %u\n",
+                   st->name, st->acquired, st->contended, st->spins);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef _LOCKSTAT_H
+#define _LOCKSTAT_H
+
+#include "../types.h"
+
+/* Per-lock contention counters. Updated by the lock holder only, so they
+ * need no atomics of their own. */
+typedef struct lock_stat {
+    const char *name;
+    uint64_t acquired;         /* Successful acquisitions */
+    uint64_t contended;        /* Acquisitions that had to wait */
+    uint64_t spins;            /* Total wait-loop iterations */
+} lock_stat_t;
+
+#define MAX_LOCKSTATS 32
+
+/* Add a lock to the registry shown by lockstat_print(); lock-free */
+void lockstat_register(lock_stat_t *st, const char *name);
+
+/* Record one acquisition that waited for 'spins' iterations */
+static inline void lockstat_acquired(lock_stat_t *st, uint64_t spins) {
+    st->acquired++;
+    if (spins != 0) {
+        st->contended++;
+        st->spins += spins;
+    }
+}
+
+void lockstat_print(void);
+
+#endif /* _LOCKSTAT_H */
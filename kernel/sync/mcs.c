@@ -0,0 +1,54 @@
+#include "mcs.h"
+#include "../riscv.h"
+
+void mcs_init(mcs_lock_t *lock, const char *name) {
+    lock->tail = NULL;
+    lockstat_register(&lock->stat, name);
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node) {
+    uint64_t spins = 0;
+    
+    node->next = NULL;
+    node->locked = 1;
+    
+    /* Join the queue; a previous tail means someone holds or waits */
+    mcs_node_t *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (prev != NULL) {
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            spins++;
+        }
+    }
+    
+    lockstat_acquired(&lock->stat, spins);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node) {
+    mcs_node_t *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    
+    if (next == NULL) {
+        /* No known successor: try to mark the lock free */
+        mcs_node_t *expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        /* A waiter swapped itself in but has not linked yet */
+        while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL) {
+        }
+    }
+    
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node) {
+    uint64_t flags = intr_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags) {
+    mcs_unlock(lock, node);
+    intr_restore(flags);
+}
@@ -0,0 +1,28 @@
+#ifndef _MCS_H
+#define _MCS_H
+
+#include "../types.h"
+#include "lockstat.h"
+
+/* MCS queue lock: each waiter spins on its own node, so a contended lock
+ * costs one cache-line transfer per hand-off instead of a stampede.
+ * The caller provides the node (usually on its stack) and passes the same
+ * node to unlock. */
+typedef struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile int locked;
+} mcs_node_t;
+
+typedef struct mcs_lock {
+    mcs_node_t *volatile tail;
+    lock_stat_t stat;
+} mcs_lock_t;
+
+void mcs_init(mcs_lock_t *lock, const char *name);
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+
+uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, uint64_t flags);
+
+#endif /* _MCS_H */
@@ -0,0 +1,172 @@
+#include "rcu.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../process/scheduler.h"
+#include "../process/workqueue.h"
+
+/* Per-CPU callback batches. 'next' waits for a grace period to be
+ * started for it, 'wait' for grace period 'wait_gp' to end, 'done' for
+ * the worker. All three are only touched by their CPU, interrupts off. */
+typedef struct rcu_cpu {
+    volatile uint64_t qs_gp;   /* Newest grace period seen at a quiescent state */
+    rcu_head_t *next;
+    rcu_head_t **next_tail;
+    rcu_head_t *wait;
+    rcu_head_t **wait_tail;
+    uint64_t wait_gp;
+    rcu_head_t *done;
+    work_t work;
+    uint64_t queued;
+    uint64_t invoked;
+} rcu_cpu_t;
+
+static rcu_cpu_t rcu_cpus[MAX_CPUS];
+static volatile uint64_t gp_seq = 0;   /* Newest grace period started */
+static int rcu_ready = 0;
+
+/* Read-side nesting before the scheduler has a current task */
+static int boot_nesting = 0;
+
+static int *nesting(void) {
+    process_t *p = current_proc();
+    return p ? &p->rcu_nesting : &boot_nesting;
+}
+
+void rcu_read_lock(void) {
+    (*nesting())++;
+    __asm__ volatile("" ::: "memory");
+}
+
+void rcu_read_unlock(void) {
+    __asm__ volatile("" ::: "memory");
+    (*nesting())--;
+}
+
+int rcu_read_lock_held(void) {
+    return *nesting() != 0;
+}
+
+/* Every CPU has reported a quiescent state since 'gp' started */
+static int gp_completed(uint64_t gp) {
+    for (int cpu = 0; cpu < sched_num_cpus(); cpu++) {
+        if (__atomic_load_n(&rcu_cpus[cpu].qs_gp, __ATOMIC_ACQUIRE) < gp) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void rcu_quiescent(void) {
+    rcu_cpu_t *rc = &rcu_cpus[sched_cpu_id()];
+    
+    /* Reads from earlier read-side sections complete before the report */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&rc->qs_gp, __atomic_load_n(&gp_seq, __ATOMIC_RELAXED),
+                     __ATOMIC_RELEASE);
+}
+
+/* Worker side: run the callbacks whose grace period has ended */
+static void rcu_do_batch(work_t *w) {
+    rcu_cpu_t *rc = (rcu_cpu_t*)w->data;
+    
+    uint64_t flags = intr_save();
+    rcu_head_t *list = rc->done;
+    rc->done = NULL;
+    intr_restore(flags);
+    
+    while (list != NULL) {
+        rcu_head_t *head = list;
+        list = head->next;
+        head->func(head);
+        rc->invoked++;
+    }
+}
+
+/* Move callbacks along: finished batch to 'done', then start the next */
+static void advance(rcu_cpu_t *rc) {
+    if (rc->wait != NULL && gp_completed(rc->wait_gp)) {
+        *rc->wait_tail = rc->done;
+        rc->done = rc->wait;
+        rc->wait = NULL;
+        rc->wait_tail = &rc->wait;
+        queue_work(&rc->work);
+    }
+    if (rc->wait == NULL && rc->next != NULL) {
+        rc->wait = rc->next;
+        rc->wait_tail = rc->next_tail;
+        rc->next = NULL;
+        rc->next_tail = &rc->next;
+        rc->wait_gp = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void rcu_tick(void) {
+    if (!rcu_ready) {
+        return;
+    }
+    
+    /* The tick interrupted code outside any read-side section */
+    if (!rcu_read_lock_held()) {
+        rcu_quiescent();
+    }
+    advance(&rcu_cpus[sched_cpu_id()]);
+}
+
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head)) {
+    /* Early boot: one thread and no readers elsewhere to wait for */
+    if (!rcu_ready) {
+        func(head);
+        return;
+    }
+    
+    head->func = func;
+    head->next = NULL;
+    
+    uint64_t flags = intr_save();
+    rcu_cpu_t *rc = &rcu_cpus[sched_cpu_id()];
+    *rc->next_tail = head;
+    rc->next_tail = &head->next;
+    rc->queued++;
+    intr_restore(flags);
+}
+
+void synchronize_rcu(void) {
+    if (rcu_read_lock_held()) {
+        panic("synchronize_rcu: inside read-side section");
+    }
+    
+    uint64_t gp = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_SEQ_CST);
+    rcu_quiescent();
+    
+    /* Other CPUs report at their next switch, idle pass or tick */
+    while (!gp_completed(gp)) {
+        sched_yield();
+    }
+}
+
+void rcu_init(void) {
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        rcu_cpu_t *rc = &rcu_cpus[cpu];
+        rc->qs_gp = 0;
+        rc->next = NULL;
+        rc->next_tail = &rc->next;
+        rc->wait = NULL;
+        rc->wait_tail = &rc->wait;
+        rc->wait_gp = 0;
+        rc->done = NULL;
+        rc->queued = 0;
+        rc->invoked = 0;
+        work_init(&rc->work, rcu_do_batch, rc);
+    }
+    __atomic_store_n(&rcu_ready, 1, __ATOMIC_RELEASE);
+    printf("[RCU] Initialized\n");
+}
+
+void rcu_print_stats(void) {
+    printf("\n[RCU] Grace periods started: %u\n", gp_seq);
+    for (int cpu = 0; cpu < sched_num_cpus(); cpu++) {
+        rcu_cpu_t *rc = &rcu_cpus[cpu];
+        printf("  CPU %d: qs at gp %u, callbacks queued %u, invoked %u\n",
+               cpu, rc->qs_gp, rc->queued, rc->invoked);
+    }
+}
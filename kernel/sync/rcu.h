@@ -0,0 +1,44 @@
+#ifndef _RCU_H
+#define _RCU_H
+
+#include "../types.h"
+
+/* Read-copy-update for read-mostly tables. Readers bracket a lookup with
+ * rcu_read_lock()/rcu_read_unlock(): a per-task counter, no atomics and
+ * no shared writes. Updaters unpublish an object, then free it only after
+ * a grace period, once every CPU has passed a quiescent state (a context
+ * switch, the idle loop, or a tick outside any read-side section).
+ *
+ * Timer preemption is deferred while a task is inside a read-side
+ * section, and sleeping there is a bug (sched_yield panics). */
+
+/* Deferred callback; embed in the object to be reclaimed */
+typedef struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+} rcu_head_t;
+
+void rcu_init(void);
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+int rcu_read_lock_held(void);
+
+/* Publish a fully initialized object / fetch one for reading */
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+
+/* Run func(head) after a grace period, from the CPU's workqueue.
+ * Safe from interrupt context. */
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head));
+
+/* Wait for a grace period; task context, outside any read-side section */
+void synchronize_rcu(void);
+
+/* Hooks: the running task passed a quiescent state / a timer tick */
+void rcu_quiescent(void);
+void rcu_tick(void);
+
+void rcu_print_stats(void);
+
+#endif /* _RCU_H */
@@ -0,0 +1,56 @@
+#include "rwlock.h"
+
+void rw_init(rwlock_t *lock, const char *name) {
+    lock->state = 0;
+    lockstat_register(&lock->stat, name);
+}
+
+void read_lock(rwlock_t *lock) {
+    uint64_t spins = 0;
+    
+    while (1) {
+        uint32_t s = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+        if (!(s & (RW_WRITER | RW_WAITING)) &&
+            __atomic_compare_exchange_n(&lock->state, &s, s + 1, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        spins++;
+    }
+    
+    /* Readers run concurrently: count with AMOs rather than as holder */
+    __atomic_fetch_add(&lock->stat.acquired, 1, __ATOMIC_RELAXED);
+    if (spins != 0) {
+        __atomic_fetch_add(&lock->stat.contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&lock->stat.spins, spins, __ATOMIC_RELAXED);
+    }
+}
+
+void read_unlock(rwlock_t *lock) {
+    __atomic_fetch_sub(&lock->state, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t *lock) {
+    uint64_t spins = 0;
+    
+    while (1) {
+        uint32_t s = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+        /* Free apart from (possibly our own) waiting flag: take it */
+        if ((s & ~RW_WAITING) == 0 &&
+            __atomic_compare_exchange_n(&lock->state, &s, RW_WRITER, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (!(s & RW_WAITING)) {
+            __atomic_fetch_or(&lock->state, RW_WAITING, __ATOMIC_RELAXED);
+        }
+        spins++;
+    }
+    
+    lockstat_acquired(&lock->stat, spins);
+}
+
+void write_unlock(rwlock_t *lock) {
+    /* Other writers still waiting re-assert RW_WAITING on their next spin */
+    __atomic_fetch_and(&lock->state, ~RW_WRITER, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,23 @@
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include "../types.h"
+#include "lockstat.h"
+
+/* Reader-writer spinlock. The low bits count readers; a waiting writer
+ * sets RW_WAITING so new readers hold off and writers are not starved. */
+#define RW_WRITER  0x80000000U
+#define RW_WAITING 0x40000000U
+
+typedef struct rwlock {
+    volatile uint32_t state;
+    lock_stat_t stat;
+} rwlock_t;
+
+void rw_init(rwlock_t *lock, const char *name);
+void read_lock(rwlock_t *lock);
+void read_unlock(rwlock_t *lock);
+void write_lock(rwlock_t *lock);
+void write_unlock(rwlock_t *lock);
+
+#endif /* _RWLOCK_H */
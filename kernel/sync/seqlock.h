@@ -0,0 +1,47 @@
+#ifndef _SEQLOCK_H
+#define _SEQLOCK_H
+
+#include "../types.h"
+#include "spinlock.h"
+
+/* Sequence lock for small read-mostly data: readers never write shared
+ * state and retry if a writer overlapped. The count is odd while a write
+ * is in progress. Writers serialize on the embedded spinlock with
+ * interrupts off, so an interrupt-context reader cannot spin forever on a
+ * writer it preempted. */
+typedef struct seqlock {
+    volatile uint32_t seq;
+    spinlock_t lock;
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t *sl, const char *name) {
+    sl->seq = 0;
+    spin_init(&sl->lock, name);
+}
+
+static inline uint64_t write_seqlock_irqsave(seqlock_t *sl) {
+    uint64_t flags = spin_lock_irqsave(&sl->lock);
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  /* seq visible before data */
+    return flags;
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t *sl, uint64_t flags) {
+    __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&sl->lock, flags);
+}
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl) {
+    uint32_t s;
+    while ((s = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1) {
+    }
+    return s;
+}
+
+/* Nonzero if the data read since read_seqbegin() may be inconsistent */
+static inline int read_seqretry(const seqlock_t *sl, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != start;
+}
+
+#endif /* _SEQLOCK_H */
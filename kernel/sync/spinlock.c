@@ -0,0 +1,62 @@
+#include "spinlock.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../process/scheduler.h"
+
+void spin_init(spinlock_t *lock, const char *name) {
+    lock->next = 0;
+    lock->owner = 0;
+    lock->cpu = -1;
+    lockstat_register(&lock->stat, name);
+}
+
+int spin_holding(spinlock_t *lock) {
+    return __atomic_load_n(&lock->owner, __ATOMIC_RELAXED) !=
+               __atomic_load_n(&lock->next, __ATOMIC_RELAXED) &&
+           lock->cpu == sched_cpu_id();
+}
+
+void spin_lock(spinlock_t *lock) {
+    if (spin_holding(lock)) {
+        panic("spin_lock: recursive acquire");
+    }
+    
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint64_t spins = 0;
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        spins++;
+    }
+    
+    lock->cpu = sched_cpu_id();
+    lockstat_acquired(&lock->stat, spins);
+}
+
+int spin_trylock(spinlock_t *lock) {
+    uint32_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    uint32_t expected = owner;
+    
+    /* Only take a ticket if it would be served immediately */
+    if (!__atomic_compare_exchange_n(&lock->next, &expected, owner + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    lock->cpu = sched_cpu_id();
+    lockstat_acquired(&lock->stat, 0);
+    return 1;
+}
+
+void spin_unlock(spinlock_t *lock) {
+    lock->cpu = -1;
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+uint64_t spin_lock_irqsave(spinlock_t *lock) {
+    uint64_t flags = intr_save();
+    spin_lock(lock);
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags) {
+    spin_unlock(lock);
+    intr_restore(flags);
+}
@@ -0,0 +1,26 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "../types.h"
+#include "lockstat.h"
+
+/* Ticket spinlock: FIFO hand-off via amoadd.w on 'next'; the holder
+ * releases by bumping 'owner'. Never sleep while holding one. */
+typedef struct spinlock {
+    volatile uint32_t next;    /* Next ticket to hand out */
+    volatile uint32_t owner;   /* Ticket now being served */
+    int cpu;                   /* Holding CPU, -1 if free (debugging) */
+    lock_stat_t stat;
+} spinlock_t;
+
+void spin_init(spinlock_t *lock, const char *name);
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+int spin_trylock(spinlock_t *lock);   /* 1 if acquired */
+int spin_holding(spinlock_t *lock);
+
+/* Also disable local interrupts; use for locks taken in interrupt context */
+uint64_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags);
+
+#endif /* _SPINLOCK_H */
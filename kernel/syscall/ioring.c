@@ -0,0 +1,242 @@
+#include "ioring.h"
+#include "syscall.h"
+#include "../printf.h"
+#include "../mm/mm.h"
+#include "../mm/vm.h"
+
+#define MAX_IORINGS 16
+
+/* Drain state of a ring. Only the drain holding CTX_BUSY touches the
+ * queues; an owner released mid-drain (an operation can sleep or, on the
+ * idle task, yield) leaves CTX_DEAD behind and that drain tears down. */
+#define CTX_IDLE 0
+#define CTX_BUSY 1
+#define CTX_DEAD 2
+
+/* Kernel-private ring state, kept out of the user-writable page */
+typedef struct ioring_ctx {
+    io_ring_t *ring;           /* Kernel address of the shared page */
+    process_t *owner;
+    uint32_t flags;
+    int used;
+    int state;                 /* CTX_*, changed only by compare-and-swap */
+} ioring_ctx_t;
+
+static ioring_ctx_t rings[MAX_IORINGS];
+
+static int ctx_cas(ioring_ctx_t *ctx, int from, int to) {
+    return __atomic_compare_exchange_n(&ctx->state, &from, to, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* Free the ring page (unless it was left to leak) and the slot */
+static void ctx_teardown(ioring_ctx_t *ctx) {
+    if (ctx->ring != NULL) {
+        free_page(ctx->ring);
+    }
+    ctx->ring = NULL;
+    ctx->owner = NULL;
+    ctx->flags = 0;
+    __atomic_store_n(&ctx->used, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctx->state, CTX_IDLE, __ATOMIC_RELEASE);
+}
+
+/* Claim the ring for one drain; 0 on success */
+static int ctx_get(ioring_ctx_t *ctx) {
+    if (!__atomic_load_n(&ctx->used, __ATOMIC_ACQUIRE) ||
+        !ctx_cas(ctx, CTX_IDLE, CTX_BUSY)) {
+        return -1;
+    }
+    /* Torn down between the two checks above */
+    if (!__atomic_load_n(&ctx->used, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&ctx->state, CTX_IDLE, __ATOMIC_RELEASE);
+        return -1;
+    }
+    return 0;
+}
+
+static void ctx_put(ioring_ctx_t *ctx) {
+    if (!ctx_cas(ctx, CTX_BUSY, CTX_IDLE)) {
+        ctx_teardown(ctx);  /* CTX_DEAD: the owner is gone */
+    }
+}
+
+/* Execute one submission and return its result. Addresses in the entry
+ * belong to the ring owner, whoever drains it: with SQPOLL that is the
+ * idle task, which has no address space of its own. */
+static int64_t ioring_exec(pagetable_t pt, const io_sqe_t *sqe) {
+    iovec_t one, *iov;
+    
+    switch (sqe->opcode) {
+        case IORING_OP_NOP:
+            return 0;
+        case IORING_OP_READ:
+        case IORING_OP_WRITE:
+            one.iov_base = (void*)sqe->addr;
+            one.iov_len = sqe->len;
+            return syscall_file_io(pt, sqe->fd, &one, 1,
+                                   sqe->opcode == IORING_OP_WRITE);
+        case IORING_OP_READV:
+        case IORING_OP_WRITEV:
+            iov = syscall_iov();
+            if (iov == NULL ||
+                syscall_fetch_iov(pt, sqe->addr, (int)sqe->len, iov) != 0) {
+                return -1;
+            }
+            return syscall_file_io(pt, sqe->fd, iov, (int)sqe->len,
+                                   sqe->opcode == IORING_OP_WRITEV);
+        default:
+            return -1;
+    }
+}
+
+/* Drain up to max entries from the SQ, posting one CQE per valid entry.
+ * The caller holds the ring (ctx_get), so the owner is still there. */
+static int ioring_drain(ioring_ctx_t *ctx, uint32_t max) {
+    io_ring_t *r = ctx->ring;
+    pagetable_t pt = ctx->owner->pagetable;
+    uint32_t head = r->sq_head;
+    uint32_t tail = __atomic_load_n(&r->sq_tail, __ATOMIC_ACQUIRE);
+    uint32_t cq_tail = r->cq_tail;
+    uint32_t cq_head = __atomic_load_n(&r->cq_head, __ATOMIC_ACQUIRE);
+    int done = 0;
+    
+    while (head != tail && (uint32_t)done < max) {
+        /* Nobody is left to reap completions */
+        if (__atomic_load_n(&ctx->state, __ATOMIC_ACQUIRE) == CTX_DEAD) {
+            break;
+        }
+        
+        /* Back-pressure instead of dropping completions */
+        if (cq_tail - cq_head >= IORING_CQ_ENTRIES) {
+            break;
+        }
+        
+        /* Snapshot the entry so the user can't change it under us */
+        io_sqe_t sqe = r->sqes[head & (IORING_SQ_ENTRIES - 1)];
+        head++;
+        
+        /* Bad opcodes are consumed without a completion, only counted */
+        if (sqe.opcode > IORING_OP_WRITEV) {
+            r->sq_dropped++;
+            done++;
+            continue;
+        }
+        
+        io_cqe_t *cqe = &r->cqes[cq_tail & (IORING_CQ_ENTRIES - 1)];
+        cqe->user_data = sqe.user_data;
+        cqe->res = ioring_exec(pt, &sqe);
+        cq_tail++;
+        done++;
+    }
+    
+    /* Publish the consumed SQ slots and the new completions */
+    __atomic_store_n(&r->sq_head, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->cq_tail, cq_tail, __ATOMIC_RELEASE);
+    
+    return done;
+}
+
+int ioring_setup(process_t *p, uint32_t flags, uint64_t *addr) {
+    if (p == NULL || addr == NULL || p->ioring != NULL) {
+        return -1;
+    }
+    
+    ioring_ctx_t *ctx = NULL;
+    for (int i = 0; i < MAX_IORINGS; i++) {
+        if (!rings[i].used) {
+            ctx = &rings[i];
+            break;
+        }
+    }
+    if (ctx == NULL) {
+        printf("[IORING] No free rings\n");
+        return -1;
+    }
+    
+    /* alloc_page() hands back a zeroed page, so all indices start at 0 */
+    io_ring_t *ring = (io_ring_t*)alloc_page();
+    if (ring == NULL) {
+        return -1;
+    }
+    ring->flags = flags;
+    
+    /* Map into the task when it has its own address space */
+    if (p->pagetable != NULL) {
+        if (mappages(p->pagetable, IORING_USER_VA, PAGE_SIZE, (uint64_t)ring,
+                     PTE_R | PTE_W | PTE_U) != 0) {
+            free_page(ring);
+            return -1;
+        }
+        *addr = IORING_USER_VA;
+    } else {
+        *addr = (uint64_t)ring;
+    }
+    
+    ctx->ring = ring;
+    ctx->owner = p;
+    rss_add(p, RSS_ANON, 1);
+    ctx->flags = flags;
+    ctx->used = 1;
+    p->ioring = ctx;
+    
+    return 0;
+}
+
+int ioring_enter(process_t *p, uint32_t to_submit) {
+    if (p == NULL || p->ioring == NULL) {
+        return -1;
+    }
+    
+    /* The idle loop owns the SQ of a polled ring */
+    ioring_ctx_t *ctx = p->ioring;
+    if ((ctx->flags & IORING_SETUP_SQPOLL) || ctx_get(ctx) != 0) {
+        return -1;
+    }
+    int done = ioring_drain(ctx, to_submit);
+    ctx_put(ctx);
+    return done;
+}
+
+void ioring_poll(void) {
+    for (int i = 0; i < MAX_IORINGS; i++) {
+        ioring_ctx_t *ctx = &rings[i];
+        if (!(ctx->flags & IORING_SETUP_SQPOLL) || ctx_get(ctx) != 0) {
+            continue;  /* Not polled, or another CPU is draining it */
+        }
+        /* Checked again once held: the slot may have been reused */
+        if (ctx->flags & IORING_SETUP_SQPOLL) {
+            ioring_drain(ctx, IORING_SQ_ENTRIES);
+        }
+        ctx_put(ctx);
+    }
+}
+
+void ioring_release(process_t *p) {
+    if (p == NULL || p->ioring == NULL) {
+        return;
+    }
+    
+    ioring_ctx_t *ctx = p->ioring;
+    p->ioring = NULL;
+    if (p->pagetable != NULL &&
+        unmappages(p->pagetable, IORING_USER_VA, PAGE_SIZE) != 0) {
+        /* Still pinned for a transfer: leak the page rather than free it */
+        printf("[IORING] Ring page of PID %u still pinned, leaking it\n", p->pid);
+        ctx->ring = NULL;  /* A running drain keeps its own pointer */
+    }
+    rss_add(p, RSS_ANON, -1);
+    
+    /* Tear down now, or hand that to the drain in progress. Waiting for
+     * it instead could deadlock: the drain may be suspended on this very
+     * CPU's idle task, which is what frees exited tasks. */
+    for (;;) {
+        if (ctx_cas(ctx, CTX_IDLE, CTX_DEAD)) {
+            ctx_teardown(ctx);
+            return;
+        }
+        if (ctx_cas(ctx, CTX_BUSY, CTX_DEAD)) {
+            return;
+        }
+    }
+}
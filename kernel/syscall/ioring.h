@@ -0,0 +1,82 @@
+#ifndef _IORING_H
+#define _IORING_H
+
+#include "../types.h"
+#include "../process/process.h"
+
+/*
+ * Shared submission/completion ring.
+ *
+ * A task gets one page holding a submission queue (SQ) it fills and a
+ * completion queue (CQ) the kernel fills. Many operations can be queued
+ * and reaped with a single SYS_IORING_ENTER, or with no trap at all when
+ * the ring is set up with IORING_SETUP_SQPOLL.
+ */
+
+/* Ring geometry (powers of two) */
+#define IORING_SQ_ENTRIES 64
+#define IORING_CQ_ENTRIES 64
+
+/* User virtual address the ring page is mapped at */
+#define IORING_USER_VA 0x3FFFFFE000UL
+
+/* Setup flags */
+#define IORING_SETUP_SQPOLL (1U << 0)  /* Kernel polls the SQ from idle */
+
+/* Opcodes */
+#define IORING_OP_NOP    0
+#define IORING_OP_READ   1
+#define IORING_OP_WRITE  2
+#define IORING_OP_READV  3
+#define IORING_OP_WRITEV 4
+
+/* Submission queue entry */
+typedef struct io_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t len;              /* Bytes, or iovec count for READV/WRITEV */
+    uint64_t fd;               /* Handle from SYS_OPEN, or FD_STDIN/FD_STDOUT */
+    uint64_t addr;             /* Buffer or iovec array */
+    uint64_t user_data;        /* Echoed back in the completion */
+} io_sqe_t;
+
+/* Completion queue entry */
+typedef struct io_cqe {
+    uint64_t user_data;
+    int64_t res;               /* Bytes transferred, or -1 */
+} io_cqe_t;
+
+/*
+ * Ring page layout. Kernel-written and user-written indices sit on
+ * separate cache lines so the two sides don't false-share.
+ */
+typedef struct io_ring {
+    /* Written by the kernel */
+    uint32_t sq_head;
+    uint32_t cq_tail;
+    uint32_t sq_dropped;       /* Bad-opcode entries skipped, no CQE */
+    uint32_t flags;            /* Setup flags, read-only for the user */
+    uint8_t pad0[48];
+    /* Written by the user */
+    uint32_t sq_tail;
+    uint32_t cq_head;
+    uint8_t pad1[56];
+    io_sqe_t sqes[IORING_SQ_ENTRIES];
+    io_cqe_t cqes[IORING_CQ_ENTRIES];
+} io_ring_t;
+
+/* Create the ring for a process; *addr receives the address it should use */
+int ioring_setup(process_t *p, uint32_t flags, uint64_t *addr);
+
+/* Consume up to to_submit SQ entries; returns the number consumed.
+ * Fails on SQPOLL rings, whose SQ only the idle loop consumes. */
+int ioring_enter(process_t *p, uint32_t to_submit);
+
+/* Drain every SQPOLL ring (called from the idle loop) */
+void ioring_poll(void);
+
+/* Tear down a process's ring */
+void ioring_release(process_t *p);
+
+#endif /* _IORING_H */
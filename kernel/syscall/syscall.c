@@ -1,38 +1,271 @@
 #include "syscall.h"
+#include "ioring.h"
 #include "../printf.h"
 #include "../process/scheduler.h"
 #include "../fs/vfs.h"
+#include "../mm/mm.h"
+#include "../mm/vm.h"
+#include "../mm/mmap.h"
+#include "../net/net.h"
+#include "../lib/string.h"
 #include "../../drivers/uart/uart.h"
 
 #define SYSCALL_ERROR ((uint64_t)-1)  /* Error return value (UINT64_MAX) */
 
+#define SYSCALL_PATH_MAX 64        /* Longest path accepted by SYS_OPEN */
+#define SYSCALL_BOUNCE_SIZE 128    /* Console bounce buffer for user tasks */
+#define SYSCALL_IO_MAX_PAGES 32    /* User pages pinned per vectored call */
+
 void syscall_init(void) {
     /* Nothing to initialize for now */
 }
 
-uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t arg2) {
-    (void)arg2; /* Unused for now */
+/*
+ * User tasks pass addresses in their own address space; kernel tasks
+ * have no page table and pass kernel pointers, which are used as-is.
+ */
+static pagetable_t user_pagetable(void) {
+    process_t *p = current_proc();
+    return p ? (pagetable_t)p->pagetable : NULL;
+}
+
+/*
+ * Vectored I/O needs two VFS_IOV_MAX arrays at once: the caller's
+ * segments and the kernel ones built from them. At 1 KB each they don't
+ * belong on a one-page kernel stack, so every task gets a page of them on
+ * first use. A task runs one call at a time, so this is as private as its
+ * stack.
+ */
+#define SCRATCH_UIOV 0
+#define SCRATCH_KIOV VFS_IOV_MAX
+
+_Static_assert(2 * VFS_IOV_MAX * sizeof(iovec_t) <= PAGE_SIZE,
+               "iovec scratch must fit a page");
+
+static iovec_t *iov_scratch(void) {
+    process_t *p = current_proc();
+    if (p == NULL) {
+        return NULL;
+    }
+    if (p->iov_scratch == NULL) {
+        p->iov_scratch = (iovec_t*)alloc_page();
+        if (p->iov_scratch != NULL) {
+            rss_add(p, RSS_KERNEL, 1);
+        }
+    }
+    return p->iov_scratch;
+}
+
+iovec_t *syscall_iov(void) {
+    iovec_t *s = iov_scratch();
+    return s ? s + SCRATCH_UIOV : NULL;
+}
+
+/* Read a line (or len bytes) from the console */
+static size_t console_read(char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = uart_getc();
+        if (buf[i] == '\n') {
+            return i + 1;
+        }
+    }
+    return len;
+}
+
+/* Console side of vectored I/O; reads stop at the first newline */
+static int64_t console_io(const iovec_t *iov, int iovcnt, int write) {
+    int64_t total = 0;
+    
+    for (int i = 0; i < iovcnt; i++) {
+        if (write) {
+            uart_write((const char*)iov[i].iov_base, iov[i].iov_len);
+            total += iov[i].iov_len;
+        } else {
+            size_t n = console_read((char*)iov[i].iov_base, iov[i].iov_len);
+            total += n;
+            if (n < iov[i].iov_len) {
+                break;
+            }
+        }
+    }
+    return total;
+}
+
+/* Dispatch kernel-addressed segments to the console or a VFS file */
+static int64_t file_io(uint64_t fd, const iovec_t *iov, int iovcnt, int write) {
+    if (fd == FD_STDIN || fd == FD_STDOUT) {
+        return console_io(iov, iovcnt, write);
+    }
+    
+    file_t *file = (file_t*)fd;
+    return write ? vfs_writev(file, iov, iovcnt) : vfs_readv(file, iov, iovcnt);
+}
+
+/*
+ * Pin the user segments and describe them as kernel segments, one per
+ * physically contiguous run, so the transfer lands directly in the user
+ * pages. Segments beyond the pin budget are left out, which the caller
+ * reports as a short transfer, as is a segment that can't be pinned once
+ * earlier ones were. Returns the number of kernel segments (0 when there
+ * is nothing to transfer), or -1 if the first non-empty segment can't be
+ * pinned. Sets *pinned to the number of user segments that must be
+ * unpinned afterwards, the last one over *last_len bytes.
+ */
+static int pin_user_iov(pagetable_t pt, const iovec_t *uiov, int iovcnt,
+                        int write, iovec_t *kiov, int *pinned,
+                        uint64_t *last_len) {
+    uint64_t pas[SYSCALL_IO_MAX_PAGES];
+    int budget = SYSCALL_IO_MAX_PAGES;
+    int nk = 0;
+    
+    *pinned = 0;
+    *last_len = 0;
+    
+    for (int i = 0; i < iovcnt && budget > 0 && nk < VFS_IOV_MAX; i++) {
+        uint64_t va = (uint64_t)uiov[i].iov_base;
+        uint64_t len = uiov[i].iov_len;
+        if (len == 0) {
+            continue;
+        }
+        
+        /* Trim the segment to what the remaining budget can pin */
+        uint64_t max_len = (uint64_t)budget * PGSIZE - (va & (PGSIZE - 1));
+        if (len > max_len) {
+            len = max_len;
+        }
+        
+        /* A device read stores into the user pages */
+        int np = vm_pin_user(pt, va, len, !write, pas, budget);
+        if (np < 0) {
+            if (nk == 0) {
+                return -1;
+            }
+            break;
+        }
+        budget -= np;
+        *pinned = i + 1;
+        *last_len = len;
+        
+        for (int j = 0; j < np; j++) {
+            uint64_t off = (j == 0) ? (va & (PGSIZE - 1)) : 0;
+            uint64_t n = PGSIZE - off;
+            if (n > len) {
+                n = len;
+            }
+            uint64_t pa = pas[j] + off;
+            
+            if (nk > 0 &&
+                (uint64_t)kiov[nk - 1].iov_base + kiov[nk - 1].iov_len == pa) {
+                kiov[nk - 1].iov_len += n;
+            } else if (nk < VFS_IOV_MAX) {
+                kiov[nk].iov_base = (void*)pa;
+                kiov[nk].iov_len = n;
+                nk++;
+            } else {
+                break;  /* Out of kernel segments: short transfer */
+            }
+            len -= n;
+        }
+    }
+    
+    return nk;
+}
+
+int syscall_fetch_iov(pagetable_t pt, uint64_t uaddr, int iovcnt, iovec_t *kiov) {
+    if (iovcnt < 0 || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+    
+    if (pt == NULL) {
+        const iovec_t *src = (const iovec_t*)uaddr;
+        for (int i = 0; i < iovcnt; i++) {
+            kiov[i] = src[i];
+        }
+        return 0;
+    }
+    return copyin(pt, kiov, uaddr, (uint64_t)iovcnt * sizeof(iovec_t));
+}
+
+int64_t syscall_file_io(pagetable_t pt, uint64_t fd, const iovec_t *iov,
+                        int iovcnt, int write) {
+    if (iov == NULL || iovcnt < 0 || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+    
+    if (pt == NULL) {
+        return file_io(fd, iov, iovcnt, write);
+    }
+    
+    iovec_t *kiov = iov_scratch();
+    if (kiov == NULL) {
+        return -1;
+    }
+    kiov += SCRATCH_KIOV;
+    int pinned;
+    uint64_t last_len;
+    int nk = pin_user_iov(pt, iov, iovcnt, write, kiov, &pinned, &last_len);
+    if (nk <= 0) {
+        return nk;  /* Bad address, or nothing to move (as file_io()) */
+    }
+    
+    int64_t ret = file_io(fd, kiov, nk, write);
+    
+    for (int i = 0; i < pinned; i++) {
+        uint64_t len = (i == pinned - 1) ? last_len : iov[i].iov_len;
+        vm_unpin_user(pt, (uint64_t)iov[i].iov_base, len);
+    }
+    return ret;
+}
+
+uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4, uint64_t arg5) {
+    pagetable_t pt = user_pagetable();
     
     switch (num) {
         case SYS_READ: {
             /* Read from stdin */
-            char *buf = (char*)arg0;
             size_t len = (size_t)arg1;
-            for (size_t i = 0; i < len; i++) {
-                buf[i] = uart_getc();
-                if (buf[i] == '\n') {
-                    return i + 1;
+            if (pt == NULL) {
+                return console_read((char*)arg0, len);
+            }
+            
+            char bounce[SYSCALL_BOUNCE_SIZE];
+            size_t total = 0;
+            while (total < len) {
+                size_t chunk = len - total;
+                if (chunk > sizeof(bounce)) {
+                    chunk = sizeof(bounce);
+                }
+                size_t n = console_read(bounce, chunk);
+                if (copyout(pt, arg0 + total, bounce, n) != 0) {
+                    return SYSCALL_ERROR;
+                }
+                total += n;
+                if (n < chunk) {
+                    break;
                 }
             }
-            return len;
+            return total;
         }
         
         case SYS_WRITE: {
-            /* Write to stdout */
-            const char *buf = (const char*)arg0;
+            /* Write to stdout in FIFO-sized bursts */
             size_t len = (size_t)arg1;
-            for (size_t i = 0; i < len; i++) {
-                uart_putc(buf[i]);
+            if (pt == NULL) {
+                uart_write((const char*)arg0, len);
+                return len;
+            }
+            
+            char bounce[SYSCALL_BOUNCE_SIZE];
+            for (size_t off = 0; off < len; off += sizeof(bounce)) {
+                size_t chunk = len - off;
+                if (chunk > sizeof(bounce)) {
+                    chunk = sizeof(bounce);
+                }
+                if (copyin(pt, bounce, arg0 + off, chunk) != 0) {
+                    return off > 0 ? off : SYSCALL_ERROR;
+                }
+                uart_write(bounce, chunk);
             }
             return len;
         }
@@ -57,7 +290,14 @@ uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t ar
         
         case SYS_OPEN: {
             /* Open file */
+            char kpath[SYSCALL_PATH_MAX];
             const char *path = (const char*)arg0;
+            if (pt != NULL) {
+                if (copyinstr(pt, kpath, arg0, sizeof(kpath)) != 0) {
+                    return SYSCALL_ERROR;
+                }
+                path = kpath;
+            }
             uint32_t flags = (uint32_t)arg1;
             file_t *file = vfs_open(path, flags);
             if (file == NULL) {
@@ -88,6 +328,105 @@ uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t ar
             return 0;
         }
         
+        case SYS_READV:
+        case SYS_WRITEV: {
+            /* arg0 = handle, arg1 = iovec array, arg2 = segment count */
+            iovec_t *iov = syscall_iov();
+            if (iov == NULL || syscall_fetch_iov(pt, arg1, (int)arg2, iov) != 0) {
+                return SYSCALL_ERROR;
+            }
+            int64_t ret = syscall_file_io(pt, arg0, iov, (int)arg2,
+                                          num == SYS_WRITEV);
+            return ret < 0 ? SYSCALL_ERROR : (uint64_t)ret;
+        }
+        
+        case SYS_IORING_SETUP: {
+            /* arg0 = setup flags; returns the ring address */
+            uint64_t addr;
+            if (ioring_setup(current_proc(), (uint32_t)arg0, &addr) != 0) {
+                return SYSCALL_ERROR;
+            }
+            return addr;
+        }
+        
+        case SYS_IORING_ENTER: {
+            /* arg0 = entries to submit. Operations complete synchronously,
+             * so every consumed entry already has its CQE when we return. */
+            int ret = ioring_enter(current_proc(), (uint32_t)arg0);
+            return ret < 0 ? SYSCALL_ERROR : (uint64_t)ret;
+        }
+        
+        case SYS_MMAP: {
+            /* arg0 = address hint (ignored), arg1 = length, arg2 = prot,
+             * arg3 = flags, arg4 = handle, arg5 = file offset */
+            (void)arg0;
+            uint64_t va = mmap_map(current_proc(), arg1, (int)arg2, (int)arg3,
+                                   (file_t*)arg4, arg5);
+            return va == 0 ? SYSCALL_ERROR : va;
+        }
+        
+        case SYS_MUNMAP: {
+            /* arg0 = address, arg1 = length */
+            return mmap_unmap(current_proc(), arg0, arg1) == 0 ? 0 : SYSCALL_ERROR;
+        }
+        
+        case SYS_MSYNC: {
+            /* arg0 = address, arg1 = length; returns pages written back */
+            int ret = mmap_sync(current_proc(), arg0, arg1);
+            return ret < 0 ? SYSCALL_ERROR : (uint64_t)ret;
+        }
+        
+        case SYS_SOCKET: {
+            /* New unbound UDP socket; a handle like SYS_OPEN's */
+            file_t *file = vfs_open("/udp", 0);
+            return file == NULL ? SYSCALL_ERROR : (uint64_t)file;
+        }
+        
+        case SYS_BIND: {
+            /* arg0 = handle, arg1 = port (0: ephemeral) */
+            return udp_bind((file_t*)arg0, (uint16_t)arg1) == 0 ? 0 : SYSCALL_ERROR;
+        }
+        
+        case SYS_CONNECT: {
+            /* arg0 = handle, arg1 = IPv4 address, arg2 = port */
+            return udp_connect((file_t*)arg0, (uint32_t)arg1, (uint16_t)arg2) == 0 ?
+                   0 : SYSCALL_ERROR;
+        }
+        
+        case SYS_SENDMMSG:
+        case SYS_RECVMMSG: {
+            /* arg0 = handle, arg1 = net_msg_t array, arg2 = count,
+             * arg3 = recv flags; returns messages transferred */
+            net_msg_t msgs[NET_MMSG_MAX];
+            int n = (int)arg2;
+            if (n < 0 || n > NET_MMSG_MAX) {
+                return SYSCALL_ERROR;
+            }
+            uint64_t size = (uint64_t)n * sizeof(net_msg_t);
+            if (pt != NULL) {
+                if (copyin(pt, msgs, arg1, size) != 0) {
+                    return SYSCALL_ERROR;
+                }
+            } else {
+                memcpy(msgs, (const void*)arg1, size);
+            }
+            int ret = (num == SYS_SENDMMSG) ?
+                      udp_sendmmsg((file_t*)arg0, msgs, n, pt) :
+                      udp_recvmmsg((file_t*)arg0, msgs, n, (int)arg3, pt);
+            if (ret > 0 && num == SYS_RECVMMSG) {
+                /* Received lengths and sources */
+                size = (uint64_t)ret * sizeof(net_msg_t);
+                if (pt != NULL) {
+                    if (copyout(pt, arg1, msgs, size) != 0) {
+                        return SYSCALL_ERROR;
+                    }
+                } else {
+                    memcpy((void*)arg1, msgs, size);
+                }
+            }
+            return ret < 0 ? SYSCALL_ERROR : (uint64_t)ret;
+        }
+        
         default:
             printf("[SYSCALL] Unknown syscall: %u\n", (uint32_t)num);
             return SYSCALL_ERROR;
@@ -2,6 +2,8 @@
 #define _SYSCALL_H
 
 #include "../types.h"
+#include "../fs/vfs.h"
+#include "../mm/vm.h"
 
 /* System call numbers */
 #define SYS_READ   0
@@ -13,11 +15,42 @@
 #define SYS_CLOSE  6
 #define SYS_GETPID 7
 #define SYS_YIELD  8
+#define SYS_READV  9
+#define SYS_WRITEV 10
+#define SYS_IORING_SETUP 11
+#define SYS_IORING_ENTER 12
+#define SYS_MMAP   13
+#define SYS_MUNMAP 14
+#define SYS_MSYNC  15
+#define SYS_SOCKET 16
+#define SYS_BIND   17
+#define SYS_CONNECT 18
+#define SYS_SENDMMSG 19
+#define SYS_RECVMMSG 20
+
+/* Console handles accepted wherever a SYS_OPEN handle is expected */
+#define FD_STDIN  0
+#define FD_STDOUT 1
 
 /* System call initialization */
 void syscall_init(void);
 
-/* System call handler */
-uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t arg2);
+/* System call handler (arguments arrive in a0-a5) */
+uint64_t syscall_handler(uint64_t num, uint64_t arg0, uint64_t arg1, uint64_t arg2,
+                         uint64_t arg3, uint64_t arg4, uint64_t arg5);
+
+/* The calling task's VFS_IOV_MAX-entry array for a caller's segments,
+ * kept off the kernel stack; NULL if it can't be allocated */
+iovec_t *syscall_iov(void);
+
+/* Copy an iovec array from the address space pt into kernel memory.
+ * pt is the page table of the task the request came from; NULL only for
+ * kernel tasks, whose addresses are used as-is. */
+int syscall_fetch_iov(pagetable_t pt, uint64_t uaddr, int iovcnt, iovec_t *kiov);
+
+/* Vectored transfer on a console or SYS_OPEN handle (shared with io rings).
+ * Segment bases are addresses in the address space pt, as above. */
+int64_t syscall_file_io(pagetable_t pt, uint64_t fd, const iovec_t *iov,
+                        int iovcnt, int write);
 
 #endif /* _SYSCALL_H */
@@ -0,0 +1,232 @@
+#include "trace.h"
+#include "../printf.h"
+#include "../riscv.h"
+#include "../fs/vfs.h"
+#include "../lib/string.h"
+#include "../process/scheduler.h"
+
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+/* Single-producer-per-CPU ring. Slots are reserved with an AMO so that an
+ * interrupt recording on top of an interrupted writer gets its own slot;
+ * each slot's seq is published last so the reader can spot torn entries. */
+typedef struct trace_ring {
+    trace_event_t events[TRACE_RING_SIZE];
+    uint64_t head;             /* Next index to reserve */
+    uint64_t tail;             /* Next index the reader consumes */
+    uint64_t lost;             /* Overwritten before they were read */
+} trace_ring_t;
+
+/* Log2 histogram over nanoseconds */
+typedef struct lat_hist {
+    uint64_t buckets[TRACE_HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} lat_hist_t;
+
+volatile int trace_enabled = 1;
+
+static trace_ring_t rings[MAX_CPUS];
+static lat_hist_t wakeup_hist;
+static lat_hist_t run_delay_hist;
+
+/* Text rendering buffer for the schedlat device */
+#define SCHEDLAT_BUF_SIZE 2048
+static char schedlat_buf[SCHEDLAT_BUF_SIZE];
+
+void trace_event(uint32_t type, uint64_t arg0, uint64_t arg1) {
+    if (!trace_enabled) {
+        return;
+    }
+    
+    int cpu = sched_cpu_id();
+    trace_ring_t *r = &rings[cpu];
+    uint64_t idx = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    trace_event_t *e = &r->events[idx & TRACE_RING_MASK];
+    
+    /* Invalidate the slot before overwriting it */
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    
+    e->ts = r_time();
+    e->type = (uint16_t)type;
+    e->cpu = (uint16_t)cpu;
+    e->arg0 = (uint32_t)arg0;
+    e->arg1 = (uint32_t)arg1;
+    __atomic_store_n(&e->seq, (uint32_t)(idx + 1), __ATOMIC_RELEASE);
+}
+
+/* Copy out slot idx if it is complete and still holds that index */
+static int read_slot(trace_ring_t *r, uint64_t idx, trace_event_t *out) {
+    trace_event_t *e = &r->events[idx & TRACE_RING_MASK];
+    uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    
+    if (seq != (uint32_t)(idx + 1)) {
+        return -1;
+    }
+    *out = *e;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+    return 0;
+}
+
+static void hist_add(lat_hist_t *h, uint64_t delta) {
+    uint64_t ns = time_to_ns(delta);
+    int b = 0;
+    
+    /* floor(log2(ns)), without relying on libgcc for clz */
+    for (uint64_t v = ns; v > 1 && b < TRACE_HIST_BUCKETS - 1; v >>= 1) {
+        b++;
+    }
+    
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    
+    uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    while (ns > max &&
+           !__atomic_compare_exchange_n(&h->max_ns, &max, ns, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void trace_wakeup_latency(uint64_t delta) {
+    hist_add(&wakeup_hist, delta);
+}
+
+void trace_run_delay(uint64_t delta) {
+    hist_add(&run_delay_hist, delta);
+}
+
+/* "trace" device: consuming reads of whole trace_event_t records, grouped
+ * per CPU (merge by ts). Events overwritten before being read are counted
+ * in the schedlat report. */
+static int trace_dev_read(file_t *file, void *buf, size_t count) {
+    (void)file;
+    trace_event_t *out = (trace_event_t*)buf;
+    size_t max = count / sizeof(trace_event_t);
+    size_t n = 0;
+    
+    for (int cpu = 0; cpu < sched_num_cpus() && n < max; cpu++) {
+        trace_ring_t *r = &rings[cpu];
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        
+        /* Writer lapped us: skip to the oldest slot still in the ring */
+        if (head - r->tail > TRACE_RING_SIZE) {
+            r->lost += head - r->tail - TRACE_RING_SIZE;
+            r->tail = head - TRACE_RING_SIZE;
+        }
+        
+        while (r->tail < head && n < max) {
+            if (read_slot(r, r->tail, &out[n]) != 0) {
+                if (head - r->tail > TRACE_RING_SIZE / 2) {
+                    r->lost++;     /* Overwritten under us */
+                    r->tail++;
+                    continue;
+                }
+                break;             /* Still being written; retry next read */
+            }
+            n++;
+            r->tail++;
+        }
+    }
+    return (int)(n * sizeof(trace_event_t));
+}
+
+static int trace_dev_write(file_t *file, const void *buf, size_t count) {
+    (void)file;
+    if (count > 0) {
+        char c = ((const char*)buf)[0];
+        if (c == '0' || c == '1') {
+            trace_enabled = c - '0';
+        }
+    }
+    return (int)count;
+}
+
+static int trace_dev_open(inode_t *inode, file_t *file) {
+    (void)inode;
+    (void)file;
+    return 0;
+}
+
+static int trace_dev_close(file_t *file) {
+    (void)file;
+    return 0;
+}
+
+static size_t hist_render(char *buf, size_t size, const char *name, lat_hist_t *h) {
+    size_t len = 0;
+    uint64_t count = h->count;
+    
+    len += snprintf(buf + len, size - len, "%s count %u avg_ns %u max_ns %u\n",
+                    name, count, count ? h->sum_ns / count : 0, h->max_ns);
+    for (int b = 0; b < TRACE_HIST_BUCKETS && len < size; b++) {
+        if (h->buckets[b] != 0) {
+            len += snprintf(buf + len, size - len, "%s_bucket %u %u\n",
+                            name, 1UL << b, h->buckets[b]);
+        }
+    }
+    return len < size ? len : size - 1;
+}
+
+/* "schedlat" device: text histograms, one "name value..." record per line;
+ * bucket lines give the lower bound in ns and the sample count */
+static int schedlat_read(file_t *file, void *buf, size_t count) {
+    size_t len = 0;
+    uint64_t lost = 0;
+    
+    for (int cpu = 0; cpu < sched_num_cpus(); cpu++) {
+        lost += rings[cpu].lost;
+    }
+    
+    len += hist_render(schedlat_buf, SCHEDLAT_BUF_SIZE, "wakeup_latency", &wakeup_hist);
+    len += hist_render(schedlat_buf + len, SCHEDLAT_BUF_SIZE - len, "run_delay", &run_delay_hist);
+    len += snprintf(schedlat_buf + len, SCHEDLAT_BUF_SIZE - len, "trace_lost %u\n", lost);
+    if (len >= SCHEDLAT_BUF_SIZE) {
+        len = SCHEDLAT_BUF_SIZE - 1;
+    }
+    
+    if (file->offset >= len) {
+        return 0;
+    }
+    if (count > len - file->offset) {
+        count = len - file->offset;
+    }
+    memcpy(buf, schedlat_buf + file->offset, count);
+    file->offset += count;
+    return (int)count;
+}
+
+/* Any write resets the histograms */
+static int schedlat_write(file_t *file, const void *buf, size_t count) {
+    (void)file;
+    (void)buf;
+    memset(&wakeup_hist, 0, sizeof(wakeup_hist));
+    memset(&run_delay_hist, 0, sizeof(run_delay_hist));
+    return (int)count;
+}
+
+static file_ops_t trace_ops = {
+    .open = trace_dev_open,
+    .close = trace_dev_close,
+    .read = trace_dev_read,
+    .write = trace_dev_write,
+};
+
+static file_ops_t schedlat_ops = {
+    .open = trace_dev_open,
+    .close = trace_dev_close,
+    .read = schedlat_read,
+    .write = schedlat_write,
+};
+
+void trace_init(void) {
+    vfs_register_device("trace", &trace_ops);
+    vfs_register_device("schedlat", &schedlat_ops);
+    printf("[TRACE] Per-CPU trace rings: %d events, %u bytes each\n",
+           TRACE_RING_SIZE, (uint32_t)sizeof(trace_event_t));
+}
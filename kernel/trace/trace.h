@@ -0,0 +1,42 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "../types.h"
+
+/* Event types */
+#define TRACE_SWITCH     1   /* arg0 = prev pid, arg1 = next pid */
+#define TRACE_WAKEUP     2   /* arg0 = pid */
+#define TRACE_ENQUEUE    3   /* arg0 = pid, arg1 = queue level (-1 for RT) */
+#define TRACE_TICK       4   /* arg0 = current pid */
+#define TRACE_IRQ_ENTRY  5   /* arg0 = scause */
+#define TRACE_IRQ_EXIT   6   /* arg0 = scause */
+
+/* Per-CPU ring capacity in events (power of two) */
+#define TRACE_RING_SIZE 512
+
+/* Log2 latency histogram buckets: bucket i counts values in [2^i, 2^(i+1)) ns */
+#define TRACE_HIST_BUCKETS 32
+
+/* One ring entry; also the record format returned by the "trace" device */
+typedef struct trace_event {
+    uint64_t ts;               /* time CSR at the event */
+    uint32_t seq;              /* Low bits of ring index + 1, written last */
+    uint16_t type;
+    uint16_t cpu;
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_event_t;
+
+/* Recording is on by default; writing '0'/'1' to the trace device toggles it */
+extern volatile int trace_enabled;
+
+void trace_init(void);
+
+/* Lock-free record into the current CPU's ring; safe from any context */
+void trace_event(uint32_t type, uint64_t arg0, uint64_t arg1);
+
+/* Latency samples (time CSR deltas) for the histograms */
+void trace_wakeup_latency(uint64_t delta);
+void trace_run_delay(uint64_t delta);
+
+#endif /* _TRACE_H */
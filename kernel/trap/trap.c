@@ -2,9 +2,33 @@
 #include "../riscv.h"
 #include "../printf.h"
 #include "../process/scheduler.h"
+#include "../mm/mmap.h"
+#include "../lib/rvv.h"
+#include "../process/fpu.h"
+#include "../trace/trace.h"
+#include "../process/cputime.h"
+#include "../fs/procfs.h"
+#include "../../drivers/plic/plic.h"
 
 extern void trap_entry(void);
 
+/* External interrupt handlers, by PLIC source */
+typedef struct irq_handler {
+    void (*fn)(void *arg);
+    void *arg;
+} irq_handler_t;
+
+static irq_handler_t irq_handlers[MAX_IRQS];
+
+/* Interrupt and fault counts; each CPU only writes its own row, and
+ * nothing reads them but /proc/interrupts */
+enum { CNT_SOFT, CNT_TIMER, CNT_EXTERNAL, CNT_PAGE_FAULT, CNT_NR };
+static const char *const cnt_names[CNT_NR] = { "soft", "timer", "external", "page_fault" };
+static uint64_t trap_counts[MAX_CPUS][CNT_NR];
+static uint64_t irq_counts[MAX_CPUS][MAX_IRQS];
+
+static void interrupts_show(seq_file_t *m);
+
 void trap_init(void) {
     printf("[TRAP] Initializing trap handling\n");
     
@@ -15,10 +39,39 @@ void trap_init(void) {
     w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
     w_sstatus(r_sstatus() | SSTATUS_SIE);
     
+    procfs_register("interrupts", interrupts_show);
     printf("[TRAP] Trap vector set to %p\n", (void*)r_stvec());
 }
 
-void trap_handler(void) {
+int trap_register_irq(uint32_t irq, void (*fn)(void *arg), void *arg) {
+    if (irq == 0 || irq >= MAX_IRQS || irq_handlers[irq].fn != NULL) {
+        return -1;
+    }
+    irq_handlers[irq].arg = arg;
+    __atomic_store_n(&irq_handlers[irq].fn, fn, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Serve every pending PLIC source before returning */
+static void external_interrupt(void) {
+    uint32_t irq;
+    while ((irq = plic_claim()) != 0) {
+        if (irq < MAX_IRQS) {
+            irq_counts[sched_cpu_id()][irq]++;
+        }
+        void (*fn)(void *arg) = irq < MAX_IRQS ?
+            __atomic_load_n(&irq_handlers[irq].fn, __ATOMIC_ACQUIRE) : NULL;
+        if (fn) {
+            fn(irq_handlers[irq].arg);
+        } else {
+            printf("[TRAP] Unhandled external interrupt %u\n", irq);
+            plic_disable(irq);
+        }
+        plic_complete(irq);
+    }
+}
+
+static void trap_dispatch(void) {
     uint64_t scause = r_scause();
     uint64_t sepc = r_sepc();
     uint64_t stval = r_stval();
@@ -27,23 +80,48 @@ void trap_handler(void) {
     if (scause & INTERRUPT_BIT) {
         /* Interrupt */
         uint64_t int_num = scause & ~INTERRUPT_BIT;
+        uint64_t *counts = trap_counts[sched_cpu_id()];
         
+        trace_event(TRACE_IRQ_ENTRY, int_num, 0);
         switch (int_num) {
             case 1: /* Supervisor software interrupt */
-                printf("[TRAP] Software interrupt\n");
+                counts[CNT_SOFT]++;
+                /* Stays pending until cleared, so acknowledge it first */
+                w_sip(r_sip() & ~SIP_SSIP);
                 break;
             case 5: /* Supervisor timer interrupt */
+                counts[CNT_TIMER]++;
                 /* Timer interrupt - call scheduler for preemption */
                 sched_tick();
                 break;
             case 9: /* Supervisor external interrupt */
-                printf("[TRAP] External interrupt\n");
+                counts[CNT_EXTERNAL]++;
+                external_interrupt();
                 break;
             default:
                 printf("[TRAP] Unknown interrupt: %u\n", (uint32_t)int_num);
                 break;
         }
+        trace_event(TRACE_IRQ_EXIT, int_num, 0);
     } else {
+        /* First FP/vector instruction of a task: bring in its state */
+        if (scause == CAUSE_ILLEGAL_INSTRUCTION &&
+            (rvv_handle_trap(current_proc(), stval) == 0 ||
+             fpu_handle_trap(current_proc(), stval) == 0)) {
+            return;
+        }
+        
+        /* Page faults inside a file mapping are populated on demand */
+        if (scause == CAUSE_LOAD_PAGE_FAULT || scause == CAUSE_STORE_PAGE_FAULT ||
+            scause == CAUSE_FETCH_PAGE_FAULT) {
+            int access = (scause == CAUSE_STORE_PAGE_FAULT) ? PROT_WRITE :
+                         (scause == CAUSE_FETCH_PAGE_FAULT) ? PROT_EXEC : PROT_READ;
+            trap_counts[sched_cpu_id()][CNT_PAGE_FAULT]++;
+            if (mmap_fault(current_proc(), stval, access) == 0) {
+                return;
+            }
+        }
+        
         /* Exception */
         printf("\n[TRAP] Exception occurred!\n");
         printf("  scause: %p\n", (void*)scause);
@@ -81,6 +159,15 @@ void trap_handler(void) {
             case CAUSE_SUPERVISOR_ECALL:
                 printf("  Environment call from S-mode\n");
                 break;
+            case CAUSE_FETCH_PAGE_FAULT:
+                printf("  Instruction page fault\n");
+                break;
+            case CAUSE_LOAD_PAGE_FAULT:
+                printf("  Load page fault\n");
+                break;
+            case CAUSE_STORE_PAGE_FAULT:
+                printf("  Store page fault\n");
+                break;
             default:
                 printf("  Unknown exception: %u\n", (uint32_t)scause);
                 break;
@@ -89,3 +176,42 @@ void trap_handler(void) {
         panic("Unhandled exception");
     }
 }
+
+void trap_handler(void) {
+    /* Charge the time up to here to the interrupted mode (user if we came
+     * from U-mode), and the handler itself as IRQ or system time */
+    int from_user = (r_sstatus() & SSTATUS_SPP) == 0;
+    int mode = (r_scause() & INTERRUPT_BIT) ? CPUTIME_IRQ : CPUTIME_SYS;
+    int prev = cputime_trap_enter(mode, from_user);
+    
+    trap_dispatch();
+    
+    cputime_trap_exit(prev);
+}
+
+/* /proc/interrupts: one line per kind, then per PLIC source that has
+ * fired, with one column per CPU */
+static void interrupts_show(seq_file_t *m) {
+    int ncpu = sched_num_cpus();
+    for (int c = 0; c < CNT_NR; c++) {
+        seq_printf(m, "%s", cnt_names[c]);
+        for (int cpu = 0; cpu < ncpu; cpu++) {
+            seq_printf(m, " %u", trap_counts[cpu][c]);
+        }
+        seq_printf(m, "\n");
+    }
+    for (uint32_t irq = 1; irq < MAX_IRQS; irq++) {
+        uint64_t total = 0;
+        for (int cpu = 0; cpu < ncpu; cpu++) {
+            total += irq_counts[cpu][irq];
+        }
+        if (total == 0) {
+            continue;
+        }
+        seq_printf(m, "irq%u", irq);
+        for (int cpu = 0; cpu < ncpu; cpu++) {
+            seq_printf(m, " %u", irq_counts[cpu][irq]);
+        }
+        seq_printf(m, "\n");
+    }
+}
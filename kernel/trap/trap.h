@@ -6,6 +6,11 @@
 /* Trap initialization */
 void trap_init(void);
 
+/* Route PLIC source irq to fn(arg), called in interrupt context;
+ * 0 on success, -1 if out of range or taken */
+#define MAX_IRQS 64
+int trap_register_irq(uint32_t irq, void (*fn)(void *arg), void *arg);
+
 /* Trap handler (called from assembly) */
 void trap_handler(void);
 
@@ -22,4 +22,10 @@ typedef int64_t ssize_t;
 #define false 0
 typedef int bool;
 
+#define offsetof(type, member) __builtin_offsetof(type, member)
+
+/* Enclosing object of an embedded member */
+#define container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
 #endif /* _TYPES_H */
@@ -0,0 +1,135 @@
+/* Host shim: just enough of the kernel's environment (console, CSRs,
+ * string helpers, RCU and per-task hooks) to run mm, process, scheduler,
+ * vfs and simplefs as ordinary user-space code (docs/TESTING.md) */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct process process_t;
+typedef struct rcu_head {
+    struct rcu_head *next;
+    void (*func)(struct rcu_head *head);
+} rcu_head_t;
+
+int shim_verbose = 0;
+int shim_fake_switch = 0;  /* swtch() returns at once instead of panicking */
+
+/* Console */
+void kprintf(const char *fmt, ...) {
+    if (!shim_verbose) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+void panic(const char *msg) {
+    fprintf(stderr, "PANIC: %s\n", msg);
+    abort();
+}
+
+/* CSRs: interrupts always "off" as far as intr_save() is concerned */
+static uint64_t csr_sstatus, csr_sie, csr_sip, csr_stvec, csr_sepc, csr_satp;
+
+uint64_t r_sstatus(void) { return csr_sstatus; }
+void w_sstatus(uint64_t x) { csr_sstatus = x; }
+uint64_t r_sie(void) { return csr_sie; }
+void w_sie(uint64_t x) { csr_sie = x; }
+uint64_t r_sip(void) { return csr_sip; }
+void w_sip(uint64_t x) { csr_sip = x; }
+uint64_t r_stvec(void) { return csr_stvec; }
+void w_stvec(uint64_t x) { csr_stvec = x; }
+uint64_t r_sepc(void) { return csr_sepc; }
+void w_sepc(uint64_t x) { csr_sepc = x; }
+uint64_t r_scause(void) { return 0; }
+uint64_t r_stval(void) { return 0; }
+uint64_t r_satp(void) { return csr_satp; }
+void w_satp(uint64_t x) { csr_satp = x; }
+
+static uint64_t host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Ticks at whatever timebase kernel/fdt.c set */
+extern uint64_t ns_per_tick;
+uint64_t r_time(void) { return host_ns() / ns_per_tick; }
+uint64_t r_cycle(void) { return host_ns(); }
+
+/* kernel/lib/string.c extras not in glibc (memcpy and friends come from
+ * libc itself) */
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+void page_clear(void *page) { memset(page, 0, 4096); }
+void page_copy(void *dst, const void *src) { memcpy(dst, src, 4096); }
+
+/* RCU: single-threaded, so every point is quiescent */
+void rcu_read_lock(void) {}
+void rcu_read_unlock(void) {}
+int rcu_read_lock_held(void) { return 1; }
+void rcu_quiescent(void) {}
+void rcu_tick(void) {}
+void call_rcu(rcu_head_t *head, void (*func)(rcu_head_t *head)) {
+    func(head);
+}
+
+/* Per-task hooks of subsystems not built on the host */
+void rvv_context_switch(process_t *old, process_t *new) { (void)old; (void)new; }
+void rvv_release(process_t *p) { (void)p; }
+void fpu_context_switch(process_t *old, process_t *new) { (void)old; (void)new; }
+void fpu_release(process_t *p) { (void)p; }
+void cputime_init(void) {}
+void cputime_switch(process_t *old, process_t *new) { (void)old; (void)new; }
+void cputime_read(process_t *p, uint64_t *ns) { (void)p; memset(ns, 0, 3 * sizeof(*ns)); }
+void trace_event(uint32_t type, uint64_t arg0, uint64_t arg1) {
+    (void)type; (void)arg0; (void)arg1;
+}
+void trace_run_delay(uint64_t delta) { (void)delta; }
+/* No console or network on the host; syscall.c only links against them */
+char uart_getc(void) { return '\n'; }
+void uart_write(const char *buf, size_t len) { (void)buf; (void)len; }
+int udp_bind(void *file, uint16_t port) { (void)file; (void)port; return -1; }
+int udp_connect(void *file, uint32_t addr, uint16_t port) {
+    (void)file; (void)addr; (void)port;
+    return -1;
+}
+int udp_sendmmsg(void *file, void *msgs, int n, void *pt) {
+    (void)file; (void)msgs; (void)n; (void)pt;
+    return -1;
+}
+int udp_recvmmsg(void *file, void *msgs, int n, int flags, void *pt) {
+    (void)file; (void)msgs; (void)n; (void)flags; (void)pt;
+    return -1;
+}
+
+/* No threads on the host: reclaim runs only directly */
+process_t *kthread_create(void (*fn)(void *arg), void *arg, const char *name) {
+    (void)fn; (void)arg; (void)name;
+    return NULL;
+}
+void trace_wakeup_latency(uint64_t delta) { (void)delta; }
+
+/* The tests never switch tasks; benchmarks of the switch path set
+ * shim_fake_switch, and the "new" task then simply carries on on the
+ * same host stack */
+void swtch(void *old, void *new) {
+    (void)old; (void)new;
+    if (!shim_fake_switch) {
+        panic("swtch called on host");
+    }
+}
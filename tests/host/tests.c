@@ -0,0 +1,1029 @@
+/* Host unit tests and microbenchmarks for the freestanding kernel modules.
+ *
+ *   make host-test            run the unit tests
+ *   make host-bench           run the microbenchmarks
+ *
+ * Each benchmark is scaled until a run takes at least BENCH_MIN_NS and
+ * reports ns per operation, in the style of Google Benchmark, plus cache
+ * misses per operation where the host has a hardware counter for them. */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mm/mm.h"
+#include "mm/dma.h"
+#include "mm/reclaim.h"
+#include "mm/vm.h"
+#include "mm/mmap.h"
+#include "process/process.h"
+#include "process/scheduler.h"
+#include "fs/vfs.h"
+#include "fs/simplefs.h"
+#include "fs/procfs.h"
+#include "fdt.h"
+#include "riscv.h"
+
+extern int shim_verbose;
+extern int shim_fake_switch;
+
+/* ---- Minimal test framework ---- */
+
+static int checks_failed = 0;
+static int tests_run = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        checks_failed++; \
+    } \
+} while (0)
+
+#define RUN_TEST(fn) do { \
+    int before = checks_failed; \
+    fn(); \
+    tests_run++; \
+    printf("%-28s %s\n", #fn, checks_failed == before ? "ok" : "FAILED"); \
+} while (0)
+
+/* ---- mm ---- */
+
+static void test_page_alloc(void) {
+    uint64_t free_before = mm_free_pages();
+    void *a = alloc_page();
+    void *b = alloc_page();
+    CHECK(a != NULL && b != NULL && a != b);
+    CHECK(((uint64_t)a & (PAGE_SIZE - 1)) == 0);
+    CHECK(mm_free_pages() == free_before - 2);
+    
+    /* Freed pages are reused first, most recent on top */
+    free_page(b);
+    CHECK(alloc_page() == b);
+    free_page(b);
+    free_page(a);
+    CHECK(mm_free_pages() == free_before);
+}
+
+static void test_page_exhaustion(void) {
+    uint64_t n = mm_free_pages();
+    void **pages = malloc((n + 1) * sizeof(void *));
+    uint64_t got = 0;
+    while ((pages[got] = alloc_page()) != NULL) {
+        got++;
+    }
+    CHECK(got == n);
+    CHECK(mm_free_pages() == 0);
+    while (got > 0) {
+        free_page(pages[--got]);
+    }
+    CHECK(mm_free_pages() == n);
+    free(pages);
+}
+
+static void test_kmalloc(void) {
+    char *a = kmalloc(3);
+    char *b = kmalloc(40);
+    CHECK(a != NULL && b != NULL);
+    CHECK(((uint64_t)b & 7) == 0);
+    CHECK(b >= a + 3);
+    
+    /* A scratch bump region hands its memory out again after a reset */
+    static uint64_t region[8];
+    bump_heap_t h;
+    bump_init(&h, region, sizeof(region), "test heap");
+    char *x = bump_alloc(&h, 40);
+    CHECK(x == (char*)region);
+    CHECK(bump_alloc(&h, 40) == NULL);
+    bump_reset(&h);
+    CHECK(bump_alloc(&h, 64) == x);
+}
+
+static void test_dma_alloc(void) {
+    dma_addr_t da, db;
+    uint8_t *a = dma_alloc(100, &da);
+    uint8_t *b = dma_alloc(3 * PAGE_SIZE, &db);
+    CHECK(a != NULL && b != NULL);
+    CHECK(da == (dma_addr_t)a && db == (dma_addr_t)b);
+    CHECK(((uint64_t)a & (DMA_ALIGN - 1)) == 0);
+    CHECK(((uint64_t)b & (PAGE_SIZE - 1)) == 0);
+    CHECK(b[0] == 0 && b[3 * PAGE_SIZE - 1] == 0);
+    
+    /* Freed space is found again; neighbours are not disturbed */
+    uint8_t *c = dma_alloc(64, NULL);
+    CHECK(c >= a + 128 || c + 64 <= a);
+    dma_free(a, 100);
+    CHECK(dma_alloc(128, NULL) == a);
+    dma_free(a, 128);
+    dma_free(b, 3 * PAGE_SIZE);
+    dma_free(c, 64);
+    
+    /* Larger than the pool: contiguous pages from the page allocator */
+    uint64_t free_before = mm_free_pages();
+    uint8_t *big = dma_alloc(DMA_POOL_PAGES * PAGE_SIZE, NULL);
+    CHECK(big != NULL);
+    CHECK(mm_free_pages() == free_before - DMA_POOL_PAGES);
+    dma_free(big, DMA_POOL_PAGES * PAGE_SIZE);
+    CHECK(mm_free_pages() == free_before);
+}
+
+/* A few pages of RAM on node 1 */
+static uint8_t node1_ram[8 * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+static void test_zones(void) {
+    uint8_t *chunk = node1_ram;
+    uint64_t lo = (uint64_t)chunk, hi = lo + 8 * PAGE_SIZE;
+    int type = lo < MM_DMA32_LIMIT ? ZONE_DMA32 : ZONE_NORMAL;
+    CHECK(mm_add_region(lo, hi, 1) == 0);
+    zone_stats_t st0, st1;
+    CHECK(mm_zone_stats(1, type, &st1) == 0 && st1.present == 8 && st1.free == 8);
+    CHECK(mm_zone_stats(2, type, &st1) != 0);
+    CHECK(mm_zone_stats(0, type, &st0) == 0);
+    uint64_t remote_before = st0.remote;
+    
+    /* The preferred node serves while it has pages, then node 0 */
+    uint64_t pages[9];
+    for (int i = 0; i < 9; i++) {
+        pages[i] = (uint64_t)alloc_page_node(1);
+    }
+    for (int i = 0; i < 8; i++) {
+        CHECK(pages[i] >= lo && pages[i] < hi);
+    }
+    CHECK(pages[8] != 0 && (pages[8] < lo || pages[8] >= hi));
+    mm_zone_stats(1, type, &st1);
+    mm_zone_stats(0, type, &st0);
+    CHECK(st1.free == 0 && st1.local == 8);
+    CHECK(st0.remote == remote_before + 1);
+    
+    /* Pages go back to the zone they came from */
+    for (int i = 0; i < 9; i++) {
+        free_page((void*)pages[i]);
+    }
+    mm_zone_stats(1, type, &st1);
+    CHECK(st1.free == 8 && st1.frees == 8);
+    
+    /* This CPU is on node 0 */
+    uint64_t p = (uint64_t)alloc_page();
+    CHECK(p < lo || p >= hi);
+    free_page((void*)p);
+}
+
+static void test_sg(void) {
+    static uint8_t buf[3 * 4096];
+    sg_entry_t ents[2];
+    sg_table_t sg;
+    sg_init(&sg, ents, 2);
+    
+    /* Adjacent ranges share an entry */
+    CHECK(sg_add_buf(&sg, buf, 1000) == 0);
+    CHECK(sg_add_buf(&sg, buf + 1000, 3000) == 0);
+    CHECK(sg.nents == 1 && ents[0].len == 4000 && sg.len == 4000);
+    CHECK(sg_add_buf(&sg, buf + 8192, 512) == 0);
+    CHECK(sg.nents == 2);
+    CHECK(sg_add_buf(&sg, buf + 4096, 512) == -1);
+    CHECK(sg.nents == 2 && sg.len == 4512);
+    
+    iovec_t iov[2] = { { buf + 8704, 100 }, { buf, 10 } };
+    CHECK(sg_add_iov(&sg, iov, 2) == -1);
+    CHECK(sg.nents == 2 && ents[1].len == 612);
+    
+    sg_trim(&sg, 700);
+    CHECK(sg.nents == 1 && ents[0].len == 3912 && sg.len == 3912);
+}
+
+static void test_vm_pin(void) {
+    const uint64_t base = 0x10000;
+    pagetable_t pt = vm_create_user_pagetable();
+    void *d0 = alloc_page();
+    void *d1 = alloc_page();
+    CHECK(pt != NULL && d0 != NULL && d1 != NULL);
+    /* Writable page, read-only page, then a hole */
+    CHECK(mappages(pt, base, PGSIZE, (uint64_t)d0, PTE_R | PTE_W | PTE_U) == 0);
+    CHECK(mappages(pt, base + PGSIZE, PGSIZE, (uint64_t)d1, PTE_R | PTE_U) == 0);
+    pte_t *p0 = walk(pt, base, 0);
+    pte_t *p1 = walk(pt, base + PGSIZE, 0);
+    uint64_t pas[2];
+    
+    /* Unaligned range whose second page is unmapped: nothing stays pinned */
+    CHECK(vm_pin_user(pt, base + PGSIZE + 100, PGSIZE, 0, pas, 2) == -1);
+    CHECK(PTE_PINS(*p1) == 0);
+    
+    /* A failed pin only undoes its own pins, not one held on the bad page */
+    CHECK(vm_pin_user(pt, base + PGSIZE, 16, 0, pas, 2) == 1);
+    CHECK(pas[0] == (uint64_t)d1 && PTE_PINS(*p1) == 1);
+    CHECK(vm_pin_user(pt, base + 100, PGSIZE, 1, pas, 2) == -1);
+    CHECK(PTE_PINS(*p0) == 0 && PTE_PINS(*p1) == 1);
+    
+    /* A pinned page can't be unmapped, and the whole range is left alone */
+    CHECK(unmappages(pt, base, 2 * PGSIZE) == -1);
+    CHECK(PTE_VALID(*p0) && PTE_VALID(*p1));
+    vm_unpin_user(pt, base + PGSIZE, 16);
+    CHECK(PTE_PINS(*p1) == 0);
+    CHECK(unmappages(pt, base, 2 * PGSIZE) == 0);
+    CHECK(*p0 == 0 && *p1 == 0);
+    
+    vm_free(pt);
+    free_page(d0);
+    free_page(d1);
+}
+
+static void test_vm_walkaddr(void) {
+    pagetable_t pt = vm_create_user_pagetable();
+    void *k = alloc_page();
+    void *u = alloc_page();
+    CHECK(pt != NULL && k != NULL && u != NULL);
+    CHECK(mappages(pt, 0x10000, PGSIZE, (uint64_t)k, PTE_R | PTE_W) == 0);
+    CHECK(mappages(pt, 0x11000, PGSIZE, (uint64_t)u, PTE_R | PTE_W | PTE_U) == 0);
+    
+    /* walkaddr() resolves any mapping; user copies only reach PTE_U pages */
+    char buf[8] = "abcdefg";
+    CHECK(walkaddr(pt, 0x10000) == (uint64_t)k);
+    CHECK(walkaddr(pt, 0x11000) == (uint64_t)u);
+    CHECK(walkaddr(pt, 0x12000) == 0);
+    CHECK(copyout(pt, 0x11000, buf, sizeof(buf)) == 0);
+    CHECK(copyin(pt, buf, 0x10000, sizeof(buf)) == -1);
+    CHECK(copyinstr(pt, buf, 0x10000, sizeof(buf)) == -1);
+    CHECK(copyinstr(pt, buf, 0x11000, sizeof(buf)) == 0);
+    CHECK(strcmp(buf, "abcdefg") == 0);
+    
+    vm_free(pt);
+    free_page(k);
+    free_page(u);
+}
+
+/* ---- process table ---- */
+
+#define NR_TEST_PROCS 100
+
+static void test_process_table(void) {
+    process_t *procs[NR_TEST_PROCS];
+    uint32_t count = process_count();
+    
+    /* More than one chunk's worth */
+    for (int i = 0; i < NR_TEST_PROCS; i++) {
+        procs[i] = process_alloc();
+        CHECK(procs[i] != NULL);
+    }
+    CHECK(process_count() == count + NR_TEST_PROCS);
+    for (int i = 0; i < NR_TEST_PROCS; i++) {
+        CHECK(process_find_by_pid(procs[i]->pid) == procs[i]);
+        CHECK(i == 0 || procs[i]->pid > procs[i - 1]->pid);
+    }
+    
+    uint64_t pid = procs[7]->pid;
+    process_t *slot = procs[7];
+    process_free(procs[7]);
+    CHECK(process_find_by_pid(pid) == NULL);
+    /* The lowest free slot is reused, under a new PID */
+    procs[7] = process_alloc();
+    CHECK(procs[7] == slot && procs[7]->pid != pid);
+    
+    for (int i = 0; i < NR_TEST_PROCS; i++) {
+        process_free(procs[i]);
+    }
+    CHECK(process_count() == count);
+}
+
+/* ---- reclaim ---- */
+
+static void test_reclaim(void) {
+    process_t *procs[NR_TEST_PROCS];
+    
+    /* Empty process-table chunks are what the shrinker gives back */
+    for (int i = 0; i < NR_TEST_PROCS; i++) {
+        procs[i] = process_alloc();
+        CHECK(procs[i] != NULL);
+    }
+    for (int i = 0; i < NR_TEST_PROCS; i++) {
+        process_free(procs[i]);
+    }
+    uint64_t reclaimable = reclaimable_pages();
+    CHECK(reclaimable >= 1);
+    
+    /* Exhaustion reclaims those pages directly before failing */
+    uint64_t n = mm_free_pages();
+    void **pages = malloc((n + reclaimable + 1) * sizeof(void *));
+    uint64_t got = 0;
+    while ((pages[got] = alloc_page()) != NULL) {
+        got++;
+    }
+    CHECK(got == n + reclaimable);
+    CHECK(reclaimable_pages() == 0);
+    mm_stats_t st;
+    mm_get_stats(&st);
+    CHECK(st.free == 0 && st.alloc_failures >= 1);
+    while (got > 0) {
+        free_page(pages[--got]);
+    }
+    free(pages);
+    
+    /* The table grows again after a trim */
+    procs[0] = process_alloc();
+    CHECK(procs[0] != NULL);
+    process_free(procs[0]);
+    
+    char buf[256];
+    file_t *f = vfs_open("/proc/meminfo", 0);
+    CHECK(f != NULL);
+    if (f != NULL) {
+        int len = vfs_read(f, buf, sizeof(buf) - 1);
+        CHECK(len > 0);
+        buf[len > 0 ? len : 0] = '\0';
+        CHECK(strncmp(buf, "mem_total_kb ", 13) == 0);
+        CHECK(strstr(buf, "\nmem_free_kb ") != NULL);
+        vfs_close(f);
+    }
+}
+
+/* ---- scheduler queues ---- */
+
+static void test_sched_queues(void) {
+    process_t *a = process_alloc();
+    process_t *b = process_alloc();
+    process_t *rt = process_alloc();
+    sched_set_policy(rt, SCHED_FIFO);
+    sched_set_priority(rt, 10);
+    
+    CHECK(!sched_has_runnable());
+    sched_add(a);
+    sched_add(b);
+    sched_add(rt);
+    CHECK(sched_has_runnable());
+    
+    CHECK(sched_remove(b) == 0);
+    CHECK(sched_remove(rt) == 0);
+    CHECK(sched_remove(a) == 0);
+    CHECK(!sched_has_runnable());
+    
+    /* Not queued any more */
+    a->state = PROC_RUNNABLE;
+    CHECK(sched_remove(a) != 0);
+    
+    /* Adding a queued task again does not link it twice */
+    sched_add(a);
+    sched_add(a);
+    CHECK(sched_remove(a) == 0);
+    CHECK(sched_remove(a) != 0);
+    
+    /* A priority change while queued still removes from the right list */
+    sched_add(rt);
+    sched_set_priority(rt, 50);
+    CHECK(sched_remove(rt) == 0);
+    CHECK(!sched_has_runnable());
+    
+    /* Raising a queued task's priority lets it run first */
+    sched_add(a);
+    sched_add(b);
+    sched_set_priority(b, 5);
+    CHECK(b->rq_queue == 5);
+    shim_fake_switch = 1;
+    sched_yield();
+    CHECK(current_proc() == b);
+    
+    /* A policy change moves it too: RT queues come before the MLFQ */
+    sched_set_policy(a, SCHED_FIFO);
+    CHECK(a->rq_queue == PRIORITY_RT_MAX);
+    sched_set_policy(a, SCHED_NORMAL);
+    CHECK(a->rq_queue > PRIORITY_RT_MAX);
+    CHECK(sched_remove(a) == 0);
+    sched_sleep();  /* b sleeps; idle is back */
+    shim_fake_switch = 0;
+    CHECK(current_proc() != b && !sched_has_runnable());
+    
+    /* Exiting takes a task off its queue */
+    sched_add(b);
+    process_free(b);
+    CHECK(!sched_has_runnable());
+    
+    process_free(a);
+    process_free(rt);
+}
+
+/* Far more runnable tasks than a level used to hold: none are dropped */
+#define NR_QUEUED_PROCS 300
+
+static void test_sched_unbounded(void) {
+    static process_t *procs[NR_QUEUED_PROCS];
+    for (int i = 0; i < NR_QUEUED_PROCS; i++) {
+        procs[i] = process_alloc();
+        CHECK(procs[i] != NULL);
+        if (procs[i] == NULL) {
+            return;
+        }
+        procs[i]->queue_level = i % NUM_QUEUE_LEVELS;
+        sched_add(procs[i]);
+    }
+    for (int i = NR_QUEUED_PROCS - 1; i >= 0; i--) {
+        CHECK(sched_remove(procs[i]) == 0);
+    }
+    CHECK(!sched_has_runnable());
+    for (int i = 0; i < NR_QUEUED_PROCS; i++) {
+        process_free(procs[i]);
+    }
+}
+
+/* ---- simplefs and vfs ---- */
+
+static void test_simplefs(void) {
+    char buf[64];
+    int ino = sfs_create("hello", VFS_FILE);
+    CHECK(ino >= 0);
+    CHECK(sfs_lookup("hello") == ino);
+    CHECK(sfs_create("hello", VFS_FILE) < 0);
+    
+    CHECK(sfs_write(ino, "world", 0, 5) == 5);
+    memset(buf, 0, sizeof(buf));
+    CHECK(sfs_read(ino, buf, 0, sizeof(buf)) == 5);
+    CHECK(memcmp(buf, "world", 5) == 0);
+    
+    /* Writes past a block boundary allocate the next block */
+    CHECK(sfs_write(ino, "xy", SFS_BLOCK_SIZE - 1, 2) == 2);
+    CHECK(sfs_read(ino, buf, SFS_BLOCK_SIZE - 1, 2) == 2);
+    CHECK(buf[0] == 'x' && buf[1] == 'y');
+    
+    CHECK(sfs_delete("hello") == 0);
+    CHECK(sfs_lookup("hello") < 0);
+}
+
+static int null_writes = 0;
+
+static int null_write(file_t *file, const void *buf, size_t count) {
+    (void)file; (void)buf;
+    null_writes++;
+    return (int)count;
+}
+
+static file_ops_t null_ops = { .write = null_write };
+
+static void test_vfs(void) {
+    CHECK(vfs_register_device("null", &null_ops) == 0);
+    CHECK(vfs_register_device("null", &null_ops) != 0);
+    
+    file_t *f = vfs_open("/null", 0);
+    CHECK(f != NULL);
+    if (f != NULL) {
+        CHECK(vfs_write(f, "abc", 3) == 3);
+        CHECK(null_writes == 1);
+        vfs_close(f);
+    }
+    
+    /* Regular files resolve through the simplefs mount */
+    f = vfs_open("/vfsfile", VFS_O_CREAT);
+    CHECK(f != NULL);
+    if (f != NULL) {
+        CHECK(vfs_write(f, "data", 4) == 4);
+        vfs_close(f);
+    }
+    CHECK(sfs_lookup("vfsfile") >= 0);
+    
+    /* A mapped file can't be deleted until its last mapping goes */
+    f = vfs_open("/vfsfile", 0);
+    CHECK(f != NULL && f->inode->ops->map != NULL);
+    if (f != NULL) {
+        CHECK(f->inode->ops->map(f->inode) == 0);
+        CHECK(f->inode->ops->map(f->inode) == 0);
+        CHECK(sfs_delete("vfsfile") == -1);
+        f->inode->ops->unmap(f->inode);
+        CHECK(sfs_delete("vfsfile") == -1);
+        f->inode->ops->unmap(f->inode);
+        CHECK(sfs_delete("vfsfile") == 0);
+        CHECK(f->inode->ops->map(f->inode) == -1);
+        vfs_close(f);
+    }
+    
+    CHECK(vfs_unregister_device("null") == 0);
+    CHECK(vfs_open("/null", 0) == NULL);
+}
+
+/* ---- mmap ---- */
+
+/* From syscall/syscall.h, whose include guard <sys/syscall.h> already took */
+int64_t syscall_file_io(pagetable_t pt, uint64_t fd, const iovec_t *iov,
+                        int iovcnt, int write);
+
+static void test_mmap_readv(void) {
+    process_t *p = process_alloc();
+    CHECK(p != NULL);
+    if (p == NULL) {
+        return;
+    }
+    pagetable_t pt = vm_create_user_pagetable();
+    p->pagetable = pt;
+    
+    file_t *m = vfs_open("/mapped", VFS_O_CREAT);
+    file_t *src = vfs_open("/mapsrc", VFS_O_CREAT);
+    CHECK(m != NULL && src != NULL);
+    if (m == NULL || src == NULL) {
+        return;
+    }
+    CHECK(vfs_write(m, "........", 8) == 8);
+    CHECK(vfs_write(src, "payload", 7) == 7);
+    vfs_close(src);
+    src = vfs_open("/mapsrc", 0);
+    CHECK(src != NULL);
+    if (src == NULL) {
+        return;
+    }
+    
+    /* Nothing is populated until first touch, here by the kernel */
+    uint64_t va = mmap_map(p, 2 * PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m, 0);
+    CHECK(va != 0);
+    CHECK(walkaddr(pt, va) == 0);
+    
+    /* A readv() into the fresh mapping faults it in writable and dirty */
+    iovec_t iov = { (void*)va, 7 };
+    CHECK(syscall_file_io(pt, (uint64_t)src, &iov, 1, 0) == 7);
+    pte_t *pte = walk(pt, va, 0);
+    CHECK(pte != NULL && PTE_VALID(*pte) && (*pte & PTE_D));
+    CHECK(PTE_PINS(*pte) == 0);
+    char buf[8] = {0};
+    CHECK(copyin(pt, buf, va, 7) == 0);
+    CHECK(memcmp(buf, "payload", 7) == 0);
+    
+    /* copyout() reaches an untouched page too; outside any VMA still fails */
+    CHECK(copyout(pt, va + PGSIZE, "x", 1) == 0);
+    CHECK(copyout(pt, va + 2 * PGSIZE, "x", 1) == -1);
+    
+    /* Nothing to transfer is not an error */
+    CHECK(syscall_file_io(pt, (uint64_t)src, &iov, 0, 0) == 0);
+    
+    /* The mapping is the file's own data, and both writes marked it dirty */
+    CHECK(mmap_sync(p, va, 2 * PGSIZE) == 2);
+    vfs_close(m);
+    m = vfs_open("/mapped", 0);
+    CHECK(m != NULL && vfs_read(m, buf, 8) == 8);
+    CHECK(memcmp(buf, "payload.", 8) == 0);
+    
+    process_free(p);
+    vm_free(pt);
+    vfs_close(m);
+    vfs_close(src);
+}
+
+/* ---- procfs ---- */
+
+#define BIG_LINES 500
+
+static void big_show(seq_file_t *m) {
+    for (int i = 0; i < BIG_LINES; i++) {
+        seq_printf(m, "line %d\n", i);
+    }
+}
+
+/* Read a whole file in small pieces; its length, or -1 */
+static int read_all(const char *path, char *out, int size) {
+    file_t *f = vfs_open(path, 0);
+    if (f == NULL) {
+        return -1;
+    }
+    int len = 0, n;
+    while (len < size - 1) {
+        n = vfs_read(f, out + len, size - 1 - len < 100 ? size - 1 - len : 100);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    out[len] = '\0';
+    vfs_close(f);
+    return len;
+}
+
+static void test_procfs(void) {
+    static char buf[8192], expect[8192];
+    
+    CHECK(read_all("/proc/zones", buf, sizeof(buf)) > 0);
+    CHECK(strncmp(buf, "node zone present free", 22) == 0);
+    CHECK(strstr(buf, "\n0 ") != NULL);
+    CHECK(read_all("/proc/sched", buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, "rt_queue ") != NULL && strstr(buf, "mlfq 0 ") != NULL);
+    CHECK(vfs_open("/proc/nothing", 0) == NULL);
+    CHECK(vfs_open("/proc/zones", VFS_O_CREAT) == NULL);
+    
+    /* Per-task files exist exactly as long as the task */
+    process_t *p = process_alloc();
+    CHECK(p != NULL);
+    snprintf(p->name, sizeof(p->name), "proctest");
+    char path[32], head[48];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)p->pid);
+    snprintf(head, sizeof(head), "%d (proctest) R ", (int)p->pid);
+    CHECK(read_all(path, buf, sizeof(buf)) > 0);
+    CHECK(strncmp(buf, head, strlen(head)) == 0);
+    CHECK(read_all("/proc/pids", buf, sizeof(buf)) > 0);
+    CHECK(strstr(buf, " proctest\n") != NULL);
+    uint64_t pid = p->pid;
+    process_free(p);
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    CHECK(vfs_open(path, 0) == NULL);
+    CHECK(vfs_open("/proc/12x/stat", 0) == NULL);
+    
+    /* Output larger than the page-sized window comes through intact */
+    CHECK(procfs_register("big", big_show) == 0);
+    int elen = 0;
+    for (int i = 0; i < BIG_LINES; i++) {
+        elen += snprintf(expect + elen, sizeof(expect) - elen, "line %d\n", i);
+    }
+    CHECK(elen > 4096);
+    CHECK(read_all("/proc/big", buf, sizeof(buf)) == elen);
+    CHECK(memcmp(buf, expect, elen) == 0);
+}
+
+/* ---- device tree ---- */
+
+/* A tree is built the way dtc lays one out: header, reserve map,
+ * structure block, strings */
+static uint8_t fdt_buf[2048];
+static uint32_t fdt_len, fdt_struct, fdt_strings_len;
+static char fdt_strings[256];
+
+static void fdt_put32(uint32_t v) {
+    fdt_buf[fdt_len++] = v >> 24;
+    fdt_buf[fdt_len++] = v >> 16;
+    fdt_buf[fdt_len++] = v >> 8;
+    fdt_buf[fdt_len++] = v;
+}
+
+static void fdt_begin(const char *name) {
+    fdt_put32(1);
+    size_t n = strlen(name) + 1;
+    memcpy(fdt_buf + fdt_len, name, n);
+    fdt_len += (n + 3) & ~3UL;
+}
+
+static void fdt_end(void) {
+    fdt_put32(2);
+}
+
+static void fdt_prop(const char *name, const void *val, uint32_t len) {
+    uint32_t off = 0;
+    while (off < fdt_strings_len && strcmp(fdt_strings + off, name) != 0) {
+        off += strlen(fdt_strings + off) + 1;
+    }
+    if (off == fdt_strings_len) {
+        size_t n = strlen(name) + 1;
+        memcpy(fdt_strings + off, name, n);
+        fdt_strings_len += n;
+    }
+    fdt_put32(3);
+    fdt_put32(len);
+    fdt_put32(off);
+    memcpy(fdt_buf + fdt_len, val, len);
+    fdt_len += (len + 3) & ~3U;
+}
+
+static void fdt_prop_str(const char *name, const char *val) {
+    fdt_prop(name, val, strlen(val) + 1);
+}
+
+/* Up to eight cells */
+static void fdt_prop_cells(const char *name, int n, ...) {
+    uint8_t val[32];
+    va_list ap;
+    va_start(ap, n);
+    for (int i = 0; i < n; i++) {
+        uint32_t v = va_arg(ap, uint32_t);
+        val[i * 4] = v >> 24;
+        val[i * 4 + 1] = v >> 16;
+        val[i * 4 + 2] = v >> 8;
+        val[i * 4 + 3] = v;
+    }
+    va_end(ap);
+    fdt_prop(name, val, n * 4);
+}
+
+/* Two harts, 1 GB, virtio nodes highest address first like QEMU's */
+static void fdt_build(void) {
+    memset(fdt_buf, 0, sizeof(fdt_buf));
+    fdt_strings_len = 0;
+    fdt_len = 40;
+    uint32_t rsvmap = fdt_len;
+    fdt_len += 16;             /* Empty reserve map */
+    fdt_struct = fdt_len;
+    
+    fdt_begin("");
+    fdt_prop_cells("#address-cells", 1, 2);
+    fdt_prop_cells("#size-cells", 1, 2);
+    fdt_prop_str("model", "test,board");
+    fdt_begin("memory@80000000");
+    fdt_prop_str("device_type", "memory");
+    fdt_prop_cells("reg", 4, 0, 0x80000000, 0, 0x40000000);
+    fdt_end();
+    fdt_begin("cpus");
+    fdt_prop_cells("#address-cells", 1, 1);
+    fdt_prop_cells("#size-cells", 1, 0);
+    fdt_prop_cells("timebase-frequency", 1, 25000000);
+    for (uint32_t hart = 0; hart < 2; hart++) {
+        fdt_begin(hart == 0 ? "cpu@0" : "cpu@1");
+        fdt_prop_str("device_type", "cpu");
+        fdt_prop_cells("reg", 1, hart);
+        fdt_prop_cells("numa-node-id", 1, hart);
+        fdt_begin("interrupt-controller");
+        fdt_prop_str("compatible", "riscv,cpu-intc");
+        fdt_prop_cells("phandle", 1, hart + 1);
+        fdt_end();
+        fdt_end();
+    }
+    fdt_end();
+    fdt_begin("soc");
+    fdt_prop_cells("#address-cells", 1, 2);
+    fdt_prop_cells("#size-cells", 1, 2);
+    fdt_begin("virtio_mmio@10002000");
+    fdt_prop_str("compatible", "virtio,mmio");
+    fdt_prop_cells("reg", 4, 0, 0x10002000, 0, 0x1000);
+    fdt_prop_cells("interrupts", 1, 2);
+    fdt_end();
+    fdt_begin("virtio_mmio@10001000");
+    fdt_prop_str("compatible", "virtio,mmio");
+    fdt_prop_cells("reg", 4, 0, 0x10001000, 0, 0x1000);
+    fdt_prop_cells("interrupts", 1, 1);
+    fdt_end();
+    fdt_begin("plic@c000000");
+    fdt_prop_str("compatible", "riscv,plic0");
+    fdt_prop_cells("reg", 4, 0, 0xc000000, 0, 0x600000);
+    fdt_prop_cells("interrupts-extended", 8, 1, 11, 1, 9, 2, 11, 2, 9);
+    fdt_end();
+    fdt_begin("serial@10000000");
+    fdt_prop_str("compatible", "ns16550a");
+    fdt_prop_cells("reg", 4, 0, 0x10000000, 0, 0x100);
+    fdt_prop_cells("interrupts", 1, 10);
+    fdt_end();
+    fdt_end();                 /* soc */
+    fdt_end();                 /* root */
+    fdt_put32(9);
+    
+    uint32_t size_struct = fdt_len - fdt_struct;
+    uint32_t off_strings = fdt_len;
+    memcpy(fdt_buf + fdt_len, fdt_strings, fdt_strings_len);
+    fdt_len += fdt_strings_len;
+    
+    uint32_t header[10] = { FDT_MAGIC, fdt_len, fdt_struct, off_strings, rsvmap,
+                            17, 16, 0, fdt_strings_len, size_struct };
+    uint32_t saved = fdt_len;
+    fdt_len = 0;
+    for (int i = 0; i < 10; i++) {
+        fdt_put32(header[i]);
+    }
+    fdt_len = saved;
+}
+
+static void test_fdt(void) {
+    fdt_build();
+    CHECK(fdt_init(1, fdt_buf) == 0);
+    CHECK(strcmp(machine.model, "test,board") == 0);
+    CHECK(machine.nr_ram == 1);
+    CHECK(machine.ram[0].start == 0x80000000UL && machine.ram[0].end == 0xc0000000UL);
+    CHECK(machine.nr_harts == 2 && machine.boot_hart == 1);
+    CHECK(machine_hart_node(1) == 1 && machine.nr_nodes == 1);  /* RAM all on 0 */
+    CHECK(machine.timebase_hz == 25000000 && ns_per_tick == 40);
+    CHECK(machine.uart.base == 0x10000000UL && machine.uart.irq == 10);
+    CHECK(machine.plic.base == 0xc000000UL);
+    CHECK(machine.plic_context == 3);  /* Hart 1's S-mode entry */
+    CHECK(machine.nr_virtio == 2);
+    CHECK(machine.virtio[0].base == 0x10001000UL && machine.virtio[0].irq == 1);
+    CHECK(machine.virtio[1].base == 0x10002000UL && machine.virtio[1].irq == 2);
+    CHECK(machine.nr_reserved == 1 && machine.reserved[0].start == (uint64_t)fdt_buf);
+    
+    /* A corrupt tree falls back to the QEMU virt defaults */
+    fdt_buf[fdt_struct + 3] = 7;
+    CHECK(fdt_init(0, fdt_buf) != 0);
+    CHECK(machine.nr_ram == 1 && machine.ram[0].end == 0x88000000UL);
+    CHECK(machine.plic_context == 1 && timebase_hz == 10000000);
+    CHECK(fdt_init(0, NULL) != 0);
+}
+
+/* ---- Microbenchmarks ---- */
+
+#define BENCH_MIN_NS 200000000ULL   /* 0.2 s per benchmark */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Cache misses of this thread from a hardware counter; -1 when the host
+ * has none (most VMs), and the column reads "-" */
+static int miss_fd = -1;
+
+static void miss_counter_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    miss_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t miss_count(void) {
+    uint64_t n = 0;
+    if (miss_fd >= 0 && read(miss_fd, &n, sizeof(n)) != sizeof(n)) {
+        n = 0;
+    }
+    return n;
+}
+
+/* Time fn(iters), growing iters until the run is long enough */
+static void bench(const char *name, void (*fn)(uint64_t iters)) {
+    uint64_t iters = 1, elapsed = 0, misses = 0;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        uint64_t m0 = miss_count();
+        fn(iters);
+        misses = miss_count() - m0;
+        elapsed = now_ns() - t0;
+        if (elapsed >= BENCH_MIN_NS || iters >= (1ULL << 32)) {
+            break;
+        }
+        /* Aim past the target, but never grow more than 10x at once */
+        uint64_t next = elapsed ? iters * BENCH_MIN_NS * 14 / 10 / elapsed : iters * 10;
+        iters = next > iters * 10 ? iters * 10 : (next <= iters ? iters + 1 : next);
+    }
+    char mstr[16] = "-";
+    if (miss_fd >= 0) {
+        snprintf(mstr, sizeof(mstr), "%.2f", (double)misses / iters);
+    }
+    printf("%-28s %10.1f ns %12llu %10s\n", name, (double)elapsed / iters,
+           (unsigned long long)iters, mstr);
+}
+
+/* Allocator churn: a working set of pages freed and reallocated */
+#define CHURN_PAGES 64
+
+static void bm_page_alloc_free(uint64_t iters) {
+    void *pages[CHURN_PAGES];
+    for (uint64_t i = 0; i < iters; i++) {
+        for (int j = 0; j < CHURN_PAGES; j++) {
+            pages[j] = alloc_page();
+        }
+        for (int j = 0; j < CHURN_PAGES; j++) {
+            free_page(pages[j]);
+        }
+    }
+}
+
+/* Ready-queue enqueue/dequeue with a few other tasks queued */
+/* Remove and requeue a task from the middle of a queue sched_bench_depth long */
+#define SCHED_BENCH_DEPTH 4096
+
+static process_t *sched_bench_procs[SCHED_BENCH_DEPTH];
+static int sched_bench_depth;
+
+static void bm_sched_add_remove(uint64_t iters) {
+    process_t *p = sched_bench_procs[sched_bench_depth / 2];
+    for (uint64_t i = 0; i < iters; i++) {
+        sched_remove(p);
+        sched_add(p);
+    }
+}
+
+/* The timer tick with SCHED_TICK_TASKS runnable tasks: slice accounting,
+ * the pick and requeue when a slice runs out, and on every 100th tick the
+ * aging pass over all of them. swtch() is the shim's, which returns at
+ * once, so only the scheduler's own work is measured. */
+#define SCHED_TICK_TASKS 4096
+
+static process_t *sched_tick_procs[SCHED_TICK_TASKS];
+
+static void bm_sched_tick(uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        sched_tick();
+    }
+}
+
+static void bm_sfs_lookup(uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        if (sfs_lookup("bench_file_31") < 0) {
+            abort();
+        }
+    }
+}
+
+static uint64_t bench_pid;
+
+static void bm_pid_lookup(uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        if (process_find_by_pid(bench_pid) == NULL) {
+            abort();
+        }
+    }
+}
+
+static void run_benchmarks(void) {
+    printf("%-28s %13s %12s %10s\n", "Benchmark", "Time", "Iterations", "Misses");
+    miss_counter_open();
+    
+    bench("BM_page_alloc_free/64", bm_page_alloc_free);
+    
+    static const int depths[] = { 16, SCHED_BENCH_DEPTH };
+    for (int d = 0; d < 2; d++) {
+        sched_bench_depth = depths[d];
+        for (int i = 0; i < sched_bench_depth; i++) {
+            sched_bench_procs[i] = process_alloc();
+            sched_add(sched_bench_procs[i]);
+        }
+        char bname[32];
+        snprintf(bname, sizeof(bname), "BM_sched_add_remove/%d", sched_bench_depth);
+        bench(bname, bm_sched_add_remove);
+        for (int i = 0; i < sched_bench_depth; i++) {
+            process_free(sched_bench_procs[i]);
+        }
+    }
+    
+    /* Spread over every MLFQ level, then let one take over from idle */
+    shim_fake_switch = 1;
+    for (int i = 0; i < SCHED_TICK_TASKS; i++) {
+        sched_tick_procs[i] = process_alloc();
+        sched_tick_procs[i]->queue_level = i % NUM_QUEUE_LEVELS;
+        sched_add(sched_tick_procs[i]);
+    }
+    sched_yield();
+    bench("BM_sched_tick/4096", bm_sched_tick);
+    /* Empty the queues; the running task then sleeps and idle is back */
+    for (int i = 0; i < SCHED_TICK_TASKS; i++) {
+        sched_remove(sched_tick_procs[i]);
+    }
+    sched_sleep();
+    shim_fake_switch = 0;
+    for (int i = 0; i < SCHED_TICK_TASKS; i++) {
+        process_free(sched_tick_procs[i]);
+    }
+    
+    char name[SFS_MAX_FILENAME];
+    for (int i = 0; i < 32; i++) {
+        snprintf(name, sizeof(name), "bench_file_%d", i);
+        sfs_create(name, VFS_FILE);
+    }
+    bench("BM_sfs_lookup/32", bm_sfs_lookup);
+    
+    process_t *procs[200];
+    for (int i = 0; i < 200; i++) {
+        procs[i] = process_alloc();
+    }
+    bench_pid = procs[123]->pid;
+    bench("BM_pid_lookup/200", bm_pid_lookup);
+    for (int i = 0; i < 200; i++) {
+        process_free(procs[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    int do_bench = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            do_bench = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            shim_verbose = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--bench] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    /* Same order as kernel_main; RAM is the pool in heap.S */
+    fdt_init(0, NULL);
+    extern char __heap_end[], __ram_end[];
+    mem_range_t ram = { (uint64_t)__heap_end, (uint64_t)__ram_end, 0 };
+    mm_init(&ram, 1, NULL, 0);
+    dma_init();
+    process_init();
+    scheduler_init();
+    vfs_init();
+    sfs_init();
+    sfs_format(256);
+    vfs_mount("/", "simplefs");
+    procfs_init();
+    vfs_mount("/proc", "procfs");
+    reclaim_init();
+    
+    if (do_bench) {
+        run_benchmarks();
+        return 0;
+    }
+    
+    RUN_TEST(test_page_alloc);
+    RUN_TEST(test_dma_alloc);      /* Needs uncarved RAM: before exhaustion */
+    RUN_TEST(test_zones);
+    RUN_TEST(test_page_exhaustion);
+    RUN_TEST(test_kmalloc);
+    RUN_TEST(test_sg);
+    RUN_TEST(test_vm_pin);
+    RUN_TEST(test_vm_walkaddr);
+    RUN_TEST(test_process_table);
+    RUN_TEST(test_reclaim);
+    RUN_TEST(test_sched_queues);
+    RUN_TEST(test_sched_unbounded);
+    RUN_TEST(test_simplefs);
+    RUN_TEST(test_vfs);
+    RUN_TEST(test_mmap_readv);
+    RUN_TEST(test_procfs);
+    RUN_TEST(test_fdt);
+    
+    printf("%d tests, %d failed checks\n", tests_run, checks_failed);
+    return checks_failed ? 1 : 0;
+}